@@ -68,6 +68,13 @@
 /* amount of data to read in one read() call */
 #define BUFFERING_DEFAULT_FILECHUNK      (1024*32)
 
+/* handles with at most this much left are filled together before the
+   others, so they don't need a disk wakeup of their own */
+#define BUFFERING_SMALL_HANDLE           BUFFERING_DEFAULT_FILECHUNK
+
+/* fill_buffer passes: small handles, then one per priority */
+#define BUFFERING_FILL_PASSES            (BUF_PRIO_HIGH + 2)
+
 #define BUF_HANDLE_MASK                  0x7FFFFFFF
 
 enum handle_flags
@@ -83,6 +90,8 @@ struct memory_handle {
     uint8_t flags;          /* Handle property flags */
     int8_t  pinned;         /* Count of pinnings */
     int8_t  signaled;       /* Stop any attempt at waiting to get the data */
+    int8_t  priority;       /* Fill priority (enum buf_priority) */
+    int8_t  missed;         /* Deadline already counted as missed */
     char    path[MAX_PATH]; /* Path if data originated in a file */
     int     fd;             /* File descriptor to path (-1 if closed) */
     size_t  data;           /* Start index of the handle's data buffer */
@@ -92,6 +101,8 @@ struct memory_handle {
     off_t   start;          /* Offset at which we started reading the file */
     off_t   pos;            /* Read position in file */
     off_t volatile end;     /* Offset at which we stopped reading the file */
+    off_t   need;           /* Offset needed by the deadline (0 if none) */
+    long    deadline;       /* Tick by which need should be buffered */
     struct memory_handle *next;
 };
 
@@ -133,6 +144,11 @@ static struct data_counters
     size_t useful;      /* Amount of data still useful to the user */
 } data_counters;
 
+/* Deadline statistics, for debugging */
+static unsigned int deadlines_met;
+static unsigned int deadline_misses;
+static unsigned int data_waits;
+
 
 /* Messages available to communicate with the buffering thread */
 enum
@@ -148,6 +164,8 @@ enum
                             fill at its earliest convenience */
     Q_HANDLE_ADDED,      /* Inform the buffering thread that a handle was added,
                             (which means the disk is spinning) */
+    Q_FILL_DEADLINE,     /* Inform the buffering thread that a handle needs
+                            data by a deadline */
 };
 
 /* Buffering thread */
@@ -328,6 +346,9 @@ add_handle(unsigned int flags, size_t data_size, size_t *data_out)
     h->flags    = flags;
     h->pinned   = 0; /* Can be moved */
     h->signaled = 0; /* Data can be waited for */
+    h->priority = BUF_PRIO_NORMAL;
+    h->missed   = 0;
+    h->need     = 0; /* No deadline */
 
     /* Return the start of the data area */
     *data_out = ringbuf_add(index, sizeof (struct memory_handle));
@@ -794,41 +815,115 @@ static void shrink_handle(struct memory_handle *h)
     }
 }
 
+/* Update the deadline statistics of a handle; the deadline is dropped
+   once its data is in */
+static void check_deadline(struct memory_handle *h)
+{
+    if (h->need == 0)
+        return;
+
+    if (h->end >= h->need || h->end >= h->filesize) {
+        if (!h->missed)
+            deadlines_met++;
+        h->need = 0;
+    } else if (!h->missed && TIME_AFTER(current_tick, h->deadline)) {
+        logf("deadline missed: %d", h->id);
+        h->missed = 1;
+        deadline_misses++;
+    }
+}
+
+static void check_deadlines(void)
+{
+    struct memory_handle *m;
+
+    for (m = first_handle; m; m = m->next)
+        check_deadline(m);
+}
+
+/* Buffer the data of pending deadlines, earliest deadline first. A handle
+   that runs out of space is put in *full and left alone from then on */
+static void fill_deadlines(struct memory_handle **full)
+{
+    while (queue_empty(&buffering_queue)) {
+        struct memory_handle *h = NULL, *m;
+
+        for (m = first_handle; m; m = m->next) {
+            check_deadline(m);
+            if (m != *full && m->need != 0 &&
+                (!h || TIME_BEFORE(m->deadline, h->deadline)))
+                h = m;
+        }
+
+        if (!h)
+            break;
+
+        off_t end = h->end;
+        if (!buffer_handle(h->id, h->need - end)) {
+            *full = h;
+            continue;
+        }
+
+        if (h->end == end) {
+            /* no progress (file error), don't try again */
+            h->need = 0;
+        }
+    }
+}
+
+/* Order in which fill_buffer visits a handle */
+static int fill_pass(const struct memory_handle *h)
+{
+    if (h->filesize - h->end <= BUFFERING_SMALL_HANDLE)
+        return 0;
+
+    if (h->id == base_handle_id)
+        return 1;
+
+    return 1 + BUF_PRIO_HIGH - h->priority;
+}
+
 /* Fill the buffer by buffering as much data as possible for handles that still
-   have data left to buffer
+   have data left to buffer. Deadlines come first, then the small handles and
+   then the others by priority, each in buffer order. Only the last handle can
+   run out of space, the others have the rest of their file reserved, so a
+   full handle is skipped and the passes go on with the others.
    Return whether or not to continue filling after this */
 static bool fill_buffer(void)
 {
     logf("fill_buffer()");
-    struct memory_handle *m = first_handle;
+    struct memory_handle *m, *full = NULL;
+    int pass;
 
-    shrink_handle(m);
+    shrink_handle(first_handle);
 
-    while (queue_empty(&buffering_queue) && m) {
-        if (m->end < m->filesize && !buffer_handle(m->id, 0)) {
-            m = NULL;
-            break;
+    for (pass = 0; pass < BUFFERING_FILL_PASSES; pass++) {
+        fill_deadlines(&full);
+
+        for (m = first_handle; m; m = m->next) {
+            if (!queue_empty(&buffering_queue))
+                return true;
+
+            if (m != full && m->end < m->filesize && fill_pass(m) == pass &&
+                !buffer_handle(m->id, 0))
+                full = m; /* no more space for this one */
         }
-        m = m->next;
     }
 
-    if (m) {
-        return true;
-    } else {
-        /* only spin the disk down if the filling wasn't interrupted by an
-           event arriving in the queue. */
-        storage_sleep();
-        return false;
-    }
+    /* only spin the disk down if the filling wasn't interrupted by an
+       event arriving in the queue. */
+    storage_sleep();
+    return false;
 }
 
 #ifdef HAVE_ALBUMART
 /* Given a file descriptor to a bitmap file, write the bitmap data to the
    buffer, with a struct bitmap and the actual data immediately following.
-   Return value is the total size (struct + data). */
+   Return value is the total size (struct + data). The album art cache key
+   is returned in key, decoded tells whether the image wasn't cached yet. */
 static int load_image(int fd, const char *path,
                       struct bufopen_bitmap_data *data,
-                      size_t bufidx)
+                      size_t bufidx, uint32_t key[2], bool *decoded)
 {
     int rc;
     struct bitmap *bmp = ringbuf_ptr(bufidx);
@@ -846,6 +941,11 @@ static int load_image(int fd, const char *path,
     int free = (int)MIN(buffer_len - buf_used(), buffer_len - bufidx)
                         - sizeof(struct bitmap);
 
+    albumart_cache_key(fd, path, aa, dim, key);
+    rc = albumart_cache_load(key, bmp, free);
+    if (rc > 0)
+        return rc + sizeof(struct bitmap);
+
 #ifdef HAVE_JPEG
     if (aa != NULL) {
         lseek(fd, aa->pos, SEEK_SET);
@@ -860,8 +960,9 @@ static int load_image(int fd, const char *path,
         rc = read_bmp_fd(fd, bmp, free, FORMAT_NATIVE|FORMAT_DITHER|
                          FORMAT_RESIZE|FORMAT_KEEP_ASPECT, NULL);
 
+    *decoded = rc > 0;
+
     return rc + (rc > 0 ? sizeof(struct bitmap) : 0);
-    (void)path;
 }
 #endif /* HAVE_ALBUMART */
 
@@ -947,6 +1048,9 @@ int bufopen(const char *file, size_t offset, enum data_type type,
 
     size_t size = 0;
 #ifdef HAVE_ALBUMART
+    uint32_t aa_key[2];
+    bool aa_decoded = false;
+
     if (type == TYPE_BITMAP) {
         /* If albumart is embedded, the complete file is not buffered,
          * but only the jpeg part; filesize() would be wrong */
@@ -1006,7 +1110,7 @@ int bufopen(const char *file, size_t offset, enum data_type type,
 #ifdef HAVE_ALBUMART
     if (type == TYPE_BITMAP) {
         /* Bitmap file: we load the data instead of the file */
-        int rc = load_image(fd, file, user_data, data);
+        int rc = load_image(fd, file, user_data, data, aa_key, &aa_decoded);
         if (rc <= 0) {
             handle_id = ERR_FILE_ERROR;
         } else {
@@ -1045,6 +1149,12 @@ int bufopen(const char *file, size_t offset, enum data_type type,
         }
     }
 
+#ifdef HAVE_ALBUMART
+    /* the cache takes the image from the handle */
+    if (handle_id >= 0 && aa_decoded)
+        albumart_cache_store(aa_key, handle_id);
+#endif
+
     logf("bufopen: new hdl %d", handle_id);
     return handle_id;
 
@@ -1138,6 +1248,9 @@ static void rebuffer_handle(int handle_id, off_t newpos)
         return;
     }
 
+    /* A pending deadline asks for as much data after the new position */
+    off_t want = h->need > h->pos ? h->need - h->pos : 0;
+
     /* When seeking foward off of the buffer, if it is a short seek attempt to
        avoid rebuffering the whole track, just read enough to satisfy */
     off_t amount = newpos - h->pos;
@@ -1182,6 +1295,9 @@ static void rebuffer_handle(int handle_id, off_t newpos)
     /* Reset the handle to its new position */
     h->ridx = h->widx = h->data = new_index;
     h->start = h->pos = h->end = newpos;
+    h->need = want ? MIN(newpos + want, h->filesize) : 0;
+    if (h->need <= newpos)
+        h->need = 0;
 
     if (h->fd >= 0)
         lseek(h->fd, newpos, SEEK_SET);
@@ -1306,6 +1422,8 @@ static struct memory_handle *prep_bufdata(int handle_id, size_t *size,
         /* Wait for the data to be ready */
         unsigned int request = 1;
 
+        data_waits++;
+
         do
         {
             if (--request == 0) {
@@ -1468,6 +1586,8 @@ buf_handle_data_type
 buf_is_handle
 buf_pin_handle
 buf_signal_handle
+buf_set_priority
+buf_set_deadline
 buf_length
 buf_used
 buf_set_watermark
@@ -1539,6 +1659,44 @@ bool buf_signal_handle(int handle_id, bool signal)
     return true;
 }
 
+bool buf_set_priority(int handle_id, enum buf_priority priority)
+{
+    struct memory_handle *h = find_handle(handle_id);
+    if (!h)
+        return false;
+
+    h->priority = priority;
+    return true;
+}
+
+/* Ask for the given amount of data after the read position to be buffered
+   by tick, ahead of anything else. Zero bytes cancels the deadline. */
+bool buf_set_deadline(int handle_id, size_t bytes, long tick)
+{
+    bool pending = false;
+
+    mutex_lock(&llist_mutex);
+
+    struct memory_handle *h = find_handle(handle_id);
+    if (h) {
+        off_t need = h->pos + MIN(bytes, (size_t)(h->filesize - h->pos));
+
+        pending     = bytes > 0 && need > h->end;
+        h->need     = pending ? need : 0;
+        h->deadline = tick;
+        h->missed   = 0;
+    }
+
+    mutex_unlock(&llist_mutex);
+
+    if (pending) {
+        LOGFQUEUE("buffering > Q_FILL_DEADLINE %d", handle_id);
+        queue_post(&buffering_queue, Q_FILL_DEADLINE, handle_id);
+    }
+
+    return h != NULL;
+}
+
 /* Return the size of the ringbuffer */
 size_t buf_length(void)
 {
@@ -1644,6 +1802,12 @@ static void NORETURN_ATTR buffering_thread(void)
                 filling = true;
                 break;
 
+            case Q_FILL_DEADLINE:
+                LOGFQUEUE("buffering < Q_FILL_DEADLINE %d", (int)ev.data);
+                /* Deadlines are served first by fill_buffer */
+                filling = true;
+                break;
+
             case SYS_TIMEOUT:
                 LOGFQUEUE_SYS_TIMEOUT("buffering < SYS_TIMEOUT");
                 break;
@@ -1653,6 +1817,7 @@ static void NORETURN_ATTR buffering_thread(void)
             continue;
 
         update_data_counters(NULL);
+        check_deadlines();
 #if 0
         /* TODO: This needs to be fixed to use the idle callback, disable it
          * for simplicity until its done right */
@@ -1769,4 +1934,7 @@ void buffering_get_debugdata(struct buffering_debug *dbgdata)
     dbgdata->buffered_data = dc.buffered;
     dbgdata->useful_data = dc.useful;
     dbgdata->watermark = BUF_WATERMARK;
+    dbgdata->deadlines_met = deadlines_met;
+    dbgdata->deadline_misses = deadline_misses;
+    dbgdata->data_waits = data_waits;
 }
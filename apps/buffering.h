@@ -38,6 +38,13 @@ enum data_type {
     TYPE_BITMAP,
 };
 
+/* Fill priorities, higher ones are buffered first */
+enum buf_priority {
+    BUF_PRIO_LOW = 0,    /* Read-ahead that is not needed soon */
+    BUF_PRIO_NORMAL,     /* Default for new handles */
+    BUF_PRIO_HIGH,       /* Data being consumed (the base handle is always) */
+};
+
 /* Error return values */
 #define ERR_HANDLE_NOT_FOUND    -1
 #define ERR_BUFFER_FULL         -2
@@ -97,6 +104,8 @@ ssize_t bufcuttail(int handle_id, size_t size);
  * buf_pin_handle: Disallow/allow handle movement. Handle may still be removed.
  * buf_handle_offset: Get the offset of the first buffered byte from the file
  * buf_set_base_handle: Tell the buffering thread which handle is currently read
+ * buf_set_priority: Set the fill priority of a handle
+ * buf_set_deadline: Request bytes past the read position by a given tick
  * buf_length: Total size of ringbuffer
  * buf_used: Total amount of buffer space used (including allocated space)
  * buf_back_off_storage: tell buffering thread to take it easy
@@ -111,6 +120,8 @@ size_t buf_length(void);
 size_t buf_used(void);
 bool buf_pin_handle(int handle_id, bool pin);
 bool buf_signal_handle(int handle_id, bool signal);
+bool buf_set_priority(int handle_id, enum buf_priority priority);
+bool buf_set_deadline(int handle_id, size_t bytes, long tick);
 
 /* Settings */
 void buf_set_watermark(size_t bytes);
@@ -123,6 +134,9 @@ struct buffering_debug {
     size_t data_rem;
     size_t useful_data;
     size_t watermark;
+    unsigned int deadlines_met;   /* Deadlines buffered in time */
+    unsigned int deadline_misses; /* Deadlines that passed before the data */
+    unsigned int data_waits;      /* Reads that had to wait for data */
 };
 void buffering_get_debugdata(struct buffering_debug *dbgdata);
 
@@ -21,6 +21,8 @@
  *
  ****************************************************************************/
 
+#include <stdio.h>
+#include <stdarg.h>
 #include "config.h"
 #include "system.h"
 #include "kernel.h"
@@ -33,6 +35,20 @@
 #include "dsp_core.h"
 #include "metadata.h"
 #include "settings.h"
+#include "file.h"
+#include "dir.h"
+#include "crc32.h"
+#include "rbpaths.h"
+#include "misc.h"
+#include "core_alloc.h"
+#include "ata_idle_notify.h"
+#ifdef HAVE_SDL_THREADS
+#include "thread-sdl.h"
+#endif
+#ifdef CODEC_JOB_THREAD
+#include <unistd.h>
+#include "job-thread.h"
+#endif
 
 /* Define LOGF_ENABLE to enable logf output in this file */
 /*#define LOGF_ENABLE*/
@@ -430,6 +446,419 @@ static bool codec_loop_track_callback(void)
     return global_settings.repeat_mode == REPEAT_ONE;
 }
 
+/* Seek indices are kept one per track, named by the CRC of its path. Saves
+ * are held in memory until the disk is idle anyway; only the newest one is
+ * kept. At most SEEK_INDEX_MAX_FILES are stored, the oldest one written
+ * makes room for a new one. */
+#define SEEK_INDEX_MAX_FILES 64
+
+/* A save waiting for the disk to be idle, the index follows */
+struct seek_index_pending
+{
+    uint32_t name_crc;
+    struct seek_index_header hdr;
+};
+
+static int seek_index_pending = 0;  /* handle, 0 = none */
+static int seek_index_move_lock = 0;
+
+/* Time stamp of the track last looked up, so a save needn't scan again */
+static uint32_t seek_index_mtime_crc = 0;
+static uint32_t seek_index_mtime = 0;
+
+static int seek_index_move_callback(int handle, void *current, void *new)
+{
+    (void)handle; (void)current; (void)new;
+
+    if (seek_index_move_lock > 0)
+        return BUFLIB_CB_CANNOT_MOVE;
+
+    return BUFLIB_CB_OK;
+}
+
+static struct buflib_callbacks seek_index_ops =
+{
+    .move_callback = seek_index_move_callback,
+};
+
+static uint32_t seek_index_name_crc(void)
+{
+    const char *path = ci.id3->path;
+    return crc_32(path, strlen(path), 0xffffffff);
+}
+
+static uint32_t seek_index_path_crc(void)
+{
+    const char *path = ci.id3->path;
+    return crc_32(path, strlen(path), 0);
+}
+
+static void seek_index_name(char *buf, size_t bufsize, uint32_t name_crc)
+{
+    snprintf(buf, bufsize, SEEK_INDEX_NAME, (unsigned long)name_crc);
+}
+
+static uint32_t seek_index_file_mtime(uint32_t name_crc)
+{
+    if (seek_index_mtime_crc != name_crc)
+    {
+        seek_index_mtime = file_mtime(ci.id3->path);
+        seek_index_mtime_crc = name_crc;
+    }
+
+    return seek_index_mtime;
+}
+
+/* Remove the oldest index if there are too many to add another one */
+static void seek_index_trim(const char *keep)
+{
+    DIR *dir = opendir(SEEK_INDEX_DIR);
+    if (!dir)
+        return;
+
+    char oldest[16] = "";
+    time_t oldest_mtime = 0;
+    int count = 0;
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)))
+    {
+        struct dirinfo info = dir_get_info(dir, entry);
+        if ((info.attribute & ATTR_DIRECTORY) ||
+            strlen(entry->d_name) >= sizeof (oldest))
+            continue;
+
+        if (!strcmp(entry->d_name, keep))
+        {
+            /* Replaced in place */
+            count = 0;
+            break;
+        }
+
+        if (count++ == 0 || info.mtime < oldest_mtime)
+        {
+            strcpy(oldest, entry->d_name);
+            oldest_mtime = info.mtime;
+        }
+    }
+
+    closedir(dir);
+
+    if (count >= SEEK_INDEX_MAX_FILES)
+    {
+        char path[MAX_PATH];
+        snprintf(path, sizeof (path), SEEK_INDEX_DIR "/%s", oldest);
+        remove(path);
+    }
+}
+
+static void seek_index_flush_callback(void)
+{
+    int handle = seek_index_pending;
+    if (handle <= 0)
+        return;
+
+    /* A save arriving meanwhile makes a new pending one */
+    seek_index_pending = 0;
+    seek_index_move_lock++;
+
+    struct seek_index_pending *p = core_get_data(handle);
+    char path[MAX_PATH];
+    seek_index_name(path, sizeof (path), p->name_crc);
+    seek_index_trim(strrchr(path, '/') + 1);
+
+    int fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        mkdir(SEEK_INDEX_DIR);
+        fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    }
+
+    if (fd >= 0)
+    {
+        size_t size = sizeof (p->hdr) + p->hdr.size;
+        if (write(fd, &p->hdr, size) != (ssize_t)size)
+        {
+            logf("seek index write failed: %s", path);
+            close(fd);
+            remove(path);
+        }
+        else
+            close(fd);
+    }
+
+    seek_index_move_lock--;
+    core_free(handle);
+}
+
+static bool codec_seek_index_load_callback(uint32_t tag, void *buf,
+                                           size_t *size)
+{
+    struct seek_index_header hdr;
+    char path[MAX_PATH];
+    uint32_t name_crc = seek_index_name_crc();
+    uint32_t path_crc = seek_index_path_crc();
+
+    /* Looked up afresh for each track that is started */
+    seek_index_mtime_crc = 0;
+    uint32_t mtime = seek_index_file_mtime(name_crc);
+
+    if (seek_index_pending > 0)
+    {
+        /* Not written yet */
+        struct seek_index_pending *p = core_get_data(seek_index_pending);
+        if (p->name_crc == name_crc && p->hdr.path_crc == path_crc)
+        {
+            if (p->hdr.tag != tag ||
+                p->hdr.filesize != (uint32_t)ci.id3->filesize ||
+                p->hdr.mtime != mtime ||
+                p->hdr.size > *size)
+                return false;
+
+            memcpy(buf, p + 1, p->hdr.size);
+            *size = p->hdr.size;
+            return true;
+        }
+    }
+
+    seek_index_name(path, sizeof (path), name_crc);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    bool ok = read(fd, &hdr, sizeof (hdr)) == sizeof (hdr) &&
+              hdr.magic == SEEK_INDEX_MAGIC && hdr.tag == tag &&
+              hdr.path_crc == path_crc &&
+              hdr.filesize == (uint32_t)ci.id3->filesize &&
+              hdr.mtime == mtime &&
+              hdr.size <= *size &&
+              read(fd, buf, hdr.size) == (ssize_t)hdr.size;
+
+    close(fd);
+
+    if (ok)
+        *size = hdr.size;
+
+    return ok;
+}
+
+static void codec_seek_index_save_callback(uint32_t tag, const void *buf,
+                                           size_t size)
+{
+    if (seek_index_pending > 0)
+        seek_index_pending = core_free(seek_index_pending);
+
+    int handle = core_alloc_ex("seek index",
+                               sizeof (struct seek_index_pending) + size,
+                               &seek_index_ops);
+    if (handle <= 0)
+        return;
+
+    struct seek_index_pending *p = core_get_data(handle);
+    p->name_crc = seek_index_name_crc();
+    p->hdr.magic = SEEK_INDEX_MAGIC;
+    p->hdr.tag = tag;
+    p->hdr.path_crc = seek_index_path_crc();
+    p->hdr.filesize = ci.id3->filesize;
+    p->hdr.mtime = seek_index_file_mtime(p->name_crc);
+    p->hdr.size = size;
+    memcpy(p + 1, buf, size);
+
+    seek_index_pending = handle;
+    register_storage_idle_func(seek_index_flush_callback);
+}
+
+#ifdef CODEC_JOB_THREAD
+/* The helper thread is only started when there is more than one CPU. Jobs
+ * are pure computation handed over by the codec so that no locking against
+ * the rest of Rockbox is needed. */
+static void codec_job_thread_init(void)
+{
+    bool running = sysconf(_SC_NPROCESSORS_ONLN) > 1 && job_thread_init();
+    logf("codec helper thread: %s", running ? "yes" : "no");
+    (void)running;
+}
+
+#define codec_job_start_callback    job_thread_start
+#define codec_job_wait_callback     job_thread_wait
+#else /* !CODEC_JOB_THREAD */
+static bool codec_job_start_callback(void (*fn)(void *arg), void *arg)
+{
+    (void)fn; (void)arg;
+    return false;
+}
+
+static void codec_job_wait_callback(void)
+{
+}
+#endif /* CODEC_JOB_THREAD */
+
+#ifdef HAVE_SDL_THREADS
+/* Hosted --detach-decoder mode: a decoder runs detached from the threading
+ * system, in parallel with everything else, and reenters it for each call
+ * back into playback. Only the bitstream decode overlaps other threads; DSP
+ * processing (in pcmbuf_insert), buffering, kernel calls and debug output
+ * all run locked, every codec API call that reaches shared state has a
+ * wrapper below. The codec's audio is pinned and only data before the read
+ * position is ever reclaimed, so pointers handed out stay valid meanwhile.
+ * These wrappers just pass through when not detached. */
+static void *codec_detached = NULL;
+
+#define CODEC_ENTER() \
+    ({ if (codec_detached) sim_thread_lock(codec_detached); })
+#define CODEC_LEAVE() \
+    ({ if (codec_detached) sim_thread_unlock(); })
+
+static unsigned codec_sleep_callback(unsigned ticks)
+{
+    CODEC_ENTER();
+    unsigned ret = sleep(ticks);
+    CODEC_LEAVE();
+    return ret;
+}
+
+static void codec_yield_callback(void)
+{
+    /* Detached, there is nobody to yield to; reentering still lets a
+       pending shutdown catch the thread */
+    CODEC_ENTER();
+    if (!codec_detached)
+        yield();
+    CODEC_LEAVE();
+}
+
+static void codec_pcmbuf_insert_locked(const void *ch1, const void *ch2,
+                                       int count)
+{
+    CODEC_ENTER();
+    codec_pcmbuf_insert_callback(ch1, ch2, count);
+    CODEC_LEAVE();
+}
+
+static void codec_set_elapsed_locked(unsigned long value)
+{
+    CODEC_ENTER();
+    audio_codec_update_elapsed(value);
+    CODEC_LEAVE();
+}
+
+static size_t codec_filebuf_locked(void *ptr, size_t size)
+{
+    CODEC_ENTER();
+    size_t ret = codec_filebuf_callback(ptr, size);
+    CODEC_LEAVE();
+    return ret;
+}
+
+static void * codec_request_buffer_locked(size_t *realsize, size_t reqsize)
+{
+    CODEC_ENTER();
+    void *ret = codec_request_buffer_callback(realsize, reqsize);
+    CODEC_LEAVE();
+    return ret;
+}
+
+static void codec_advance_buffer_locked(size_t amount)
+{
+    CODEC_ENTER();
+    codec_advance_buffer_callback(amount);
+    CODEC_LEAVE();
+}
+
+static bool codec_seek_buffer_locked(size_t newpos)
+{
+    CODEC_ENTER();
+    bool ret = codec_seek_buffer_callback(newpos);
+    CODEC_LEAVE();
+    return ret;
+}
+
+static void codec_seek_complete_locked(void)
+{
+    CODEC_ENTER();
+    codec_seek_complete_callback();
+    CODEC_LEAVE();
+}
+
+static void codec_set_offset_locked(size_t value)
+{
+    CODEC_ENTER();
+    audio_codec_update_offset(value);
+    CODEC_LEAVE();
+}
+
+static void codec_configure_locked(int setting, intptr_t value)
+{
+    CODEC_ENTER();
+    codec_configure_callback(setting, value);
+    CODEC_LEAVE();
+}
+
+static enum codec_command_action codec_get_command_locked(intptr_t *param)
+{
+    CODEC_ENTER();
+    enum codec_command_action ret = codec_get_command_callback(param);
+    CODEC_LEAVE();
+    return ret;
+}
+
+static bool codec_loop_track_locked(void)
+{
+    CODEC_ENTER();
+    bool ret = codec_loop_track_callback();
+    CODEC_LEAVE();
+    return ret;
+}
+
+static bool codec_seek_index_load_locked(uint32_t tag, void *buf,
+                                         size_t *size)
+{
+    CODEC_ENTER();
+    bool ret = codec_seek_index_load_callback(tag, buf, size);
+    CODEC_LEAVE();
+    return ret;
+}
+
+static void codec_seek_index_save_locked(uint32_t tag, const void *buf,
+                                         size_t size)
+{
+    CODEC_ENTER();
+    codec_seek_index_save_callback(tag, buf, size);
+    CODEC_LEAVE();
+}
+
+#if defined(DEBUG) || defined(SIMULATOR)
+/* debugf() formats into a shared buffer in some builds */
+static void codec_debugf_locked(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+
+    CODEC_ENTER();
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof (buf), fmt, ap);
+    va_end(ap);
+    debugf("%s", buf);
+    CODEC_LEAVE();
+}
+#endif /* DEBUG || SIMULATOR */
+
+#ifdef ROCKBOX_HAS_LOGF
+static void codec_logf_locked(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+
+    CODEC_ENTER();
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof (buf), fmt, ap);
+    va_end(ap);
+    _logf("%s", buf);
+    CODEC_LEAVE();
+}
+#endif /* ROCKBOX_HAS_LOGF */
+#endif /* HAVE_SDL_THREADS */
+
 
 /** --- CODEC THREAD --- **/
 
@@ -516,8 +945,22 @@ static void run_codec(void)
         buf_pin_handle(ci.audio_hid, true);
     }
 
+#ifdef HAVE_SDL_THREADS
+    /* Encoders use callbacks from elsewhere; keep them in lockstep */
+    if (!encoder)
+        codec_detached = sim_thread_detach();
+#endif
+
     status = codec_run_proc();
 
+#ifdef HAVE_SDL_THREADS
+    if (codec_detached)
+    {
+        sim_thread_lock(codec_detached);
+        codec_detached = NULL;
+    }
+#endif
+
     if (!encoder)
     {
         /* Codec is done with it - let it move */
@@ -637,8 +1080,38 @@ void INIT_ATTR codec_thread_init(void)
     ci.configure        = codec_configure_callback;
     ci.get_command      = codec_get_command_callback;
     ci.loop_track       = codec_loop_track_callback;
+    ci.seek_index_load  = codec_seek_index_load_callback;
+    ci.seek_index_save  = codec_seek_index_save_callback;
+    ci.job_start        = codec_job_start_callback;
+    ci.job_wait         = codec_job_wait_callback;
+#ifdef HAVE_SDL_THREADS
+    ci.sleep            = codec_sleep_callback;
+    ci.yield            = codec_yield_callback;
+    ci.pcmbuf_insert    = codec_pcmbuf_insert_locked;
+    ci.set_elapsed      = codec_set_elapsed_locked;
+    ci.read_filebuf     = codec_filebuf_locked;
+    ci.request_buffer   = codec_request_buffer_locked;
+    ci.advance_buffer   = codec_advance_buffer_locked;
+    ci.seek_buffer      = codec_seek_buffer_locked;
+    ci.seek_complete    = codec_seek_complete_locked;
+    ci.set_offset       = codec_set_offset_locked;
+    ci.configure        = codec_configure_locked;
+    ci.get_command      = codec_get_command_locked;
+    ci.loop_track       = codec_loop_track_locked;
+    ci.seek_index_load  = codec_seek_index_load_locked;
+    ci.seek_index_save  = codec_seek_index_save_locked;
+#if defined(DEBUG) || defined(SIMULATOR)
+    ci.debugf           = codec_debugf_locked;
+#endif
+#ifdef ROCKBOX_HAS_LOGF
+    ci.logf             = codec_logf_locked;
+#endif
+#endif
 
     /* Init threading */
+#ifdef CODEC_JOB_THREAD
+    codec_job_thread_init();
+#endif
     queue_init(&codec_queue, false);
     codec_thread_id = create_thread(
             codec_thread, codec_stack, sizeof(codec_stack), 0,
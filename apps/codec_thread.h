@@ -23,7 +23,32 @@
 #define _CODEC_THREAD_H
 
 #include <stdbool.h>
+#include <inttypes.h>
 #include "config.h"
+#include "rbpaths.h"
+
+/* Hosted builds give codecs a native helper thread for work beside the
+ * decoding (ci->job_start), Rockbox threads never run in parallel. */
+#if defined(APPLICATION) && !defined(_WIN32)
+#define CODEC_JOB_THREAD
+#endif
+
+/* Seek indices kept between plays, for the codecs (ci->seek_index_load/save)
+ * and for mpegplayer. One file per media file, named by the crc_32() of its
+ * path seeded with 0xffffffff; the header is followed by the user's data. */
+#define SEEK_INDEX_DIR      ROCKBOX_DIR "/seekidx"
+#define SEEK_INDEX_NAME     SEEK_INDEX_DIR "/%08lx.idx"
+#define SEEK_INDEX_MAGIC    0x52534932 /* 'RSI2' */
+
+struct seek_index_header
+{
+    uint32_t magic;
+    uint32_t tag;       /* format of the data */
+    uint32_t path_crc;  /* crc_32() of the path seeded with 0, for collisions */
+    uint32_t filesize;  /* rebuild if the file changed */
+    uint32_t mtime;
+    uint32_t size;      /* bytes of data following */
+};
 
 /* codec identity */
 const char *get_codec_filename(int cod_spec);
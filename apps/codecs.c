@@ -151,6 +151,10 @@ struct codec_api ci = {
     /* new stuff at the end, sort into place next time
        the API gets incompatible */
 
+    NULL, /* seek_index_load */
+    NULL, /* seek_index_save */
+    NULL, /* job_start */
+    NULL, /* job_wait */
 };
 
 void codec_get_full_path(char *path, const char *codec_root_fn)
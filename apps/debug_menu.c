@@ -94,6 +94,8 @@
 #include "pcmbuf.h"
 #include "buffering.h"
 #include "playback.h"
+#include "dsp_core.h"
+#include "dsp_misc.h"
 #if defined(HAVE_SPDIF_OUT) || defined(HAVE_SPDIF_IN)
 #include "spdif.h"
 #endif
@@ -483,6 +485,10 @@ static bool dbg_buffering_thread(void)
                              pcmbuf_used_descs(), pcmbufdescs);
             screens[i].putsf(0, line++, "watermark: %6d",
                              (int)(d.watermark));
+            screens[i].putsf(0, line++, "deadlines: %u/%u missed",
+                             d.deadline_misses,
+                             d.deadlines_met + d.deadline_misses);
+            screens[i].putsf(0, line++, "data waits: %u", d.data_waits);
 
             screens[i].update();
         }
@@ -498,6 +504,121 @@ static bool dbg_buffering_thread(void)
 #endif /* CONFIG_CODEC */
 #endif /* HAVE_LCD_BITMAP */
 
+#if CONFIG_CODEC == SWCODEC
+static int dsp_profile_callback(int btn, struct gui_synclist *lists)
+{
+    struct dsp_config *dsp = dsp_get_config(CODEC_IDX_AUDIO);
+    struct dsp_profile prof;
+    (void)lists;
+
+    if (btn == ACTION_STD_OK)
+    {
+        /* Restart counting */
+        dsp_configure(dsp, DSP_PROFILE_ENABLE, true);
+        btn = ACTION_NONE;
+    }
+
+    simplelist_set_line_count(0);
+
+    if (!dsp_configure(dsp, DSP_PROFILE_GET, (intptr_t)&prof))
+    {
+        simplelist_addline("Not supported on this target");
+        return btn;
+    }
+
+    /* Everything relative to the audio time that has been output */
+    uint64_t ns_per_tick = 1000000000ull / prof.timer_freq;
+    uint64_t out_samples = prof.stages[prof.num_stages - 1].samples;
+    uint64_t audio_ns = out_samples * 1000000000ull /
+                            dsp_get_output_frequency(dsp);
+    uint64_t total_ns = 0;
+
+    for (unsigned int i = 0; i < prof.num_stages; i++)
+        total_ns += prof.stages[i].time * ns_per_tick;
+
+    unsigned int load = audio_ns ? total_ns * 1000 / audio_ns : 0;
+    simplelist_addline("Audio: %lu ms", (unsigned long)(audio_ns / 1000000));
+    simplelist_addline("Total: %u.%u%% realtime", load / 10, load % 10);
+
+    for (unsigned int i = 0; i < prof.num_stages; i++)
+    {
+        struct dsp_profile_stage *st = &prof.stages[i];
+
+        if (st->calls == 0)
+            continue;
+
+        uint64_t ns = st->time * ns_per_tick;
+        load = audio_ns ? ns * 1000 / audio_ns : 0;
+        simplelist_addline("%s: %u.%u%% %lu ns/smp", st->name,
+                           load / 10, load % 10,
+                           (unsigned long)(st->samples ? ns / st->samples : 0));
+    }
+
+    if (btn == ACTION_NONE)
+        btn = ACTION_REDRAW;
+
+    return btn;
+}
+
+static bool dbg_dsp_profile(void)
+{
+    struct dsp_config *dsp = dsp_get_config(CODEC_IDX_AUDIO);
+    struct simplelist_info info;
+    simplelist_info_init(&info, "DSP profile [OK to reset]", 0, NULL);
+    info.action_callback = dsp_profile_callback;
+    info.hide_selection = true;
+    info.scroll_all = true;
+    info.timeout = HZ/2;
+
+    dsp_configure(dsp, DSP_PROFILE_ENABLE, true);
+    bool ret = simplelist_show_list(&info);
+    dsp_configure(dsp, DSP_PROFILE_ENABLE, false);
+    return ret;
+}
+#endif /* CONFIG_CODEC == SWCODEC */
+
+#ifdef HAVE_PCM_ALSA
+#include "pcm-alsa.h"
+
+static int pcm_alsa_callback(int btn, struct gui_synclist *lists)
+{
+    struct pcm_alsa_debug dbg;
+    (void)lists;
+
+    /* OK restarts counting */
+    pcm_alsa_get_debug(&dbg, btn == ACTION_STD_OK);
+    if (btn == ACTION_STD_OK)
+        btn = ACTION_NONE;
+
+    simplelist_set_line_count(0);
+    simplelist_addline("Method: %s%s", dbg.method, dbg.mmap ? " (mmap)" : "");
+    simplelist_addline("Period: %lu frames", dbg.period_size);
+    simplelist_addline("Buffer: %lu frames", dbg.buffer_size);
+    simplelist_addline("Periods written: %lu", dbg.periods);
+    simplelist_addline("Xruns: %lu", dbg.xruns);
+    simplelist_addline("Recovery: %lu us (max %lu)", dbg.recovery_last,
+                       dbg.recovery_max);
+    simplelist_addline("Fill: %lu frames (min %lu)", dbg.fill_last,
+                       dbg.fill_min);
+
+    if (btn == ACTION_NONE)
+        btn = ACTION_REDRAW;
+
+    return btn;
+}
+
+static bool dbg_pcm_alsa(void)
+{
+    struct simplelist_info info;
+    simplelist_info_init(&info, "PCM output [OK to reset]", 0, NULL);
+    info.action_callback = pcm_alsa_callback;
+    info.hide_selection = true;
+    info.scroll_all = true;
+    info.timeout = HZ/2;
+    return simplelist_show_list(&info);
+}
+#endif /* HAVE_PCM_ALSA */
+
 static const char* bf_getname(int selected_item, void *data,
                                    char *buffer, size_t buffer_len)
 {
@@ -1870,6 +1991,8 @@ static int database_callback(int btn, struct gui_synclist *lists)
 
     simplelist_addline("Queue length: %d",
              stat->queue_length);
+    simplelist_addline("Last query: %s",
+             *tagcache_get_last_plan() ? tagcache_get_last_plan() : "---");
 
     if (synced)
     {
@@ -2389,6 +2512,10 @@ static const char* dbg_talk_get_name(int selected_item, void *data,
             snprintf(buffer, buffer_len, "Cache hits / misses: %d / %d",
                     talk_data->cache_hits, talk_data->cache_misses);
             break;
+        case 7:
+            snprintf(buffer, buffer_len, "Prefetched clips / used: %d / %d",
+                    talk_data->prefetch_loads, talk_data->prefetch_hits);
+            break;
         default:
             buffer = "TODO";
             break;
@@ -2402,7 +2529,7 @@ static bool dbg_talk(void)
     struct simplelist_info list;
     struct talk_debug_data data;
     if (talk_get_debug_data(&data))
-        simplelist_info_init(&list, "Voice Information:", 7, &data);
+        simplelist_info_init(&list, "Voice Information:", 8, &data);
     else
         simplelist_info_init(&list, "Voice Information:", 1, NULL);
     list.scroll_all = true;
@@ -2533,6 +2660,104 @@ static bool dbg_skin_engine(void)
 #endif
     return simplelist_show_list(&info);
 }
+
+static unsigned long skin_last_pixels[NB_SCREENS];
+static long skin_last_tick;
+
+static int skin_updates_callback(int btn, struct gui_synclist *lists)
+{
+    long ticks = current_tick - skin_last_tick;
+    (void)lists;
+
+    /* OK restarts counting */
+    if (btn == ACTION_STD_OK)
+    {
+        skin_reset_update_stats();
+        memset(skin_last_pixels, 0, sizeof(skin_last_pixels));
+        btn = ACTION_NONE;
+    }
+
+    simplelist_set_line_count(0);
+    FOR_NB_SCREENS(i)
+    {
+        struct skin_update_stats *stats = skin_get_update_stats(i);
+        long elapsed = current_tick - stats->reset_tick;
+#if NB_SCREENS > 1
+        simplelist_addline("%s display:", i == 0 ? "Main" : "Remote");
+#endif
+        simplelist_addline("Now: %lu pixels/s", ticks > 0 ?
+                (stats->pixels - skin_last_pixels[i]) * HZ / ticks : 0);
+        simplelist_addline("Average: %lu pixels/s", elapsed > 0 ?
+                (unsigned long)((uint64_t)stats->pixels * HZ / elapsed) : 0);
+        simplelist_addline("Updates: %lu (%lu full)", stats->updates,
+                           stats->full_updates);
+        skin_last_pixels[i] = stats->pixels;
+    }
+    skin_last_tick = current_tick;
+
+    if (btn == ACTION_NONE)
+        btn = ACTION_REDRAW;
+
+    return btn;
+}
+
+static bool dbg_skin_updates(void)
+{
+    struct simplelist_info info;
+    simplelist_info_init(&info, "Skin LCD updates [OK to reset]", 0, NULL);
+    info.action_callback = skin_updates_callback;
+    info.hide_selection = true;
+    info.timeout = HZ;
+
+    FOR_NB_SCREENS(i)
+        skin_last_pixels[i] = skin_get_update_stats(i)->pixels;
+    skin_last_tick = current_tick;
+    return simplelist_show_list(&info);
+}
+#endif
+
+#ifdef HAVE_LCD_BITMAP
+static int font_cache_callback(int btn, struct gui_synclist *lists)
+{
+    struct font_cache_stats stats;
+    int i;
+    (void)lists;
+
+    simplelist_set_line_count(0);
+    for (i = 0; i < MAXFONTS; i++)
+    {
+        const char *name = font_filename(i);
+        if (!name)
+            continue;
+        if (!font_get_cache_stats(i, &stats))
+        {
+            simplelist_addline("%d: %s (in RAM)", i, name);
+            continue;
+        }
+        unsigned long lookups = stats.hits + stats.misses;
+        simplelist_addline("%d: %s", i, name);
+        simplelist_addline("\tglyphs: %d of %d", stats.size, stats.capacity);
+        simplelist_addline("\thits: %lu misses: %lu (%lu%%)",
+                stats.hits, stats.misses,
+                lookups ? (unsigned long)((uint64_t)stats.hits * 100 / lookups) : 0);
+    }
+
+    if (btn == ACTION_NONE)
+        btn = ACTION_REDRAW;
+
+    return btn;
+}
+
+static bool dbg_font_cache(void)
+{
+    struct simplelist_info info;
+    simplelist_info_init(&info, "Glyph cache", 0, NULL);
+    info.action_callback = font_cache_callback;
+    info.hide_selection = true;
+    info.scroll_all = true;
+    info.timeout = HZ;
+    return simplelist_show_list(&info);
+}
 #endif
 
 
@@ -2583,6 +2808,8 @@ static const struct {
         { "Screendump", dbg_screendump },
 #endif
         { "Skin Engine RAM usage", dbg_skin_engine },
+        { "Skin Engine LCD updates", dbg_skin_updates },
+        { "View glyph cache", dbg_font_cache },
 #endif
 #if (CONFIG_PLATFORM & PLATFORM_NATIVE)
         { "View HW info", dbg_hw_info },
@@ -2609,6 +2836,7 @@ static const struct {
 #ifdef HAVE_LCD_BITMAP
 #if CONFIG_CODEC == SWCODEC
         { "View buffering thread", dbg_buffering_thread },
+        { "View DSP profile", dbg_dsp_profile },
 #elif !defined(SIMULATOR)
         { "View audio thread", dbg_audio_thread },
 #endif
@@ -2617,6 +2845,9 @@ static const struct {
 #endif /* PM_DEBUG */
 #endif /* HAVE_LCD_BITMAP */
         { "View buflib allocs", dbg_buflib_allocs },
+#ifdef HAVE_PCM_ALSA
+        { "View PCM output", dbg_pcm_alsa },
+#endif
 #ifndef SIMULATOR
 #if CONFIG_TUNER
         { "FM Radio", dbg_fm_radio },
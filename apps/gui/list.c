@@ -320,6 +320,24 @@ static void gui_list_put_selection_on_screen(struct gui_synclist * gui_list,
         gui_list->start_item[screen] = new_start_item;
 }
 
+/* Have the clips for the items around the selection loaded while the user
+ * listens to this one */
+static void gui_synclist_prefetch_talk(struct gui_synclist *lists)
+{
+    list_speak_item *cb = lists->callback_speak_item;
+    int selected = lists->selected_item;
+
+    if (!talk_prefetch_begin())
+        return;
+
+    if (selected + 1 < lists->nb_items)
+        cb(selected + 1, lists->data);
+    if (selected > 0)
+        cb(selected - 1, lists->data);
+
+    talk_prefetch_end();
+}
+
 static void _gui_synclist_speak_item(struct gui_synclist *lists)
 {
     list_speak_item *cb = lists->callback_speak_item;
@@ -342,6 +360,7 @@ static void _gui_synclist_speak_item(struct gui_synclist *lists)
             lists->scheduled_talk_tick = 0; /* work done */
             cb(lists->selected_item, lists->data);
             lists->last_talked_tick = current_tick;
+            gui_synclist_prefetch_talk(lists);
         }
     }
 }
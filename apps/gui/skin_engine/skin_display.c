@@ -185,6 +185,7 @@ void draw_progressbar(struct gui_wps *gwps, int line, struct progressbar *pb)
         /* if Y was not set calculate by font height,Y is -line_number-1 */
         y = line*line_height + (0 > center ? 0 : center);
     }
+    skin_damage_rect(display, vp, x, y, width, height);
 
     if (pb->type == SKIN_TOKEN_VOLUMEBAR)
     {
@@ -398,6 +399,7 @@ void wps_display_images(struct gui_wps *gwps, struct viewport* vp)
     {
         struct wps_token *token = SKINOFFSETTOPTR(get_skin_buffer(data), list->token);
         struct gui_img *img = (struct gui_img*)SKINOFFSETTOPTR(get_skin_buffer(data), token->value.data);
+        bool was_here = SKINOFFSETTOPTR(get_skin_buffer(data), img->last_vp) == vp;
         if (img->using_preloaded_icons && img->display >= 0)
         {
             screen_put_icon(display, img->x, img->y, img->display);
@@ -409,6 +411,26 @@ void wps_display_images(struct gui_wps *gwps, struct viewport* vp)
                 wps_draw_image(gwps, img, img->display, vp);
             }
         }
+        /* Redrawing the same subimage at the same place changes nothing on
+         * the screen, anything else needs to be pushed */
+        if (img->display >= 0 ? (!was_here || img->display != img->last_display)
+                              : (was_here && img->last_display >= 0))
+        {
+            if (img->using_preloaded_icons)
+                skin_damage_rect(display, vp, img->x, img->y,
+                                 get_icon_width(display->screen_type),
+                                 get_icon_height(display->screen_type));
+            else if (img->is_9_segment)
+                skin_damage_rect(display, vp, 0, 0, vp->width, vp->height);
+            else
+                skin_damage_rect(display, vp, img->x, img->y,
+                                 img->bm.width, img->subimage_height);
+        }
+        if (img->display >= 0 || was_here)
+        {
+            img->last_display = img->display;
+            img->last_vp = PTRTOSKINOFFSET(get_skin_buffer(data), vp);
+        }
         list = SKINOFFSETTOPTR(get_skin_buffer(data), list->next);
     }
 #ifdef HAVE_ALBUMART
@@ -418,6 +440,7 @@ void wps_display_images(struct gui_wps *gwps, struct viewport* vp)
         && aa->draw_handle >= 0)
     {
         draw_album_art(gwps, aa->draw_handle, false);
+        skin_damage_rect(display, vp, aa->x, aa->y, aa->width, aa->height);
         aa->draw_handle = -1;
     }
 #endif
@@ -638,6 +661,8 @@ void draw_peakmeters(struct gui_wps *gwps, int line_number,
             peak_meter_enable(true);
             peak_meter_screen(gwps->display, 0, peak_meter_y,
                               MIN(h, viewport->y+viewport->height - peak_meter_y));
+            skin_damage_rect(gwps->display, viewport, 0, peak_meter_y,
+                             viewport->width, h);
         }
     }
 }
@@ -40,6 +40,11 @@ void wps_display_images(struct gui_wps *gwps, struct viewport* vp);
 void skin_render_viewport(struct skin_element* viewport, struct gui_wps *gwps,
                         struct skin_viewport* skin_viewport, unsigned long refresh_type);
 
+/* Mark an area of vp (in vp coordinates) as changed, skin_render() pushes
+ * only the changed areas to the LCD */
+void skin_damage_rect(struct screen *display, struct viewport *vp,
+                      int x, int y, int width, int height);
+
 #endif
 
 /* Evaluate the conditional that is at *token_index and return whether a skip
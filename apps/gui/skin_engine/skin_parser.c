@@ -51,6 +51,8 @@
 #else
 #include "debug.h"
 #include "language.h"
+#include "crc32.h"
+#include "version.h"
 #endif /*__PCTOOL__*/
 
 #include <ctype.h>
@@ -121,6 +123,11 @@ static struct skin_element *first_viewport;
 
 static struct line *curr_line;
 
+#ifndef __PCTOOL__
+/* the skin uses the list title, the compiled skin cache replays this */
+static bool parsed_title;
+#endif
+
 static int follow_lang_direction = 0;
 
 typedef int (*parse_function)(struct skin_element *element,
@@ -426,6 +433,8 @@ static int parse_image_load(struct skin_element *element,
     img->y = y;
     img->num_subimages = subimages;
     img->display = -1;
+    img->last_display = -1;
+    img->last_vp = PTRTOSKINOFFSET(skin_buffer, NULL);
     img->using_preloaded_icons = false;
     img->buflib_handle = -1;
     img->is_9_segment = false;
@@ -1125,6 +1134,8 @@ static int parse_progressbar_tag(struct skin_element* element,
             img->y = 0;
             img->num_subimages = 1;
             img->display = -1;
+            img->last_display = -1;
+            img->last_vp = PTRTOSKINOFFSET(skin_buffer, NULL);
             img->using_preloaded_icons = false;
             img->buflib_handle = -1;
             img->vp = PTRTOSKINOFFSET(skin_buffer, &curr_vp->vp);
@@ -2086,6 +2097,9 @@ static int convert_viewport(struct wps_data *data, struct skin_element* element)
     skin_vp->label = PTRTOSKINOFFSET(skin_buffer, NULL);
     skin_vp->is_infovp = false;
     skin_vp->parsed_fontid = 1;
+#ifdef HAVE_LCD_BITMAP
+    skin_vp->lines_known = 0;
+#endif
     element->data = PTRTOSKINOFFSET(skin_buffer, skin_vp);
     curr_vp = skin_vp;
     curr_viewport_element = element;
@@ -2280,6 +2294,7 @@ static int skin_element_callback(struct skin_element* element, void* data)
                 case SKIN_TOKEN_LIST_TITLE_TEXT:
 #ifndef __PCTOOL__
                     sb_skin_has_title(curr_screen);
+                    parsed_title = true;
 #endif
                     break;
 #endif
@@ -2423,12 +2438,336 @@ static int skin_element_callback(struct skin_element* element, void* data)
     return CALLBACK_OK;
 }
 
+#ifndef __PCTOOL__
+/* Compiled skin cache
+ *
+ * The skin buffer as a successful parse leaves it is written to
+ * SKIN_CACHE_DIR, one file per skin file and screen, and read back with a
+ * single read the next time the same skin is loaded. Everything in the
+ * buffer refers to the rest by offset so it can be used as is, only the few
+ * absolute pointers (tag table, settings, image filenames, wps_data) are
+ * relocated. Bitmaps, fonts and the backdrop are loaded from their files
+ * afterwards just like after a parse.
+ *
+ * The parse depends on more than the skin text: the default viewport (theme,
+ * statusbar, UI font and colours), language direction, screen and build all
+ * go into env_crc, a cache is only used if they match.
+ */
+#define SKIN_CACHE_DIR      ROCKBOX_DIR "/skincache"
+#define SKIN_CACHE_MAGIC    0x52534b31 /* 'RSK1' */
+
+/* backdrop_filename values that don't point into the skin buffer */
+#define CACHE_BACKDROP_NULL     -1
+#define CACHE_BACKDROP_DEFAULT  -2
+#define CACHE_BACKDROP_BUFFER   -3
+
+struct skin_cache_header
+{
+    uint32_t magic;
+    uint32_t path_crc;      /* differently seeded than the name, for collisions */
+    uint32_t text_crc;      /* the skin source */
+    uint32_t env_crc;       /* everything else the parse depends on */
+    uint32_t size;          /* bytes of skin buffer following */
+    /* addresses when written, to relocate absolute pointers */
+    intptr_t buffer_base;
+    intptr_t tag_base;
+    intptr_t settings_base;
+    struct wps_data data;   /* as the parse left it */
+    bool has_title;
+#ifdef HAVE_LCD_BITMAP
+    struct {
+        int32_t name;       /* offset into the buffer, -1 if unused */
+        int32_t glyphs;
+    } fonts[MAXUSERFONTS];
+#endif
+#if (LCD_DEPTH > 1) || (defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1))
+    int32_t backdrop;       /* offset or CACHE_BACKDROP_* */
+#endif
+};
+
+static uint32_t skin_cache_file(char *buf, size_t bufsize, const char *skin)
+{
+    snprintf(buf, bufsize, SKIN_CACHE_DIR "/%08lx.%d",
+             (unsigned long)crc_32(skin, strlen(skin), 0xffffffff),
+             (int)curr_screen);
+    return crc_32(skin, strlen(skin), 0);
+}
+
+static uint32_t skin_cache_env_crc(void)
+{
+    struct {
+        struct viewport defaults;
+        struct viewport fullscreen;
+        int width, height, depth;
+        int font_height;
+        int glyphs;
+        bool rtl;
+        bool radio;
+#ifdef HAVE_LCD_COLOR
+        unsigned lss, lse, lst;
+#endif
+    } env;
+    struct screen *display = &screens[curr_screen];
+
+    memset(&env, 0, sizeof (env));
+    viewport_set_defaults(&env.defaults, curr_screen);
+    viewport_set_fullscreen(&env.fullscreen, curr_screen);
+    env.width = display->lcdwidth;
+    env.height = display->lcdheight;
+    env.depth = display->depth;
+#ifdef HAVE_LCD_BITMAP
+    env.font_height = font_get(display->getuifont())->height;
+    env.glyphs = global_settings.glyphs_to_cache;
+#endif
+    env.rtl = lang_is_rtl();
+#if CONFIG_TUNER
+    env.radio = radio_hardware_present();
+#endif
+#ifdef HAVE_LCD_COLOR
+    env.lss = global_settings.lss_color;
+    env.lse = global_settings.lse_color;
+    env.lst = global_settings.lst_color;
+#endif
+    return crc_32(&env, sizeof (env),
+                  crc_32(rbversion, strlen(rbversion), 0xffffffff));
+}
+
+static void skin_cache_relocate_tree(struct skin_element *element,
+                                     intptr_t tag_delta,
+                                     struct wps_data *data)
+{
+    (void)data;
+    for (; element; element = SKINOFFSETTOPTR(skin_buffer, element->next))
+    {
+        OFFSETTYPE(struct skin_element *) *children =
+                SKINOFFSETTOPTR(skin_buffer, element->children);
+        struct skin_tag_parameter *params =
+                SKINOFFSETTOPTR(skin_buffer, element->params);
+        int i;
+
+        if (element->tag)
+            element->tag = (const struct tag_info *)
+                    ((intptr_t)element->tag + tag_delta);
+
+        if (element->type == LINE_ALTERNATOR)
+        {
+            struct line_alternator *alternator =
+                    SKINOFFSETTOPTR(skin_buffer, element->data);
+            alternator->next_change_tick = current_tick;
+        }
+#ifdef HAVE_LCD_BITMAP
+        else if (element->type == TAG)
+        {
+            struct wps_token *token =
+                    SKINOFFSETTOPTR(skin_buffer, element->data);
+            if (token && token->type == SKIN_TOKEN_LIST_ITEM_CFG)
+            {
+                struct listitem_viewport_cfg *cfg =
+                        SKINOFFSETTOPTR(skin_buffer, token->value.data);
+                cfg->data = data;
+            }
+        }
+#endif
+
+        for (i = 0; i < element->children_count; i++)
+            skin_cache_relocate_tree(SKINOFFSETTOPTR(skin_buffer, children[i]),
+                                     tag_delta, data);
+        for (i = 0; i < element->params_count; i++)
+        {
+            if (params[i].type == CODE)
+                skin_cache_relocate_tree(
+                        SKINOFFSETTOPTR(skin_buffer, params[i].data.code),
+                        tag_delta, data);
+        }
+    }
+}
+
+/* Fill the skin buffer from the cache instead of parsing, skin_buffer_init()
+ * must have been called. Leaves the buffer empty if there is no usable
+ * cache. */
+static bool skin_cache_load(struct wps_data *wps_data, const char *skin,
+                            uint32_t text_crc, uint32_t env_crc)
+{
+    struct skin_cache_header hdr;
+    char path[MAX_PATH];
+    uint32_t path_crc = skin_cache_file(path, sizeof (path), skin);
+    size_t buffersize = skin_buffer_freespace();
+    char *buffer = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    bool ok = read(fd, &hdr, sizeof (hdr)) == sizeof (hdr) &&
+              hdr.magic == SKIN_CACHE_MAGIC && hdr.path_crc == path_crc &&
+              hdr.text_crc == text_crc &&
+              hdr.env_crc == env_crc &&
+              hdr.size > 0 && hdr.size <= buffersize &&
+              (buffer = skin_buffer_alloc(hdr.size)) != NULL &&
+              read(fd, buffer, hdr.size) == (ssize_t)hdr.size;
+
+    close(fd);
+
+    if (!ok)
+    {
+        skin_buffer_init(skin_buffer, buffersize);
+        return false;
+    }
+
+    /* the handles and slots aren't part of the cache */
+    hdr.data.buflib_handle = wps_data->buflib_handle;
+#ifdef HAVE_BACKDROP_IMAGE
+    hdr.data.backdrop_id = wps_data->backdrop_id;
+#endif
+#ifdef HAVE_ALBUMART
+    hdr.data.playback_aa_slot = wps_data->playback_aa_slot;
+    hdr.data.last_albumart_width = wps_data->last_albumart_width;
+    hdr.data.last_albumart_height = wps_data->last_albumart_height;
+#endif
+    *wps_data = hdr.data;
+
+    skin_cache_relocate_tree(SKINOFFSETTOPTR(skin_buffer, wps_data->tree),
+                             (intptr_t)get_tag_table() - hdr.tag_base,
+                             wps_data);
+
+#ifdef HAVE_LCD_BITMAP
+    /* images keep their filename until load_skin_bitmaps() */
+    intptr_t buffer_delta = (intptr_t)skin_buffer - hdr.buffer_base;
+    struct skin_token_list *list = SKINOFFSETTOPTR(skin_buffer,
+                                                   wps_data->images);
+    for (; list; list = SKINOFFSETTOPTR(skin_buffer, list->next))
+    {
+        struct wps_token *token = SKINOFFSETTOPTR(skin_buffer, list->token);
+        struct gui_img *img = SKINOFFSETTOPTR(skin_buffer, token->value.data);
+        img->bm.data = (char *)((intptr_t)img->bm.data + buffer_delta);
+    }
+
+    for (int i = 0; i < MAXUSERFONTS; i++)
+    {
+        skinfonts[i].id = -1;
+        skinfonts[i].name = hdr.fonts[i].name < 0 ? NULL :
+                                skin_buffer + hdr.fonts[i].name;
+        skinfonts[i].glyphs = hdr.fonts[i].glyphs;
+    }
+#endif
+
+#ifdef HAVE_TOUCHSCREEN
+    intptr_t settings_delta = (intptr_t)settings - hdr.settings_base;
+    list = SKINOFFSETTOPTR(skin_buffer, wps_data->touchregions);
+    for (; list; list = SKINOFFSETTOPTR(skin_buffer, list->next))
+    {
+        struct wps_token *token = SKINOFFSETTOPTR(skin_buffer, list->token);
+        struct touchregion *region =
+                SKINOFFSETTOPTR(skin_buffer, token->value.data);
+        if (region->action == ACTION_SETTINGS_INC ||
+            region->action == ACTION_SETTINGS_DEC ||
+            region->action == ACTION_SETTINGS_SET)
+        {
+            region->setting_data.setting = (const struct settings_list *)
+                ((intptr_t)region->setting_data.setting + settings_delta);
+        }
+        else if (region->action == ACTION_TOUCH_MUTE)
+            region->value = global_settings.volume;
+    }
+#endif
+
+#if (LCD_DEPTH > 1) || (defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1))
+    if (hdr.backdrop >= 0)
+        backdrop_filename = skin_buffer + hdr.backdrop;
+    else if (hdr.backdrop == CACHE_BACKDROP_BUFFER)
+        backdrop_filename = BACKDROP_BUFFERNAME;
+    else if (hdr.backdrop == CACHE_BACKDROP_DEFAULT)
+        backdrop_filename = "-";
+    else
+        backdrop_filename = NULL;
+#endif
+
+#ifdef HAVE_ALBUMART
+    struct skin_albumart *aa = SKINOFFSETTOPTR(skin_buffer,
+                                               wps_data->albumart);
+    if (aa)
+    {
+        struct dim dimensions = { .width = aa->width, .height = aa->height };
+        int albumart_slot = playback_claim_aa_slot(&dimensions);
+        if (0 <= albumart_slot)
+            wps_data->playback_aa_slot = albumart_slot;
+    }
+#endif
+
+    if (hdr.has_title)
+        sb_skin_has_title(curr_screen);
+
+    return true;
+}
+
+static void skin_cache_save(struct wps_data *wps_data, const char *skin,
+                            uint32_t text_crc, uint32_t env_crc)
+{
+    struct skin_cache_header hdr;
+    char path[MAX_PATH];
+
+    memset(&hdr, 0, sizeof (hdr));
+    hdr.magic = SKIN_CACHE_MAGIC;
+    hdr.path_crc = skin_cache_file(path, sizeof (path), skin);
+    hdr.text_crc = text_crc;
+    hdr.env_crc = env_crc;
+    hdr.size = skin_buffer_usage();
+    hdr.buffer_base = (intptr_t)skin_buffer;
+    hdr.tag_base = (intptr_t)get_tag_table();
+    hdr.settings_base = (intptr_t)settings;
+    hdr.data = *wps_data;
+    hdr.has_title = parsed_title;
+#ifdef HAVE_LCD_BITMAP
+    for (int i = 0; i < MAXUSERFONTS; i++)
+    {
+        hdr.fonts[i].name = skinfonts[i].name ?
+                                skinfonts[i].name - skin_buffer : -1;
+        hdr.fonts[i].glyphs = skinfonts[i].glyphs;
+    }
+#endif
+#if (LCD_DEPTH > 1) || (defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1))
+    if (!backdrop_filename)
+        hdr.backdrop = CACHE_BACKDROP_NULL;
+    else if (backdrop_filename >= skin_buffer &&
+             backdrop_filename < skin_buffer + hdr.size)
+        hdr.backdrop = backdrop_filename - skin_buffer;
+    else if (!strcmp(backdrop_filename, "-"))
+        hdr.backdrop = CACHE_BACKDROP_DEFAULT;
+    else
+        hdr.backdrop = CACHE_BACKDROP_BUFFER;
+#endif
+
+    int fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        mkdir(SKIN_CACHE_DIR);
+        fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+        if (fd < 0)
+            return;
+    }
+
+    if (write(fd, &hdr, sizeof (hdr)) != sizeof (hdr) ||
+        write(fd, skin_buffer, hdr.size) != (ssize_t)hdr.size)
+    {
+        DEBUGF("skin cache write failed: %s\n", path);
+        close(fd);
+        remove(path);
+        return;
+    }
+
+    close(fd);
+}
+#endif /* __PCTOOL__ */
+
 /* to setup up the wps-data from a format-buffer (isfile = false)
    from a (wps-)file (isfile = true)*/
 bool skin_data_load(enum screen_type screen, struct wps_data *wps_data,
                     const char *buf, bool isfile, struct skin_stats *stats)
 {
     char *wps_buffer = NULL;
+#ifndef __PCTOOL__
+    uint32_t text_crc = 0;
+#endif
     if (!wps_data || !buf)
         return false;
 #ifdef HAVE_LCD_BITMAP
@@ -2448,6 +2787,9 @@ bool skin_data_load(enum screen_type screen, struct wps_data *wps_data,
 
     _stats = stats;
     skin_clear_stats(stats);
+#ifndef __PCTOOL__
+    parsed_title = false;
+#endif
     /* get buffer space from the plugin buffer */
     size_t buffersize = 0;
     wps_buffer = (char *)plugin_get_buffer(&buffersize);
@@ -2484,6 +2826,9 @@ bool skin_data_load(enum screen_type screen, struct wps_data *wps_data,
         close(fd);
         if (start <= 0)
             return false;
+#ifndef __PCTOOL__
+        text_crc = crc_32(wps_buffer, start, 0xffffffff);
+#endif
         start++;
         skin_buffer = &wps_buffer[start];
         buffersize -= start;
@@ -2499,10 +2844,21 @@ bool skin_data_load(enum screen_type screen, struct wps_data *wps_data,
     backdrop_filename = "-";
     wps_data->backdrop_id = -1;
 #endif
-    /* parse the skin source */
+    /* parse the skin source, unless it was compiled before */
     skin_buffer_init(skin_buffer, buffersize);
-    struct skin_element *tree = skin_parse(wps_buffer, skin_element_callback, wps_data);
-    wps_data->tree = PTRTOSKINOFFSET(skin_buffer, tree);
+#ifndef __PCTOOL__
+    uint32_t env_crc = isfile ? skin_cache_env_crc() : 0;
+    if (!isfile || !skin_cache_load(wps_data, buf, text_crc, env_crc))
+#endif
+    {
+        struct skin_element *tree = skin_parse(wps_buffer,
+                                               skin_element_callback, wps_data);
+        wps_data->tree = PTRTOSKINOFFSET(skin_buffer, tree);
+#ifndef __PCTOOL__
+        if (isfile && tree)
+            skin_cache_save(wps_data, buf, text_crc, env_crc);
+#endif
+    }
     if (!SKINOFFSETTOPTR(skin_buffer, wps_data->tree)) {
 #ifdef DEBUG_SKIN_ENGINE
         if (isfile && debug_wps)
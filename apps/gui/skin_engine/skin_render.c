@@ -24,12 +24,14 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <limits.h>
 #include "strlcat.h"
 
 #include "config.h"
 #include "core_alloc.h"
 #include "kernel.h"
 #include "appevents.h"
+#include "font.h"
 #ifdef HAVE_ALBUMART
 #include "albumart.h"
 #endif
@@ -50,6 +52,7 @@
 #include "root_menu.h"
 #include "misc.h"
 #include "list.h"
+#include "crc32.h"
 
 
 #define MAX_LINE 1024
@@ -93,6 +96,218 @@ get_child(OFFSETTYPE(struct skin_element**) children, int child)
     return SKINOFFSETTOPTR(skin_buffer, kids[child]);
 }
 
+#ifdef HAVE_LCD_BITMAP
+/* Areas changed since the last LCD update, in screen coordinates. Only these
+ * are pushed by skin_render() unless the whole screen was redrawn. */
+#define MAX_DAMAGE_RECTS 8
+static struct skin_damage {
+    int count; /* -1 if the whole screen needs to be pushed */
+    struct { short x, y, width, height; } rect[MAX_DAMAGE_RECTS];
+} damage[NB_SCREENS];
+
+/* The skin being drawn by skin_render(), whose viewports remember their
+ * text lines (see line_changed()). NULL while nothing is tracked. */
+static struct wps_data *tracking_data;
+
+static struct skin_update_stats update_stats[NB_SCREENS];
+
+struct skin_update_stats *skin_get_update_stats(int screen)
+{
+    return &update_stats[screen];
+}
+
+void skin_reset_update_stats(void)
+{
+    FOR_NB_SCREENS(i)
+    {
+        memset(&update_stats[i], 0, sizeof(update_stats[i]));
+        update_stats[i].reset_tick = current_tick;
+    }
+}
+
+/* Forget the remembered text lines of the tracked skin which overlap an
+ * area (in screen coordinates), except those of the viewport drawing it */
+static void invalidate_lines(int x, int y, int width, int height,
+                             struct skin_viewport *drawn_by)
+{
+    struct skin_element *viewport;
+
+    for (viewport = SKINOFFSETTOPTR(skin_buffer, tracking_data->tree);
+         viewport;
+         viewport = SKINOFFSETTOPTR(skin_buffer, viewport->next))
+    {
+        struct skin_viewport *skin_vp = SKINOFFSETTOPTR(skin_buffer, viewport->data);
+        struct viewport *vp = &skin_vp->vp;
+        int line_height, first, last;
+
+        if (skin_vp == drawn_by || !skin_vp->lines_known ||
+            x >= vp->x + vp->width || x + width <= vp->x ||
+            y >= vp->y + vp->height || y + height <= vp->y)
+            continue;
+        line_height = font_get(vp->font)->height;
+        first = MAX(y - vp->y, 0) / line_height;
+        last = (MIN(y + height, vp->y + vp->height) - vp->y - 1) / line_height;
+        if (first >= SKIN_VP_TRACKED_LINES)
+            continue;
+        last = MIN(last, SKIN_VP_TRACKED_LINES - 1);
+        skin_vp->lines_known &= ~(((2u << (last - first)) - 1) << first);
+    }
+}
+
+static void damage_rect(struct screen *display, struct viewport *vp,
+                        int x, int y, int width, int height,
+                        struct skin_viewport *drawn_by)
+{
+    struct skin_damage *d = &damage[display->screen_type];
+    int i, best = 0, best_growth = INT_MAX;
+
+    /* clip to the viewport and make it absolute */
+    if (x < 0)
+    {
+        width += x;
+        x = 0;
+    }
+    if (y < 0)
+    {
+        height += y;
+        y = 0;
+    }
+    width = MIN(width, vp->width - x);
+    height = MIN(height, vp->height - y);
+    if (width <= 0 || height <= 0)
+        return;
+    x += vp->x;
+    y += vp->y;
+
+    /* lines drawn over have to be drawn again, even if unchanged */
+    if (tracking_data)
+        invalidate_lines(x, y, width, height, drawn_by);
+    if (d->count < 0)
+        return;
+
+    /* merge with a rectangle if that costs no extra pixels (neighbouring
+     * lines of a viewport), else add it. When full merge with the one
+     * growing the least. */
+    for (i = 0; i < d->count; i++)
+    {
+        int x1 = MIN(x, d->rect[i].x);
+        int y1 = MIN(y, d->rect[i].y);
+        int x2 = MAX(x + width, d->rect[i].x + d->rect[i].width);
+        int y2 = MAX(y + height, d->rect[i].y + d->rect[i].height);
+        int growth = (x2 - x1) * (y2 - y1) - width * height -
+                     d->rect[i].width * d->rect[i].height;
+        if (growth < best_growth)
+        {
+            best = i;
+            best_growth = growth;
+        }
+    }
+    if (best_growth > 0 && d->count < MAX_DAMAGE_RECTS)
+    {
+        i = d->count++;
+        d->rect[i].x = x;
+        d->rect[i].y = y;
+        d->rect[i].width = width;
+        d->rect[i].height = height;
+    }
+    else
+    {
+        int x2 = MAX(x + width, d->rect[best].x + d->rect[best].width);
+        int y2 = MAX(y + height, d->rect[best].y + d->rect[best].height);
+        d->rect[best].x = MIN(x, d->rect[best].x);
+        d->rect[best].y = MIN(y, d->rect[best].y);
+        d->rect[best].width = x2 - d->rect[best].x;
+        d->rect[best].height = y2 - d->rect[best].y;
+    }
+}
+
+void skin_damage_rect(struct screen *display, struct viewport *vp,
+                      int x, int y, int width, int height)
+{
+    damage_rect(display, vp, x, y, width, height, NULL);
+}
+
+/* clear an image's area, the text lines under it are gone too */
+static void clear_image(struct gui_wps *gwps, struct viewport *vp,
+                        struct gui_img *img)
+{
+    clear_image_pos(gwps, img);
+    if (tracking_data)
+        invalidate_lines(vp->x + img->x, vp->y + img->y,
+                         img->bm.width, img->subimage_height, NULL);
+}
+
+static void skin_damage_all(struct screen *display)
+{
+    damage[display->screen_type].count = -1;
+}
+
+/* push the changed areas (or everything) to the LCD */
+static void skin_update_damage(struct screen *display, bool full)
+{
+    struct skin_damage *d = &damage[display->screen_type];
+    struct skin_update_stats *stats = &update_stats[display->screen_type];
+    unsigned long pixels = 0;
+    int i;
+
+    if (full || d->count < 0)
+    {
+        display->update();
+        pixels = display->lcdwidth * display->lcdheight;
+        stats->full_updates++;
+    }
+    else
+    {
+        for (i = 0; i < d->count; i++)
+        {
+            display->update_rect(d->rect[i].x, d->rect[i].y,
+                                 d->rect[i].width, d->rect[i].height);
+            pixels += d->rect[i].width * d->rect[i].height;
+        }
+    }
+    if (pixels)
+    {
+        stats->pixels += pixels;
+        stats->updates++;
+    }
+    d->count = 0;
+}
+
+/* Returns false if the current line would be drawn exactly like it is on the
+ * screen, and remembers it for the next time. */
+static bool line_changed(struct skin_draw_info *info)
+{
+    struct skin_viewport *skin_vp = info->skin_vp;
+    struct viewport *vp = &skin_vp->vp;
+    struct line_desc *desc = &info->line_desc;
+    struct align_pos *align = &info->align;
+    int looks[] = {
+        vp->x, vp->y, vp->width, vp->font, info->line_number,
+        vp->fg_pattern, vp->bg_pattern, info->line_scrolls,
+        desc->style, desc->text_color, desc->line_color,
+        desc->line_end_color, desc->nlines, desc->line,
+    };
+    int line = info->line_number;
+    uint16_t bit;
+    uint32_t crc;
+
+    if (line >= SKIN_VP_TRACKED_LINES)
+        return true;
+    bit = 1 << line;
+    crc = crc_32(looks, sizeof(looks), 0xffffffff);
+    /* the separators matter, "ab" left is not "a" left and "b" centered */
+    crc = crc_32(align->left ?: "", strlen(align->left ?: "") + 1, crc);
+    crc = crc_32(align->center ?: "", strlen(align->center ?: "") + 1, crc);
+    crc = crc_32(align->right ?: "", strlen(align->right ?: "") + 1, crc);
+
+    if ((skin_vp->lines_known & bit) && skin_vp->line_crcs[line] == crc)
+        return false;
+    skin_vp->line_crcs[line] = crc;
+    skin_vp->lines_known |= bit;
+    return true;
+}
+#endif
+
 
 static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
                              struct skin_element *element, struct skin_viewport* skin_vp)
@@ -223,6 +438,8 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
                     vp->fg_pattern = backup;
 #endif
                 }
+                skin_damage_rect(gwps->display, vp, rect->x, rect->y,
+                                 rect->width, rect->height);
             }
             break;
         case SKIN_TOKEN_PEAKMETER_LEFTBAR:
@@ -283,7 +500,7 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
                     a += id->offset;
 
                     /* Clear the image, as in conditionals */
-                    clear_image_pos(gwps, img);
+                    clear_image(gwps, vp, img);
 
                     /* If the token returned a value which is higher than
                      * the amount of subimages, don't draw it. */
@@ -319,6 +536,7 @@ static bool do_non_text_tags(struct gui_wps *gwps, struct skin_draw_info *info,
             gui_statusbar_draw(&(statusbars.statusbars[gwps->display->screen_type]),
                                info->refresh_type == SKIN_REFRESH_ALL,
                                SKINOFFSETTOPTR(skin_buffer, token->value.data));
+            skin_damage_rect(gwps->display, vp, 0, 0, vp->width, vp->height);
             break;
         case SKIN_TOKEN_VIEWPORT_CUSTOMLIST:
             if (do_refresh)
@@ -409,7 +627,7 @@ static void do_tags_in_hidden_conditional(struct skin_element* branch,
                 struct image_display *id = SKINOFFSETTOPTR(skin_buffer, token->value.data);
                 struct gui_img *img = skin_find_item(SKINOFFSETTOPTR(skin_buffer, id->label), 
                                                      SKIN_FIND_IMAGE, data);
-                clear_image_pos(gwps, img);
+                clear_image(gwps, &info->skin_vp->vp, img);
             }
             else if (token->type == SKIN_TOKEN_PEAKMETER)
             {
@@ -451,6 +669,8 @@ static void do_tags_in_hidden_conditional(struct skin_element* branch,
                             gwps->display->set_viewport(&skin_viewport->vp);
                             gwps->display->clear_viewport();
                             gwps->display->set_viewport(&info->skin_vp->vp);
+                            skin_damage_rect(gwps->display, &skin_viewport->vp, 0, 0,
+                                    skin_viewport->vp.width, skin_viewport->vp.height);
                             skin_viewport->hidden_flags |= VP_DRAW_HIDDEN;
 
 #if (LCD_DEPTH > 1) || (defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1))
@@ -468,8 +688,11 @@ static void do_tags_in_hidden_conditional(struct skin_element* branch,
 #ifdef HAVE_ALBUMART
             else if (data->albumart && token->type == SKIN_TOKEN_ALBUMART_DISPLAY)
             {
+                struct skin_albumart *aa = SKINOFFSETTOPTR(skin_buffer, data->albumart);
                 draw_album_art(gwps,
                         playback_current_aa_hid(data->playback_aa_slot), true);
+                skin_damage_rect(gwps->display, SKINOFFSETTOPTR(skin_buffer, aa->vp),
+                                 aa->x, aa->y, aa->width, aa->height);
             }
 #endif
             child = SKINOFFSETTOPTR(skin_buffer, child->next);
@@ -802,7 +1025,14 @@ void skin_render_viewport(struct skin_element* viewport, struct gui_wps *gwps,
         }
 #endif
         /* only update if the line needs to be, and there is something to write */
-        if (refresh_type && (needs_update || update_all))
+        if (refresh_type && (needs_update || update_all)
+#ifdef HAVE_LCD_BITMAP
+            /* but not if it would come out exactly as it is on the screen */
+            && (!tracking_data || line_changed(&info) ||
+                (refresh_type&SKIN_REFRESH_ALL) == SKIN_REFRESH_ALL ||
+                info.force_redraw || update_all)
+#endif
+           )
         {
             if (info.force_redraw)
                 display->scroll_stop_viewport_rect(&skin_viewport->vp,
@@ -810,6 +1040,12 @@ void skin_render_viewport(struct skin_element* viewport, struct gui_wps *gwps,
                     skin_viewport->vp.width, display->getcharheight());
             write_line(display, align, info.line_number,
                     info.line_scrolls, &info.line_desc);
+#ifdef HAVE_LCD_BITMAP
+            damage_rect(display, &skin_viewport->vp,
+                    0, info.line_number*display->getcharheight(),
+                    skin_viewport->vp.width, display->getcharheight(),
+                    skin_viewport);
+#endif
         }
         if (!info.no_line_break)
             info.line_number++;
@@ -841,6 +1077,10 @@ void skin_render(struct gui_wps *gwps, unsigned refresh_mode)
     }
 #endif
 
+#ifdef HAVE_LCD_BITMAP
+    tracking_data = data;
+#endif
+
     viewport = SKINOFFSETTOPTR(skin_buffer, data->tree);
     skin_viewport = SKINOFFSETTOPTR(skin_buffer, viewport->data);
     label = SKINOFFSETTOPTR(skin_buffer, skin_viewport->label);
@@ -892,7 +1132,16 @@ void skin_render(struct gui_wps *gwps, unsigned refresh_mode)
         if ((vp_refresh_mode&SKIN_REFRESH_ALL) == SKIN_REFRESH_ALL)
         {
             display->clear_viewport();
+#ifdef HAVE_LCD_BITMAP
+            skin_damage_rect(display, &skin_viewport->vp, 0, 0,
+                             skin_viewport->vp.width, skin_viewport->vp.height);
+#endif
         }
+#if (LCD_DEPTH > 1) || (defined(HAVE_REMOTE_LCD) && LCD_REMOTE_DEPTH > 1)
+        /* what is drawn to the backdrop shows through anywhere */
+        if (skin_viewport->output_to_backdrop_buffer && vp_refresh_mode)
+            skin_damage_all(display);
+#endif
         /* render */
         if (viewport->children_count)
             skin_render_viewport(get_child(viewport->children, 0), gwps,
@@ -912,7 +1161,13 @@ void skin_render(struct gui_wps *gwps, unsigned refresh_mode)
     }
     /* Restore the default viewport */
     display->set_viewport(NULL);
+#ifdef HAVE_LCD_BITMAP
+    tracking_data = NULL;
+    skin_update_damage(display,
+                (old_refresh_mode&SKIN_REFRESH_ALL) == SKIN_REFRESH_ALL);
+#else
     display->update();
+#endif
 }
 
 #ifdef HAVE_LCD_BITMAP
@@ -995,6 +1250,9 @@ void skin_render_playlistviewer(struct playlistviewer* viewer,
                     vp->width, display->getcharheight());
             write_line(display, align, info.line_number,
                     info.line_scrolls, &info.line_desc);
+            skin_damage_rect(display, vp,
+                    0, info.line_number*display->getcharheight(),
+                    vp->width, display->getcharheight());
         }
         info.line_number++;
         info.offset++;
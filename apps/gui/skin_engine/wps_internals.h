@@ -40,6 +40,16 @@ struct skin_stats {
 int skin_get_num_skins(void);
 struct skin_stats *skin_get_stats(int number, int screen);
 #define skin_clear_stats(stats) memset(stats, 0, sizeof(struct skin_stats))
+
+/* LCD updates done by skin_render(), per screen */
+struct skin_update_stats {
+    unsigned long pixels;       /* pushed to the LCD */
+    unsigned long updates;      /* renders which pushed anything */
+    unsigned long full_updates; /* ... of those, whole screen updates */
+    long reset_tick;            /* when the counting started */
+};
+struct skin_update_stats *skin_get_update_stats(int screen);
+void skin_reset_update_stats(void);
 bool skin_backdrop_get_debug(int index, char **path, int *ref_count, size_t *size);
 
 /* Timeout unit expressed in HZ. In WPS, all timeouts are given in seconds
@@ -92,6 +102,9 @@ struct gui_img {
     OFFSETTYPE(char*) label;
     bool loaded;            /* load state */
     int display;
+    /* what was shown by the last render, to find the areas that changed */
+    int last_display;
+    OFFSETTYPE(struct viewport*) last_vp;
     bool using_preloaded_icons; /* using the icon system instead of a bmp */
     bool is_9_segment;
 };
@@ -181,12 +194,19 @@ struct gradient_config {
 #define VP_DEFAULT_LABEL    NULL
 #endif
 #define VP_DEFAULT_LABEL_STRING "|"
+#define SKIN_VP_TRACKED_LINES 16
 struct skin_viewport {
     struct viewport vp;   /* The LCD viewport struct */
     char hidden_flags;
     bool is_infovp;
     OFFSETTYPE(char*) label;
     int   parsed_fontid;
+#ifdef HAVE_LCD_BITMAP
+    /* hashes of the first text lines as last drawn, bit n of lines_known
+     * is cleared whenever something else may have drawn over line n */
+    uint32_t line_crcs[SKIN_VP_TRACKED_LINES];
+    uint16_t lines_known;
+#endif
 #if (LCD_DEPTH > 1) || (defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1))
     bool output_to_backdrop_buffer;
     bool fgbg_changed;
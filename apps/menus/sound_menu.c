@@ -170,6 +170,10 @@ static int timestretch_callback(int action,const struct menu_item_ex *this_item)
 
     MENUITEM_SETTING(dithering_enabled,
                      &global_settings.dithering_enabled, lowlatency_callback);
+#ifdef HAVE_SINC_RESAMPLER
+    MENUITEM_SETTING(resample_quality,
+                     &global_settings.resample_quality, lowlatency_callback);
+#endif
     MENUITEM_SETTING(afr_enabled,
                      &global_settings.afr_enabled, lowlatency_callback);
     MENUITEM_SETTING(pbe,
@@ -265,6 +269,9 @@ MAKE_MENU(sound_settings, ID2P(LANG_SOUND_SETTINGS), NULL, Icon_Audio,
 #endif
 #if CONFIG_CODEC == SWCODEC
           ,&crossfeed_menu, &equalizer_menu, &dithering_enabled
+#ifdef HAVE_SINC_RESAMPLER
+          ,&resample_quality
+#endif
           ,&surround_menu, &pbe_menu, &afr_enabled
 #ifdef HAVE_PITCHCONTROL
           ,&timestretch_enabled
@@ -1141,6 +1141,20 @@ int open_utf8(const char* pathname, int flags)
     return ret >= 0 ? fd : -1;
 }
 
+/** Get the modification time of a file, 0 if it isn't found. */
+time_t file_mtime(const char *path)
+{
+    time_t mtime;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return 0;
+
+    mtime = filemtime(fd);
+    close(fd);
+    return mtime > 0 ? mtime : 0;
+}
+
 
 #ifdef HAVE_LCD_COLOR
 /*
@@ -68,6 +68,11 @@
  * for their correct seek target, 32k seems a good size */
 #define AUDIO_REBUFFER_GUESS_SIZE    (1024*32)
 
+/* Amount of audio the buffering should have in shortly after the codec
+ * starts on a track, ahead of any read-ahead of later tracks */
+#define AUDIO_DEADLINE_SECONDS       2
+#define AUDIO_DEADLINE_TICKS         (HZ/2)
+
 /* Define LOGF_ENABLE to enable logf output in this file */
 /* #define LOGF_ENABLE */
 #include "logf.h"
@@ -995,6 +1000,21 @@ static void audio_update_filebuf_watermark(int seconds)
 }
 
 
+/* Give the buffering a deadline for the start of the track about to be
+   decoded */
+static void audio_set_track_deadline(const struct track_info *info,
+                                     const struct mp3entry *id3)
+{
+    size_t bytes = info->filesize;
+
+    if (!rbcodec_format_is_atomic(id3->codectype))
+        bytes = MIN(bytes, id3->bitrate * (1000/8) * AUDIO_DEADLINE_SECONDS);
+
+    buf_set_deadline(info->audio_hid, bytes,
+                     current_tick + AUDIO_DEADLINE_TICKS);
+}
+
+
 /** -- Track change notification -- **/
 
 /* Check the pcmbuf track changes and return write the message into the event
@@ -1524,6 +1544,7 @@ static bool audio_start_codec(bool auto_skip)
     ci.audio_hid = info->audio_hid;
     ci.filesize = info->filesize;
     buf_set_base_handle(info->audio_hid);
+    audio_set_track_deadline(info, cur_id3);
 
     /* All required data is now available for the codec */
     codec_go();
@@ -2000,6 +2021,11 @@ static int audio_finish_load_track(struct track_info *info)
             /* This is the current track to decode - should be started now */
             trackstat = LOAD_TRACK_READY;
         }
+        else
+        {
+            /* Read-ahead, the other handles go first */
+            buf_set_priority(hid, BUF_PRIO_LOW);
+        }
     }
     else
     {
@@ -2541,6 +2567,11 @@ static void audio_start_playback(const struct audio_resume_info *resume_info,
         logf("%s(%lu, %lu): starting", __func__, resume.elapsed,
              resume.offset);
 
+#ifdef HAVE_ALBUMART
+        /* Album art may have been added since the last searches */
+        albumart_clear_search_cache();
+#endif
+
         /* Set audio parameters */
 #if INPUT_SRC_CAPS != 0
         audio_set_input_source(AUDIO_SRC_PLAYBACK, SRCF_PLAYBACK);
@@ -2922,6 +2953,7 @@ static void audio_on_ff_rewind(long time)
             ci.audio_hid = cur_info->audio_hid;
             ci.filesize = cur_info->filesize;
             buf_set_base_handle(cur_info->audio_hid);
+            audio_set_track_deadline(cur_info, ci_id3);
         }
 
         if (!haltres)
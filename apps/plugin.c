@@ -404,6 +404,7 @@ static const struct plugin_api rockbox_api = {
     reload_directory,
     create_numbered_filename,
     FS_PREFIX(file_exists),
+    file_mtime,
     strip_extension,
     crc_32,
     filetype_get_attr,
@@ -160,12 +160,12 @@ void* plugin_get_buffer(size_t *buffer_size);
 #define PLUGIN_MAGIC 0x526F634B /* RocK */
 
 /* increase this every time the api struct changes */
-#define PLUGIN_API_VERSION 233
+#define PLUGIN_API_VERSION 235
 
 /* update this to latest version if a change to the api struct breaks
    backwards compatibility (and please take the opportunity to sort in any
    new function which are "waiting" at the end of the function table) */
-#define PLUGIN_MIN_API_VERSION 233
+#define PLUGIN_MIN_API_VERSION 235
 
 /* plugin return codes */
 /* internal returns start at 0x100 to make exit(1..255) work */
@@ -458,6 +458,7 @@ struct plugin_api {
                                       const char *prefix, const char *suffix,
                                       int numberlen IF_CNFN_NUM_(, int *num));
     bool (*file_exists)(const char *path);
+    time_t (*file_mtime)(const char *path);
     char* (*strip_extension)(char* buffer, int buffer_size, const char *filename);
     uint32_t (*crc_32)(const void *src, uint32_t len, uint32_t crc32);
 
@@ -0,0 +1,263 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#include "plugin.h"
+#include "fake_codec_api.h"
+
+static struct codec_api *ci;
+static struct fake_ci_file *file;
+static void *codec_mallocbuf;
+static void (*configure_callback)(int setting, intptr_t value);
+static volatile enum codec_command_action codec_action;
+
+/* Returns buffer to malloc array. Only codeclib should need this. */
+static void* codec_get_buffer(size_t *size)
+{
+    *size = CODEC_SIZE;
+    return codec_mallocbuf;
+}
+
+/*
+ *  Helper function used when the file is larger then the available memory.
+ *  Rebuffers the file by setting the start of the audio buffer to be
+ *  new_offset and filling from there.
+ */
+static int fill_buffer(size_t new_offset)
+{
+    size_t n, bytestoread;
+    long temp = *rb->current_tick;
+
+    if (file->fd < 0)
+        return -1;
+
+    rb->lseek(file->fd, new_offset, SEEK_SET);
+
+    if (new_offset + file->bufsize <= file->filesize)
+        bytestoread = file->bufsize;
+    else
+        bytestoread = file->filesize - new_offset;
+
+    n = rb->read(file->fd, file->buf, bytestoread);
+
+    if (n != bytestoread)
+    {
+        DEBUGF("read fail:  got %d bytes, expected %d\n", (int)n,
+               (int)bytestoread);
+        file->read_failed = true;
+        return -1;
+    }
+    file->offset = new_offset;
+
+    /*keep track of how much time we spent buffering*/
+    file->rebuffer_ticks += *rb->current_tick - temp;
+
+    return 0;
+}
+
+/* Set song position in WPS (value in ms). */
+static void set_elapsed(unsigned long value)
+{
+    ci->id3->elapsed = value;
+}
+
+/* Read next <size> amount bytes from file buffer to <ptr>.
+   Will return number of bytes read or 0 if end of file. */
+static size_t read_filebuf(void *ptr, size_t size)
+{
+    size_t realsize;
+
+    if (ci->curpos >= (off_t)file->filesize)
+        return 0;
+
+    realsize = MIN(file->filesize - ci->curpos, size);
+
+    /* check if we have enough bytes ready*/
+    if (realsize > file->bufsize - (ci->curpos - file->offset))
+    {
+        /*rebuffer so that we start at ci->curpos*/
+        if (fill_buffer(ci->curpos) < 0)
+            return 0;
+    }
+
+    rb->memcpy(ptr, file->buf + (ci->curpos - file->offset), realsize);
+    ci->curpos += realsize;
+    return realsize;
+}
+
+/* Request pointer to file buffer which can be used to read
+   <realsize> amount of data. <reqsize> tells the buffer system
+   how much data it should try to allocate. If <realsize> is 0,
+   end of file is reached. */
+static void* request_buffer(size_t *realsize, size_t reqsize)
+{
+    *realsize = ci->curpos < (off_t)file->filesize ?
+                    MIN(file->filesize - ci->curpos, reqsize) : 0;
+
+    /*check if we have enough bytes ready - requested > bufsize-currentbufpos*/
+    if (*realsize > file->bufsize - (ci->curpos - file->offset))
+    {
+        /*rebuffer so that we start at ci->curpos*/
+        if (fill_buffer(ci->curpos) < 0)
+            *realsize = 0;
+    }
+
+    return file->buf + (ci->curpos - file->offset);
+}
+
+/* Advance file buffer position by <amount> amount of bytes. */
+static void advance_buffer(size_t amount)
+{
+    ci->curpos += amount;
+    ci->id3->offset = ci->curpos;
+}
+
+/* Seek file buffer to position <newpos> beginning of file. */
+static bool seek_buffer(size_t newpos)
+{
+    ci->curpos = newpos;
+    return true;
+}
+
+/* Codec should call this function when it has done the seeking. */
+static void seek_complete(void)
+{
+    /* Do nothing */
+}
+
+/* Codec calls this to know what it should do next. */
+static enum codec_command_action get_command(intptr_t *param)
+{
+    rb->yield();
+    return codec_action;
+    (void)param;
+}
+
+/* Some codecs call this to determine whether they should loop. */
+static bool loop_track(void)
+{
+    return false;
+}
+
+static void set_offset(size_t value)
+{
+    ci->id3->offset = value;
+}
+
+/* Configure different codec buffer parameters. */
+static void configure(int setting, intptr_t value)
+{
+    if (configure_callback)
+        configure_callback(setting, value);
+}
+
+void fake_ci_set_action(enum codec_command_action action)
+{
+    codec_action = action;
+}
+
+void fake_ci_init(struct codec_api *api, struct fake_ci_file *f,
+                  void *mallocbuf,
+                  void (*pcmbuf_insert)(const void *ch1, const void *ch2,
+                                        int count),
+                  void (*configure_cb)(int setting, intptr_t value))
+{
+    ci = api;
+    file = f;
+    codec_mallocbuf = mallocbuf;
+    configure_callback = configure_cb;
+    codec_action = CODEC_ACTION_NULL;
+
+    file->offset = 0;
+    file->rebuffer_ticks = 0;
+    file->read_failed = false;
+
+    /* --- Our "fake" implementations of the codec API functions. --- */
+
+    ci->dsp = rb->dsp_get_config(CODEC_IDX_AUDIO);
+    ci->codec_get_buffer = codec_get_buffer;
+    ci->pcmbuf_insert = pcmbuf_insert;
+    ci->set_elapsed = set_elapsed;
+    ci->read_filebuf = read_filebuf;
+    ci->request_buffer = request_buffer;
+    ci->advance_buffer = advance_buffer;
+    ci->seek_buffer = seek_buffer;
+    ci->seek_complete = seek_complete;
+    ci->set_offset = set_offset;
+    ci->configure = configure;
+    ci->get_command = get_command;
+    ci->loop_track = loop_track;
+
+    /* Nothing is kept between runs and the codec gets no helper thread, so
+       every run decodes the same way */
+    ci->seek_index_load = NULL;
+    ci->seek_index_save = NULL;
+    ci->job_start = NULL;
+    ci->job_wait = NULL;
+
+    ci->filesize = file->filesize;
+    ci->curpos = 0;
+
+    /* --- "Core" functions --- */
+
+    /* kernel/ system */
+    ci->sleep = rb->sleep;
+    ci->yield = rb->yield;
+
+    /* strings and memory */
+    ci->strcpy = rb->strcpy;
+    ci->strlen = rb->strlen;
+    ci->strcmp = rb->strcmp;
+    ci->strcat = rb->strcat;
+    ci->memset = rb->memset;
+    ci->memcpy = rb->memcpy;
+    ci->memmove = rb->memmove;
+    ci->memcmp = rb->memcmp;
+    ci->memchr = rb->memchr;
+#if defined(DEBUG) || defined(SIMULATOR)
+    ci->debugf = rb->debugf;
+#endif
+#ifdef ROCKBOX_HAS_LOGF
+    ci->logf = rb->logf;
+#endif
+
+    ci->qsort = rb->qsort;
+
+#ifdef RB_PROFILE
+    ci->profile_thread = rb->profile_thread;
+    ci->profstop = rb->profstop;
+    ci->profile_func_enter = rb->profile_func_enter;
+    ci->profile_func_exit = rb->profile_func_exit;
+#endif
+
+    ci->commit_dcache = rb->commit_dcache;
+    ci->commit_discard_dcache = rb->commit_discard_dcache;
+    ci->commit_discard_idcache = rb->commit_discard_idcache;
+
+#if NUM_CORES > 1
+    ci->create_thread = rb->create_thread;
+    ci->thread_thaw = rb->thread_thaw;
+    ci->thread_wait = rb->thread_wait;
+    ci->semaphore_init = rb->semaphore_init;
+    ci->semaphore_wait = rb->semaphore_wait;
+    ci->semaphore_release = rb->semaphore_release;
+#endif
+
+#if defined(CPU_ARM) && (CONFIG_PLATFORM & PLATFORM_NATIVE)
+    ci->__div0 = rb->__div0;
+#endif
+}
@@ -0,0 +1,49 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef _LIB_FAKE_CODEC_API_H_
+#define _LIB_FAKE_CODEC_API_H_
+
+#include "plugin.h"
+
+/* A codec API for plugins that run codecs outside of playback, feeding
+ * them one file from a plugin buffer. The plugin loads the start of the
+ * file and its metadata, the rest is read in as the codec gets there. */
+
+struct fake_ci_file {
+    int fd;                 /* to rebuffer from, unused if all of it fits */
+    size_t filesize;
+    unsigned char *buf;
+    size_t bufsize;         /* bytes of the file buf can hold */
+    size_t offset;          /* file position of buf[0] */
+    long rebuffer_ticks;    /* time spent reading after the start */
+    bool read_failed;
+};
+
+/* Set up ci to decode file into pcmbuf_insert. configure may be NULL. The
+ * plugin still sets ci->id3 before loading the codec. */
+void fake_ci_init(struct codec_api *ci, struct fake_ci_file *file,
+                  void *mallocbuf,
+                  void (*pcmbuf_insert)(const void *ch1, const void *ch2,
+                                        int count),
+                  void (*configure)(int setting, intptr_t value));
+
+/* What get_command returns to the codec from now on */
+void fake_ci_set_action(enum codec_command_action action);
+
+#endif /* _LIB_FAKE_CODEC_API_H_ */
@@ -74,6 +74,9 @@ const char * mpeg_get_reason_str(int reason)
     case MPEG_ALLOC_DISKBUF:
         str = "MPEG_ALLOC_DISKBUF";
         break;
+    case MPEG_ALLOC_SEEK_INDEX:
+        str = "MPEG_ALLOC_SEEK_INDEX";
+        break;
     case MPEG_ALLOC_CODEC_MALLOC:
         str = "MPEG_ALLOC_CODEC_MALLOC";
         break;
@@ -35,6 +35,8 @@
 
 #if defined(CPU_COLDFIRE) || defined (CPU_ARM)
 #define IDCT_ASM
+#elif defined(__SSE2__)
+#define IDCT_ASM /* idct_sse2.c */
 #endif
 
 #ifndef IDCT_ASM
@@ -0,0 +1,231 @@
+/*
+ * idct_sse2.c
+ * SSE2 version of idct.c for x86-64 hosts
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ */
+
+/*
+ * The same arithmetic as the C version, so the output is bit exact. The
+ * block is transposed so that each 1-D pass works on all eight rows (or
+ * columns) at once, four lanes of 32 bits per half. pmaddwd does the
+ * butterflies exactly; the multiply by 181 is done with shifts since SSE2
+ * has no 32 bit multiply.
+ */
+
+#include <inttypes.h>
+#include <emmintrin.h>
+#include "mpeg2.h"
+#include "attributes.h"
+#include "mpeg2_internal.h"
+
+#define W1 2841 /* 2048 * sqrt (2) * cos (1 * pi / 16) */
+#define W2 2676 /* 2048 * sqrt (2) * cos (2 * pi / 16) */
+#define W3 2408 /* 2048 * sqrt (2) * cos (3 * pi / 16) */
+#define W5 1609 /* 2048 * sqrt (2) * cos (5 * pi / 16) */
+#define W6 1108 /* 2048 * sqrt (2) * cos (6 * pi / 16) */
+#define W7 565  /* 2048 * sqrt (2) * cos (7 * pi / 16) */
+
+/* Pairs of coefficients for pmaddwd, first one applied to the even word */
+#define WPAIR(a, b) _mm_set1_epi32(((uint32_t)(uint16_t)(b) << 16) | \
+                                   (uint16_t)(a))
+
+static inline void transpose (__m128i * const r)
+{
+    __m128i a0 = _mm_unpacklo_epi16 (r[0], r[1]);
+    __m128i a1 = _mm_unpackhi_epi16 (r[0], r[1]);
+    __m128i a2 = _mm_unpacklo_epi16 (r[2], r[3]);
+    __m128i a3 = _mm_unpackhi_epi16 (r[2], r[3]);
+    __m128i a4 = _mm_unpacklo_epi16 (r[4], r[5]);
+    __m128i a5 = _mm_unpackhi_epi16 (r[4], r[5]);
+    __m128i a6 = _mm_unpacklo_epi16 (r[6], r[7]);
+    __m128i a7 = _mm_unpackhi_epi16 (r[6], r[7]);
+    __m128i b0 = _mm_unpacklo_epi32 (a0, a2);
+    __m128i b1 = _mm_unpackhi_epi32 (a0, a2);
+    __m128i b2 = _mm_unpacklo_epi32 (a1, a3);
+    __m128i b3 = _mm_unpackhi_epi32 (a1, a3);
+    __m128i b4 = _mm_unpacklo_epi32 (a4, a6);
+    __m128i b5 = _mm_unpackhi_epi32 (a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32 (a5, a7);
+    __m128i b7 = _mm_unpackhi_epi32 (a5, a7);
+
+    r[0] = _mm_unpacklo_epi64 (b0, b4);
+    r[1] = _mm_unpackhi_epi64 (b0, b4);
+    r[2] = _mm_unpacklo_epi64 (b1, b5);
+    r[3] = _mm_unpackhi_epi64 (b1, b5);
+    r[4] = _mm_unpacklo_epi64 (b2, b6);
+    r[5] = _mm_unpackhi_epi64 (b2, b6);
+    r[6] = _mm_unpacklo_epi64 (b3, b7);
+    r[7] = _mm_unpackhi_epi64 (b3, b7);
+}
+
+static inline __m128i mul181 (__m128i x)
+{
+    /* 181 = 128 + 32 + 16 + 4 + 1 */
+    __m128i y = _mm_add_epi32 (x, _mm_slli_epi32 (x, 2));
+    y = _mm_add_epi32 (y, _mm_slli_epi32 (x, 4));
+    y = _mm_add_epi32 (y, _mm_slli_epi32 (x, 5));
+    return _mm_add_epi32 (y, _mm_slli_epi32 (x, 7));
+}
+
+/* Store to int16_t like the C version does: keep the low 16 bits */
+static inline __m128i narrow (__m128i lo, __m128i hi)
+{
+    lo = _mm_srai_epi32 (_mm_slli_epi32 (lo, 16), 16);
+    hi = _mm_srai_epi32 (_mm_slli_epi32 (hi, 16), 16);
+    return _mm_packs_epi32 (lo, hi);
+}
+
+/* One half of a 1-D pass, on four lanes. The UNPACK macro selects them. */
+#define IDCT_HALF(UNPACK, v, o, bias, shift)                                \
+    do {                                                                    \
+        const __m128i zero = _mm_setzero_si128 ();                          \
+        __m128i d0, d2, t0, t1, t2, t3, a0, a1, a2, a3, b0, b1, b2, b3;     \
+        __m128i p;                                                          \
+                                                                            \
+        /* word in the upper half = value << 16, >> 5 gives value << 11 */  \
+        d0 = _mm_srai_epi32 (UNPACK (zero, v[0]), 5);                       \
+        d0 = _mm_add_epi32 (d0, bias);                                      \
+        d2 = _mm_srai_epi32 (UNPACK (zero, v[2]), 5);                       \
+        t0 = _mm_add_epi32 (d0, d2);                                        \
+        t1 = _mm_sub_epi32 (d0, d2);                                        \
+        p = UNPACK (v[3], v[1]);                                            \
+        t2 = _mm_madd_epi16 (p, WPAIR (W6, W2));                            \
+        t3 = _mm_madd_epi16 (p, WPAIR (-W2, W6));                           \
+        a0 = _mm_add_epi32 (t0, t2);                                        \
+        a1 = _mm_add_epi32 (t1, t3);                                        \
+        a2 = _mm_sub_epi32 (t1, t3);                                        \
+        a3 = _mm_sub_epi32 (t0, t2);                                        \
+                                                                            \
+        p = UNPACK (v[7], v[4]);                                            \
+        t0 = _mm_madd_epi16 (p, WPAIR (W7, W1));                            \
+        t1 = _mm_madd_epi16 (p, WPAIR (-W1, W7));                           \
+        p = UNPACK (v[5], v[6]);                                            \
+        t2 = _mm_madd_epi16 (p, WPAIR (W3, W5));                            \
+        t3 = _mm_madd_epi16 (p, WPAIR (-W5, W3));                           \
+        b0 = _mm_add_epi32 (t0, t2);                                        \
+        b3 = _mm_add_epi32 (t1, t3);                                        \
+        t0 = _mm_sub_epi32 (t0, t2);                                        \
+        t1 = _mm_sub_epi32 (t1, t3);                                        \
+        b1 = mul181 (_mm_srai_epi32 (_mm_add_epi32 (t0, t1), 8));           \
+        b2 = mul181 (_mm_srai_epi32 (_mm_sub_epi32 (t0, t1), 8));           \
+                                                                            \
+        o[0] = _mm_srai_epi32 (_mm_add_epi32 (a0, b0), shift);              \
+        o[1] = _mm_srai_epi32 (_mm_add_epi32 (a1, b1), shift);              \
+        o[2] = _mm_srai_epi32 (_mm_add_epi32 (a2, b2), shift);              \
+        o[3] = _mm_srai_epi32 (_mm_add_epi32 (a3, b3), shift);              \
+        o[4] = _mm_srai_epi32 (_mm_sub_epi32 (a3, b3), shift);              \
+        o[5] = _mm_srai_epi32 (_mm_sub_epi32 (a2, b2), shift);              \
+        o[6] = _mm_srai_epi32 (_mm_sub_epi32 (a1, b1), shift);              \
+        o[7] = _mm_srai_epi32 (_mm_sub_epi32 (a0, b0), shift);              \
+    } while (0)
+
+/* 1-D idct of eight lanes, v[i] holding input i of each lane */
+#define IDCT_PASS(v, bias, shift)                                           \
+    do {                                                                    \
+        __m128i lo[8], hi[8];                                               \
+        int i;                                                              \
+        IDCT_HALF (_mm_unpacklo_epi16, v, lo, bias, shift);                 \
+        IDCT_HALF (_mm_unpackhi_epi16, v, hi, bias, shift);                 \
+        for (i = 0; i < 8; i++)                                             \
+            v[i] = narrow (lo[i], hi[i]);                                   \
+    } while (0)
+
+/* Full 2-D idct, leaves the rows of the result in r */
+static inline void idct (int16_t * const block, __m128i * const r)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i shortcut, dc;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        r[i] = _mm_load_si128 ((const __m128i *)(block + 8 * i));
+
+    transpose (r);
+
+    /* Rows with only a DC coefficient are shortcut in the C version with
+     * a result that differs in rounding - do the same */
+    shortcut = _mm_or_si128 (_mm_or_si128 (r[1], r[2]),
+                             _mm_or_si128 (r[3], r[4]));
+    shortcut = _mm_or_si128 (shortcut, _mm_or_si128 (r[5], r[6]));
+    shortcut = _mm_cmpeq_epi16 (_mm_or_si128 (shortcut, r[7]), zero);
+    dc = _mm_and_si128 (shortcut, _mm_srai_epi16 (r[0], 1));
+
+    IDCT_PASS (r, _mm_set1_epi32 (2048), 12);
+
+    for (i = 0; i < 8; i++)
+        r[i] = _mm_or_si128 (dc, _mm_andnot_si128 (shortcut, r[i]));
+
+    transpose (r);
+
+    IDCT_PASS (r, _mm_set1_epi32 (65536), 17);
+
+    for (i = 0; i < 8; i++)
+        _mm_store_si128 ((__m128i *)(block + 8 * i), zero);
+}
+
+void mpeg2_idct_copy (int16_t * block, uint8_t * dest,
+                      const int stride)
+{
+    __m128i r[8];
+    int i;
+
+    idct (block, r);
+
+    for (i = 0; i < 8; i++)
+    {
+        _mm_storel_epi64 ((__m128i *)dest, _mm_packus_epi16 (r[i], r[i]));
+        dest += stride;
+    }
+}
+
+void mpeg2_idct_add (const int last, int16_t * block,
+                     uint8_t * dest, const int stride)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    __m128i r[8], d;
+    int i;
+
+    if (last != 129 || (block[0] & (7 << 4)) == (4 << 4))
+    {
+        idct (block, r);
+
+        for (i = 0; i < 8; i++)
+        {
+            d = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i *)dest), zero);
+            d = _mm_adds_epi16 (d, r[i]);
+            _mm_storel_epi64 ((__m128i *)dest, _mm_packus_epi16 (d, d));
+            dest += stride;
+        }
+    }
+    else
+    {
+        const __m128i DC = _mm_set1_epi16 ((block[0] + 64) >> 7);
+        block[0] = block[63] = 0;
+
+        for (i = 0; i < 8; i++)
+        {
+            d = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i *)dest), zero);
+            d = _mm_adds_epi16 (d, DC);
+            _mm_storel_epi64 ((__m128i *)dest, _mm_packus_epi16 (d, d));
+            dest += stride;
+        }
+    }
+}
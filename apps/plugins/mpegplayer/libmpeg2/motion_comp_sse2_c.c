@@ -0,0 +1,94 @@
+/*
+ * motion_comp_sse2_c.c
+ * SSE2 motion compensation for x86-64 hosts
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * $Id$
+ */
+#include <inttypes.h>
+#include <emmintrin.h>
+#include "mpeg2.h"
+#include "attributes.h"
+#include "mpeg2_internal.h"
+
+/* Same results as motion_comp.h: pavgb is exactly avg2. avg4 is done in 16
+ * bits since two rounds of pavgb would round twice. References are never
+ * aligned; 8 pixel wide blocks use the low half of the registers. */
+
+#define load_16(p)      _mm_loadu_si128 ((const __m128i *)(p))
+#define store_16(p, v)  _mm_storeu_si128 ((__m128i *)(p), v)
+#define load_8(p)       _mm_loadl_epi64 ((const __m128i *)(p))
+#define store_8(p, v)   _mm_storel_epi64 ((__m128i *)(p), v)
+
+#define predict_o(w)    load_##w (ref)
+#define predict_x(w)    _mm_avg_epu8 (load_##w (ref), load_##w (ref + 1))
+#define predict_y(w)    _mm_avg_epu8 (load_##w (ref), load_##w (ref + stride))
+#define predict_xy(w)   avg4 (load_##w (ref), load_##w (ref + 1), \
+                              load_##w (ref + stride),            \
+                              load_##w (ref + stride + 1))
+
+#define put(w, pred)    store_##w (dest, pred)
+#define avg(w, pred)    store_##w (dest, _mm_avg_epu8 (pred, load_##w (dest)))
+
+static inline __m128i avg4 (__m128i a, __m128i b, __m128i c, __m128i d)
+{
+    const __m128i zero = _mm_setzero_si128 ();
+    const __m128i two = _mm_set1_epi16 (2);
+    __m128i lo, hi;
+
+    lo = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero),
+                        _mm_unpacklo_epi8 (b, zero));
+    lo = _mm_add_epi16 (lo, _mm_unpacklo_epi8 (c, zero));
+    lo = _mm_add_epi16 (lo, _mm_unpacklo_epi8 (d, zero));
+    lo = _mm_srli_epi16 (_mm_add_epi16 (lo, two), 2);
+
+    hi = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero),
+                        _mm_unpackhi_epi8 (b, zero));
+    hi = _mm_add_epi16 (hi, _mm_unpackhi_epi8 (c, zero));
+    hi = _mm_add_epi16 (hi, _mm_unpackhi_epi8 (d, zero));
+    hi = _mm_srli_epi16 (_mm_add_epi16 (hi, two), 2);
+
+    return _mm_packus_epi16 (lo, hi);
+}
+
+#define MC_FUNC_W(op, xy, w)                                          \
+    void MC_##op##_##xy##_##w (uint8_t * dest, const uint8_t * ref,   \
+                               const int stride, int height)          \
+    {                                                                 \
+        do {                                                          \
+            op (w, predict_##xy (w));                                 \
+            ref += stride;                                            \
+            dest += stride;                                           \
+        } while (--height);                                           \
+    }
+
+#define MC_FUNC(op, xy) \
+    MC_FUNC_W(op, xy, 16) \
+    MC_FUNC_W(op, xy, 8)
+
+/* definitions of the actual mc functions */
+
+MC_FUNC (put, o)
+MC_FUNC (avg, o)
+MC_FUNC (put, x)
+MC_FUNC (avg, x)
+MC_FUNC (put, y)
+MC_FUNC (avg, y)
+MC_FUNC (put, xy)
+MC_FUNC (avg, xy)
@@ -207,6 +207,7 @@ typedef enum
     MPEG_ALLOC_AUDIOBUF,
     MPEG_ALLOC_PCMOUT,
     MPEG_ALLOC_DISKBUF,
+    MPEG_ALLOC_SEEK_INDEX,
     __MPEG_ALLOC_FIRST = -256,
 } mpeg2_alloc_t;
 
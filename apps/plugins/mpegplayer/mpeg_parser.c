@@ -350,6 +350,237 @@ static bool check_times(const struct stream *str)
         str->end_pts != INVALID_TIMESTAMP;
 }
 
+/* Seek index: file positions of I-frames by timestamp, recorded as the video
+ * is decoded and kept with the movie between plays together with the stream
+ * times, which then need not be probed again when it is opened. Entries are
+ * at least step apart; when the table fills up every other entry is dropped
+ * and the step doubled. The file format and location are those of the codec
+ * seek indices (codec_thread.h). */
+#define SEEK_INDEX_TAG      0x4d504731 /* 'MPG1' */
+#define SEEK_INDEX_ENTRIES  1024
+#define SEEK_INDEX_MIN_SAVE 16  /* new entries worth writing the index for */
+#define SEEK_INDEX_STEP     (TS_SECOND/4)
+#define SEEK_INDEX_DIRECT   (2*TS_SECOND) /* max. time to decode up from an
+                                             entry instead of searching */
+#define SEEK_INDEX_MARGIN   (2*TS_SECOND) /* audio and video multiplexing
+                                             skew allowed for */
+
+struct seek_index_entry
+{
+    uint32_t pts;       /* I-frame timestamp */
+    uint32_t pos;       /* Position of the PES packet carrying it */
+};
+
+/* Allocated by parser_init(), 8 KiB */
+static struct seek_index
+{
+    uint32_t video_start;   /* Stream times found at the first open */
+    uint32_t video_end;
+    uint32_t audio_start;
+    uint32_t audio_end;
+    uint32_t has_audio;     /* Audio stream was found */
+    uint32_t step;          /* Minimum time between entries */
+    uint32_t added;         /* Entries ever added */
+    uint32_t count;         /* Entries used */
+    struct seek_index_entry entry[SEEK_INDEX_ENTRIES];
+} *seek_index SHAREDBSS_ATTR;
+
+#define SEEK_INDEX_SIZE(count) \
+    (offsetof(struct seek_index, entry) + \
+     (count)*sizeof (struct seek_index_entry))
+
+static char seek_index_path[MAX_PATH];
+static uint32_t seek_index_crc;
+static uint32_t seek_index_mtime;
+static uint32_t seek_index_saved; /* Entries added when loaded or saved */
+static bool seek_index_loaded;
+
+static void seek_index_init(void)
+{
+    rb->memset(seek_index, 0, SEEK_INDEX_SIZE(0));
+    seek_index->step = SEEK_INDEX_STEP;
+    seek_index_saved = 0;
+    seek_index_loaded = false;
+}
+
+/* Load the index for the file, returning true if it had the stream times */
+static bool seek_index_load(const char *filename)
+{
+    struct seek_index_header hdr;
+    size_t len = rb->strlen(filename);
+    bool ok;
+    int fd;
+
+    rb->snprintf(seek_index_path, sizeof (seek_index_path), SEEK_INDEX_NAME,
+                 (unsigned long)rb->crc_32(filename, len, 0xffffffff));
+    seek_index_crc = rb->crc_32(filename, len, 0);
+    seek_index_mtime = rb->file_mtime(filename);
+
+    fd = rb->open(seek_index_path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    ok = rb->read(fd, &hdr, sizeof (hdr)) == sizeof (hdr) &&
+         hdr.magic == SEEK_INDEX_MAGIC && hdr.tag == SEEK_INDEX_TAG &&
+         hdr.path_crc == seek_index_crc &&
+         hdr.filesize == (uint32_t)disk_buf.filesize &&
+         hdr.mtime == seek_index_mtime &&
+         hdr.size >= SEEK_INDEX_SIZE(0) && hdr.size <= sizeof (*seek_index) &&
+         rb->read(fd, seek_index, hdr.size) == (ssize_t)hdr.size &&
+         seek_index->count <= SEEK_INDEX_ENTRIES &&
+         hdr.size == SEEK_INDEX_SIZE(seek_index->count) &&
+         seek_index->step != 0;
+
+    rb->close(fd);
+
+    if (!ok)
+    {
+        seek_index_init();
+        return false;
+    }
+
+    seek_index_saved = seek_index->added;
+    seek_index_loaded = true;
+    return true;
+}
+
+static void seek_index_save(void)
+{
+    struct seek_index_header hdr;
+    size_t size = SEEK_INDEX_SIZE(seek_index->count);
+    int fd;
+
+    /* Not worth rewriting for a few entries once the times are stored */
+    if (seek_index_loaded &&
+        seek_index->added < seek_index_saved + SEEK_INDEX_MIN_SAVE)
+        return;
+
+    hdr.magic = SEEK_INDEX_MAGIC;
+    hdr.tag = SEEK_INDEX_TAG;
+    hdr.path_crc = seek_index_crc;
+    hdr.filesize = disk_buf.filesize;
+    hdr.mtime = seek_index_mtime;
+    hdr.size = size;
+
+    fd = rb->open(seek_index_path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        rb->mkdir(SEEK_INDEX_DIR);
+        fd = rb->open(seek_index_path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+        if (fd < 0)
+            return;
+    }
+
+    if (rb->write(fd, &hdr, sizeof (hdr)) != sizeof (hdr) ||
+        rb->write(fd, seek_index, size) != (ssize_t)size)
+    {
+        DEBUGF("seek index write failed: %s\n", seek_index_path);
+        rb->close(fd);
+        rb->remove(seek_index_path);
+        return;
+    }
+
+    rb->close(fd);
+    seek_index_saved = seek_index->added;
+    seek_index_loaded = true;
+}
+
+/* Return the number of entries at or before time */
+static unsigned seek_index_search(uint32_t time)
+{
+    unsigned lo = 0, hi = seek_index->count;
+
+    while (lo < hi)
+    {
+        unsigned mid = (lo + hi) / 2;
+
+        if (seek_index->entry[mid].pts <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Called by the video thread for each tagged I-frame it parses */
+void parser_index_add(uint32_t pts, off_t pos)
+{
+    struct seek_index_entry *e = seek_index->entry;
+    unsigned i;
+
+    if (!parser_can_seek() || pts == INVALID_TIMESTAMP)
+        return;
+
+    if (seek_index->count >= SEEK_INDEX_ENTRIES)
+    {
+        for (i = 0; i < SEEK_INDEX_ENTRIES/2; i++)
+            e[i] = e[i*2];
+
+        seek_index->count = SEEK_INDEX_ENTRIES/2;
+        seek_index->step *= 2;
+    }
+
+    i = seek_index_search(pts);
+
+    /* Keep the spacing and drop anything out of order in the file */
+    if (i > 0 && (pts - e[i-1].pts < seek_index->step ||
+                  (uint32_t)pos <= e[i-1].pos))
+        return;
+
+    if (i < seek_index->count && (e[i].pts - pts < seek_index->step ||
+                                 (uint32_t)pos >= e[i].pos))
+        return;
+
+    rb->memmove(&e[i+1], &e[i], (seek_index->count - i)*sizeof (*e));
+    e[i].pts = pts;
+    e[i].pos = pos;
+    seek_index->count++;
+    seek_index->added++;
+}
+
+/* Return the position of an I-frame shortly before time or -1 if none is
+ * indexed */
+static off_t seek_index_find(uint32_t time)
+{
+    unsigned i = seek_index_search(time);
+
+    if (i == 0 || time - seek_index->entry[i-1].pts > SEEK_INDEX_DIRECT)
+        return -1;
+
+    return seek_index->entry[i-1].pos;
+}
+
+/* Narrow a search window for any stream to indexed points around time */
+static void seek_index_window(uint32_t time, ssize_t *pos_left,
+                              uint32_t *time_left, ssize_t *pos_right,
+                              uint32_t *time_right)
+{
+    unsigned i;
+
+    if (time >= *time_left + SEEK_INDEX_MARGIN)
+    {
+        i = seek_index_search(time - SEEK_INDEX_MARGIN);
+
+        if (i > 0 && seek_index->entry[i-1].pts > *time_left)
+        {
+            *pos_left = seek_index->entry[i-1].pos;
+            *time_left = seek_index->entry[i-1].pts;
+        }
+    }
+
+    if (time + SEEK_INDEX_MARGIN <= *time_right)
+    {
+        i = seek_index_search(time + SEEK_INDEX_MARGIN - 1);
+
+        if (i < seek_index->count && seek_index->entry[i].pts < *time_right)
+        {
+            *pos_right = seek_index->entry[i].pos;
+            *time_right = seek_index->entry[i].pts;
+        }
+    }
+}
+
 /* Return the best-fit file offset of a timestamp in the PES where
  * timstamp <= time < next timestamp. Will try to return something reasonably
  * valid if best-fit could not be made. */
@@ -367,6 +598,8 @@ static off_t mpeg_parser_seek_PTS(uint32_t time, unsigned id)
 
     stream_scan_init(&sk);
 
+    seek_index_window(time, &pos_left, &time_left, &pos_right, &time_right);
+
     /* Initial estimate taken from average bitrate - later interpolations are
      * taken similarly based on the remaining file interval */
     pos_new = muldiv_uint32(time - time_left, pos_right - pos_left,
@@ -874,6 +1107,7 @@ static int parse_demux(struct stream *str, enum stream_parse_mode type)
 
         str->curr_packet = p;
         str->curr_packet_end = p + bytes;
+        str->pkt_pos = str->hdr.win_right;
         str->hdr.win_left = str->hdr.win_right + length;
         str->hdr.win_right = str->hdr.win_left + bytes;
 
@@ -963,11 +1197,27 @@ static int parse_elementary(struct stream *str, enum stream_parse_mode type)
     return STREAM_OK;
 }
 
+/* Have the video thread decode up to the frame at time starting from pos */
+static int sync_video(uint32_t time, off_t pos)
+{
+    str_parser.parms.sd.time = time;
+    str_parser.parms.sd.sk.pos = MAX(pos, 0);
+    str_parser.parms.sd.sk.len = 1024*1024;
+    str_parser.parms.sd.sk.dir = SSCAN_FORWARD;
+
+    DEBUGF("thumb pos:%ld len:%ld\n", str_parser.parms.sd.sk.pos,
+           (long)str_parser.parms.sd.sk.len);
+
+    return str_send_msg(&video_str, STREAM_SYNC,
+                        (intptr_t)&str_parser.parms.sd);
+}
+
 bool parser_prepare_image(uint32_t time)
 {
     struct stream_scan sk;
     int tries;
     int result;
+    off_t pos;
 
     stream_scan_init(&sk);
 
@@ -983,6 +1233,22 @@ bool parser_prepare_image(uint32_t time)
 
     str_send_msg(&video_str, STREAM_RESET, 0);
 
+    if (parser_can_seek())
+    {
+        /* An indexed I-frame close enough before the time needs no search */
+        pos = seek_index_find(time);
+
+        if (pos >= 0)
+        {
+            result = sync_video(time, pos);
+
+            if (result == STREAM_PERFECT_MATCH)
+                goto image_done;
+
+            DEBUGF("index miss: %ld\n", (long)pos);
+        }
+    }
+
     sk.pos = parser_can_seek() ?
                 mpeg_parser_seek_PTS(time, video_str.id) : 0;
     sk.len = sk.pos;
@@ -1014,16 +1280,7 @@ try_again:
         }
     }
 
-    str_parser.parms.sd.time = time;
-    str_parser.parms.sd.sk.pos = MAX(sk.pos, 0);
-    str_parser.parms.sd.sk.len = 1024*1024;
-    str_parser.parms.sd.sk.dir = SSCAN_FORWARD;
-
-    DEBUGF("thumb pos:%ld len:%ld\n", str_parser.parms.sd.sk.pos,
-           (long)str_parser.parms.sd.sk.len);
-
-    result = str_send_msg(&video_str, STREAM_SYNC,
-                          (intptr_t)&str_parser.parms.sd);
+    result = sync_video(time, sk.pos);
 
     if (result != STREAM_PERFECT_MATCH)
     {
@@ -1034,6 +1291,7 @@ try_again:
             goto try_again;
     }
 
+image_done:
 #ifdef HAVE_ADJUSTABLE_CPU_FREQ
     rb->cpu_boost(false);
 #endif
@@ -1081,7 +1339,7 @@ void parser_prepare_streaming(void)
         sw.right - sw.left + 4*MIN_BUFAHEAD);
 }
 
-int parser_init_stream(void)
+int parser_init_stream(const char *filename)
 {
     if (disk_buf.in_file < 0)
         return STREAM_ERROR;
@@ -1117,9 +1375,32 @@ int parser_init_stream(void)
 
     if (str_parser.format == STREAM_FMT_MPEG_PS)
     {
+        bool has_audio;
+
         /* Initalize start_pts and end_pts with the length (in 45kHz units) of
-         * the movie. INVALID_TIMESTAMP if the time could not be determined */
-        if (!init_times(&video_str) || !check_times(&video_str))
+         * the movie. INVALID_TIMESTAMP if the time could not be determined.
+         * They are kept in the seek index once found. */
+        if (seek_index_load(filename))
+        {
+            video_str.start_pts = seek_index->video_start;
+            video_str.end_pts = seek_index->video_end;
+            audio_str.start_pts = seek_index->audio_start;
+            audio_str.end_pts = seek_index->audio_end;
+            has_audio = seek_index->has_audio != 0;
+        }
+        else
+        {
+            init_times(&video_str); /* Times stay invalid if not found */
+            has_audio = init_times(&audio_str);
+
+            seek_index->video_start = video_str.start_pts;
+            seek_index->video_end = video_str.end_pts;
+            seek_index->audio_start = audio_str.start_pts;
+            seek_index->audio_end = audio_str.end_pts;
+            seek_index->has_audio = has_audio;
+        }
+
+        if (!check_times(&video_str))
         {
             /* Must have video at least */
             parser_init_state();
@@ -1128,7 +1409,7 @@ int parser_init_stream(void)
 
         str_parser.flags |= STREAMF_CAN_SEEK;
 
-        if (init_times(&audio_str))
+        if (has_audio)
         {
             /* Audio will be part of playback pool */
             stream_add_stream(&audio_str);
@@ -1192,12 +1473,29 @@ int parser_init_stream(void)
 
 void parser_close_stream(void)
 {
+    if (parser_can_seek())
+        seek_index_save();
+
     stream_remove_streams();
     parser_init_state();
 }
 
 bool parser_init(void)
 {
+    size_t size = sizeof (*seek_index) + CACHEALIGN_SIZE;
+    unsigned char *buf = mpeg_malloc(size, MPEG_ALLOC_SEEK_INDEX);
+
+    if (buf == NULL)
+        return false;
+
+#if NUM_CORES > 1
+    /* The video thread adds entries on the COP, seeking uses them on the
+     * CPU */
+    CACHEALIGN_BUFFER(buf, size);
+    buf = UNCACHED_ADDR(buf);
+#endif
+    seek_index = (struct seek_index *)buf;
+
     parser_init_state();
     return true;
 }
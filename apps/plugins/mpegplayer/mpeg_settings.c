@@ -960,6 +960,58 @@ static int get_start_time(uint32_t duration)
     return button;
 }
 
+#ifdef MPEG_DECODE_BENCHMARK
+/* Decode for up to this long from the start of the file */
+#define BENCHMARK_TICKS (HZ*60)
+
+static void decode_benchmark(void)
+{
+    struct video_benchmark_data vb;
+    long fps;
+
+    rb->splash(0, "Decoding... (any key stops)");
+
+    vb.max_ticks = BENCHMARK_TICKS;
+
+    if (!stream_video_benchmark(&vb))
+    {
+        rb->splash(HZ*2, "Benchmark failed");
+        return;
+    }
+
+#ifdef HAVE_ADJUSTABLE_CPU_FREQ
+    rb->cpu_boost(true);
+#endif
+
+    while (!vb.done)
+    {
+        int button = mpeg_button_get(HZ/10);
+
+        if (button != BUTTON_NONE && !(button & BUTTON_REL))
+            vb.cancel = true;
+    }
+
+#ifdef HAVE_ADJUSTABLE_CPU_FREQ
+    rb->cpu_boost(false);
+#endif
+
+    if (vb.num_frames <= 0 || vb.ticks <= 0)
+    {
+        rb->splash(HZ*2, "Benchmark failed");
+        return;
+    }
+
+    /* In 100ths of a frame per second */
+    fps = muldiv_uint32(HZ*100, vb.num_frames, vb.ticks);
+
+    DEBUGF("mpegplayer benchmark: %d frames in %ld ticks, %ld.%02ld fps\n",
+           vb.num_frames, vb.ticks, fps / 100, fps % 100);
+
+    rb->splashf(HZ*5, "%d frames: %ld.%02ld fps", vb.num_frames,
+                fps / 100, fps % 100);
+}
+#endif /* MPEG_DECODE_BENCHMARK */
+
 static int show_start_menu(uint32_t duration)
 {
     int selected = 0;
@@ -971,9 +1023,15 @@ static int show_start_menu(uint32_t duration)
     char hms_str[32];
     struct hms hms;
 
+#ifdef MPEG_DECODE_BENCHMARK
+    MENUITEM_STRINGLIST(menu, "Mpegplayer Menu", mpeg_sysevent_callback,
+                        "Play from beginning", resume_str, "Set start time",
+                        "Settings", "Benchmark decoding", "Quit mpegplayer");
+#else
     MENUITEM_STRINGLIST(menu, "Mpegplayer Menu", mpeg_sysevent_callback,
                         "Play from beginning", resume_str, "Set start time",
                         "Settings", "Quit mpegplayer");
+#endif
 
     ts_to_hms(settings.resume_time, &hms);
     hms_format(hms_str, sizeof(hms_str), &hms);
@@ -1015,6 +1073,12 @@ static int show_start_menu(uint32_t duration)
             mpeg_settings();
             break;
 
+#ifdef MPEG_DECODE_BENCHMARK
+        case MPEG_START_BENCHMARK:
+            decode_benchmark();
+            break;
+#endif
+
         default:
             result = MPEG_START_QUIT;
             menu_quit = true;
@@ -53,6 +53,9 @@ enum mpeg_start_id
     MPEG_START_RESUME,
     MPEG_START_SEEK,
     MPEG_START_SETTINGS,
+#ifdef MPEG_DECODE_BENCHMARK
+    MPEG_START_BENCHMARK,
+#endif
     MPEG_START_QUIT,
     MPEG_START_EXIT,
 };
@@ -29,6 +29,12 @@
 #endif
 /* #else function-like empty macros are defined in the headers */
 
+/* "Benchmark decoding" in the start menu, for measuring the decoder on
+ * hosts and in debug builds */
+#if (CONFIG_PLATFORM & PLATFORM_HOSTED) || defined(DEBUG)
+#define MPEG_DECODE_BENCHMARK
+#endif
+
 /* Should be enough for now */
 #define MPEGPLAYER_MAX_STREAMS 4
 
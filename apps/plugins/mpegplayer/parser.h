@@ -88,7 +88,8 @@ bool parser_init(void);
 void str_initialize(struct stream *str, off_t pos);
 bool parser_prepare_image(uint32_t time);
 bool parser_get_video_size(struct vo_ext *sz);
-int parser_init_stream(void);
+int parser_init_stream(const char *filename);
+void parser_index_add(uint32_t pts, off_t pos);
 void parser_close_stream(void);
 static inline bool parser_can_seek(void)
     { return str_parser.flags & STREAMF_CAN_SEEK; }
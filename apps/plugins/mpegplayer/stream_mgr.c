@@ -381,7 +381,7 @@ void stream_on_open(const char *filename)
     if (disk_buf_open(filename) >= 0)
     {
         /* Initialize the parser */
-        err = parser_init_stream();
+        err = parser_init_stream(filename);
 
         if (err >= STREAM_OK)
         {
@@ -846,6 +846,32 @@ bool stream_set_callback(long id, void *fn)
     return retval;
 }
 
+#ifdef MPEG_DECODE_BENCHMARK
+/* Time decoding the video without displaying it - only while stopped. The
+ * message is posted, so the caller doesn't hold the lock while it runs. */
+bool stream_video_benchmark(struct video_benchmark_data *vb)
+{
+    bool retval = false;
+
+    vb->cancel = false;
+    vb->done = false;
+
+    stream_mgr_lock();
+
+    if (video_str.thread != 0 && disk_buf.in_file >= 0 &&
+        stream_mgr.status == STREAM_STOPPED)
+    {
+        str_send_msg(&video_str, STREAM_RESET, 0);
+        str_post_msg(&video_str, VIDEO_BENCHMARK, (intptr_t)vb);
+        retval = true;
+    }
+
+    stream_mgr_unlock();
+
+    return retval;
+}
+#endif /* MPEG_DECODE_BENCHMARK */
+
 /* Return the time playback should resume if interrupted */
 uint32_t stream_get_resume_time(void)
 {
@@ -1120,15 +1146,15 @@ int stream_init(void)
     {
         rb->splash(HZ, "Cannot create video thread!");
     }
+    else if (!parser_init())
+    {
+        rb->splash(HZ, "Parser init failed!");
+    }
     /* Disk buffer takes max allotment of what's left so it must be last */
     else if (!disk_buf_init())
     {
         rb->splash(HZ, "Cannot create buffering thread!");
     }
-    else if (!parser_init())
-    {
-        rb->splash(HZ, "Parser init failed!");
-    }
     else
     {    
         return STREAM_OK;
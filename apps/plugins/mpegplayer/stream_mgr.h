@@ -157,6 +157,12 @@ static inline void stream_video_stats(struct video_output_stats *s)
 
 bool stream_set_callback(long id, void * fn);
 
+#ifdef MPEG_DECODE_BENCHMARK
+/* Start decoding the video from the start without showing it and time it.
+ * Returns at once, vb->done is set when it finished. */
+bool stream_video_benchmark(struct video_benchmark_data *vb);
+#endif
+
 /* Keep the disk spinning (for seeking and browsing) */
 static inline void stream_keep_disk_active(void)
 {
@@ -52,6 +52,7 @@ struct stream
     uint32_t end_pts;            /* Last timestamp for stream */
     uint32_t pts;                /* Last presentation timestamp */
     uint32_t pkt_flags;          /* PKT_* flags */
+    off_t    pkt_pos;            /* File position of the packet header */
     unsigned id;                 /* Stream identifier */
 };
 
@@ -109,6 +110,9 @@ enum stream_message
     VIDEO_SET_CLIP_RECT,      /* Set the visible video area */
     VIDEO_GET_CLIP_RECT,      /* Return the visible video area */
     VIDEO_SET_POST_FRAME_CALLBACK, /* Set a callback after frame is drawn */
+#ifdef MPEG_DECODE_BENCHMARK
+    VIDEO_BENCHMARK,          /* Decode as fast as possible without drawing */
+#endif
     STREAM_MESSAGE_LAST,
 };
 
@@ -126,6 +130,19 @@ struct str_sync_data
     struct stream_scan sk; /* Specification of start/limits/direction */
 };
 
+#ifdef MPEG_DECODE_BENCHMARK
+/* Data parameter for VIDEO_BENCHMARK, which is posted so that the caller
+ * can stop it */
+struct video_benchmark_data
+{
+    long max_ticks;         /* Stop after this long if not at the end yet */
+    volatile bool cancel;   /* Set by the caller to stop early */
+    volatile bool done;     /* Set by the video thread when finished */
+    int  num_frames;        /* Number of frames decoded */
+    long ticks;             /* Time it took */
+};
+#endif
+
 /* Stream status codes - not eqivalent to thread states */
 enum stream_status
 {
@@ -446,6 +446,65 @@ sync_finished:
     return retval;
 }
 
+#ifdef MPEG_DECODE_BENCHMARK
+/* Decode the stream from the beginning, every frame and as fast as possible
+ * without drawing anything, to measure the decoder alone */
+static bool video_benchmark(struct video_thread_data *td,
+                            struct video_benchmark_data *vb)
+{
+    struct stream tmp_str;
+    long start, end;
+
+    tmp_str.id = video_str.id;
+    tmp_str.hdr.pos = 0;
+    tmp_str.hdr.limit = disk_buf_filesize();
+
+    mpeg2_reset(td->mpeg2dec, false);
+    mpeg2_skip(td->mpeg2dec, 0);
+
+    vb->num_frames = 0;
+    start = *rb->current_tick;
+    end = start + vb->max_ticks;
+
+    while (!vb->cancel && TIME_BEFORE(*rb->current_tick, end))
+    {
+        switch (mpeg2_parse(td->mpeg2dec))
+        {
+        case STATE_BUFFER:
+            if (parser_get_next_data(&tmp_str, STREAM_PM_RANDOM_ACCESS)
+                    != STREAM_OK)
+                goto bench_finished;
+
+            mpeg2_buffer(td->mpeg2dec, tmp_str.curr_packet,
+                         tmp_str.curr_packet_end);
+            td->info = mpeg2_info(td->mpeg2dec);
+            break;
+
+        case STATE_SLICE:
+        case STATE_END:
+        case STATE_INVALID_END:
+            if (td->info->display_fbuf != NULL)
+                vb->num_frames++;
+            break;
+
+        default:
+            break;
+        }
+
+        rb->yield();
+    }
+
+bench_finished:
+    vb->ticks = *rb->current_tick - start;
+
+    /* Nothing in the frame buffers belongs to the current position now */
+    td->syncf_perfect = 0;
+
+    vb->done = true;
+    return vb->num_frames > 0;
+}
+#endif /* MPEG_DECODE_BENCHMARK */
+
 static bool frame_print_handler(struct video_thread_data *td)
 {
     bool retval;
@@ -641,6 +700,20 @@ static void video_thread_msg(struct video_thread_data *td)
             reply = true;
             break;
 
+#ifdef MPEG_DECODE_BENCHMARK
+        case VIDEO_BENCHMARK:
+            if (td->state != TSTATE_INIT)
+            {
+                /* Can only use after a reset was issued */
+                ((struct video_benchmark_data *)td->ev.data)->done = true;
+                break;
+            }
+
+            reply = video_benchmark(td,
+                        (struct video_benchmark_data *)td->ev.data);
+            break;
+#endif
+
         case STREAM_QUIT:
             /* Time to go - make thread exit */
             td->state = TSTATE_EOS;
@@ -740,8 +813,10 @@ static void video_thread(void)
                 goto message_wait;
 
             case STREAM_OK:
+                /* The second tag carries where the picture can be found */
                 if (video_str.pkt_flags & PKT_HAS_TS)
-                    mpeg2_tag_picture(td.mpeg2dec, video_str.pts, 0);
+                    mpeg2_tag_picture(td.mpeg2dec, video_str.pts,
+                                      video_str.pkt_pos);
 
                 mpeg2_buffer(td.mpeg2dec, video_str.curr_packet,
                               video_str.curr_packet_end);
@@ -764,6 +839,13 @@ static void video_thread(void)
             switch (td.info->current_picture->flags & PIC_MASK_CODING_TYPE)
             {
             case PIC_FLAG_CODING_TYPE_I:
+                if (td.info->current_picture->flags & PIC_FLAG_TAGS)
+                {
+                    /* Remember where decoding can start for this time */
+                    parser_index_add(td.info->current_picture->tag,
+                                     td.info->current_picture->tag2);
+                }
+
                 if (++td.num_intra >= 2)
                     td.group_est = td.num_picture / (td.num_intra - 1);
 
@@ -0,0 +1,798 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * Benchmark runner: memory, file I/O, LCD, DSP, codec and JPEG speed in a
+ * fixed sequence, written to one CSV file and compared against a baseline
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/* Results go to BENCH_DIR/latest.csv as "suite,name,value,unit" lines after
+ * a few "# key,value" header lines. The codec and image suites use whatever
+ * audio and .jpg files are found in BENCH_DIR, so keep a fixed set of short
+ * files there to make runs comparable. The same format is written by
+ * lib/rbcodec/test/bench.py for hosted builds. */
+
+#include "plugin.h"
+#include "lib/helper.h"
+#include "lib/pluginlib_actions.h"
+#if CONFIG_CODEC == SWCODEC
+#include "lib/fake_codec_api.h"
+#endif
+
+static const struct button_mapping *plugin_contexts[] = { pla_main_ctx };
+
+#define BENCH_DIR     ROCKBOX_DIR "/bench"
+#define RESULT_FILE   BENCH_DIR "/latest.csv"
+#define BASELINE_FILE BENCH_DIR "/baseline.csv"
+#define TEST_FILE     BENCH_DIR "/bench.tmp"
+
+#define MAX_RESULTS   64
+#define MIN_TICKS     (HZ/2) /* shortest timed loop */
+#define DURATION      (2*HZ) /* length of the fixed time tests */
+#define TOLERANCE     5      /* percent, smaller changes count as noise */
+
+#define MEM_SIZE      (256*1024)
+#if (CONFIG_STORAGE & STORAGE_MMC)
+#define FILE_SIZE     (1024*1024)
+#else
+#define FILE_SIZE     (4*1024*1024)
+#endif
+#define FILE_CHUNK    (64*1024)
+
+struct result
+{
+    char suite[8];
+    char name[24];
+    char unit[8];
+    long value;    /* in hundredths */
+    long baseline; /* in hundredths, -1 if not in the baseline */
+};
+
+static struct result results[MAX_RESULTS];
+static int num_results;
+static bool quit;
+
+static unsigned char *audiobuf;
+static size_t audiobuf_size;
+static unsigned char *pluginbuf;
+static size_t pluginbuf_size;
+
+/* Screen logging */
+static int line;
+static int max_line;
+
+static void log_init(void)
+{
+    int h;
+
+    rb->lcd_getstringsize("A", NULL, &h);
+    max_line = LCD_HEIGHT / h;
+    line = 0;
+    rb->lcd_clear_display();
+    rb->lcd_update();
+}
+
+static void log_text(const char *text)
+{
+    rb->lcd_puts(0, line, text);
+    if (++line >= max_line)
+        line = 0;
+    rb->lcd_update();
+}
+
+static bool check_quit(void)
+{
+    int button = pluginlib_getaction(0, plugin_contexts,
+                                     ARRAYLEN(plugin_contexts));
+    if (button == PLA_EXIT || button == PLA_CANCEL)
+        quit = true;
+    return quit;
+}
+
+/* Units where a bigger number is better, everything else is a time */
+static bool higher_is_better(const char *unit)
+{
+    return !rb->strcmp(unit, "MB/s") || !rb->strcmp(unit, "fps") ||
+           !rb->strcmp(unit, "x");
+}
+
+static void add_result(const char *suite, const char *name, long value,
+                       const char *unit)
+{
+    struct result *r;
+    char str[48];
+    char *p;
+
+    if (num_results >= MAX_RESULTS)
+        return;
+
+    r = &results[num_results++];
+    rb->strlcpy(r->suite, suite, sizeof(r->suite));
+    rb->strlcpy(r->name, name, sizeof(r->name));
+    rb->strlcpy(r->unit, unit, sizeof(r->unit));
+    r->value = value;
+    r->baseline = -1;
+
+    /* Names come from file names too, keep the CSV parseable */
+    for (p = r->name; *p; p++)
+        if (*p == ',')
+            *p = '_';
+
+    rb->snprintf(str, sizeof(str), "%s %s: %ld.%02ld %s", suite, r->name,
+                 value / 100, value % 100, unit);
+    log_text(str);
+}
+
+/* Repeats fn with doubling counts until it runs for at least MIN_TICKS.
+   Returns the ticks taken, *count is the number of calls made. */
+static long time_loop(void (*fn)(void), unsigned long *count)
+{
+    long ticks;
+    unsigned long i;
+
+    *count = 1;
+    while (1)
+    {
+        rb->sleep(0); /* sync to tick */
+        ticks = *rb->current_tick;
+        for (i = 0; i < *count; i++)
+            fn();
+        ticks = *rb->current_tick - ticks;
+
+        if (ticks >= MIN_TICKS || *count >= 0x10000000)
+            return ticks > 0 ? ticks : 1;
+        *count *= 2;
+    }
+}
+
+/* Hundredths of MB/s for <count> passes over <size> bytes */
+static long mb_per_sec(unsigned long count, size_t size, long ticks)
+{
+    unsigned long kb = count * (size / 1024);
+    return (long)((unsigned long long)kb * HZ * 100 / 1024 / ticks);
+}
+
+/** memory **/
+
+static int *mem_src;
+static int *mem_dst;
+static volatile int mem_sink;
+
+static void mem_read(void)
+{
+    const int *p = mem_src, *end = mem_src + MEM_SIZE / sizeof(int);
+    int x = 0;
+    while (p < end)
+    {
+        x += p[0] + p[1] + p[2] + p[3];
+        p += 4;
+    }
+    mem_sink = x;
+}
+
+static void mem_write(void)
+{
+    int *p = mem_dst, *end = mem_dst + MEM_SIZE / sizeof(int);
+    int x = mem_sink;
+    while (p < end)
+    {
+        p[0] = x; p[1] = x; p[2] = x; p[3] = x;
+        p += 4;
+    }
+}
+
+static void mem_memset(void)
+{
+    rb->memset(mem_dst, mem_sink, MEM_SIZE);
+}
+
+static void mem_memcpy(void)
+{
+    rb->memcpy(mem_dst, mem_src, MEM_SIZE);
+}
+
+static void bench_mem(void)
+{
+    static const struct
+    {
+        const char *name;
+        void (*fn)(void);
+    } tests[] =
+    {
+        { "read",   mem_read   },
+        { "write",  mem_write  },
+        { "memset", mem_memset },
+        { "memcpy", mem_memcpy },
+    };
+    unsigned long count;
+    long ticks;
+    unsigned i;
+
+    if (audiobuf_size < 2 * MEM_SIZE)
+        return;
+
+    mem_src = (int *)audiobuf;
+    mem_dst = (int *)(audiobuf + MEM_SIZE);
+    rb->memset(mem_src, 0x55, MEM_SIZE);
+
+    for (i = 0; i < ARRAYLEN(tests) && !check_quit(); i++)
+    {
+        ticks = time_loop(tests[i].fn, &count);
+        add_result("mem", tests[i].name, mb_per_sec(count, MEM_SIZE, ticks),
+                   "MB/s");
+    }
+}
+
+/** file I/O **/
+
+static void bench_file(void)
+{
+    long ticks;
+    size_t size = MIN((size_t)FILE_SIZE, audiobuf_size);
+    size_t done;
+    int fd;
+
+    size -= size % FILE_CHUNK;
+    if (size == 0)
+        return;
+
+    /* Write a new file */
+    fd = rb->creat(TEST_FILE, 0666);
+    if (fd < 0)
+        return;
+    ticks = *rb->current_tick;
+    for (done = 0; done < size; done += FILE_CHUNK)
+        if (rb->write(fd, audiobuf + done, FILE_CHUNK) != FILE_CHUNK)
+            break;
+    rb->close(fd);
+    ticks = *rb->current_tick - ticks;
+    if (done < size)
+        goto error;
+    add_result("file", "write", mb_per_sec(1, size, MAX(ticks, 1)), "MB/s");
+
+    if (check_quit())
+        goto error;
+
+    /* And read it back */
+    fd = rb->open(TEST_FILE, O_RDONLY);
+    if (fd < 0)
+        goto error;
+    ticks = *rb->current_tick;
+    for (done = 0; done < size; done += FILE_CHUNK)
+        if (rb->read(fd, audiobuf + done, FILE_CHUNK) != FILE_CHUNK)
+            break;
+    rb->close(fd);
+    ticks = *rb->current_tick - ticks;
+    if (done == size)
+        add_result("file", "read", mb_per_sec(1, size, MAX(ticks, 1)),
+                   "MB/s");
+
+error:
+    rb->remove(TEST_FILE);
+}
+
+/** LCD **/
+
+#ifdef HAVE_LCD_BITMAP
+static long frames_per_sec(int what)
+{
+    long ticks, end;
+    long frames = 0;
+    int y;
+
+    rb->sleep(0); /* sync to tick */
+    ticks = *rb->current_tick;
+    while ((end = *rb->current_tick) - ticks < DURATION)
+    {
+        switch (what)
+        {
+        case 0:
+            rb->lcd_update();
+            break;
+        case 1:
+            rb->lcd_update_rect(LCD_WIDTH/4, LCD_HEIGHT/4,
+                                LCD_WIDTH/2, LCD_HEIGHT/2);
+            break;
+        case 2:
+            rb->lcd_clear_display();
+            for (y = 0; y < LCD_HEIGHT; y += LCD_HEIGHT/8)
+                rb->lcd_putsxy(frames & 7, y, "The quick brown fox");
+            rb->lcd_update();
+            break;
+        }
+        frames++;
+    }
+
+    return (long)((long long)frames * HZ * 100 / (end - ticks));
+}
+
+static void bench_lcd(void)
+{
+    static const char * const names[] = { "update", "update 1/4", "text" };
+    long fps[ARRAYLEN(names)];
+    unsigned i;
+
+    /* Logging would be in the way of the text test, report afterwards */
+    for (i = 0; i < ARRAYLEN(names); i++)
+        fps[i] = frames_per_sec(i);
+
+    log_init();
+    for (i = 0; i < ARRAYLEN(names); i++)
+        add_result("lcd", names[i], fps[i], "fps");
+}
+#endif /* HAVE_LCD_BITMAP */
+
+#if CONFIG_CODEC == SWCODEC
+/** DSP **/
+
+#define DSP_RATE   48000 /* resampled to the output rate */
+#define DSP_FRAMES 1024
+
+static void bench_dsp(void)
+{
+    struct dsp_config *dsp = rb->dsp_get_config(CODEC_IDX_AUDIO);
+    int16_t *in = (int16_t *)pluginbuf;
+    int16_t *out = in + 2 * DSP_FRAMES;
+    int out_count = (pluginbuf_size / sizeof(int16_t) - 2 * DSP_FRAMES) / 2;
+    unsigned long frames = 0;
+    unsigned random = 0x78c3;
+    long ticks, end;
+    int i;
+
+    if (out_count < DSP_FRAMES * 2)
+        return;
+
+    /* Noise at a rate that needs resampling, with the user's DSP settings */
+    for (i = 0; i < 2 * DSP_FRAMES; i++)
+    {
+        random = 75 * random + 74;
+        in[i] = (int16_t)random >> 2;
+    }
+
+    rb->dsp_configure(dsp, DSP_RESET, 0);
+    rb->dsp_configure(dsp, DSP_SET_FREQUENCY, DSP_RATE);
+    rb->dsp_configure(dsp, DSP_SET_SAMPLE_DEPTH, 16);
+    rb->dsp_configure(dsp, DSP_SET_STEREO_MODE, STEREO_INTERLEAVED);
+    rb->dsp_configure(dsp, DSP_FLUSH, 0);
+
+    rb->sleep(0); /* sync to tick */
+    ticks = *rb->current_tick;
+    while ((end = *rb->current_tick) - ticks < DURATION)
+    {
+        struct dsp_buffer src, dst;
+
+        src.remcount = DSP_FRAMES;
+        src.pin[0] = in;
+        src.pin[1] = NULL;
+        src.proc_mask = 0;
+
+        while (src.remcount > 0)
+        {
+            dst.remcount = 0;
+            dst.p16out = out;
+            dst.bufcount = out_count;
+            rb->dsp_process(dsp, &src, &dst);
+        }
+
+        frames += DSP_FRAMES;
+    }
+
+    rb->dsp_configure(dsp, DSP_RESET, 0);
+
+    /* audio time / wall time */
+    add_result("dsp", "48k stereo", (frames / (DSP_RATE / 1000)) * HZ /
+               ((end - ticks) * 10), "x");
+}
+
+/** codecs **/
+
+static void *codec_mallocbuf;
+static unsigned char *filebuf;
+static size_t filebuf_size;
+
+static struct codec_api ci;
+static struct fake_ci_file file;
+static struct mp3entry id3;
+static volatile bool codec_playing;
+static volatile long endtick;
+
+static void pcmbuf_insert(const void *ch1, const void *ch2, int count)
+{
+    (void)ch1; (void)ch2; (void)count;
+    rb->reset_poweroff_timer();
+}
+
+static void codec_thread(void)
+{
+    if (rb->codec_load_file(rb->get_codec_filename(id3.codectype), &ci) >= 0)
+        rb->codec_run_proc();
+
+    rb->codec_close();
+
+    endtick = *rb->current_tick;
+    codec_playing = false;
+}
+
+/* Decodes a whole file from RAM with null output, without the DSP */
+static void bench_codec_file(const char *path, const char *name)
+{
+    long ticks;
+    int fd;
+
+    fd = rb->open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    file.filesize = rb->filesize(fd);
+    rb->memset(&id3, 0, sizeof(id3));
+    if (file.filesize > filebuf_size || !rb->get_metadata(&id3, fd, path) ||
+        id3.length == 0)
+    {
+        rb->close(fd);
+        return;
+    }
+
+    rb->lseek(fd, 0, SEEK_SET);
+    if ((size_t)rb->read(fd, filebuf, file.filesize) != file.filesize)
+    {
+        rb->close(fd);
+        return;
+    }
+    rb->close(fd);
+
+    /* All of it is in RAM, nothing to rebuffer */
+    file.fd = -1;
+    file.buf = filebuf;
+    file.bufsize = file.filesize;
+    fake_ci_init(&ci, &file, codec_mallocbuf, pcmbuf_insert, NULL);
+    ci.id3 = &id3;
+
+    codec_playing = true;
+    ticks = *rb->current_tick;
+
+    rb->codec_thread_do_callback(codec_thread, NULL);
+
+    while (codec_playing)
+    {
+        if (check_quit())
+            fake_ci_set_action(CODEC_ACTION_HALT);
+        rb->sleep(HZ/10);
+    }
+    ticks = endtick - ticks;
+
+    rb->codec_thread_do_callback(NULL, NULL);
+
+    if (!quit)
+        add_result("codec", name, id3.length * HZ / (MAX(ticks, 1) * 10),
+                   "x");
+}
+#endif /* CONFIG_CODEC == SWCODEC */
+
+/** JPEG **/
+
+#ifdef HAVE_JPEG
+static const char *jpeg_path;
+static struct bitmap jpeg_bm;
+static bool jpeg_failed;
+
+static void jpeg_decode(void)
+{
+    jpeg_bm.width = LCD_WIDTH;
+    jpeg_bm.height = LCD_HEIGHT;
+    jpeg_bm.data = audiobuf;
+    if (rb->read_jpeg_file(jpeg_path, &jpeg_bm, audiobuf_size,
+                           FORMAT_NATIVE|FORMAT_RESIZE|FORMAT_KEEP_ASPECT,
+                           NULL) < 0)
+        jpeg_failed = true;
+}
+
+/* Decode and scale to the screen size, reading from the file each time */
+static void bench_jpeg_file(const char *path, const char *name)
+{
+    unsigned long count;
+    long ticks;
+
+    jpeg_path = path;
+    jpeg_failed = false;
+    jpeg_decode();
+    if (jpeg_failed)
+        return;
+
+    ticks = time_loop(jpeg_decode, &count);
+    if (!jpeg_failed)
+        add_result("jpeg", name, ticks * 100000 / (HZ * (long)count), "ms");
+}
+#endif /* HAVE_JPEG */
+
+/* Runs the file based suites on everything in BENCH_DIR, sorted by the
+   directory order which is stable as long as the files don't change */
+static void bench_files(void)
+{
+    char path[MAX_PATH];
+    struct dirent *entry;
+    DIR *dir;
+
+    dir = rb->opendir(BENCH_DIR);
+    if (!dir)
+        return;
+
+    while ((entry = rb->readdir(dir)) && !check_quit())
+    {
+        struct dirinfo info = rb->dir_get_info(dir, entry);
+        const char *ext = rb->strrchr(entry->d_name, '.');
+
+        if ((info.attribute & ATTR_DIRECTORY) || !ext ||
+            !rb->strcasecmp(ext, ".csv") || !rb->strcasecmp(ext, ".tmp"))
+            continue;
+
+        rb->snprintf(path, sizeof(path), BENCH_DIR "/%s", entry->d_name);
+#ifdef HAVE_JPEG
+        if (!rb->strcasecmp(ext, ".jpg") || !rb->strcasecmp(ext, ".jpeg"))
+        {
+            bench_jpeg_file(path, entry->d_name);
+            continue;
+        }
+#endif
+#if CONFIG_CODEC == SWCODEC
+        bench_codec_file(path, entry->d_name);
+#endif
+    }
+
+    rb->closedir(dir);
+}
+
+/** report **/
+
+/* Parses "123.45" into hundredths */
+static long parse_value(const char *s)
+{
+    long value = rb->atoi(s) * 100;
+    const char *dot = rb->strchr(s, '.');
+
+    if (dot && dot[1] >= '0' && dot[1] <= '9')
+    {
+        value += (dot[1] - '0') * 10;
+        if (dot[2] >= '0' && dot[2] <= '9')
+            value += dot[2] - '0';
+    }
+    return value;
+}
+
+static void read_baseline(void)
+{
+    char buf[80];
+    char *suite, *name, *value, *unit, *end;
+    int fd, i;
+
+    fd = rb->open(BASELINE_FILE, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    while (rb->read_line(fd, buf, sizeof(buf)) > 0)
+    {
+        if (buf[0] == '#')
+            continue;
+
+        suite = buf;
+        if (!(name = rb->strchr(suite, ',')))
+            continue;
+        *name++ = '\0';
+        if (!(value = rb->strchr(name, ',')))
+            continue;
+        *value++ = '\0';
+        if (!(unit = rb->strchr(value, ',')))
+            continue;
+        *unit++ = '\0';
+        if ((end = rb->strchr(unit, '\r')))
+            *end = '\0';
+
+        for (i = 0; i < num_results; i++)
+        {
+            struct result *r = &results[i];
+            if (!rb->strcmp(r->suite, suite) && !rb->strcmp(r->name, name) &&
+                !rb->strcmp(r->unit, unit))
+            {
+                r->baseline = parse_value(value);
+                break;
+            }
+        }
+    }
+
+    rb->close(fd);
+}
+
+/* Percentage change against the baseline, positive is better */
+static int compare(const struct result *r)
+{
+    long value = r->value, base = r->baseline;
+
+    /* Keep the products below in range */
+    while (value > 0x100000 || base > 0x100000)
+    {
+        value >>= 1;
+        base >>= 1;
+    }
+    if (base <= 0)
+        return 0;
+
+    if (higher_is_better(r->unit))
+        return (value - base) * 100 / base;
+    else
+        return (base - value) * 100 / base;
+}
+
+static bool write_results(const char *filename)
+{
+    int fd, i;
+
+    fd = rb->creat(filename, 0666);
+    if (fd < 0)
+        return false;
+
+    rb->fdprintf(fd, "# version,%s\n", rb->rbversion);
+    rb->fdprintf(fd, "# target,%s\n", MODEL_NAME);
+#if (CONFIG_PLATFORM & PLATFORM_NATIVE)
+    rb->fdprintf(fd, "# cpu_mhz,%ld\n", *rb->cpu_frequency / 1000000);
+#endif
+    for (i = 0; i < num_results; i++)
+    {
+        struct result *r = &results[i];
+        rb->fdprintf(fd, "%s,%s,%ld.%02ld,%s\n", r->suite, r->name,
+                     r->value / 100, r->value % 100, r->unit);
+    }
+
+    rb->close(fd);
+    return true;
+}
+
+static const char* result_get_name(int selected_item, void *data,
+                                   char *buffer, size_t buffer_len)
+{
+    const struct result *r = &results[selected_item];
+    (void)data;
+
+    if (r->baseline < 0)
+        rb->snprintf(buffer, buffer_len, "%s %s: %ld.%02ld %s",
+                     r->suite, r->name, r->value / 100, r->value % 100,
+                     r->unit);
+    else
+        rb->snprintf(buffer, buffer_len, "%s %s: %ld.%02ld %s (%+d%%)",
+                     r->suite, r->name, r->value / 100, r->value % 100,
+                     r->unit, compare(r));
+    return buffer;
+}
+
+static void show_results(void)
+{
+    struct simplelist_info info;
+    char title[32];
+    int i, worse = 0;
+
+    for (i = 0; i < num_results; i++)
+        if (results[i].baseline >= 0 && compare(&results[i]) < -TOLERANCE)
+            worse++;
+
+    rb->snprintf(title, sizeof(title), "%d results, %d worse",
+                 num_results, worse);
+    rb->simplelist_info_init(&info, title, num_results, NULL);
+    info.hide_selection = true;
+    info.scroll_all = true;
+    info.get_name = result_get_name;
+    rb->simplelist_show_list(&info);
+}
+
+static void run_all(void)
+{
+    num_results = 0;
+    quit = false;
+
+    log_init();
+    log_text("Running, this takes a while");
+
+#ifdef HAVE_ADJUSTABLE_CPU_FREQ
+    rb->cpu_boost(true);
+#endif
+
+    bench_mem();
+    if (!quit)
+        bench_file();
+#ifdef HAVE_LCD_BITMAP
+    if (!quit)
+        bench_lcd();
+#endif
+#if CONFIG_CODEC == SWCODEC
+    if (!quit)
+        bench_dsp();
+#endif
+    if (!quit)
+        bench_files();
+
+#ifdef HAVE_ADJUSTABLE_CPU_FREQ
+    rb->cpu_boost(false);
+#endif
+
+    if (quit)
+    {
+        rb->splash(HZ, "Aborted");
+        num_results = 0;
+        return;
+    }
+
+    read_baseline();
+    if (!write_results(RESULT_FILE))
+        rb->splash(HZ, "Can't write " RESULT_FILE);
+    show_results();
+}
+
+enum plugin_status plugin_start(const void* parameter)
+{
+    int selection = 0;
+    (void)parameter;
+
+    pluginbuf = rb->plugin_get_buffer(&pluginbuf_size);
+    audiobuf = rb->plugin_get_audio_buffer(&audiobuf_size);
+#if CONFIG_CODEC == SWCODEC
+    /* Align to pointer size, tlsf wants that */
+    codec_mallocbuf = (void*)(((intptr_t)audiobuf +
+                       sizeof(intptr_t)-1) & ~(sizeof(intptr_t)-1));
+    filebuf = SKIPBYTES(codec_mallocbuf, CODEC_SIZE);
+    filebuf_size = audiobuf_size > CODEC_SIZE + sizeof(intptr_t) ?
+                       audiobuf_size - CODEC_SIZE - sizeof(intptr_t) : 0;
+#endif
+
+    if (!rb->dir_exists(BENCH_DIR))
+        rb->mkdir(BENCH_DIR);
+
+    backlight_ignore_timeout();
+
+    MENUITEM_STRINGLIST(menu, "Benchmarks", NULL,
+                        "Run all", "Show last results",
+                        "Save last results as baseline", "Quit");
+
+    while (1)
+    {
+        switch (rb->do_menu(&menu, &selection, NULL, false))
+        {
+        case 0:
+            run_all();
+            break;
+        case 1:
+            if (num_results)
+                show_results();
+            else
+                rb->splash(HZ, "Nothing run yet");
+            break;
+        case 2:
+            if (num_results && write_results(BASELINE_FILE))
+            {
+                int i;
+                for (i = 0; i < num_results; i++)
+                    results[i].baseline = results[i].value;
+                rb->splash(HZ, "Saved " BASELINE_FILE);
+            }
+            else
+                rb->splash(HZ, "Nothing saved");
+            break;
+        case MENU_ATTACHED_USB:
+            backlight_use_settings();
+            return PLUGIN_USB_CONNECTED;
+        default:
+            backlight_use_settings();
+            return PLUGIN_OK;
+        }
+    }
+}
@@ -22,6 +22,7 @@
 #include "lib/pluginlib_touchscreen.h"
 #include "lib/pluginlib_exit.h"
 #include "lib/pluginlib_actions.h"
+#include "lib/fake_codec_api.h"
 
 /* this set the context to use with PLA */
 static const struct button_mapping *plugin_contexts[] = { pla_main_ctx };
@@ -98,16 +99,13 @@ struct wavinfo_t
 static void* audiobuf;
 static void* codec_mallocbuf;
 static size_t audiosize;
-static size_t audiobufsize;
-static int offset;
-static int fd;
 
 /* Our local implementation of the codec API */
 static struct codec_api ci;
+static struct fake_ci_file file;
 
 struct test_track_info {
     struct mp3entry id3;       /* TAG metadata */
-    size_t filesize;           /* File total length */
 };
 
 static struct test_track_info track;
@@ -117,11 +115,9 @@ static bool use_dsp;
 static bool checksum;
 static uint32_t crc32;
 
-static volatile unsigned int elapsed;
 static volatile bool codec_playing;
-static volatile enum codec_command_action codec_action;
+static bool aborted;
 static volatile long endtick;
-static volatile long rebuffertick;
 struct wavinfo_t wavinfo;
 
 static unsigned char wav_header[44] =
@@ -207,13 +203,6 @@ void close_wav(void)
     rb->close(wavinfo.fd);
 }
 
-/* Returns buffer to malloc array. Only codeclib should need this. */
-static void* codec_get_buffer(size_t *size)
-{
-   *size = CODEC_SIZE;
-   return codec_mallocbuf;
-}
-
 static int process_dsp(const void *ch1, const void *ch2, int count)
 {
     struct dsp_buffer src;
@@ -253,44 +242,6 @@ static void pcmbuf_insert_null(const void *ch1, const void *ch2, int count)
     rb->reset_poweroff_timer();
 }
 
-/*
- *  Helper function used when the file is larger then the available memory. 
- *  Rebuffers the file by setting the start of the audio buffer to be 
- *  new_offset and filling from there.
- */
-static int fill_buffer(int new_offset){
-    size_t n, bytestoread;
-    long temp = *rb->current_tick;
-    rb->lseek(fd,new_offset,SEEK_SET);
-    
-    if(new_offset + audiobufsize <= track.filesize)
-        bytestoread = audiobufsize;
-    else
-        bytestoread = track.filesize-new_offset;
-    
-    n = rb->read(fd, audiobuf,bytestoread);
-
-    if (n != bytestoread)
-    {
-        log_text("Read failed.",true);
-        DEBUGF("read fail:  got %d bytes, expected %d\n", (int)n, (int)audiobufsize);
-        rb->backlight_on();
-
-        if (fd >= 0)
-        {
-            rb->close(fd);
-        }
-
-        return -1;
-    }
-    offset = new_offset;
-    
-    /*keep track of how much time we spent buffering*/
-    rebuffertick += *rb->current_tick-temp;
-    
-    return 0;
-}
-
 /* WAV output or calculate crc32 of output*/
 static void pcmbuf_insert_wav_checksum(const void *ch1, const void *ch2, int count)
 {
@@ -401,100 +352,8 @@ static void pcmbuf_insert_wav_checksum(const void *ch1, const void *ch2, int cou
     } /* else */
 }
 
-/* Set song position in WPS (value in ms). */
-static void set_elapsed(unsigned long value)
-{
-    elapsed = value;
-    ci.id3->elapsed = value;
-}
-
-
-/* Read next <size> amount bytes from file buffer to <ptr>.
-   Will return number of bytes read or 0 if end of file. */
-static size_t read_filebuf(void *ptr, size_t size)
-{
-   if (ci.curpos > (off_t)track.filesize)
-   {
-       return 0;
-   } else {
-        size_t realsize = MIN(track.filesize-ci.curpos,size);
-        
-       /* check if we have enough bytes ready*/
-       if(realsize >(audiobufsize - (ci.curpos-offset)))
-       {
-           /*rebuffer so that we start at ci.curpos*/
-           fill_buffer(ci.curpos);
-        }
-       
-       rb->memcpy(ptr, audiobuf + (ci.curpos-offset), realsize);
-       ci.curpos += realsize;
-       return realsize;
-   }
-}
-
-
-/* Request pointer to file buffer which can be used to read
-   <realsize> amount of data. <reqsize> tells the buffer system
-   how much data it should try to allocate. If <realsize> is 0,
-   end of file is reached. */
-static void* request_buffer(size_t *realsize, size_t reqsize)
-{
-    *realsize = MIN(track.filesize-ci.curpos,reqsize);
-
-    /*check if we have enough bytes ready - requested > bufsize-currentbufpos*/
-    if(*realsize>(audiobufsize - (ci.curpos-offset)))
-    {
-        /*rebuffer so that we start at ci.curpos*/
-       fill_buffer(ci.curpos);
-    }
-    
-    return (audiobuf + (ci.curpos-offset));
-}
-
-/* Advance file buffer position by <amount> amount of bytes. */
-static void advance_buffer(size_t amount)
-{
-    ci.curpos += amount;
-    ci.id3->offset = ci.curpos;
-}
-
-
-/* Seek file buffer to position <newpos> beginning of file. */
-static bool seek_buffer(size_t newpos)
-{
-    ci.curpos = newpos;
-    return true;
-}
-
-
-/* Codec should call this function when it has done the seeking. */
-static void seek_complete(void)
-{
-    /* Do nothing */
-}
-
-/* Codec calls this to know what it should do next. */
-static enum codec_command_action get_command(intptr_t *param)
-{
-    rb->yield();
-    return codec_action;
-    (void)param;
-}
-
-/* Some codecs call this to determine whether they should loop. */
-static bool loop_track(void)
-{
-    return false;
-}
-
-static void set_offset(size_t value)
-{
-    ci.id3->offset = value;
-}
-
-
 /* Configure different codec buffer parameters. */
-static void configure(int setting, intptr_t value)
+static void configure_wav(int setting, intptr_t value)
 {
     if (use_dsp)
         rb->dsp_configure(ci.dsp, setting, value);
@@ -523,80 +382,6 @@ static void configure(int setting, intptr_t value)
 
 }
 
-static void init_ci(void)
-{
-    /* --- Our "fake" implementations of the codec API functions. --- */
-
-    ci.dsp = rb->dsp_get_config(CODEC_IDX_AUDIO);
-    ci.codec_get_buffer = codec_get_buffer;
-
-    if (wavinfo.fd >= 0 || checksum) {
-        ci.pcmbuf_insert = pcmbuf_insert_wav_checksum;
-    } else {
-        ci.pcmbuf_insert = pcmbuf_insert_null;
-    }
-
-    ci.set_elapsed = set_elapsed;
-    ci.read_filebuf = read_filebuf;
-    ci.request_buffer = request_buffer;
-    ci.advance_buffer = advance_buffer;
-    ci.seek_buffer = seek_buffer;
-    ci.seek_complete = seek_complete;
-    ci.set_offset = set_offset;
-    ci.configure = configure;
-    ci.get_command = get_command;
-    ci.loop_track = loop_track;
-
-    /* --- "Core" functions --- */
-
-    /* kernel/ system */
-    ci.sleep = rb->sleep;
-    ci.yield = rb->yield;
-
-    /* strings and memory */
-    ci.strcpy = rb->strcpy;
-    ci.strlen = rb->strlen;
-    ci.strcmp = rb->strcmp;
-    ci.strcat = rb->strcat;
-    ci.memset = rb->memset;
-    ci.memcpy = rb->memcpy;
-    ci.memmove = rb->memmove;
-    ci.memcmp = rb->memcmp;
-    ci.memchr = rb->memchr;
-#if defined(DEBUG) || defined(SIMULATOR)
-    ci.debugf = rb->debugf;
-#endif
-#ifdef ROCKBOX_HAS_LOGF
-    ci.logf = rb->logf;
-#endif
-
-    ci.qsort = rb->qsort;
-
-#ifdef RB_PROFILE
-    ci.profile_thread = rb->profile_thread;
-    ci.profstop = rb->profstop;
-    ci.profile_func_enter = rb->profile_func_enter;
-    ci.profile_func_exit = rb->profile_func_exit;
-#endif
-
-    ci.commit_dcache = rb->commit_dcache;
-    ci.commit_discard_dcache = rb->commit_discard_dcache;
-    ci.commit_discard_idcache = rb->commit_discard_idcache;
-
-#if NUM_CORES > 1
-    ci.create_thread = rb->create_thread;
-    ci.thread_thaw = rb->thread_thaw;
-    ci.thread_wait = rb->thread_wait;
-    ci.semaphore_init = rb->semaphore_init;
-    ci.semaphore_wait = rb->semaphore_wait;
-    ci.semaphore_release = rb->semaphore_release;
-#endif
-
-#if defined(CPU_ARM) && (CONFIG_PLATFORM & PLATFORM_NATIVE)
-    ci.__div0 = rb->__div0;
-#endif
-}
-
 static void codec_thread(void)
 {
     const char* codecname;
@@ -617,7 +402,7 @@ static void codec_thread(void)
     rb->codec_close();
 
     /* Signal to the main thread that we are done */
-    endtick = *rb->current_tick - rebuffertick;
+    endtick = *rb->current_tick - file.rebuffer_ticks;
     codec_playing = false;
 }
 
@@ -631,7 +416,6 @@ static enum plugin_status test_track(const char* filename)
     unsigned long duration;
     const char* ch;
     char str[MAX_PATH];
-    offset=0;
 
     /* Display filename (excluding any path)*/
     ch = rb->strrchr(filename, '/');
@@ -645,49 +429,50 @@ static enum plugin_status test_track(const char* filename)
 
     log_text("Loading...",false);
 
-    fd = rb->open(filename,O_RDONLY);
-    if (fd < 0)
+    file.fd = rb->open(filename,O_RDONLY);
+    if (file.fd < 0)
     {
         log_text("Cannot open file",true);
         goto exit;
     }
 
-    track.filesize = rb->filesize(fd);
+    file.filesize = rb->filesize(file.fd);
 
     /* Clear the id3 struct */
     rb->memset(&track.id3, 0, sizeof(struct mp3entry));
 
-    if (!rb->get_metadata(&(track.id3), fd, filename))
+    if (!rb->get_metadata(&(track.id3), file.fd, filename))
     {
         log_text("Cannot read metadata",true);
         goto exit;
     }
 
-    if (track.filesize > audiosize)
+    file.buf = audiobuf;
+    if (file.filesize > audiosize)
     {
-        audiobufsize=audiosize;
+        file.bufsize=audiosize;
         
     } else 
     {
-        audiobufsize=track.filesize;
+        file.bufsize=file.filesize;
     }
 
-    n = rb->read(fd, audiobuf, audiobufsize);
+    n = rb->read(file.fd, audiobuf, file.bufsize);
 
-    if (n != audiobufsize)
+    if (n != file.bufsize)
     {
         log_text("Read failed.",true);
         goto exit;
     }
     
 
-    /* Initialise the function pointers in the codec API */
-    init_ci();
-
-    /* Prepare the codec struct for playing the whole file */
-    ci.filesize = track.filesize;
+    /* Initialise the function pointers in the codec API and prepare the
+       codec struct for playing the whole file */
+    fake_ci_init(&ci, &file, codec_mallocbuf,
+                 (wavinfo.fd >= 0 || checksum) ? pcmbuf_insert_wav_checksum
+                                               : pcmbuf_insert_null,
+                 configure_wav);
     ci.id3 = &track.id3;
-    ci.curpos = 0;
 
     if (use_dsp) {
         rb->dsp_configure(ci.dsp, DSP_RESET, 0);
@@ -697,11 +482,10 @@ static enum plugin_status test_track(const char* filename)
     if (checksum)
         crc32 = 0xffffffff;
 
-    rebuffertick=0;
     starttick = *rb->current_tick;
 
     codec_playing = true;
-    codec_action = CODEC_ACTION_NULL;
+    aborted = false;
 
     rb->codec_thread_do_callback(codec_thread, NULL);
 
@@ -712,11 +496,12 @@ static enum plugin_status test_track(const char* filename)
                           ARRAYLEN(plugin_contexts));
         if ((button == TESTCODEC_EXITBUTTON) || (button == TESTCODEC_EXITBUTTON2))
         {
-            codec_action = CODEC_ACTION_HALT;
+            fake_ci_set_action(CODEC_ACTION_HALT);
+            aborted = true;
             break;
         }
 
-        rb->snprintf(str,sizeof(str),"%d of %d",elapsed,(int)track.id3.length);
+        rb->snprintf(str,sizeof(str),"%d of %d",(int)track.id3.elapsed,(int)track.id3.length);
         log_text(str,false);
     }
     ticks = endtick - starttick;
@@ -726,10 +511,14 @@ static enum plugin_status test_track(const char* filename)
     rb->backlight_on();
     log_text(str,true);
 
-    if (codec_action == CODEC_ACTION_HALT)
+    if (aborted)
     {
         /* User aborted test */
     }    
+    else if (file.read_failed)
+    {
+        log_text("Read failed.",true);
+    }
     else if (checksum)
     {
         rb->snprintf(str, sizeof(str), "CRC32 - %08x", (unsigned)crc32);
@@ -773,9 +562,9 @@ static enum plugin_status test_track(const char* filename)
 exit:
     rb->backlight_on();
 
-    if (fd >= 0)
+    if (file.fd >= 0)
     {
-        rb->close(fd);
+        rb->close(file.fd);
     }
 
     return res;
@@ -814,7 +603,7 @@ void plugin_quit(void)
     lcd->update_viewport();
     if (rb->touchscreen_get_mode() == TOUCHSCREEN_POINT)
     {
-        while (codec_action != CODEC_ACTION_HALT &&
+        while (!aborted &&
                touchbutton_get(button, ARRAYLEN(button)) != ACTION_STD_OK);
     }
     else
@@ -823,7 +612,7 @@ void plugin_quit(void)
             btn = pluginlib_getaction(TIMEOUT_BLOCK, plugin_contexts,
                           ARRAYLEN(plugin_contexts));
             exit_on_usb(btn);
-        } while ((codec_action != CODEC_ACTION_HALT)
+        } while (!aborted
                        && (btn != TESTCODEC_EXITBUTTON)
                        && (btn != TESTCODEC_EXITBUTTON2));
 }
@@ -991,7 +780,7 @@ menu:
                     rb->snprintf(filename,sizeof(filename),"%s%s",dirpath,entry->d_name);
                     test_track(filename);
 
-                    if (codec_action == CODEC_ACTION_HALT)
+                    if (aborted)
                         break;
 
                     log_text("", true);
@@ -73,6 +73,24 @@ static inline void dsp_process_end(struct dsp_loop_context *ctx)
 #define DSP_PROCESS_END() \
     dsp_process_end(&__ctx)
 
+/* Timer for DSP stage profiling (DSP_PROFILE_ENABLE) */
+#if defined(USEC_TIMER)
+#define DSP_PROFILE_TIMER()     USEC_TIMER
+#define DSP_PROFILE_TIMER_FREQ  1000000ul
+#elif (CONFIG_PLATFORM & PLATFORM_HOSTED) && !defined(WIN32)
+#include <time.h>
+
+static inline uint32_t dsp_profile_timer(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+#define DSP_PROFILE_TIMER()     dsp_profile_timer()
+#define DSP_PROFILE_TIMER_FREQ  1000000000ul
+#endif
+
 #endif
 
 #define DSP_OUT_MIN_HZ      PLAY_SAMPR_HW_MIN
@@ -28,6 +28,12 @@
 #include "dircache.h"
 #include "misc.h"
 #include "pathfuncs.h"
+#include "crc32.h"
+#include "ata_idle_notify.h"
+#include "buffering.h"
+#include "dir.h"
+#include "file.h"
+#include "rbpaths.h"
 #include "settings.h"
 #include "wps.h"
 
@@ -138,8 +144,15 @@ static bool try_exts(char *path, int len)
  * then the colon is skipped ("100x100" will be used) and the track
  * specific image (./<trackname><size>.bmp) is tried last instead of first.
  */
-bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
-                           char *buf, int buflen)
+enum search_what
+{
+    SEARCH_ALL = 0,
+    SEARCH_TRACK,       /* only the file specific to the track */
+    SEARCH_ALBUM,       /* everything but the file specific to the track */
+};
+
+static bool search_files(const struct mp3entry *id3, const char *size_string,
+                         char *buf, int buflen, enum search_what what)
 {
     char path[MAX_PATH + 1];
     char dir[MAX_PATH + 1];
@@ -166,13 +179,16 @@ bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
         track_first = 0;
     }
 
+    if (what != SEARCH_ALL)
+        track_first = 1;
+
     strip_filename(dir, sizeof(dir), trackname);
     dirlen = strlen(dir);
     albumlen = id3->album ? strlen(id3->album) : 0;
 
     for(pass = 0; pass < 2 - track_first; pass++)
     {
-        if (track_first || pass)
+        if ((track_first || pass) && what != SEARCH_ALBUM)
         {
             /* the first file we look for is one specific to the
                current track */
@@ -185,7 +201,7 @@ bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
 #endif
             found = try_exts(path, pathlen);
         }
-        if (pass)
+        if (pass || what == SEARCH_TRACK)
             break;
         if (!found && albumlen > 0)
         {
@@ -271,7 +287,83 @@ bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
     return true;
 }
 
+/* Look for the first matching album art bitmap, see search_files() */
+bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
+                           char *buf, int buflen)
+{
+    return search_files(id3, size_string, buf, buflen, SEARCH_ALL);
+}
+
 #ifndef PLUGIN
+/* Results of the album level searches, so that the tracks of an album don't
+ * probe all the candidate names again. An empty path means there is no album
+ * art. The file specific to a track is still looked for every time. */
+#define SEARCH_CACHE_SIZE 8
+
+static struct search_cache_entry
+{
+    uint32_t key;                   /* 0 if unused */
+    char path[MAX_PATH];
+} search_cache[SEARCH_CACHE_SIZE];
+static int search_cache_next;
+
+static uint32_t search_cache_key(const struct mp3entry *id3,
+                                 const char *size_string)
+{
+    const char *artist = id3->albumartist ?: id3->artist;
+    const char *file = strrchr(id3->path, '/');
+    uint32_t key = 0xffffffff;
+
+    /* Everything the album level search depends on */
+    if (file)
+        key = crc_32(id3->path, file - id3->path, key);
+    if (id3->album)
+        key = crc_32(id3->album, strlen(id3->album) + 1, key);
+    if (artist)
+        key = crc_32(artist, strlen(artist) + 1, key);
+    key = crc_32(size_string, strlen(size_string), key);
+
+    return key ?: 1;
+}
+
+static bool search_album_cached(const struct mp3entry *id3,
+                                const char *size_string, char *buf, int buflen)
+{
+    uint32_t key = search_cache_key(id3, size_string);
+    struct search_cache_entry *e;
+    bool found;
+    int i;
+
+    for (i = 0; i < SEARCH_CACHE_SIZE; i++)
+    {
+        e = &search_cache[i];
+        if (e->key == key)
+        {
+            logf("Album art search cached: %s", e->path);
+            if (!e->path[0])
+                return false;
+            strlcpy(buf, e->path, buflen);
+            return true;
+        }
+    }
+
+    found = search_files(id3, size_string, buf, buflen, SEARCH_ALBUM);
+
+    e = &search_cache[search_cache_next];
+    search_cache_next = (search_cache_next + 1) % SEARCH_CACHE_SIZE;
+    e->key = key;
+    strlcpy(e->path, found ? buf : "", sizeof(e->path));
+
+    return found;
+}
+
+/* Forget the search results, called when playback starts so that album art
+ * added in the meantime is found */
+void albumart_clear_search_cache(void)
+{
+    memset(search_cache, 0, sizeof(search_cache));
+}
+
 /* Look for albumart bitmap in the same dir as the track and in its parent dir.
  * Stores the found filename in the buf parameter.
  * Returns true if a bitmap was found, false otherwise */
@@ -289,12 +381,266 @@ bool find_albumart(const struct mp3entry *id3, char *buf, int buflen,
               dim->width, dim->height);
 
     /* First we look for a bitmap of the right size */
-    if (search_albumart_files(id3, size_string, buf, buflen))
+    if (search_files(id3, size_string, buf, buflen, SEARCH_TRACK) ||
+        search_album_cached(id3, size_string, buf, buflen))
         return true;
 
     /* Then we look for generic bitmaps */
     *size_string = 0;
-    return search_albumart_files(id3, size_string, buf, buflen);
+    return search_files(id3, size_string, buf, buflen, SEARCH_TRACK) ||
+           search_album_cached(id3, size_string, buf, buflen);
+}
+
+/* Decoded and scaled album art is kept in ALBUMART_CACHE_DIR, so that it can
+ * be loaded with a single read the next time. The file is picked by a hash of
+ * the source and the size; the header tells whether it really holds the
+ * wanted image. A fixed number of slots bounds the disk space used. */
+#define ALBUMART_CACHE_SLOTS 256
+#define ALBUMART_CACHE_MAGIC (0x41414302 + (LCD_DEPTH << 8))
+
+/* New images are written when the disk is idle, straight from their
+   buffering handles. This many at most can wait. */
+#define ALBUMART_CACHE_PENDING 4
+
+struct albumart_cache_header
+{
+    uint32_t magic;
+    uint32_t key[2];
+    int32_t  width;
+    int32_t  height;
+    int32_t  format;
+    int32_t  alpha_offset;
+    int32_t  size;
+};
+
+/* images waiting to be written, hid 0 marks a free slot */
+static struct
+{
+    uint32_t key[2];
+    int hid;
+} cache_pending[ALBUMART_CACHE_PENDING];
+
+/* Two independent hashes of the source file, its size and time stamp, the
+   embedded image position and the wanted size */
+void albumart_cache_key(int fd, const char *path,
+                        const struct mp3_albumart *aa,
+                        const struct dim *dim, uint32_t key[2])
+{
+    struct
+    {
+        int32_t  filesize;
+        uint32_t mtime;
+        int32_t  pos;
+        int32_t  size;
+        int32_t  width;
+        int32_t  height;
+    } src =
+    {
+        .filesize = filesize(fd),
+        .mtime    = filemtime(fd),
+        .pos      = aa ? aa->pos : 0,
+        .size     = aa ? aa->size : 0,
+        .width    = dim->width,
+        .height   = dim->height,
+    };
+    const unsigned char *p;
+    size_t len = strlen(path);
+    uint32_t fnv = 2166136261u;
+
+    key[0] = crc_32(path, len, 0xffffffff);
+    key[0] = crc_32(&src, sizeof(src), key[0]);
+
+    for (p = (const unsigned char *)path; len--; p++)
+        fnv = (fnv ^ *p) * 16777619u;
+    for (p = (const unsigned char *)&src; p < (const unsigned char *)(&src + 1); p++)
+        fnv = (fnv ^ *p) * 16777619u;
+    key[1] = fnv;
+}
+
+static void albumart_cache_file(char *buf, size_t bufsize,
+                                const uint32_t key[2])
+{
+    snprintf(buf, bufsize, ALBUMART_CACHE_DIR "/%02x.bmc",
+             (unsigned)(key[0] % ALBUMART_CACHE_SLOTS));
+}
+
+static void cache_header_to_bitmap(const struct albumart_cache_header *hdr,
+                                   struct bitmap *bm)
+{
+    bm->width = hdr->width;
+    bm->height = hdr->height;
+#if (LCD_DEPTH > 1) || defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1)
+    bm->format = hdr->format;
+#endif
+#ifdef HAVE_LCD_COLOR
+    bm->alpha_offset = hdr->alpha_offset;
+#endif
+}
+
+/* Load the image into bm->data, which has room for maxsize bytes. Returns the
+   size of the data like read_bmp_fd(), or -1 if the image isn't cached. */
+int albumart_cache_load(const uint32_t key[2], struct bitmap *bm, int maxsize)
+{
+    struct albumart_cache_header hdr;
+    char file[MAX_PATH];
+    int i, cfd, rc = -1;
+
+    for (i = 0; i < ALBUMART_CACHE_PENDING; i++)
+    {
+        /* Not written yet, copy it from the other handle */
+        struct bitmap *p;
+        ssize_t size;
+
+        if (!cache_pending[i].hid ||
+            cache_pending[i].key[0] != key[0] ||
+            cache_pending[i].key[1] != key[1])
+            continue;
+
+        size = bufgetdata(cache_pending[i].hid, 0, (void **)&p);
+        size -= sizeof(*p);
+        if (size <= 0 || size > maxsize)
+            return -1;
+
+        memcpy(bm->data, p->data, size);
+        bm->width = p->width;
+        bm->height = p->height;
+#if (LCD_DEPTH > 1) || defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1)
+        bm->format = p->format;
+#endif
+#ifdef HAVE_LCD_COLOR
+        bm->alpha_offset = p->alpha_offset;
+#endif
+        return size;
+    }
+
+    albumart_cache_file(file, sizeof(file), key);
+
+    cfd = open(file, O_RDONLY);
+    if (cfd < 0)
+        return -1;
+
+    if (read(cfd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+        hdr.magic == ALBUMART_CACHE_MAGIC &&
+        hdr.key[0] == key[0] && hdr.key[1] == key[1] &&
+        hdr.size > 0 && hdr.size <= maxsize &&
+        read(cfd, bm->data, hdr.size) == hdr.size)
+    {
+        cache_header_to_bitmap(&hdr, bm);
+        rc = hdr.size;
+        logf("Album art from cache: %s", file);
+    }
+
+    close(cfd);
+    return rc;
+}
+
+/* Write an image to its slot, returns the slot's file name or NULL */
+static const char *albumart_cache_write(const uint32_t key[2],
+                                        const struct bitmap *bm, int size,
+                                        char *file, size_t bufsize)
+{
+    struct albumart_cache_header hdr;
+    int cfd;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = ALBUMART_CACHE_MAGIC;
+    hdr.key[0] = key[0];
+    hdr.key[1] = key[1];
+    hdr.width = bm->width;
+    hdr.height = bm->height;
+#if (LCD_DEPTH > 1) || defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1)
+    hdr.format = bm->format;
+#endif
+#ifdef HAVE_LCD_COLOR
+    hdr.alpha_offset = bm->alpha_offset;
+#endif
+    hdr.size = size;
+
+    albumart_cache_file(file, bufsize, key);
+
+    cfd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (cfd < 0)
+    {
+        mkdir(ALBUMART_CACHE_DIR);
+        cfd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+        if (cfd < 0)
+            return NULL;
+    }
+
+    if (write(cfd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        write(cfd, bm->data, size) != size)
+    {
+        close(cfd);
+        remove(file);
+        return NULL;
+    }
+
+    close(cfd);
+    return file;
+}
+
+static void albumart_cache_flush_callback(void)
+{
+    char file[MAX_PATH];
+    int i;
+
+    for (i = 0; i < ALBUMART_CACHE_PENDING; i++)
+    {
+        int hid = cache_pending[i].hid;
+        struct bitmap *bm;
+        ssize_t size;
+
+        if (!hid)
+            continue;
+
+        /* A store arriving meanwhile takes a new slot */
+        cache_pending[i].hid = 0;
+
+        /* Pinned, the image stays where it is while it is written. The
+           track may still be dropped meanwhile, then the file could hold
+           anything and goes. */
+        if (!buf_pin_handle(hid, true))
+            continue;
+
+        size = bufgetdata(hid, 0, (void **)&bm) - sizeof(*bm);
+        if (size > 0 &&
+            albumart_cache_write(cache_pending[i].key, bm, size,
+                                 file, sizeof(file)) &&
+            !buf_is_handle(hid))
+            remove(file);
+
+        buf_pin_handle(hid, false);
+    }
+}
+
+/* Store an image as decoded by read_bmp_fd() and friends, once it is in the
+   buffering handle hid. It is written from there when the disk is idle, so
+   that buffering isn't held up and no memory is needed for a copy. */
+void albumart_cache_store(const uint32_t key[2], int hid)
+{
+    int i, slot = -1;
+
+    for (i = 0; i < ALBUMART_CACHE_PENDING; i++)
+    {
+        if (!cache_pending[i].hid)
+        {
+            slot = i;
+            continue;
+        }
+
+        if (cache_pending[i].key[0] == key[0] &&
+            cache_pending[i].key[1] == key[1])
+            return;
+    }
+
+    /* The image is simply decoded again the next time */
+    if (slot < 0)
+        return;
+
+    cache_pending[slot].key[0] = key[0];
+    cache_pending[slot].key[1] = key[1];
+    cache_pending[slot].hid = hid;
+    register_storage_idle_func(albumart_cache_flush_callback);
 }
 
 /* Draw the album art bitmap from the given handle ID onto the given WPS.
@@ -39,6 +39,19 @@ bool find_albumart(const struct mp3entry *id3, char *buf, int buflen,
 /* Draw the album art bitmap from the given handle ID onto the given Skin.
    Call with clear = true to clear the bitmap instead of drawing it. */
 void draw_album_art(struct gui_wps *gwps, int handle_id, bool clear);
+
+/* Forget the remembered results of find_albumart() */
+void albumart_clear_search_cache(void);
+
+/* Disk cache of decoded and scaled album art, keyed by the source file (and
+ * embedded image) and the wanted size. albumart_cache_load() returns the data
+ * size like read_bmp_fd(), or -1 if the image isn't cached.
+ * albumart_cache_store() takes the image from its buffering handle later. */
+void albumart_cache_key(int fd, const char *path,
+                        const struct mp3_albumart *aa, const struct dim *dim,
+                        uint32_t key[2]);
+int albumart_cache_load(const uint32_t key[2], struct bitmap *bm, int maxsize);
+void albumart_cache_store(const uint32_t key[2], int hid);
 #endif
 
 bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
@@ -1048,6 +1048,9 @@ void settings_apply(bool read_disk)
     }
 
     dsp_dither_enable(global_settings.dithering_enabled);
+#ifdef HAVE_SINC_RESAMPLER
+    dsp_set_resample_quality(global_settings.resample_quality);
+#endif
     dsp_surround_set_balance(global_settings.surround_balance);
     dsp_surround_set_cutoff(global_settings.surround_fx1, global_settings.surround_fx2);
     dsp_surround_mix(global_settings.surround_mix);
@@ -862,6 +862,9 @@ struct user_settings
     int governor;
     int usb_mode;
 #endif
+#ifdef HAVE_SINC_RESAMPLER
+    int  resample_quality;  /* enum resample_quality */
+#endif
 };
 
 /** global variables **/
@@ -1689,6 +1689,13 @@ const struct settings_list settings[] = {
     /* dithering */
     OFFON_SETTING(F_SOUNDSETTING, dithering_enabled, LANG_DITHERING, false,
                   "dithering enabled", dsp_dither_enable),
+#ifdef HAVE_SINC_RESAMPLER
+    /* resampler */
+    CHOICE_SETTING(F_SOUNDSETTING, resample_quality, LANG_RESAMPLE_QUALITY,
+                   RESAMPLE_QUALITY_HIGH, "resample quality", "normal,high",
+                   dsp_set_resample_quality, 2,
+                   ID2P(LANG_NORMAL), ID2P(LANG_HIGH)),
+#endif
     /* surround */
     TABLE_SETTING(F_SOUNDSETTING, surround_enabled,
                   LANG_SURROUND, 0, "surround enabled", "off",
@@ -88,6 +88,10 @@
 #include "eeprom_settings.h"
 #endif
 
+#ifdef TAGCACHE_PARSE_THREADS
+#include <pthread.h>
+#endif
+
 #undef HAVE_DIRCACHE
 
 #ifdef __PCTOOL__
@@ -203,6 +207,61 @@ static const char * const index_entry_ec     = "lllllllllllllllllllllll";
 static const char * const tagcache_header_ec = "lll";
 static const char * const master_header_ec   = "llllll";
 
+/**
+ * Filename hash index, an open addressed table of the crc_32 of each
+ * filename and its index entry. Built by commit() and valid as long as the
+ * master index has the same size.
+ */
+struct filename_hash_header {
+    int32_t magic;          /* Header version number */
+    int32_t master_entries; /* Entries of the master index when built */
+    int32_t master_size;    /* Data size of the master index when built */
+    int32_t slots;          /* Number of slots following */
+};
+
+struct filename_hash_slot {
+    uint32_t crc;           /* crc_32 of the filename */
+    int32_t idx_id;         /* Index entry, -1 for an empty slot */
+};
+
+static const char * const filename_hash_header_ec = "llll";
+static const char * const filename_hash_slot_ec   = "ll";
+
+/**
+ * Numeric indices, the (value, index entry) pairs of all entries sorted by
+ * the value of a numeric tag, for range clauses. Built by commit() like the
+ * filename hash. Entries changed at runtime are kept in a small list and
+ * checked in addition to the index range until the next rebuild.
+ */
+struct numindex_header {
+    int32_t magic;          /* Header version number */
+    int32_t master_entries; /* Entries of the master index when built */
+    int32_t master_size;    /* Data size of the master index when built */
+    int32_t dirty;          /* Entries have changed since it was built */
+    int32_t count;          /* Number of entries following */
+};
+
+struct numindex_entry {
+    int32_t value;          /* Tag value */
+    int32_t idx_id;         /* Index entry */
+};
+
+static const char * const numindex_header_ec = "lllll";
+static const char * const numindex_entry_ec  = "ll";
+
+/* Tags having a numeric index. */
+static const unsigned char numindex_tags[] = {
+    tag_year, tag_rating, tag_playcount, tag_lastplayed
+};
+
+static struct numindex_state {
+    bool valid;             /* Index file usable for searches */
+    bool dirty;             /* Dirty flag written to the file */
+    int32_t count;          /* Entries in the file */
+    int changed_count;      /* Entries changed since the index was built */
+    int32_t changed[TAGCACHE_NUMINDEX_CHANGES];
+} numindex[ARRAYLEN(numindex_tags)];
+
 static struct master_header current_tcmh;
 
 #ifdef HAVE_TC_RAMCACHE
@@ -210,6 +269,8 @@ static struct master_header current_tcmh;
 struct ramcache_header {
     char *tags[TAG_COUNT];       /* Tag file content (not including filename tag) */
     int entry_count[TAG_COUNT];  /* Number of entries in the indices. */
+    struct filename_hash_slot *filename_hash; /* Filename hash, if loaded */
+    int filename_hash_slots;     /* Number of slots in filename_hash */
     struct index_entry indices[0]; /* Master index file content */
 };
 
@@ -258,6 +319,11 @@ static struct tempbuf_searchidx **lookup;
 
 /* Used when building the temporary file. */
 static int cachefd = -1, filenametag_fd;
+
+/* Filename hash and master index kept open along with filenametag_fd. */
+static bool hash_session;
+static int hashfd = -1, lookup_masterfd = -1;
+static struct filename_hash_header hash_hdr;
 static int total_entry_count = 0;
 static int data_size = 0;
 static int processed_dir_count;
@@ -267,6 +333,12 @@ static volatile int write_lock;
 static volatile int read_lock;
 
 static bool delete_entry(long idx_id);
+static bool get_index(int masterfd, int idxid,
+                      struct index_entry *idx, bool use_ram);
+static int current_dir_sig(void);
+static void dir_sig_failed(int slot);
+static void allocate_tempbuf(void);
+static void free_tempbuf(void);
 
 const char* tagcache_tag_to_str(int tag)
 {
@@ -436,6 +508,519 @@ static long find_entry_ram(const char *filename, int dc)
 }
 #endif
 
+static bool filename_hash_valid(const struct filename_hash_header *hdr,
+                                const struct master_header *tcmh)
+{
+    return hdr->magic == TAGCACHE_MAGIC && hdr->slots > 0
+        && hdr->master_entries == tcmh->tch.entry_count
+        && hdr->master_size == tcmh->tch.datasize;
+}
+
+/* Check the filename of a hash candidate from the tag file. */
+static bool filename_hash_match(int masterfd, int fd, int idx_id,
+                                const char *filename)
+{
+    struct index_entry idx;
+    struct tagfile_entry tfe;
+    char buf[TAG_MAXLEN+32];
+
+    /* Fails for deleted entries */
+    if (!get_index(masterfd, idx_id, &idx, true))
+        return false;
+
+    lseek(fd, idx.tag_seek[tag_filename], SEEK_SET);
+    if (ecread_tagfile_entry(fd, &tfe) != sizeof(struct tagfile_entry)
+        || tfe.tag_length >= (long)sizeof(buf)
+        || read(fd, buf, tfe.tag_length) != tfe.tag_length)
+    {
+        logf("filename hash: read error");
+        return false;
+    }
+
+    return !strcmp(filename, buf);
+}
+
+/* Open the filename hash and check it against the master index header. */
+static int open_filename_hash(struct filename_hash_header *hdr,
+                              const struct master_header *tcmh)
+{
+    int fd = open(TAGCACHE_FILE_HASH, O_RDONLY);
+
+    if (fd < 0)
+        return -1;
+
+    if (ecread(fd, hdr, 1, filename_hash_header_ec, tc_stat.econ)
+            != sizeof(struct filename_hash_header)
+        || !filename_hash_valid(hdr, tcmh))
+    {
+        logf("filename hash out of date");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Open the hash and master index for the lookups done while filenametag_fd
+ * is held open, so they aren't reopened for every file of a scan. */
+static void open_filename_hash_session(void)
+{
+    struct master_header tcmh;
+
+    hash_session = true;
+    if ( (lookup_masterfd = open_master_fd(&tcmh, false)) < 0)
+        return ;
+
+    hashfd = open_filename_hash(&hash_hdr, &tcmh);
+}
+
+static void close_filename_hash_session(void)
+{
+    if (hashfd >= 0)
+        close(hashfd);
+    if (lookup_masterfd >= 0)
+        close(lookup_masterfd);
+    hashfd = lookup_masterfd = -1;
+    hash_session = false;
+}
+
+/* Probe the on-disk hash from the home slot, a few slots per read. */
+static long probe_filename_hash(int fd, const struct filename_hash_header *hdr,
+                                int masterfd, int tagfd, uint32_t crc,
+                                const char *filename)
+{
+    struct filename_hash_slot slots[16];
+    long idx_id = -1;
+    int i, n, count;
+
+    i = crc % hdr->slots;
+    for (count = 0; count < hdr->slots && idx_id < 0; )
+    {
+        int len = MIN((int)ARRAYLEN(slots), hdr->slots - i);
+
+        lseek(fd, sizeof(struct filename_hash_header)
+                  + i * sizeof(struct filename_hash_slot), SEEK_SET);
+        if (ecread(fd, slots, len, filename_hash_slot_ec, tc_stat.econ)
+                != (ssize_t)(len * sizeof(struct filename_hash_slot)))
+        {
+            logf("filename hash: read error");
+            return -2;
+        }
+
+        for (n = 0; n < len && count < hdr->slots; n++, count++)
+        {
+            if (slots[n].idx_id < 0)
+            {
+                count = hdr->slots; /* End of the chain */
+                break;
+            }
+
+            if (slots[n].crc == crc
+                && filename_hash_match(masterfd, tagfd, slots[n].idx_id,
+                                       filename))
+            {
+                idx_id = slots[n].idx_id;
+                break;
+            }
+        }
+
+        i = (i + len) % hdr->slots;
+    }
+
+    return idx_id;
+}
+
+/* Look up a filename in the hash index. Returns its index entry, -1 if the
+ * file isn't in the db, or -2 if there is no usable hash. */
+static long find_entry_hash(const char *filename, int tagfd)
+{
+    struct filename_hash_header hdr;
+    uint32_t crc = crc_32(filename, strlen(filename), 0xffffffff);
+    long idx_id;
+    int fd;
+
+#ifdef HAVE_TC_RAMCACHE
+    if (tc_stat.ramcache && ramcache_hdr->filename_hash != NULL)
+    {
+        int i, n, count;
+
+        /* Filenames aren't kept in ram, candidates are checked on disk.
+         * The table may move while reading so don't keep pointers to it. */
+        count = ramcache_hdr->filename_hash_slots;
+        for (i = crc % count, n = 0; n < count; n++, i = (i + 1) % count)
+        {
+            struct filename_hash_slot slot = ramcache_hdr->filename_hash[i];
+
+            if (slot.idx_id < 0)
+                break;
+
+            if (slot.crc == crc
+                && filename_hash_match(-1, tagfd, slot.idx_id, filename))
+                return slot.idx_id;
+        }
+
+        return -1;
+    }
+#endif
+
+    if (hash_session && tagfd == filenametag_fd)
+    {
+        if (hashfd < 0)
+            return -2;
+
+        return probe_filename_hash(hashfd, &hash_hdr, lookup_masterfd, tagfd,
+                                   crc, filename);
+    }
+
+    if ( (fd = open_filename_hash(&hdr, &current_tcmh)) < 0)
+        return -2;
+
+    idx_id = probe_filename_hash(fd, &hdr, -1, tagfd, crc, filename);
+    close(fd);
+
+    return idx_id;
+}
+
+/* Build the filename hash index of the committed db in tempbuf. */
+static void build_filename_hash(const struct master_header *tcmh)
+{
+    struct filename_hash_header hdr;
+    struct filename_hash_slot *table = (struct filename_hash_slot *)tempbuf;
+    struct tagcache_header tch;
+    struct tagfile_entry tfe;
+    char buf[TAG_MAXLEN+32];
+    int fd, i;
+
+    remove(TAGCACHE_FILE_HASH);
+
+    /* Keep the table at most 2/3 full. */
+    hdr.magic = TAGCACHE_MAGIC;
+    hdr.master_entries = tcmh->tch.entry_count;
+    hdr.master_size = tcmh->tch.datasize;
+    hdr.slots = tcmh->tch.entry_count + tcmh->tch.entry_count / 2 + 1;
+    if (hdr.slots * sizeof(struct filename_hash_slot) > tempbuf_size)
+    {
+        logf("no room for the filename hash");
+        return ;
+    }
+
+    memset(table, 0xff, hdr.slots * sizeof(struct filename_hash_slot));
+
+    if ( (fd = open_tag_fd(&tch, tag_filename, false)) < 0)
+        return ;
+
+    while (ecread_tagfile_entry(fd, &tfe) == sizeof(struct tagfile_entry))
+    {
+        if (tfe.tag_length >= (long)sizeof(buf)
+            || read(fd, buf, tfe.tag_length) != tfe.tag_length)
+        {
+            logf("filename hash: read error");
+            close(fd);
+            return ;
+        }
+
+        /* Deleted entries have their filename cleared. */
+        if (*buf == '\0')
+            continue;
+
+        uint32_t crc = crc_32(buf, strlen(buf), 0xffffffff);
+        for (i = crc % hdr.slots; table[i].idx_id >= 0; i = (i + 1) % hdr.slots)
+            ;
+
+        table[i].crc = crc;
+        table[i].idx_id = tfe.idx_id;
+
+        do_timed_yield();
+    }
+    close(fd);
+
+    fd = open(TAGCACHE_FILE_HASH, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        logf("%s open fail", TAGCACHE_FILE_HASH);
+        return ;
+    }
+
+    if (ecwrite(fd, &hdr, 1, filename_hash_header_ec, tc_stat.econ)
+            != sizeof(struct filename_hash_header)
+        || ecwrite(fd, table, hdr.slots, filename_hash_slot_ec, tc_stat.econ)
+            != (ssize_t)(hdr.slots * sizeof(struct filename_hash_slot)))
+    {
+        logf("filename hash: write error");
+        close(fd);
+        remove(TAGCACHE_FILE_HASH);
+        return ;
+    }
+    close(fd);
+
+    logf("filename hash: %ld slots", (long)hdr.slots);
+}
+
+/* Check the filename hash and rebuild it if it is missing or out of date,
+ * e.g. for a db created by an older version. */
+static void check_filename_hash(void)
+{
+    struct filename_hash_header hdr;
+    struct master_header tcmh;
+    bool local_allocation = false;
+    int fd;
+
+    if ( (fd = open_master_fd(&tcmh, false)) < 0)
+        return ;
+    close(fd);
+
+    if ( (fd = open_filename_hash(&hdr, &tcmh)) >= 0)
+    {
+        close(fd);
+        return ;
+    }
+
+    /* A stale hash is never used, don't leave it to be checked on every
+     * lookup. */
+    remove(TAGCACHE_FILE_HASH);
+    if (tcmh.dirty)
+        return ;
+
+    if (tempbuf_size == 0)
+    {
+        allocate_tempbuf();
+        local_allocation = true;
+    }
+
+    build_filename_hash(&tcmh);
+
+    if (local_allocation)
+        free_tempbuf();
+}
+
+static int numindex_compare(const void *p1, const void *p2)
+{
+    const struct numindex_entry *e1 = p1;
+    const struct numindex_entry *e2 = p2;
+
+    if (e1->value != e2->value)
+        return e1->value < e2->value ? -1 : 1;
+
+    return e1->idx_id - e2->idx_id;
+}
+
+static int open_numindex(int n, struct numindex_header *hdr, int flags)
+{
+    char fn[MAX_PATH];
+    int fd;
+
+    snprintf(fn, sizeof fn, TAGCACHE_FILE_NUMINDEX, numindex_tags[n]);
+    fd = open(fn, flags);
+    if (fd < 0)
+        return -1;
+
+    if (ecread(fd, hdr, 1, numindex_header_ec, tc_stat.econ)
+            != sizeof(struct numindex_header)
+        || hdr->magic != TAGCACHE_MAGIC)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Build the numeric index of one tag of the committed db in tempbuf. */
+static void build_numindex(int n, const struct master_header *tcmh)
+{
+    struct numindex_header hdr;
+    struct numindex_entry *entries = (struct numindex_entry *)tempbuf;
+    struct master_header myhdr;
+    struct index_entry idx;
+    char fn[MAX_PATH];
+    int fd, i;
+
+    snprintf(fn, sizeof fn, TAGCACHE_FILE_NUMINDEX, numindex_tags[n]);
+    remove(fn);
+
+    if (tcmh->tch.entry_count * sizeof(struct numindex_entry) > tempbuf_size)
+    {
+        logf("no room for numeric index %d", numindex_tags[n]);
+        return ;
+    }
+
+    if ( (fd = open_master_fd(&myhdr, false)) < 0)
+        return ;
+
+    hdr.magic = TAGCACHE_MAGIC;
+    hdr.master_entries = tcmh->tch.entry_count;
+    hdr.master_size = tcmh->tch.datasize;
+    hdr.dirty = 0;
+    hdr.count = 0;
+
+    for (i = 0; i < tcmh->tch.entry_count; i++)
+    {
+        if (ecread_index_entry(fd, &idx) != sizeof(struct index_entry))
+        {
+            logf("numeric index: read error");
+            close(fd);
+            return ;
+        }
+
+        if (idx.flag & FLAG_DELETED)
+            continue;
+
+        entries[hdr.count].value = idx.tag_seek[numindex_tags[n]];
+        entries[hdr.count].idx_id = i;
+        hdr.count++;
+
+        do_timed_yield();
+    }
+    close(fd);
+
+    qsort(entries, hdr.count, sizeof(struct numindex_entry), numindex_compare);
+
+    fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        logf("%s open fail", fn);
+        return ;
+    }
+
+    if (ecwrite(fd, &hdr, 1, numindex_header_ec, tc_stat.econ)
+            != sizeof(struct numindex_header)
+        || ecwrite(fd, entries, hdr.count, numindex_entry_ec, tc_stat.econ)
+            != (ssize_t)(hdr.count * sizeof(struct numindex_entry)))
+    {
+        logf("numeric index: write error");
+        close(fd);
+        remove(fn);
+        return ;
+    }
+    close(fd);
+
+    logf("numeric index %d: %ld entries", numindex_tags[n], (long)hdr.count);
+}
+
+static bool numindex_usable(const struct numindex_header *hdr,
+                            const struct master_header *tcmh)
+{
+    return !hdr->dirty
+        && hdr->master_entries == tcmh->tch.entry_count
+        && hdr->master_size == tcmh->tch.datasize;
+}
+
+/* Rebuild the numeric indices that are missing or out of date. */
+static void check_numindices(void)
+{
+    struct numindex_header hdr;
+    struct master_header tcmh;
+    int fd, n;
+
+    if (tempbuf_size == 0)
+        return ;
+
+    if ( (fd = open_master_fd(&tcmh, false)) < 0)
+        return ;
+    close(fd);
+
+    if (tcmh.dirty)
+        return ;
+
+    for (n = 0; n < (int)ARRAYLEN(numindex_tags); n++)
+    {
+        bool valid = false;
+
+        if ( (fd = open_numindex(n, &hdr, O_RDONLY)) >= 0)
+        {
+            valid = numindex_usable(&hdr, &tcmh);
+            close(fd);
+        }
+
+        if (!valid)
+            build_numindex(n, &tcmh);
+    }
+}
+
+/* Load the state of the numeric indices for the current db. */
+static void load_numindices(void)
+{
+    struct numindex_header hdr;
+    int fd, n;
+
+    for (n = 0; n < (int)ARRAYLEN(numindex_tags); n++)
+    {
+        struct numindex_state *state = &numindex[n];
+
+        state->valid = false;
+        state->dirty = false;
+        state->count = 0;
+        state->changed_count = 0;
+
+        if ( (fd = open_numindex(n, &hdr, O_RDONLY)) < 0)
+            continue;
+        close(fd);
+
+        if (numindex_usable(&hdr, &current_tcmh))
+        {
+            state->valid = true;
+            state->count = hdr.count;
+        }
+    }
+}
+
+#ifndef __PCTOOL__
+/* Keep track of entries whose indexed tags change after the indices were
+ * built. The dirty flag is written to the file before the first change so
+ * a crash can't leave a stale index behind. */
+static void numindex_update(int idx_id, const struct index_entry *old,
+                            const struct index_entry *idx)
+{
+    struct numindex_header hdr;
+    int fd, n, i;
+
+    for (n = 0; n < (int)ARRAYLEN(numindex_tags); n++)
+    {
+        struct numindex_state *state = &numindex[n];
+        int tag = numindex_tags[n];
+
+        if (!state->valid || old->tag_seek[tag] == idx->tag_seek[tag])
+            continue;
+
+        if (!state->dirty)
+        {
+            state->dirty = true;
+            if ( (fd = open_numindex(n, &hdr, O_RDWR)) >= 0)
+            {
+                hdr.dirty = 1;
+                lseek(fd, 0, SEEK_SET);
+                if (ecwrite(fd, &hdr, 1, numindex_header_ec, tc_stat.econ)
+                        != sizeof(struct numindex_header))
+                {
+                    state->valid = false;
+                }
+                close(fd);
+            }
+            else
+                state->valid = false;
+        }
+
+        for (i = 0; i < state->changed_count; i++)
+        {
+            if (state->changed[i] == idx_id)
+                break;
+        }
+
+        if (i < state->changed_count)
+            continue;
+
+        if (state->changed_count == TAGCACHE_NUMINDEX_CHANGES)
+        {
+            logf("numeric index %d: too many changes", tag);
+            state->valid = false;
+            continue;
+        }
+
+        state->changed[state->changed_count++] = idx_id;
+    }
+}
+#endif /* !__PCTOOL__ */
+
 static long find_entry_disk(const char *filename_raw, bool localfd)
 {
     struct tagcache_header tch;
@@ -467,6 +1052,15 @@ static long find_entry_disk(const char *filename_raw, bool localfd)
             return -1;
     }
     
+    /* The hash index is authoritative when it is up to date. */
+    pos = find_entry_hash(filename, fd);
+    if (pos != -2)
+    {
+        if (fd != filenametag_fd || localfd)
+            close(fd);
+        return pos >= 0 ? pos : -4;
+    }
+    
     check_again:
     
     if (last_pos > 0)
@@ -638,6 +1232,9 @@ static bool get_index(int masterfd, int idxid,
 
 static bool write_index(int masterfd, int idxid, struct index_entry *idx)
 {
+    struct index_entry old;
+    int n;
+
     /* We need to exclude all memory only flags & tags when writing to disk. */
     if (idx->flag & FLAG_DIRCACHE)
     {
@@ -645,6 +1242,18 @@ static bool write_index(int masterfd, int idxid, struct index_entry *idx)
         return false;
     }
     
+    /* Note the changes of indexed numeric tags. */
+    for (n = 0; n < (int)ARRAYLEN(numindex_tags) && !numindex[n].valid; n++)
+        ;
+
+    if (n < (int)ARRAYLEN(numindex_tags))
+    {
+        lseek(masterfd, idxid * sizeof(struct index_entry)
+              + sizeof(struct master_header), SEEK_SET);
+        if (ecread_index_entry(masterfd, &old) == sizeof(struct index_entry))
+            numindex_update(idxid, &old, idx);
+    }
+
 #ifdef HAVE_TC_RAMCACHE
     /* Only update numeric data. Writing the whole index to RAM by memcpy
      * destroys dircache pointers!
@@ -1116,38 +1725,320 @@ bool tagcache_check_clauses(struct tagcache_search *tcs,
     return check_clauses(tcs, &idx, clause, count);
 }
 
-static bool add_uniqbuf(struct tagcache_search *tcs, unsigned long id)
+static bool add_uniqbuf(struct tagcache_search *tcs, unsigned long id)
+{
+    int i;
+    
+    /* If uniq buffer is not defined we must return true for search to work. */
+    if (tcs->unique_list == NULL || (!TAGCACHE_IS_UNIQUE(tcs->type)
+                                     && !TAGCACHE_IS_NUMERIC(tcs->type)))
+    {
+        return true;
+    }
+    
+    for (i = 0; i < tcs->unique_list_count; i++)
+    {
+        /* Return false if entry is found. */
+        if (tcs->unique_list[i] == id)
+            return false;
+    }
+    
+    if (tcs->unique_list_count < tcs->unique_list_capacity)
+    {
+        tcs->unique_list[i] = id;
+        tcs->unique_list_count++;
+    }
+    
+    return true;
+}
+
+#ifndef __PCTOOL__
+/* Description of the last query plan, for the debug screen. */
+static char last_plan[48];
+
+const char* tagcache_get_last_plan(void)
+{
+    return last_plan;
+}
+
+static int numindex_find(int tag)
+{
+    int i;
+
+    for (i = 0; i < (int)ARRAYLEN(numindex_tags); i++)
+    {
+        if (numindex_tags[i] == tag)
+            return i;
+    }
+
+    return -1;
+}
+
+/* Find the first entry of a numeric index with a value above (after set)
+ * or not below the given one. */
+static int numindex_bound(int fd, int count, long value, bool after)
+{
+    struct numindex_entry entry;
+    int lo = 0, hi = count;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        lseek(fd, sizeof(struct numindex_header)
+                  + mid * sizeof(struct numindex_entry), SEEK_SET);
+        if (ecread(fd, &entry, 1, numindex_entry_ec, tc_stat.econ)
+                != sizeof(struct numindex_entry))
+            return -1;
+
+        if (entry.value < value || (after && entry.value == value))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Choose between scanning the master index and scanning a range of one of
+ * the numeric indices, whichever has to look at fewer entries. Only range
+ * clauses every result must satisfy can narrow the search, so anything
+ * with a logical-or is a full scan. */
+static void plan_search(struct tagcache_search *tcs)
+{
+    struct numindex_header hdr;
+    long best_lo = 0, best_hi = 0;
+    int best_rows = current_tcmh.tch.entry_count / 4;
+    int i, n;
+
+    tcs->planned = true;
+    tcs->plan_tag = -1;
+    tcs->plan_fd = -1;
+
+    for (i = 0; i < tcs->clause_count; i++)
+    {
+        if (tcs->clause[i]->type == clause_logical_or)
+            break;
+    }
+
+    for (n = 0; n < (int)ARRAYLEN(numindex_tags)
+                && i == tcs->clause_count; n++)
+    {
+        long lo = INT32_MIN, hi = INT32_MAX;
+        bool usable = false;
+        int j, fd, first, last;
+
+        if (!numindex[n].valid)
+            continue;
+
+        for (j = 0; j < tcs->clause_count; j++)
+        {
+            const struct tagcache_search_clause *clause = tcs->clause[j];
+            long value = clause->numeric_data;
+
+            if (clause->tag != numindex_tags[n] || !clause->numeric)
+                continue;
+
+            switch (clause->type)
+            {
+                case clause_is:
+                    lo = MAX(lo, value);
+                    hi = MIN(hi, value);
+                    break;
+                case clause_gt:
+                    if (value >= INT32_MAX)
+                        hi = lo - 1;
+                    else
+                        lo = MAX(lo, value + 1);
+                    break;
+                case clause_gteq:
+                    lo = MAX(lo, value);
+                    break;
+                case clause_lt:
+                    if (value <= INT32_MIN)
+                        lo = hi + 1;
+                    else
+                        hi = MIN(hi, value - 1);
+                    break;
+                case clause_lteq:
+                    hi = MIN(hi, value);
+                    break;
+                default:
+                    continue;
+            }
+
+            usable = true;
+        }
+
+        if (!usable)
+            continue;
+
+        if ( (fd = open_numindex(n, &hdr, O_RDONLY)) < 0)
+            continue;
+
+        first = last = 0;
+        if (lo <= hi)
+        {
+            first = numindex_bound(fd, hdr.count, lo, false);
+            last = numindex_bound(fd, hdr.count, hi, true);
+        }
+
+        if (first < 0 || last < 0 || last - first >= best_rows)
+        {
+            close(fd);
+            continue;
+        }
+
+        if (tcs->plan_fd >= 0)
+            close(tcs->plan_fd);
+
+        tcs->plan_tag = numindex_tags[n];
+        tcs->plan_fd = fd;
+        tcs->plan_pos = first;
+        tcs->plan_end = last;
+        tcs->plan_changed = 0;
+        tcs->plan_changes = numindex[n].changed_count;
+        best_rows = last - first;
+        best_lo = lo;
+        best_hi = hi;
+    }
+
+    if (tcs->plan_tag >= 0)
+    {
+        snprintf(last_plan, sizeof last_plan, "%s %ld..%ld: %d+%d/%ld",
+                 tags_str[tcs->plan_tag], best_lo, best_hi, best_rows,
+                 tcs->plan_changes, (long)current_tcmh.tch.entry_count);
+    }
+    else
+    {
+        snprintf(last_plan, sizeof last_plan, "full scan: %ld",
+                 (long)current_tcmh.tch.entry_count);
+    }
+
+    logf("plan: %s", last_plan);
+}
+
+/* Add an entry found through a numeric index to the seek list if it
+ * passes the filters and clauses. */
+static void add_planned_entry(struct tagcache_search *tcs, int idx_id)
+{
+    struct tagcache_seeklist_entry *seeklist;
+    struct index_entry entry;
+    int j;
+
+#ifdef HAVE_TC_RAMCACHE
+    if (tcs->ramsearch)
+    {
+        memcpy(&entry, &ramcache_hdr->indices[idx_id],
+               sizeof(struct index_entry));
+    }
+    else
+#endif
+    {
+        lseek(tcs->masterfd, idx_id * sizeof(struct index_entry)
+              + sizeof(struct master_header), SEEK_SET);
+        if (ecread_index_entry(tcs->masterfd, &entry)
+                != sizeof(struct index_entry))
+        {
+            logf("planned entry: read error");
+            return ;
+        }
+    }
+
+    /* Skip deleted files. */
+    if (entry.flag & FLAG_DELETED)
+        return ;
+
+    /* Go through all filters.. */
+    for (j = 0; j < tcs->filter_count; j++)
+    {
+        if (entry.tag_seek[tcs->filter_tag[j]] != tcs->filter_seek[j])
+            return ;
+    }
+
+    /* Check for conditions. */
+    if (!check_clauses(tcs, &entry, tcs->clause, tcs->clause_count))
+        return ;
+
+    /* Add to the seek list if not already in uniq buffer. */
+    if (!add_uniqbuf(tcs, entry.tag_seek[tcs->type]))
+        return ;
+
+    /* Lets add it. */
+    seeklist = &tcs->seeklist[tcs->seek_list_count];
+    seeklist->seek = entry.tag_seek[tcs->type];
+    seeklist->flag = entry.flag;
+    seeklist->idx_id = idx_id;
+    tcs->seek_list_count++;
+}
+
+/* Fill the seek list from the index range of the plan, then from the
+ * entries that had changed when the plan was chosen. Results come in the
+ * order of the index rather than the master index. */
+static bool build_planned_list(struct tagcache_search *tcs)
 {
-    int i;
-    
-    /* If uniq buffer is not defined we must return true for search to work. */
-    if (tcs->unique_list == NULL || (!TAGCACHE_IS_UNIQUE(tcs->type)
-                                     && !TAGCACHE_IS_NUMERIC(tcs->type)))
-    {
-        return true;
-    }
-    
-    for (i = 0; i < tcs->unique_list_count; i++)
+    const struct numindex_state *state = &numindex[numindex_find(tcs->plan_tag)];
+    struct numindex_entry entries[16];
+    int i, n, len;
+
+    tcs->seek_list_count = 0;
+
+    while (tcs->plan_pos < tcs->plan_end
+           && tcs->seek_list_count < SEEK_LIST_SIZE)
     {
-        /* Return false if entry is found. */
-        if (tcs->unique_list[i] == id)
-            return false;
+        len = MIN((int)ARRAYLEN(entries), tcs->plan_end - tcs->plan_pos);
+
+        lseek(tcs->plan_fd, sizeof(struct numindex_header)
+              + tcs->plan_pos * sizeof(struct numindex_entry), SEEK_SET);
+        if (ecread(tcs->plan_fd, entries, len, numindex_entry_ec, tc_stat.econ)
+                != (ssize_t)(len * sizeof(struct numindex_entry)))
+        {
+            logf("numeric index: read error");
+            tcs->plan_pos = tcs->plan_end;
+            break;
+        }
+
+        for (n = 0; n < len && tcs->seek_list_count < SEEK_LIST_SIZE; n++)
+        {
+            tcs->plan_pos++;
+
+            /* Changed entries are checked with their current values later. */
+            for (i = 0; i < tcs->plan_changes; i++)
+            {
+                if (state->changed[i] == entries[n].idx_id)
+                    break;
+            }
+
+            if (i == tcs->plan_changes)
+                add_planned_entry(tcs, entries[n].idx_id);
+        }
+
+        yield();
     }
-    
-    if (tcs->unique_list_count < tcs->unique_list_capacity)
+
+    while (tcs->plan_changed < tcs->plan_changes
+           && tcs->seek_list_count < SEEK_LIST_SIZE)
     {
-        tcs->unique_list[i] = id;
-        tcs->unique_list_count++;
+        add_planned_entry(tcs, state->changed[tcs->plan_changed++]);
     }
-    
-    return true;
+
+    return tcs->seek_list_count > 0;
 }
+#endif /* !__PCTOOL__ */
 
 static bool build_lookup_list(struct tagcache_search *tcs)
 {
     struct index_entry entry;
     int i, j;
     
+#ifndef __PCTOOL__
+    if (!tcs->planned)
+        plan_search(tcs);
+
+    if (tcs->plan_tag >= 0)
+        return build_planned_list(tcs);
+#endif
+
     tcs->seek_list_count = 0;
     
 #ifdef HAVE_TC_RAMCACHE
@@ -1269,10 +2160,16 @@ static void remove_files(void)
     tc_stat.ramcache = false;
     tc_stat.econ = false;
     remove(TAGCACHE_FILE_MASTER);
+    remove(TAGCACHE_FILE_DIRS);
+    remove(TAGCACHE_FILE_HASH);
     for (i = 0; i < TAG_COUNT; i++)
     {
         if (TAGCACHE_IS_NUMERIC(i))
+        {
+            snprintf(buf, sizeof buf, TAGCACHE_FILE_NUMINDEX, i);
+            remove(buf);
             continue;
+        }
         
         snprintf(buf, sizeof buf, TAGCACHE_FILE_INDEX, i);
         remove(buf);
@@ -1310,6 +2207,8 @@ static bool check_all_headers(void)
         close(fd);
     }
     
+    load_numindices();
+    
     return true;
 }
 
@@ -1669,6 +2568,14 @@ void tagcache_search_finish(struct tagcache_search *tcs)
         }
     }
     
+#ifndef __PCTOOL__
+    if (tcs->planned && tcs->plan_fd >= 0)
+    {
+        close(tcs->plan_fd);
+        tcs->plan_fd = -1;
+    }
+#endif
+    
     tcs->ramsearch = false;
     tcs->valid = false;
     tcs->initialized = 0;
@@ -1802,6 +2709,260 @@ static int check_if_empty(char **tag)
     entry.tag_offset[tag] = offset; \
     entry.tag_length[tag] = check_if_empty(data); \
     offset += entry.tag_length[tag]
+/* Write a parsed file to the temporary db. */
+static void write_tagcache_entry(char *path, unsigned long mtime,
+                                 struct mp3entry *id3)
+{
+    struct temp_file_entry entry;
+    int offset = 0;
+    bool has_albumartist;
+    bool has_grouping;
+
+    memset(&entry, 0, sizeof(struct temp_file_entry));
+
+    logf("-> %s", path);
+    
+    if (id3->tracknum <= 0)              /* Track number missing? */
+    {
+        id3->tracknum = -1;
+    }
+    
+    /* Numeric tags */
+    entry.tag_offset[tag_year] = id3->year;
+    entry.tag_offset[tag_discnumber] = id3->discnum;
+    entry.tag_offset[tag_tracknumber] = id3->tracknum;
+    entry.tag_offset[tag_length] = id3->length;
+    entry.tag_offset[tag_bitrate] = id3->bitrate;
+    entry.tag_offset[tag_mtime] = mtime;
+    
+    /* String tags. */
+    has_albumartist = id3->albumartist != NULL
+        && strlen(id3->albumartist) > 0;
+    has_grouping = id3->grouping != NULL
+        && strlen(id3->grouping) > 0;
+
+    ADD_TAG(entry, tag_filename, &path);
+    ADD_TAG(entry, tag_title, &id3->title);
+    ADD_TAG(entry, tag_artist, &id3->artist);
+    ADD_TAG(entry, tag_album, &id3->album);
+    ADD_TAG(entry, tag_genre, &id3->genre_string);
+    ADD_TAG(entry, tag_composer, &id3->composer);
+    ADD_TAG(entry, tag_comment, &id3->comment);
+    if (has_albumartist)
+    {
+        ADD_TAG(entry, tag_albumartist, &id3->albumartist);
+    }
+    else
+    {
+        ADD_TAG(entry, tag_albumartist, &id3->artist);
+    }
+    if (has_grouping)
+    {
+        ADD_TAG(entry, tag_grouping, &id3->grouping);
+    }
+    else
+    {
+        ADD_TAG(entry, tag_grouping, &id3->title);
+    }
+    entry.data_length = offset;
+    
+    /* Write the header */
+    write(cachefd, &entry, sizeof(struct temp_file_entry));
+    
+    /* And tags also... Correct order is critical */
+    write_item(path);
+    write_item(id3->title);
+    write_item(id3->artist);
+    write_item(id3->album);
+    write_item(id3->genre_string);
+    write_item(id3->composer);
+    write_item(id3->comment);
+    if (has_albumartist)
+    {
+        write_item(id3->albumartist);
+    }
+    else
+    {
+        write_item(id3->artist);
+    }
+    if (has_grouping)
+    {
+        write_item(id3->grouping);
+    }
+    else
+    {
+        write_item(id3->title);
+    }
+    total_entry_count++;    
+}
+
+/* Read the metadata of a file. Touches no tagcache state, so it may run on
+ * a parser thread. */
+static bool parse_tagcache_file(const char *path, struct mp3entry *id3)
+{
+    bool ret;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        logf("open fail: %s", path);
+        return false;
+    }
+
+    memset(id3, 0, sizeof(struct mp3entry));
+    ret = get_metadata(id3, fd, path);
+    close(fd);
+
+    return ret;
+}
+
+#ifdef TAGCACHE_PARSE_THREADS
+/* Files found by check_dir are queued in walk order. The parser threads
+ * take them from parse_next and the tagcache thread writes them out from
+ * parse_head once parsed, so the temporary db is identical to an inline
+ * build. */
+static struct parse_job
+{
+    bool done;
+    bool ok;
+    unsigned long mtime;
+    int dir_sig;        /* Signature slot of its directory */
+    char path[TAG_MAXLEN+1];
+    struct mp3entry id3;
+} parse_queue[TAGCACHE_PARSE_QUEUE_LENGTH];
+
+#define PARSE_JOB(i) (&parse_queue[(i) & (TAGCACHE_PARSE_QUEUE_LENGTH-1)])
+
+static unsigned int parse_head; /* Oldest job, next to write out */
+static unsigned int parse_next; /* Next job for a parser thread */
+static unsigned int parse_tail; /* Next free slot */
+static bool parse_quit;
+static pthread_mutex_t parse_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t parse_job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t parse_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t parse_threads[TAGCACHE_PARSE_THREADS];
+static int parse_thread_count;
+
+static void * parse_thread(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&parse_mtx);
+    while (1)
+    {
+        while (!parse_quit && parse_next == parse_tail)
+            pthread_cond_wait(&parse_job_cond, &parse_mtx);
+
+        if (parse_quit)
+            break;
+
+        struct parse_job *job = PARSE_JOB(parse_next++);
+        pthread_mutex_unlock(&parse_mtx);
+
+        bool ok = parse_tagcache_file(job->path, &job->id3);
+
+        pthread_mutex_lock(&parse_mtx);
+        job->ok = ok;
+        job->done = true;
+        pthread_cond_signal(&parse_done_cond);
+    }
+    pthread_mutex_unlock(&parse_mtx);
+
+    return NULL;
+}
+
+/* Write out the finished jobs at the head of the queue, waiting until no
+ * more than 'keep' jobs remain queued. */
+static void parse_queue_flush(unsigned int keep)
+{
+    pthread_mutex_lock(&parse_mtx);
+    while (parse_head != parse_tail)
+    {
+        struct parse_job *job = PARSE_JOB(parse_head);
+
+        if (!job->done)
+        {
+            if (parse_tail - parse_head <= keep)
+                break;
+
+            pthread_cond_wait(&parse_done_cond, &parse_mtx);
+            continue;
+        }
+
+        /* The slot is ours until parse_head moves past it. */
+        pthread_mutex_unlock(&parse_mtx);
+        if (job->ok)
+            write_tagcache_entry(job->path, job->mtime, &job->id3);
+        else
+            dir_sig_failed(job->dir_sig);
+        pthread_mutex_lock(&parse_mtx);
+
+        job->done = false;
+        parse_head++;
+    }
+    pthread_mutex_unlock(&parse_mtx);
+}
+
+static void parse_queue_add(const char *path, unsigned long mtime)
+{
+    parse_queue_flush(TAGCACHE_PARSE_QUEUE_LENGTH - 1);
+
+    /* Free slots are only touched by this thread. */
+    struct parse_job *job = PARSE_JOB(parse_tail);
+    strlcpy(job->path, path, sizeof(job->path));
+    job->mtime = mtime;
+    job->dir_sig = current_dir_sig();
+
+    pthread_mutex_lock(&parse_mtx);
+    parse_tail++;
+    pthread_cond_signal(&parse_job_cond);
+    pthread_mutex_unlock(&parse_mtx);
+}
+
+static void parse_threads_start(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = MIN(MAX(cpus, 1), TAGCACHE_PARSE_THREADS);
+
+    parse_head = parse_next = parse_tail = 0;
+    parse_quit = false;
+
+    for (parse_thread_count = 0; parse_thread_count < count;
+         parse_thread_count++)
+    {
+        if (pthread_create(&parse_threads[parse_thread_count], NULL,
+                           parse_thread, NULL) != 0)
+            break;
+    }
+
+    logf("tagcache: %d parser threads", parse_thread_count);
+}
+
+/* Stop the parser threads. Queued files are written out unless the scan
+ * was aborted. */
+static void parse_threads_stop(bool flush)
+{
+    if (parse_thread_count == 0)
+        return;
+
+    if (flush)
+        parse_queue_flush(0);
+
+    pthread_mutex_lock(&parse_mtx);
+    parse_quit = true;
+    pthread_cond_broadcast(&parse_job_cond);
+    pthread_mutex_unlock(&parse_mtx);
+
+    while (parse_thread_count > 0)
+        pthread_join(parse_threads[--parse_thread_count], NULL);
+
+    for (unsigned int i = 0; i < TAGCACHE_PARSE_QUEUE_LENGTH; i++)
+        parse_queue[i].done = false;
+    parse_head = parse_next = parse_tail = 0;
+}
+#endif /* TAGCACHE_PARSE_THREADS */
+
 /* GCC 3.4.6 for Coldfire can choose to inline this function. Not a good
  * idea, as it uses lots of stack and is called from a recursive function
  * (check_dir).
@@ -1814,15 +2975,8 @@ static void __attribute__ ((noinline)) add_tagcache(char *path,
                                                    )
 {
     struct mp3entry id3;
-    struct temp_file_entry entry;
-    bool ret;
-    int fd;
     int idx_id = -1;
-    char tracknumfix[3];
-    int offset = 0;
     int path_length = strlen(path);
-    bool has_albumartist;
-    bool has_grouping;
 
 #ifdef SIMULATOR
     /* Crude logging for the sim - to aid in debugging */
@@ -1857,127 +3011,54 @@ static void __attribute__ ((noinline)) add_tagcache(char *path,
 
     /* Be sure the entry doesn't exist. */
     if (filenametag_fd >= 0 && idx_id < 0)
-        idx_id = find_entry_disk(path, false);
-    
-    /* Check if file has been modified. */
-    if (idx_id >= 0)
-    {
-        struct index_entry idx;
-        
-        /* TODO: Mark that the index exists (for fast reverse scan) */
-        //found_idx[idx_id/8] |= idx_id%8;
-        
-        if (!get_index(-1, idx_id, &idx, true))
-        {
-            logf("failed to retrieve index entry");
-            return ;
-        }
-        
-        if ((unsigned long)idx.tag_seek[tag_mtime] == mtime)
-        {
-            /* No changes to file. */
-            return ;
-        }
-        
-        /* Metadata might have been changed. Delete the entry. */
-        logf("Re-adding: %s", path);
-        if (!delete_entry(idx_id))
-        {
-            logf("delete_entry failed: %d", idx_id);
-            return ;
-        }
-    }
-    
-    fd = open(path, O_RDONLY);
-    if (fd < 0)
-    {
-        logf("open fail: %s", path);
-        return ;
-    }
-
-    memset(&id3, 0, sizeof(struct mp3entry));
-    memset(&entry, 0, sizeof(struct temp_file_entry));
-    memset(&tracknumfix, 0, sizeof(tracknumfix));
-    ret = get_metadata(&id3, fd, path);
-    close(fd);
-
-    if (!ret)
-        return ;
-
-    logf("-> %s", path);
-    
-    if (id3.tracknum <= 0)              /* Track number missing? */
-    {
-        id3.tracknum = -1;
-    }
-    
-    /* Numeric tags */
-    entry.tag_offset[tag_year] = id3.year;
-    entry.tag_offset[tag_discnumber] = id3.discnum;
-    entry.tag_offset[tag_tracknumber] = id3.tracknum;
-    entry.tag_offset[tag_length] = id3.length;
-    entry.tag_offset[tag_bitrate] = id3.bitrate;
-    entry.tag_offset[tag_mtime] = mtime;
-    
-    /* String tags. */
-    has_albumartist = id3.albumartist != NULL
-        && strlen(id3.albumartist) > 0;
-    has_grouping = id3.grouping != NULL
-        && strlen(id3.grouping) > 0;
-
-    ADD_TAG(entry, tag_filename, &path);
-    ADD_TAG(entry, tag_title, &id3.title);
-    ADD_TAG(entry, tag_artist, &id3.artist);
-    ADD_TAG(entry, tag_album, &id3.album);
-    ADD_TAG(entry, tag_genre, &id3.genre_string);
-    ADD_TAG(entry, tag_composer, &id3.composer);
-    ADD_TAG(entry, tag_comment, &id3.comment);
-    if (has_albumartist)
-    {
-        ADD_TAG(entry, tag_albumartist, &id3.albumartist);
-    }
-    else
-    {
-        ADD_TAG(entry, tag_albumartist, &id3.artist);
-    }
-    if (has_grouping)
-    {
-        ADD_TAG(entry, tag_grouping, &id3.grouping);
-    }
-    else
-    {
-        ADD_TAG(entry, tag_grouping, &id3.title);
-    }
-    entry.data_length = offset;
-    
-    /* Write the header */
-    write(cachefd, &entry, sizeof(struct temp_file_entry));
+        idx_id = find_entry_disk(path, false);
     
-    /* And tags also... Correct order is critical */
-    write_item(path);
-    write_item(id3.title);
-    write_item(id3.artist);
-    write_item(id3.album);
-    write_item(id3.genre_string);
-    write_item(id3.composer);
-    write_item(id3.comment);
-    if (has_albumartist)
-    {
-        write_item(id3.albumartist);
-    }
-    else
+    /* Check if file has been modified. */
+    if (idx_id >= 0)
     {
-        write_item(id3.artist);
+        struct index_entry idx;
+        
+        /* TODO: Mark that the index exists (for fast reverse scan) */
+        //found_idx[idx_id/8] |= idx_id%8;
+        
+        if (!get_index(lookup_masterfd, idx_id, &idx, true))
+        {
+            logf("failed to retrieve index entry");
+            dir_sig_failed(current_dir_sig());
+            return ;
+        }
+        
+        if ((unsigned long)idx.tag_seek[tag_mtime] == mtime)
+        {
+            /* No changes to file. */
+            return ;
+        }
+        
+        /* Metadata might have been changed. Delete the entry. */
+        logf("Re-adding: %s", path);
+        if (!delete_entry(idx_id))
+        {
+            logf("delete_entry failed: %d", idx_id);
+            dir_sig_failed(current_dir_sig());
+            return ;
+        }
     }
-    if (has_grouping)
+    
+#ifdef TAGCACHE_PARSE_THREADS
+    if (parse_thread_count > 0)
     {
-        write_item(id3.grouping);
+        parse_queue_add(path, mtime);
+        return ;
     }
-    else
+#endif
+
+    if (!parse_tagcache_file(path, &id3))
     {
-        write_item(id3.title);
+        dir_sig_failed(current_dir_sig());
+        return ;
     }
-    total_entry_count++;    
+
+    write_tagcache_entry(path, mtime, &id3);
 }
 
 static bool tempbuf_insert(char *str, int id, int idx_id, bool unique)
@@ -2947,6 +4028,8 @@ static bool commit(void)
     if (tmpfd < 0)
     {
         logf("nothing to commit");
+        check_filename_hash();
+        check_numindices();
         return true;
     }
     
@@ -2968,6 +4051,8 @@ static bool commit(void)
         logf("nothing to commit");
         close(tmpfd);
         remove(TAGCACHE_FILE_TEMP);
+        check_filename_hash();
+        check_numindices();
         return true;
     }
 
@@ -3091,6 +4176,10 @@ static bool commit(void)
     ecwrite(masterfd, &tcmh, 1, master_header_ec, tc_stat.econ);
     close(masterfd);
     
+    build_filename_hash(&tcmh);
+    for (i = 0; i < (int)ARRAYLEN(numindex_tags); i++)
+        build_numindex(i, &tcmh);
+    
     logf("tagcache committed");
     tc_stat.ready = check_all_headers();
     tc_stat.readyvalid = true;
@@ -3517,6 +4606,8 @@ bool tagcache_import_changelog(void)
     write_lock++;
     
     filenametag_fd = open_tag_fd(&tch, tag_filename, false);
+    if (filenametag_fd >= 0)
+        open_filename_hash_session();
     
     fast_readline(clfd, buf, sizeof buf, (long *)masterfd,
                   parse_changelog_line);
@@ -3524,6 +4615,7 @@ bool tagcache_import_changelog(void)
     close(clfd);
     close(masterfd);
     
+    close_filename_hash_session();
     if (filenametag_fd >= 0)
     {
         close(filenametag_fd);
@@ -3852,6 +4944,10 @@ static void fix_ramcache(void* old_addr, void* new_addr)
     ptrdiff_t offpos = new_addr - old_addr;
     for (int i = 0; i < TAG_COUNT; i++)
         ramcache_hdr->tags[i] += offpos;
+
+    if (ramcache_hdr->filename_hash != NULL)
+        ramcache_hdr->filename_hash = (struct filename_hash_slot *)
+            ((char *)ramcache_hdr->filename_hash + offpos);
 }
 
 static int move_cb(int handle, void* current, void* new)
@@ -3890,6 +4986,21 @@ static bool allocate_tagcache(void)
      */
     tc_stat.ramcache_allocated = tcmh.tch.datasize + 256 + TAGCACHE_RESERVE +
         sizeof(struct ramcache_header) + TAG_COUNT*sizeof(void *);
+
+    /* And the filename hash if there's one. */
+    if ( (fd = open(TAGCACHE_FILE_HASH, O_RDONLY)) >= 0)
+    {
+        struct filename_hash_header hhdr;
+
+        if (ecread(fd, &hhdr, 1, filename_hash_header_ec, tc_stat.econ)
+                == sizeof(struct filename_hash_header)
+            && filename_hash_valid(&hhdr, &tcmh))
+        {
+            tc_stat.ramcache_allocated +=
+                hhdr.slots * sizeof(struct filename_hash_slot) + 4;
+        }
+        close(fd);
+    }
     int handle = core_alloc_ex("tc ramcache", tc_stat.ramcache_allocated, &ops);
     ramcache_hdr = core_get_data(handle);
     memset(ramcache_hdr, 0, sizeof(struct ramcache_header));
@@ -4197,6 +5308,31 @@ static bool load_tagcache(void)
         close(fd);
     }
     
+    /* Load the filename hash, lookups fall back to disk without it. */
+    ramcache_hdr->filename_hash = NULL;
+    if ( (fd = open(TAGCACHE_FILE_HASH, O_RDONLY)) >= 0)
+    {
+        struct filename_hash_header hhdr;
+        long len;
+
+        p = (char *)((long)p & ~0x03) + 0x04;
+        if (ecread(fd, &hhdr, 1, filename_hash_header_ec, tc_stat.econ)
+                == sizeof(struct filename_hash_header)
+            && filename_hash_valid(&hhdr, &tcmh))
+        {
+            len = hhdr.slots * sizeof(struct filename_hash_slot);
+            if (len + 4 <= bytesleft
+                && ecread(fd, p, hhdr.slots, filename_hash_slot_ec,
+                          tc_stat.econ) == len)
+            {
+                ramcache_hdr->filename_hash = (struct filename_hash_slot *)p;
+                ramcache_hdr->filename_hash_slots = hhdr.slots;
+                bytesleft -= len + 4;
+            }
+        }
+        close(fd);
+    }
+    
     tc_stat.ramcache_used = tc_stat.ramcache_allocated - bytesleft;
     logf("tagcache loaded into ram!");
 
@@ -4211,6 +5347,308 @@ failure_nofd:
 }
 #endif /* HAVE_TC_RAMCACHE */
 
+/**
+ * Directory signatures for incremental updates. The signature of a
+ * directory is a crc over the names, sizes and mtimes of its entries, so it
+ * changes whenever a file in it is added, removed, renamed or rewritten
+ * (directory mtimes alone aren't maintained on FAT). The number of entries
+ * and the newest mtime are compared as well, so that a crc collision alone
+ * can't hide a change. check_dir() computes it while reading the directory.
+ * Files in directories with the same signature as in the last scan are
+ * neither parsed nor checked for deletion. A directory with a file that
+ * couldn't be added gets no signature, so it is tried again next time.
+ */
+struct dir_sig {
+    uint32_t path_crc;  /* crc_32 of the directory path */
+    uint32_t sig;       /* crc_32 of the directory listing */
+    uint32_t count;     /* Number of entries or DIR_SIG_FAILED */
+    uint32_t mtime;     /* Newest mtime of its files */
+};
+static const char * const dir_sig_ec = "llll";
+
+#define DIR_SIG_FAILED 0xffffffff
+
+/* Signatures of the last scan, sorted by path_crc. */
+struct dir_sig_entry {
+    struct dir_sig ds;
+    bool unchanged;     /* Found with the same signature during this scan */
+};
+
+#ifdef __PCTOOL__
+static struct dir_sig_entry *dir_sig_buf;
+#else
+static int dir_sig_handle;
+#endif
+static int dir_sig_count;       /* Entries of the last scan */
+static int dir_sig_fd = -1;     /* Signatures of this scan */
+static int dir_sig_new_count;   /* Slots taken in it */
+static bool dir_sig_write_error;
+
+/* Directories being scanned, innermost first. Their signatures are written
+ * to their slots once their scan is finished. */
+static struct dir_scan {
+    struct dir_scan *parent;
+    int slot;
+    bool failed;        /* A file of it couldn't be added */
+} *dir_scan_top;
+
+static struct dir_sig_entry * get_dir_sigs(void)
+{
+#ifdef __PCTOOL__
+    return dir_sig_buf;
+#else
+    /* May move with any allocation, don't keep across yields */
+    return core_get_data(dir_sig_handle);
+#endif
+}
+
+static void free_dir_sigs(void)
+{
+    if (dir_sig_count == 0)
+        return ;
+
+#ifdef __PCTOOL__
+    free(dir_sig_buf);
+    dir_sig_buf = NULL;
+#else
+    dir_sig_handle = core_free(dir_sig_handle);
+#endif
+    dir_sig_count = 0;
+}
+
+static int dir_sig_compare(const void *a, const void *b)
+{
+    uint32_t crc_a = ((const struct dir_sig_entry *)a)->ds.path_crc;
+    uint32_t crc_b = ((const struct dir_sig_entry *)b)->ds.path_crc;
+
+    return crc_a < crc_b ? -1 : crc_a > crc_b;
+}
+
+/* Start writing the signatures of this scan, and load the last ones if the
+ * db is to be updated rather than built from scratch. */
+static void open_dir_sigs(bool update)
+{
+    struct tagcache_header hdr;
+    struct dir_sig_entry *sigs;
+    bool econ = false;
+    int fd;
+    int i, n;
+
+    free_dir_sigs();
+
+    fd = update ? open(TAGCACHE_FILE_DIRS, O_RDONLY) : -1;
+    if (fd >= 0)
+    {
+        memset(&hdr, 0, sizeof(hdr));
+        if (read(fd, &hdr, sizeof(hdr)) == sizeof(hdr)
+            && hdr.magic != TAGCACHE_MAGIC)
+        {
+            /* Written by the database tool on a different endian host. */
+            lseek(fd, 0, SEEK_SET);
+            ecread(fd, &hdr, 1, tagcache_header_ec, true);
+            econ = true;
+        }
+
+        if (hdr.magic != TAGCACHE_MAGIC || hdr.entry_count <= 0 ||
+            filesize(fd) != (off_t)(sizeof(hdr) +
+                                    hdr.entry_count * sizeof(struct dir_sig)))
+            logf("dir signatures missing or corrupt");
+#ifdef __PCTOOL__
+        else if ((dir_sig_buf = malloc(hdr.entry_count *
+                                       sizeof(struct dir_sig_entry))))
+#else
+        else if ((dir_sig_handle = core_alloc("tc dir sigs",
+                     hdr.entry_count * sizeof(struct dir_sig_entry))) > 0)
+#endif
+        {
+            dir_sig_count = hdr.entry_count;
+            sigs = get_dir_sigs();
+            for (i = 0, n = 0; i < hdr.entry_count; i++)
+            {
+                if (ecread(fd, &sigs[n].ds, 1, dir_sig_ec, econ)
+                        != sizeof(struct dir_sig))
+                {
+                    logf("dir signature read error");
+                    free_dir_sigs();
+                    n = 0;
+                    break;
+                }
+
+                /* Directories that failed are scanned again */
+                if (sigs[n].ds.count == DIR_SIG_FAILED)
+                    continue;
+
+                sigs[n++].unchanged = false;
+            }
+            dir_sig_count = n;
+
+            if (dir_sig_count > 0)
+                qsort(sigs, dir_sig_count, sizeof(struct dir_sig_entry),
+                      dir_sig_compare);
+        }
+        close(fd);
+    }
+
+    logf("%d dir signatures loaded", dir_sig_count);
+
+    dir_sig_new_count = 0;
+    dir_sig_write_error = false;
+    dir_scan_top = NULL;
+    dir_sig_fd = open(TAGCACHE_FILE_DIRS_TEMP,
+                      O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (dir_sig_fd >= 0)
+    {
+        memset(&hdr, 0, sizeof(hdr));
+        write(dir_sig_fd, &hdr, sizeof(hdr));
+    }
+}
+
+/* Finish the signatures of this scan, they replace the last ones only if
+ * all the files found were committed. */
+static void close_dir_sigs(bool commit)
+{
+    struct tagcache_header hdr;
+
+    if (dir_sig_fd < 0)
+        return ;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TAGCACHE_MAGIC;
+    hdr.entry_count = dir_sig_new_count;
+    lseek(dir_sig_fd, 0, SEEK_SET);
+    ecwrite(dir_sig_fd, &hdr, 1, tagcache_header_ec, tc_stat.econ);
+    close(dir_sig_fd);
+    dir_sig_fd = -1;
+
+    if (commit && !dir_sig_write_error)
+        rename(TAGCACHE_FILE_DIRS_TEMP, TAGCACHE_FILE_DIRS);
+    else
+        remove(TAGCACHE_FILE_DIRS_TEMP);
+}
+
+static struct dir_sig_entry * find_dir_sig(const char *path, int len)
+{
+    struct dir_sig_entry *sigs = get_dir_sigs();
+    uint32_t path_crc = crc_32(path, len, 0xffffffff);
+    int lo = 0, hi = dir_sig_count - 1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (sigs[mid].ds.path_crc < path_crc)
+            lo = mid + 1;
+        else if (sigs[mid].ds.path_crc > path_crc)
+            hi = mid - 1;
+        else
+            return &sigs[mid];
+    }
+
+    return NULL;
+}
+
+/* Take the slot for the signature of a directory about to be scanned */
+static void dir_scan_begin(struct dir_scan *scan)
+{
+    scan->parent = dir_scan_top;
+    scan->slot = dir_sig_fd >= 0 ? dir_sig_new_count++ : -1;
+    scan->failed = false;
+    dir_scan_top = scan;
+}
+
+static void write_dir_sig(int slot, const struct dir_sig *ds)
+{
+    if (slot < 0 || dir_sig_fd < 0)
+        return ;
+
+    lseek(dir_sig_fd, sizeof(struct tagcache_header) +
+                      slot * sizeof(struct dir_sig), SEEK_SET);
+    if (ecwrite(dir_sig_fd, ds, 1, dir_sig_ec, tc_stat.econ)
+            != sizeof(struct dir_sig))
+        dir_sig_write_error = true;
+}
+
+/* Finish the scan of a directory and write its signature */
+static void dir_scan_end(struct dir_scan *scan, const char *dirname,
+                         struct dir_sig *ds, bool success)
+{
+    dir_scan_top = scan->parent;
+
+    ds->path_crc = crc_32(dirname, strlen(dirname), 0xffffffff);
+    if (!success || scan->failed)
+        ds->count = DIR_SIG_FAILED;
+
+    write_dir_sig(scan->slot, ds);
+}
+
+static int current_dir_sig(void)
+{
+    return dir_scan_top ? dir_scan_top->slot : -1;
+}
+
+/* A file of the directory with the signature in this slot couldn't be
+ * added */
+static void dir_sig_failed(int slot)
+{
+    struct dir_scan *scan;
+
+    if (slot < 0)
+        return ;
+
+    for (scan = dir_scan_top; scan; scan = scan->parent)
+    {
+        if (scan->slot == slot)
+        {
+            scan->failed = true;
+            return ;
+        }
+    }
+
+    /* Parsed after its directory was finished */
+    struct dir_sig ds = { 0, 0, DIR_SIG_FAILED, 0 };
+    write_dir_sig(slot, &ds);
+}
+
+/* Add an entry of a directory to its signature */
+static void dir_sig_add(struct dir_sig *ds, const struct dirent *entry,
+                        const struct dirinfo *info)
+{
+    struct {
+        uint32_t attribute;
+        uint32_t size;
+        uint32_t mtime;
+    } data;
+
+    ds->sig = crc_32(entry->d_name, strlen((char *)entry->d_name) + 1,
+                     ds->sig);
+    ds->count++;
+
+    /* Subdirectories are checked on their own. */
+    if (info->attribute & ATTR_DIRECTORY)
+        return ;
+
+    data.attribute = info->attribute;
+    data.size = info->size;
+    data.mtime = info->mtime;
+    ds->sig = crc_32(&data, sizeof(data), ds->sig);
+
+    if (info->mtime > ds->mtime)
+        ds->mtime = info->mtime;
+}
+
+/* Returns true if a directory is unchanged since the last scan */
+static bool dir_sig_unchanged(const char *dirname, const struct dir_sig *ds)
+{
+    struct dir_sig_entry *old = find_dir_sig(dirname, strlen(dirname));
+
+    if (old == NULL || old->ds.sig != ds->sig ||
+        old->ds.count != ds->count || old->ds.mtime != ds->mtime)
+        return false;
+
+    old->unchanged = true;
+    return true;
+}
+
 static bool check_deleted_files(void)
 {
     int fd;
@@ -4224,6 +5662,7 @@ static bool check_deleted_files(void)
     if (fd < 0)
     {
         logf("%s open fail", buf);
+        free_dir_sigs();
         return false;
     }
 
@@ -4238,6 +5677,7 @@ static bool check_deleted_files(void)
         {
             logf("too long tag");
             close(fd);
+            free_dir_sigs();
             return false;
         }
         
@@ -4245,6 +5685,7 @@ static bool check_deleted_files(void)
         {
             logf("read error #14");
             close(fd);
+            free_dir_sigs();
             return false;
         }
         
@@ -4252,6 +5693,18 @@ static bool check_deleted_files(void)
         if (*buf == '\0')
             continue;
         
+        /* Files in directories unchanged since the last scan exist. */
+        if (dir_sig_count > 0)
+        {
+            char *slash = strrchr(buf, '/');
+            struct dir_sig_entry *ds = NULL;
+
+            if (slash != NULL)
+                ds = find_dir_sig(buf, slash == buf ? 1 : slash - buf);
+            if (ds != NULL && ds->unchanged)
+                continue;
+        }
+
         /* Now check if the file exists. */
         if (!file_exists(buf))
         {
@@ -4262,6 +5715,7 @@ static bool check_deleted_files(void)
     }
     
     close(fd);
+    free_dir_sigs();
     
     logf("done");
     
@@ -4400,12 +5854,85 @@ static int free_search_roots(struct search_roots_ll * start)
 #define free_search_roots(a) do {} while(0)
 #endif
 
+/* Add a file found in a directory scan, curpath is its path */
+static void check_file(DIR *dir, const struct dirinfo *info)
+{
+    tc_stat.curentry = curpath;
+
+    /* Add a new entry to the temporary db file. */
+    add_tagcache(curpath, info->mtime
+#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
+                 , dir->internal_entry
+#endif
+                 );
+#if !defined(HAVE_TC_RAMCACHE) || !defined(HAVE_DIRCACHE)
+    (void)dir;
+#endif
+
+    /* Wait until current path for debug screen is read and unset. */
+    while (tc_stat.syncscreen && tc_stat.curentry != NULL)
+        yield();
+
+    tc_stat.curentry = NULL;
+}
+
+/* Add the files of a directory whose signature turned out to have changed
+ * during its scan, curpath is its path */
+static bool check_changed_dir(void)
+{
+    DIR *dir;
+    int len;
+    bool success = false;
+
+    dir = opendir(curpath);
+    if (!dir)
+    {
+        logf("tagcache: opendir(%s) failed", curpath);
+        return false;
+    }
+
+    len = strlen(curpath);
+    /* don't add an extra / for curpath == / */
+    if (len <= 1) len = 0;
+
+#ifdef __PCTOOL__
+    while (1)
+#else
+    while (!check_event_queue())
+#endif
+    {
+        struct dirent *entry = readdir(dir);
+        if (entry == NULL)
+        {
+            success = true;
+            break;
+        }
+
+        struct dirinfo info = dir_get_info(dir, entry);
+        if (info.attribute & ATTR_DIRECTORY)
+            continue;
+
+        yield();
+
+        snprintf(&curpath[len], sizeof(curpath) - len, "/%s", entry->d_name);
+        check_file(dir, &info);
+        curpath[len] = '\0';
+    }
+
+    closedir(dir);
+
+    return success;
+}
+
 static bool check_dir(const char *dirname, int add_files)
 {
     DIR *dir;
     int len;
     int success = false;
     int ignore, unignore;
+    bool add_here;
+    struct dir_scan scan;
+    struct dir_sig ds = { 0, 0xffffffff, 0, 0 };
 
     dir = opendir(dirname);
     if (!dir)
@@ -4420,6 +5947,13 @@ static bool check_dir(const char *dirname, int add_files)
     if (ignore != unignore)
         add_files = unignore;
 
+    /* The files of a directory known from the last scan are only added if
+     * its signature turns out to have changed. */
+    add_here = add_files && !find_dir_sig(dirname, strlen(dirname));
+
+    if (add_files)
+        dir_scan_begin(&scan);
+
     /* Recursively scan the dir. */
 #ifdef __PCTOOL__
     while (1)
@@ -4442,6 +5976,8 @@ static bool check_dir(const char *dirname, int add_files)
 
         yield();
 
+        dir_sig_add(&ds, entry, &info);
+
         len = strlen(curpath);
         /* don't add an extra / for curpath == / */
         if (len <= 1) len = 0;
@@ -4460,29 +5996,22 @@ static bool check_dir(const char *dirname, int add_files)
 #else
             check_dir(curpath, add_files);
 #endif
-        else if (add_files)
-        {
-            tc_stat.curentry = curpath;
-            
-            /* Add a new entry to the temporary db file. */
-            add_tagcache(curpath, info.mtime
-#if defined(HAVE_TC_RAMCACHE) && defined(HAVE_DIRCACHE)
-                         , dir->internal_entry
-#endif
-                         );
-            
-            /* Wait until current path for debug screen is read and unset. */
-            while (tc_stat.syncscreen && tc_stat.curentry != NULL)
-                yield();
-            
-            tc_stat.curentry = NULL;
-        }
+        else if (add_here)
+            check_file(dir, &info);
 
         curpath[len] = '\0';
     }
-    
+
     closedir(dir);
 
+    if (add_files)
+    {
+        if (success && !add_here && !dir_sig_unchanged(dirname, &ds))
+            success = check_changed_dir();
+
+        dir_scan_end(&scan, dirname, &ds, success);
+    }
+
     return success;
 }
 
@@ -4533,6 +6062,9 @@ void do_tagcache_build(const char *path[])
     }
 
     filenametag_fd = open_tag_fd(&header, tag_filename, false);
+    if (filenametag_fd >= 0)
+        open_filename_hash_session();
+    open_dir_sigs(filenametag_fd >= 0);
     
     cpu_boost(true);
 
@@ -4543,6 +6075,10 @@ void do_tagcache_build(const char *path[])
 
     ret = true;
 
+#ifdef TAGCACHE_PARSE_THREADS
+    parse_threads_start();
+#endif
+
     roots_ll[0].path = path[0];
     roots_ll[0].next = NULL;
     /* i is for the path vector, j for the roots_ll array
@@ -4566,6 +6102,10 @@ void do_tagcache_build(const char *path[])
     }
     free_search_roots(&roots_ll[0]);
 
+#ifdef TAGCACHE_PARSE_THREADS
+    parse_threads_stop(ret);
+#endif
+
     /* Write the header. */
     header.magic = TAGCACHE_MAGIC;
     header.datasize = data_size;
@@ -4574,6 +6114,7 @@ void do_tagcache_build(const char *path[])
     write(cachefd, &header, sizeof(struct tagcache_header));
     close(cachefd);
 
+    close_filename_hash_session();
     if (filenametag_fd >= 0)
     {
         close(filenametag_fd);
@@ -4583,6 +6124,7 @@ void do_tagcache_build(const char *path[])
     if (!ret)
     {
         logf("Aborted.");
+        close_dir_sigs(false);
         cpu_boost(false);
         return ;
     }
@@ -4594,7 +6136,10 @@ void do_tagcache_build(const char *path[])
     if (commit())
     {
         logf("tagcache built!");
+        close_dir_sigs(true);
     }
+    else
+        close_dir_sigs(false);
 #ifdef __PCTOOL__
     free_tempbuf();
 #endif
@@ -4732,7 +6277,10 @@ static void tagcache_thread(void)
                 {
                     load_ramcache();
                     if (tc_stat.ramcache && global_settings.tagcache_autoupdate)
+                    {
                         tagcache_build();
+                        free_dir_sigs();
+                    }
                 }
                 else
 #endif
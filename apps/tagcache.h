@@ -55,7 +55,7 @@ enum tag_type { tag_artist = 0, tag_album, tag_genre, tag_title,
 #define TAGCACHE_MAGIC  0x5443480f
 
 /* Dump store/restore header version 'TCSxx'. */
-#define TAGCACHE_STATEFILE_MAGIC 0x54435301
+#define TAGCACHE_STATEFILE_MAGIC 0x54435302
 
 /* How much to allocate extra space for ramcache. */
 #define TAGCACHE_RESERVE 32768
@@ -83,6 +83,20 @@ enum tag_type { tag_artist = 0, tag_album, tag_genre, tag_title,
 #define TAGCACHE_MAX_FILTERS 4
 #define TAGCACHE_MAX_CLAUSES 32
 
+/* Entries whose indexed numeric tags may change before the numeric index
+ * is dropped until the next commit or boot. */
+#define TAGCACHE_NUMINDEX_CHANGES 64
+
+/* Hosted builds parse metadata on native threads while scanning for files,
+ * Rockbox threads never run in parallel so elsewhere parsing stays inline. */
+#if defined(APPLICATION) && !defined(__PCTOOL__) && !defined(_WIN32)
+/* Max parser threads, the number of online CPUs is used up to this. */
+#define TAGCACHE_PARSE_THREADS 8
+/* Files queued ahead of the one being written to the temporary db
+ * (must be a power of 2). */
+#define TAGCACHE_PARSE_QUEUE_LENGTH 32
+#endif
+
 /* Tag database files. */
 
 /* Temporary database containing new tags to be committed to the main db. */
@@ -100,6 +114,18 @@ enum tag_type { tag_artist = 0, tag_album, tag_genre, tag_title,
 /* Serialized DB. */
 #define TAGCACHE_STATEFILE       ROCKBOX_DIR "/database_state.tcd"
 
+/* Sorted secondary indices of some numeric tags. */
+#define TAGCACHE_FILE_NUMINDEX   ROCKBOX_DIR "/database_num%d.tcd"
+
+/* Hashed filename index of the main database. */
+#define TAGCACHE_FILE_HASH       ROCKBOX_DIR "/database_hash.tcd"
+
+/* Directory signatures of the last scan, for incremental updates. */
+#define TAGCACHE_FILE_DIRS       ROCKBOX_DIR "/database_dirs.tcd"
+
+/* Directory signatures of a scan not committed yet. */
+#define TAGCACHE_FILE_DIRS_TEMP  ROCKBOX_DIR "/database_dirs_tmp.tcd"
+
 /* Tag to be used on untagged files. */
 #define UNTAGGED "<Untagged>"
 
@@ -190,6 +216,13 @@ struct tagcache_search {
     unsigned long *unique_list;
     int unique_list_capacity;
     int unique_list_count;
+    bool planned;        /* Query plan chosen */
+    int plan_tag;        /* Tag of the numeric index scanned, -1 if none */
+    int plan_fd;
+    int plan_pos;        /* Range of the numeric index left to scan */
+    int plan_end;
+    int plan_changed;    /* Changed entries checked after the range */
+    int plan_changes;    /* Changed entries when the plan was chosen */
 
     /* Exported variables. */
     bool ramsearch;      /* Is ram copy of the tagcache being used. */
@@ -235,6 +268,7 @@ bool tagcache_modify_numeric_entry(struct tagcache_search *tcs,
                                    int tag, long data);
 
 struct tagcache_stat* tagcache_get_stat(void);
+const char* tagcache_get_last_plan(void);
 int tagcache_get_commit_step(void);
 bool tagcache_prepare_shutdown(void);
 void tagcache_shutdown(void);
@@ -29,6 +29,7 @@
 #include "file.h"
 #include "system.h"
 #include "kernel.h"
+#include "storage.h"
 #include "settings.h"
 #include "settings_list.h"
 #if CONFIG_CODEC == SWCODEC
@@ -161,17 +162,29 @@ static struct buflib_context clip_ctx;
 struct clip_cache_metadata {
     long tick;
     int handle, voice_id;
+    unsigned uses;   /* times spoken, halved each time the cache turns over */
+    bool prefetched; /* loaded ahead of being spoken and not spoken yet */
 };
 
 static int metadata_table_handle;
 static unsigned max_clips;
+static unsigned clips_loaded; /* since the use counts were last halved */
 static int cache_hits, cache_misses;
+static int prefetch_loads, prefetch_hits;
+/* The thread in talk_prefetch_begin()..talk_prefetch_end(), whose talk calls
+ * only load clips. Other threads' calls meanwhile speak as usual. */
+static unsigned int prefetch_thread = 0;
 
 static struct queue_entry queue[QUEUE_SIZE]; /* queue of scheduled clips */
 static struct queue_entry silence, *last_clip;
 
 /***************** Private implementation *****************/
 
+static inline bool prefetching(void)
+{
+    return prefetch_thread != 0 && thread_self() == prefetch_thread;
+}
+
 static int index_handle, talk_handle;
 
 static int move_callback(int handle, void *current, void *new)
@@ -340,33 +353,62 @@ static int index2id(int index)
 }
 #endif
 
-static int free_oldest_clip(void)
+/* is the clip scheduled for playback? */
+static bool clip_is_queued(int handle)
+{
+    bool queued = false;
+
+    talk_queue_lock();
+    for (int i = queue_read; i != queue_write; i = (i + 1) & QUEUE_MASK)
+    {
+        if (queue[i].handle == handle)
+        {
+            queued = true;
+            break;
+        }
+    }
+    talk_queue_unlock();
+
+    return queued;
+}
+
+/* is clip a better candidate for eviction than the current victim? */
+static bool clip_less_worth(const struct clip_cache_metadata *cc,
+                            const struct clip_cache_metadata *victim,
+                            long now)
+{
+    /* thumb clips are spoken once, they go first */
+    if ((cc->voice_id == VOICEONLY_DELIMITER) !=
+        (victim->voice_id == VOICEONLY_DELIMITER))
+        return cc->voice_id == VOICEONLY_DELIMITER;
+    /* then the least used, the least recently used of those */
+    if (cc->uses != victim->uses)
+        return cc->uses < victim->uses;
+    return (now - cc->tick) > (now - victim->tick);
+}
+
+/* Returns the slot freed, or -1 if every clip is queued or silence */
+static int free_least_used_clip(void)
 {
     unsigned i;
-    int oldest = 0;
-    long age, now;
+    int victim = -1;
+    long now = current_tick;
     struct clip_entry* clipbuf;
     struct clip_cache_metadata *cc = buflib_get_data(&clip_ctx, metadata_table_handle);
-    for(age = i = 0, now = current_tick; i < max_clips; i++)
+    for(i = 0; i < max_clips; i++)
     {
-        if (cc[i].handle)
-        {
-            if ((now - cc[i].tick) > age && cc[i].voice_id != VOICE_PAUSE)
-            {
-                /* find the last-used clip but never consider silence */
-                age = now - cc[i].tick;
-                oldest = i;
-            }
-            else if (cc[i].voice_id == VOICEONLY_DELIMITER)
-            {
-                /* thumb clips are freed immediately */
-                oldest = i;
-                break;
-            }
-        }
+        /* never consider silence, nor what is about to be played */
+        if (!cc[i].handle || cc[i].voice_id == VOICE_PAUSE)
+            continue;
+        if (victim >= 0 && !clip_less_worth(&cc[i], &cc[victim], now))
+            continue;
+        if (clip_is_queued(cc[i].handle))
+            continue;
+        victim = i;
     }
-    /* free the last one if no oldest one could be determined */
-    cc = &cc[oldest];
+    if (victim < 0)
+        return -1;
+    cc = &cc[victim];
     cc->handle = buflib_free(&clip_ctx, cc->handle);
     /* need to clear the LOADED bit too (not for thumb clips) */
     if (cc->voice_id != VOICEONLY_DELIMITER)
@@ -374,12 +416,13 @@ static int free_oldest_clip(void)
         clipbuf = core_get_data(index_handle);
         clipbuf[id2index(cc->voice_id)].size &= ~LOADED_MASK;
     }
-    return oldest;
+    return victim;
 }
 
 
-/* common code for load_initial_clips() and get_clip() */
-static void add_cache_entry(int clip_handle, int table_index, int id)
+/* common code for load_initial_clips() and get_clip(). Returns false if
+ * there was no slot to be had, the caller still owns clip_handle then. */
+static bool add_cache_entry(int clip_handle, int table_index, int id)
 {
     unsigned i;
     struct clip_cache_metadata *cc = buflib_get_data(&clip_ctx, metadata_table_handle);
@@ -394,12 +437,31 @@ static void add_cache_entry(int clip_handle, int table_index, int id)
     {   /* find an empty slot */
         for(i = 0; cc[i].handle && i < max_clips; i++) ;
         if (i == max_clips) /* no free slot in the cache table? */
-            i = free_oldest_clip();
+        {
+            int victim = free_least_used_clip();
+            if (victim < 0)
+                return false;
+            i = victim;
+        }
         cc = &cc[i];
     }
     cc->handle = clip_handle;
     cc->tick = current_tick;
     cc->voice_id = id;
+    cc->uses = 1;
+    cc->prefetched = prefetching();
+
+    /* age the use counts so that clips which were popular once don't stay
+     * forever */
+    if (++clips_loaded >= max_clips)
+    {
+        cc = buflib_get_data(&clip_ctx, metadata_table_handle);
+        for (i = 0; i < max_clips; i++)
+            cc[i].uses /= 2;
+        clips_loaded = 0;
+    }
+
+    return true;
 }
 
 static ssize_t read_clip_data(int fd, int index, int clip_handle)
@@ -483,10 +545,18 @@ static int get_clip(long id, struct queue_entry *q)
     {   /* clip needs loading */
         int fd, handle, oldest = -1;
         ssize_t ret;
-        cache_misses++;
-        /* free clips from cache until this one succeeds to allocate */
+        if (prefetching())
+            prefetch_loads++;
+        else
+            cache_misses++;
+        /* free clips from cache until this one succeeds to allocate, give
+         * up if only queued clips are left */
         while ((handle = buflib_alloc(&clip_ctx, clipsize)) < 0)
-            oldest = free_oldest_clip();
+        {
+            oldest = free_least_used_clip();
+            if (oldest < 0)
+                return -1;
+        }
         /* handle should now hold a valid alloc. Load from disk
          * and insert into cache */
         fd = open_voicefile();
@@ -495,17 +565,30 @@ static int get_clip(long id, struct queue_entry *q)
         if (ret < 0)
             return ret;
         /* finally insert into metadata table */
-        add_cache_entry(handle, oldest, id);
+        if (!add_cache_entry(handle, oldest, id))
+        {
+            clipbuf = core_get_data(index_handle);
+            clipbuf[index].size &= ~LOADED_MASK;
+            buflib_free(&clip_ctx, handle);
+            return -1;
+        }
         retval = handle;
     }
     else
     {   /* clip is in memory already; find where it was loaded */
-        cache_hits++;
         struct clip_cache_metadata *cc;
         static int i;
         cc = buflib_get_data(&clip_ctx, metadata_table_handle);
         for (i = 0; cc[i].voice_id != id || !cc[i].handle; i++) ;
-        cc[i].tick = current_tick; /* reset age */
+        if (!prefetching())
+        {
+            cache_hits++;
+            if (cc[i].prefetched)
+                prefetch_hits++;
+            cc[i].prefetched = false;
+            cc[i].uses++;
+            cc[i].tick = current_tick; /* reset age */
+        }
         clipsize &= ~LOADED_MASK; /* without the extra bit gives true size */
         retval = cc[i].handle;
     }
@@ -733,6 +816,9 @@ static void mp3_callback(const void** start, size_t* size)
 /* stop the playback and the pending clips */
 void talk_force_shutup(void)
 {
+    if (prefetching())
+        return;
+
     /* Most of this is MAS only */
 #if CONFIG_CODEC != SWCODEC
 #ifdef SIMULATOR
@@ -810,6 +896,9 @@ static void queue_clip(struct queue_entry *clip, bool enqueue)
     struct queue_entry *qe;
     int queue_level;
 
+    if (prefetching())
+        return; /* only loading */
+
     if (!enqueue)
         talk_shutup(); /* cut off all the pending stuff */
     /* Something is being enqueued, force_enqueue_next override is no
@@ -966,6 +1055,34 @@ void talk_buffer_set_policy(int policy)
     }
 }
 
+/* From here to talk_prefetch_end() the calling thread's talk functions load
+ * the clips they would speak into the cache but don't speak them, so the
+ * next utterance can be spoken without waiting for the disk. The loads
+ * happen on the caller's thread, so a sleeping disk is never spun up for
+ * them. Returns false if there is nothing to gain, in which case
+ * talk_prefetch_end() needn't be called. */
+bool talk_prefetch_begin(void)
+{
+    if (!has_voicefile || talk_handle <= 0 || talk_temp_disable_count > 0)
+        return false;
+#ifndef TALK_PROGRESSIVE_LOAD
+    /* all clips were loaded up front */
+    if (voicebuf_size >= voicefile_size)
+        return false;
+#endif
+#ifdef HAVE_DISK_STORAGE
+    if (!storage_disk_is_active())
+        return false;
+#endif
+    prefetch_thread = thread_self();
+    return true;
+}
+
+void talk_prefetch_end(void)
+{
+    prefetch_thread = 0;
+}
+
 /* play a voice ID from voicefile */
 int talk_id(int32_t id, bool enqueue)
 {
@@ -1037,7 +1154,8 @@ int talk_idarray(const long *ids, bool enqueue)
 /* Make sure the current utterance is not interrupted by the next one. */
 void talk_force_enqueue_next(void)
 {
-    force_enqueue_next = true;
+    if (!prefetching())
+        force_enqueue_next = true;
 }
 
 /* play a thumbnail from file */
@@ -1056,6 +1174,8 @@ static int _talk_file(const char* filename,
     /* reload needed? */
     if (talk_temp_disable_count > 0)
         return -1;  /* talking has been disabled */
+    if (prefetching()) /* thumbnails aren't cached, only tell if there is one */
+        return file_exists(filename) ? 1 : 0;
     if (!check_audio_status())
         return -1;
     if (talk_handle <= 0)
@@ -1085,7 +1205,14 @@ static int _talk_file(const char* filename,
 
     /* free clips from cache until this one succeeds to allocate */
     while ((handle = buflib_alloc(&clip_ctx, size)) < 0)
-        oldest = free_oldest_clip();
+    {
+        oldest = free_least_used_clip();
+        if (oldest < 0)
+        {
+            close(fd);
+            return 0;
+        }
+    }
 
     size = read_to_handle_ex(fd, &clip_ctx, handle, 0, size);
     close(fd);
@@ -1109,7 +1236,11 @@ static int _talk_file(const char* filename,
         /* finally insert into metadata table. thumb clips go under the
          * VOICEONLY_DELIMITER id so the cache can distinguish them from
          * normal clips */
-        add_cache_entry(handle, oldest, VOICEONLY_DELIMITER);
+        if (!add_cache_entry(handle, oldest, VOICEONLY_DELIMITER))
+        {
+            buflib_free(&clip_ctx, handle);
+            return 0;
+        }
         queue_clip(&clip, true);
     }
     else
@@ -1561,6 +1692,8 @@ bool talk_get_debug_data(struct talk_debug_data *data)
     data->cached_clips = cached;
     data->cache_hits   = cache_hits;
     data->cache_misses = cache_misses;
+    data->prefetch_loads = prefetch_loads;
+    data->prefetch_hits  = prefetch_hits;
 
     return true;
 }
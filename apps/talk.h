@@ -119,6 +119,9 @@ void talk_setting(const void *global_settings_variable); /* read a setting */
 void talk_disable(bool disable); /* temporarily disable (or re-enable) talking (temporarily, not persisted) */
 void talk_force_shutup(void); /* kill voice unconditionally */
 void talk_shutup(void); /* Interrupt voice, as when enqueue is false */
+/* load what the talk functions in between would say without saying it */
+bool talk_prefetch_begin(void);
+void talk_prefetch_end(void);
 
 /* helper function for speaking fractional numbers */
 void talk_fractional(char *tbuf, int value, int unit);
@@ -170,6 +173,8 @@ struct talk_debug_data {
     int  cached_clips;
     int  cache_hits;
     int  cache_misses;
+    int  prefetch_loads;
+    int  prefetch_hits;
 };
 
 bool talk_get_debug_data(struct talk_debug_data *data);
@@ -1134,6 +1134,25 @@ file_error:
     return rc;
 }
 
+/* get the modification time of an open file */
+time_t filemtime(int fildes)
+{
+    struct filestr_desc * const file = GET_FILESTR(READER, fildes);
+    if (!file)
+        FILE_ERROR_RETURN(ERRNO, -1);
+
+    time_t rc;
+    struct fat_direntry fatent;
+
+    if (fat_fstat(&file->stream.infop->fatfile, &fatent) < 0)
+        FILE_ERROR(EIO, -2);
+
+    rc = fattime_mktime(fatent.wrtdate, fatent.wrttime);
+file_error:
+    RELEASE_FILESTR(READER, file);
+    return rc;
+}
+
 /* test if two file descriptors refer to the same file */
 int fsamefile(int fildes1, int fildes2)
 {
@@ -331,6 +331,17 @@ void fileobj_fileop_truncate(struct filestr_base *stream)
         ftruncate_internal_callback(stream, s);
 }
 
+/* the FS driver cut the file's cluster chain short; the runs of it that any
+   stream has learned may no longer be part of the file */
+void fileobj_discard_extents(struct fat_file *fatfilep)
+{
+    struct fileobj_binding *fobp =
+        container_of(fatfilep, struct fileobj_binding, bind.info.fatfile);
+
+    FOR_EACH_STREAM(FIRST, fobp, s)
+        fat_discard_extents(&s->fatstr);
+}
+
 /* query for the pointer to the size storage for the file object */
 file_size_t * fileobj_get_sizep(const struct filestr_base *stream)
 {
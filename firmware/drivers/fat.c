@@ -30,6 +30,7 @@
 #include "pathfuncs.h"
 #include "disk_cache.h"
 #include "file_internal.h" /* for struct filestr_cache */
+#include "fileobj_mgr.h"
 #include "storage.h"
 #include "timefuncs.h"
 #include "rbunicode.h"
@@ -795,35 +796,105 @@ static unsigned long cluster2sec(struct bpb *fat_bpb, long cluster)
             + fat_bpb->firstdatasector;
 }
 
-#ifdef HAVE_FAT16SUPPORT
-static long get_next_cluster16(struct bpb *fat_bpb, long startcluster)
+/* lock the cache and return the cached FAT sector holding the entry of
+   cluster, with *offset set to the index of the entry in it; returns NULL with
+   the cache unlocked if the sector can't be read */
+static void * cache_fat_entry(struct bpb *fat_bpb, unsigned long cluster,
+                              unsigned long *offset)
 {
-    /* if FAT16 root dir, dont use the FAT */
-    if (startcluster < 0)
-        return startcluster + 1;
+    unsigned long perfatsec = CLUSTERS_PER_FAT_SECTOR;
 
-    unsigned long entry = startcluster;
-    unsigned long sector = entry / CLUSTERS_PER_FAT16_SECTOR;
-    unsigned long offset = entry % CLUSTERS_PER_FAT16_SECTOR;
+#ifdef HAVE_FAT16SUPPORT
+    if (fat_bpb->is_fat16)
+        perfatsec = CLUSTERS_PER_FAT16_SECTOR;
+#endif /* HAVE_FAT16SUPPORT */
+
+    unsigned long sector = cluster / perfatsec;
+    *offset = cluster % perfatsec;
 
     dc_lock_cache();
 
-    uint16_t *sec = cache_sector(fat_bpb, sector + fat_bpb->fatrgnstart);
+    void *sec = cache_sector(fat_bpb, sector + fat_bpb->fatrgnstart);
     if (!sec)
     {
         dc_unlock_cache();
         DEBUGF("%s: Could not cache sector %lu\n", __func__, sector);
+    }
+
+    return sec;
+}
+
+/* return the next cluster in the chain, 0 at its end or -1 on error; if count
+   isn't NULL, also the number of clusters after cluster that follow it
+   contiguously as far as its FAT sector tells */
+static long get_next_cluster_run(struct bpb *fat_bpb, long cluster,
+                                 long *count)
+{
+    unsigned long perfatsec = CLUSTERS_PER_FAT_SECTOR;
+    unsigned long eofmark = FAT_EOF_MARK;
+    long run = 0;
+
+#ifdef HAVE_FAT16SUPPORT
+    if (fat_bpb->is_fat16)
+    {
+        /* if FAT16 root dir, dont use the FAT */
+        if (cluster < 0)
+        {
+            if (count)
+                *count = 0;
+            return cluster + 1;
+        }
+
+        perfatsec = CLUSTERS_PER_FAT16_SECTOR;
+        eofmark = FAT16_EOF_MARK;
+    }
+#endif /* HAVE_FAT16SUPPORT */
+
+    unsigned long entry = cluster;
+    unsigned long offset;
+
+    void *sec = cache_fat_entry(fat_bpb, entry, &offset);
+    if (!sec)
         return -1;
+
+    unsigned long next;
+
+    while (1)
+    {
+    #ifdef HAVE_FAT16SUPPORT
+        if (fat_bpb->is_fat16)
+            next = letoh16(((uint16_t *)sec)[offset]);
+        else
+    #endif /* HAVE_FAT16SUPPORT */
+            next = letoh32(((uint32_t *)sec)[offset]) & 0x0fffffff;
+
+        if (!count || next != entry + 1)
+            break;
+
+        run++;
+
+        if (++offset >= perfatsec)
+            break;
+
+        entry++;
     }
 
-    long next = letoh16(sec[offset]);
+    dc_unlock_cache();
+
+    if (count)
+        *count = run;
+
+    if (run)
+        return cluster + 1;
 
     /* is this last cluster in chain? */
-    if (next >= FAT16_EOF_MARK)
-        next = 0;
+    return next >= eofmark ? 0 : (long)next;
+}
 
-    dc_unlock_cache();
-    return next;
+#ifdef HAVE_FAT16SUPPORT
+static long get_next_cluster16(struct bpb *fat_bpb, long startcluster)
+{
+    return get_next_cluster_run(fat_bpb, startcluster, NULL);
 }
 
 static long find_free_cluster16(struct bpb *fat_bpb, long startcluster)
@@ -868,8 +939,7 @@ static long find_free_cluster16(struct bpb *fat_bpb, long startcluster)
 static int update_fat_entry16(struct bpb *fat_bpb, unsigned long entry,
                               unsigned long val)
 {
-    unsigned long sector = entry / CLUSTERS_PER_FAT16_SECTOR;
-    unsigned long offset = entry % CLUSTERS_PER_FAT16_SECTOR;
+    unsigned long offset;
 
     val &= 0xFFFF;
 
@@ -881,15 +951,9 @@ static int update_fat_entry16(struct bpb *fat_bpb, unsigned long entry,
     if (entry < 2)
         panicf("Updating reserved FAT16 entry %lu\n", entry);
 
-    dc_lock_cache();
-
-    int16_t *sec = cache_sector(fat_bpb, sector + fat_bpb->fatrgnstart);
+    int16_t *sec = cache_fat_entry(fat_bpb, entry, &offset);
     if (!sec)
-    {
-        dc_unlock_cache();
-        DEBUGF("Could not cache sector %lu\n", sector);
         return -1;
-    }
 
     uint16_t curval = letoh16(sec[offset]);
 
@@ -961,28 +1025,7 @@ static void update_fsinfo32(struct bpb *fat_bpb)
 
 static long get_next_cluster32(struct bpb *fat_bpb, long startcluster)
 {
-    unsigned long entry = startcluster;
-    unsigned long sector = entry / CLUSTERS_PER_FAT_SECTOR;
-    unsigned long offset = entry % CLUSTERS_PER_FAT_SECTOR;
-
-    dc_lock_cache();
-
-    uint32_t *sec = cache_sector(fat_bpb, sector + fat_bpb->fatrgnstart);
-    if (!sec)
-    {
-        dc_unlock_cache();
-        DEBUGF("%s: Could not cache sector %lu\n", __func__, sector);
-        return -1;
-    }
-
-    long next = letoh32(sec[offset]) & 0x0fffffff;
-
-    /* is this last cluster in chain? */
-    if (next >= FAT_EOF_MARK)
-        next = 0;
-
-    dc_unlock_cache();
-    return next;
+    return get_next_cluster_run(fat_bpb, startcluster, NULL);
 }
 
 static long find_free_cluster32(struct bpb *fat_bpb, long startcluster)
@@ -1027,8 +1070,7 @@ static long find_free_cluster32(struct bpb *fat_bpb, long startcluster)
 static int update_fat_entry32(struct bpb *fat_bpb, unsigned long entry,
                               unsigned long val)
 {
-    unsigned long sector = entry / CLUSTERS_PER_FAT_SECTOR;
-    unsigned long offset = entry % CLUSTERS_PER_FAT_SECTOR;
+    unsigned long offset;
 
     DEBUGF("%s(entry:%lx,val:%lx)\n", __func__, entry, val);
 
@@ -1038,15 +1080,9 @@ static int update_fat_entry32(struct bpb *fat_bpb, unsigned long entry,
     if (entry < 2)
         panicf("Updating reserved FAT32 entry %lu\n", entry);
 
-    dc_lock_cache();
-
-    uint32_t *sec = cache_sector(fat_bpb, sector + fat_bpb->fatrgnstart);
+    uint32_t *sec = cache_fat_entry(fat_bpb, entry, &offset);
     if (!sec)
-    {
-        dc_unlock_cache();
-        DEBUGF("Could not cache sector %lu\n", sector);
         return -1;
-    }
 
     uint32_t curval = letoh32(sec[offset]);
 
@@ -2045,6 +2081,44 @@ bool fat_dir_is_parent(const struct fat_file *dir, const struct fat_file *file)
             IF_MV( && dir->volume == file->volume );
 }
 
+/* read the directory entry of a file, the long name isn't filled in */
+int fat_fstat(struct fat_file *file, struct fat_direntry *entry)
+{
+    struct bpb * const fat_bpb = FAT_BPB(file->volume);
+    if (!fat_bpb)
+        return -1;
+
+    int rc;
+
+    if (!file->dircluster)
+    {
+        /* the root directory has no entry of its own */
+        fat_empty_fat_direntry(entry);
+        return 0;
+    }
+
+    /* open the parent directory */
+    struct fat_file parent;
+    fat_open_internal(IF_MV(file->volume,) file->dircluster, &parent);
+
+    struct fat_filestr parentstr;
+    fat_filestr_init(&parentstr, &parent);
+
+    dc_lock_cache();
+
+    union raw_dirent *ent = cache_direntry(fat_bpb, &parentstr, file->e.entry);
+    if (!ent || !ent->name[0] || ent->name[0] == 0xe5)
+        FAT_ERROR(-2);
+
+    entry->name[0] = '\0';
+    parse_short_direntry(ent, entry);
+
+    rc = 0;
+fat_error:
+    dc_unlock_cache();
+    return rc;
+}
+
 bool fat_file_is_same(const struct fat_file *file1,
                       const struct fat_file *file2)
 {
@@ -2334,6 +2408,131 @@ unsigned long fat_query_sectornum(const struct fat_filestr *filestr)
     return fat_bpb->bpb_secperclus*filestr->clusternum + filestr->sectornum + 1;
 }
 
+/** Extent cache **/
+
+/* Each stream remembers a few runs of contiguous clusters of its file as the
+   chain is followed, so that reading through a run doesn't consult the FAT
+   for every cluster and seeking starts from the closest run rather than from
+   the first cluster. Runs are found by scanning ahead in the FAT sector that
+   the lookup caches anyway. Links already followed only change when the file
+   is truncated, which discards the extents. */
+
+/* return the index of the last extent starting at or before clusternum or -1
+   if there is none */
+static int find_extent(const struct fat_filestr *filestr, long clusternum)
+{
+    int lo = 0, hi = filestr->numextents;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (filestr->extents[mid].clusternum <= clusternum)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo - 1;
+}
+
+static void remove_extent(struct fat_filestr *filestr, int i)
+{
+    struct fat_extent *ext = filestr->extents;
+    memmove(&ext[i], &ext[i + 1],
+            (--filestr->numextents - i) * sizeof (*ext));
+}
+
+static void add_extent(struct fat_filestr *filestr, long clusternum,
+                       long cluster, long count)
+{
+    struct fat_extent *ext = filestr->extents;
+    int i = find_extent(filestr, clusternum);
+
+    if (i >= 0 && clusternum <= ext[i].clusternum + ext[i].count &&
+        cluster - ext[i].cluster == clusternum - ext[i].clusternum)
+    {
+        /* continues the run before */
+        long end = clusternum + count;
+        if (end > ext[i].clusternum + ext[i].count)
+            ext[i].count = end - ext[i].clusternum;
+    }
+    else
+    {
+        i++;
+
+        if (filestr->numextents >= FAT_MAX_EXTENTS)
+        {
+            /* make room by dropping the shortest run, if shorter */
+            int shortest = 0;
+            for (int j = 1; j < FAT_MAX_EXTENTS; j++)
+            {
+                if (ext[j].count < ext[shortest].count)
+                    shortest = j;
+            }
+
+            if (ext[shortest].count >= count)
+                return;
+
+            remove_extent(filestr, shortest);
+            if (shortest < i)
+                i--;
+        }
+
+        memmove(&ext[i + 1], &ext[i],
+                (filestr->numextents - i) * sizeof (*ext));
+        ext[i].clusternum = clusternum;
+        ext[i].cluster    = cluster;
+        ext[i].count      = count;
+        filestr->numextents++;
+    }
+
+    /* absorb the runs it now reaches */
+    while (i + 1 < (int)filestr->numextents &&
+           ext[i + 1].clusternum <= ext[i].clusternum + ext[i].count)
+    {
+        long end = ext[i + 1].clusternum + ext[i + 1].count;
+
+        if (ext[i + 1].cluster - ext[i].cluster ==
+                ext[i + 1].clusternum - ext[i].clusternum &&
+            end > ext[i].clusternum + ext[i].count)
+        {
+            ext[i].count = end - ext[i].clusternum;
+        }
+
+        remove_extent(filestr, i + 1);
+    }
+}
+
+/* return the cluster following cluster, which is number clusternum in the
+   file, using and adding to the stream's extents */
+static long get_next_file_cluster(struct bpb *fat_bpb,
+                                  struct fat_filestr *filestr,
+                                  long clusternum, long cluster)
+{
+    int i = find_extent(filestr, clusternum);
+    if (i >= 0)
+    {
+        const struct fat_extent *ext = &filestr->extents[i];
+        if (clusternum + 1 < ext->clusternum + ext->count &&
+            cluster - ext->cluster == clusternum - ext->clusternum)
+            return cluster + 1;
+    }
+
+    long count;
+    long next = get_next_cluster_run(fat_bpb, cluster, &count);
+
+    if (count)
+        add_extent(filestr, clusternum, cluster, count + 1);
+
+    return next;
+}
+
+void fat_discard_extents(struct fat_filestr *filestr)
+{
+    filestr->numextents = 0;
+}
+
 /* helper for fat_readwrite */
 static long transfer(struct bpb *fat_bpb, unsigned long start, long count,
                      char *buf, bool write)
@@ -2453,8 +2652,9 @@ long fat_readwrite(struct fat_filestr *filestr, unsigned long sectorcount,
         if (++sectornum >= fat_bpb->bpb_secperclus)
         {
             /* out of sectors in this cluster; get the next cluster */
-            long newcluster = write ? next_write_cluster(fat_bpb, cluster) :
-                                      get_next_cluster(fat_bpb, cluster);
+            long newcluster = write ?
+                next_write_cluster(fat_bpb, cluster) :
+                get_next_file_cluster(fat_bpb, filestr, clusternum, cluster);
             if (newcluster)
             {
                 cluster = newcluster;
@@ -2523,6 +2723,7 @@ void fat_rewind(struct fat_filestr *filestr)
     filestr->clusternum   = 0;
     filestr->sectornum    = FAT_RW_VAL;
     filestr->eof          = false;
+    filestr->numextents   = 0;
 }
 
 int fat_seek(struct fat_filestr *filestr, unsigned long seeksector)
@@ -2560,23 +2761,37 @@ int fat_seek(struct fat_filestr *filestr, unsigned long seeksector)
         clusternum = seeksector / fat_bpb->bpb_secperclus;
         sectornum = seeksector % fat_bpb->bpb_secperclus;
 
-        long numclusters = clusternum;
+        long num = 0;
 
         if (filestr->clusternum && clusternum >= filestr->clusternum)
         {
             /* seek forward from current position */
             cluster = filestr->lastcluster;
-            numclusters -= filestr->clusternum;
+            num = filestr->clusternum;
+        }
+
+        int i = find_extent(filestr, clusternum);
+        if (i >= 0)
+        {
+            /* a known run gets closer? */
+            const struct fat_extent *ext = &filestr->extents[i];
+            long extnum = MIN(clusternum, ext->clusternum + ext->count - 1);
+
+            if (extnum > num)
+            {
+                cluster = ext->cluster + (extnum - ext->clusternum);
+                num = extnum;
+            }
         }
 
-        for (long i = 0; i < numclusters; i++)
+        for (; num < clusternum; num++)
         {
-            cluster = get_next_cluster(fat_bpb, cluster);
+            cluster = get_next_file_cluster(fat_bpb, filestr, num, cluster);
 
             if (!cluster)
             {
                 DEBUGF("Seeking beyond the end of the file! "
-                       "(sector %lu, cluster %ld)\n", seeksector, i);
+                       "(sector %lu, cluster %ld)\n", seeksector, num);
                 FAT_ERROR(FAT_SEEK_EOF);
             }
         }
@@ -2597,7 +2812,7 @@ fat_error:
     return rc;
 }
 
-int fat_truncate(const struct fat_filestr *filestr)
+int fat_truncate(struct fat_filestr *filestr)
 {
     DEBUGF("%s(): %lX\n", __func__, filestr->lastcluster);
 
@@ -2610,6 +2825,9 @@ int fat_truncate(const struct fat_filestr *filestr)
     long last = filestr->lastcluster;
     long next = 0;
 
+    /* every stream of the file may know runs past the new end */
+    fileobj_discard_extents(filestr->fatfilep);
+
     /* truncate trailing clusters after the current position */
     if (last)
     {
@@ -946,6 +946,12 @@ Lyre prototype 1 */
 #define HAVE_CROSSFADE
 #endif
 
+/*include the band-limited sinc resampler - requires 17 KiB of filter state and
+  many times the cycles of the default one */
+#if (CONFIG_PLATFORM & PLATFORM_HOSTED)
+#define HAVE_SINC_RESAMPLER
+#endif
+
 #endif /*  (CONFIG_CODEC == SWCODEC) */
 
 /* Determine if accesses should be strictly long aligned. */
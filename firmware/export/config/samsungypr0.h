@@ -101,6 +101,11 @@
 #define HAVE_AS3514
 #define HAVE_AS3543
 
+/* Audio goes out through ALSA (pcm-alsa.c) */
+#define HAVE_PCM_ALSA
+/* fed from a realtime writer thread rather than the async callback */
+#define PCM_ALSA_WRITER_THREAD
+
 /* We don't have hardware controls */
 #define HAVE_SW_TONE_CONTROLS
 
@@ -99,6 +99,11 @@
 /* We have WM1808, which so far is compatible with the following */
 #define HAVE_WM8978
 
+/* Audio goes out through ALSA (pcm-alsa.c) */
+#define HAVE_PCM_ALSA
+/* fed from a realtime writer thread rather than the async callback */
+#define PCM_ALSA_WRITER_THREAD
+
 /* For the moment the only supported frequency is 44kHz,
  * even if the codec supports more (see wmcodec-ypr1.c)
  */
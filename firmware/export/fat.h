@@ -48,6 +48,12 @@
 #define FAT_MAX_TRANSFER_SIZE 256
 #endif
 
+/* runs of contiguous clusters each open stream remembers of its file; more
+ * make seeking in fragmented files cheaper but every stream pays for them */
+#ifndef FAT_MAX_EXTENTS
+#define FAT_MAX_EXTENTS 4
+#endif
+
 /* still experimental? */
 /* increasing this will increase the total memory used by the cache; the
    cache, as noted in disk_cache.h, has other minimum requirements that may
@@ -116,6 +122,14 @@ struct fat_file
     struct fat_dirscan_info e;  /* entry information */
 };
 
+/* a run of contiguous clusters in a file's cluster chain */
+struct fat_extent
+{
+    long clusternum;            /* cluster number within the file */
+    long cluster;               /* its cluster on the volume */
+    long count;                 /* number of clusters in the run */
+};
+
 /* this stores what was last accessed when read or writing a file's data */
 struct fat_filestr
 {
@@ -125,6 +139,8 @@ struct fat_filestr
     long          clusternum;   /* cluster number of last access */
     unsigned long sectornum;    /* sector number within current cluster */
     bool          eof;          /* end-of-file reached */
+    unsigned int  numextents;   /* extents known, sorted by clusternum */
+    struct fat_extent extents[FAT_MAX_EXTENTS];
 };
 
 /** File entity functions **/
@@ -156,7 +172,8 @@ long fat_readwrite(struct fat_filestr *filestr, unsigned long sectorcount,
                    void *buf, bool write);
 void fat_rewind(struct fat_filestr *filestr);
 int fat_seek(struct fat_filestr *filestr, unsigned long sector);
-int fat_truncate(const struct fat_filestr *filestr);
+int fat_truncate(struct fat_filestr *filestr);
+void fat_discard_extents(struct fat_filestr *filestr);
 
 /** Directory stream functions **/
 struct filestr_cache;
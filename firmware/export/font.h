@@ -138,6 +138,12 @@ struct font* font_get(int font);
 int font_getstringsize(const unsigned char *str, int *w, int *h, int fontnumber);
 int font_get_width(struct font* ft, unsigned short ch);
 const unsigned char * font_get_bits(struct font* ft, unsigned short ch);
+/* Loads the glyphs of a UCS-2 string ahead of font_get_{bits,width} */
+void font_prefetch_glyphs(struct font* pf, const unsigned short *ucs);
+#ifndef __PCTOOL__
+/* Glyph cache statistics, false if the font isn't loaded or not cached */
+bool font_get_cache_stats(int font_id, struct font_cache_stats *stats);
+#endif
 
 #else /* HAVE_LCD_BITMAP */
 
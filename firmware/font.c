@@ -119,7 +119,8 @@ static int buflibmove_callback(int handle, void* current, void* new)
     UPDATE(alloc->font.buffer_end);
     UPDATE(alloc->font.buffer_position);
 
-    UPDATE(alloc->font.cache._index);
+    UPDATE(alloc->font.cache._hash);
+    UPDATE(alloc->font.cache._next);
     UPDATE(alloc->font.cache._lru._base);
 
     return BUFLIB_CB_OK;
@@ -355,9 +356,9 @@ static size_t font_glyphs_to_bufsize(struct font *pf, int glyphs)
 {
     size_t bufsize;
 
-    /* LRU bytes per glyph */
+    /* LRU and hash bytes per glyph */
     bufsize = LRU_SLOT_OVERHEAD + sizeof(struct font_cache_entry) + 
-        sizeof( unsigned short);
+        2 * sizeof(short);
     /* Image bytes per glyph */
     bufsize += glyph_bytes(pf, pf->maxwidth);
     bufsize *= glyphs;
@@ -881,7 +882,7 @@ static void glyph_file_write(void* data)
         if ( data == NULL )
             return;
     }
-    if ( p->_char_code == 0xffff )
+    if (!(p->_flags & FONT_CACHE_USED))
         return;
     
     ch = p->_char_code + pf->firstchar;
@@ -929,6 +930,63 @@ static int ushortcmp(const void *a, const void *b)
 {
     return ((int)(*(unsigned short*)a - *(unsigned short*)b));
 }
+
+/*
+ * Brings all glyphs of a 0 terminated UCS-2 string into the cache at once.
+ * The missing ones are loaded in char code order, which is also the order
+ * of their widths, offsets and bitmaps in the file, so each section is read
+ * front to back instead of seeking around for every glyph drawn.
+ */
+void font_prefetch_glyphs(struct font* pf, const unsigned short *ucs)
+{
+#define MAX_PREFETCH 64
+    unsigned short missing[MAX_PREFETCH];
+    int count = 0, seen = 0, i;
+
+    if (pf->fd < 0 || pf == &sysfont)
+        return;
+
+    /* stop at half the cache so that loading can't push out glyphs
+     * needed by the same string */
+    for (; *ucs && count < MAX_PREFETCH && seen < pf->cache._capacity / 2;
+         ucs++)
+    {
+        unsigned short char_code = *ucs;
+        if (char_code < pf->firstchar ||
+            char_code >= pf->firstchar+pf->size)
+            char_code = pf->defaultchar;
+        char_code -= pf->firstchar;
+
+        seen++;
+        if (!font_cache_touch(&pf->cache, char_code))
+            missing[count++] = char_code;
+    }
+    if (count == 0)
+        return;
+
+    qsort(missing, count, sizeof(unsigned short), ushortcmp);
+    for (i = 0; i < count; i++)
+    {
+        if (i == 0 || missing[i] != missing[i-1])
+            font_cache_prefetch(&pf->cache, missing[i],
+                                load_cache_entry, pf);
+    }
+}
+
+bool font_get_cache_stats(int font_id, struct font_cache_stats *stats)
+{
+    if (font_id < 0 || font_id >= MAXFONTS)
+        return false;
+    int handle = buflib_allocations[font_id];
+    if (handle <= 0)
+        return false;
+    struct font *pf = pf_from_handle(handle);
+    if (pf->fd < 0 && !pf->disabled)
+        return false; /* entirely in RAM */
+    font_cache_get_stats(&pf->cache, stats);
+    return true;
+}
+
 static void glyph_cache_load(const char *font_path, struct font *pf)
 {
 #define MAX_SORT 256
@@ -1030,6 +1088,12 @@ int font_get_width(struct font* pf, unsigned short char_code)
     return pf->width? pf->width[char_code]: pf->maxwidth;
 }
 
+void font_prefetch_glyphs(struct font* pf, const unsigned short *ucs)
+{
+    (void)pf;
+    (void)ucs;
+}
+
 const unsigned char* font_get_bits(struct font* pf, unsigned short char_code)
 {
     const unsigned char* bits;
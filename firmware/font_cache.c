@@ -18,17 +18,20 @@
  *
  ****************************************************************************/
 
+#include <stddef.h>
 #include <string.h>
 #include "font_cache.h"
 #include "debug.h"
 
+#define NO_ENTRY -1
+
 /*******************************************************************************
  * font_cache_lru_init
  ******************************************************************************/
 static void font_cache_lru_init(void* data)
 {
     struct font_cache_entry* p = data;
-    p->_char_code = 0xffff;   /* assume invalid char */
+    p->_flags = 0;   /* free, any char code is valid */
 }
 
 /*******************************************************************************
@@ -41,84 +44,151 @@ void font_cache_create(
     int bitmap_bytes_size)
 {
     int font_cache_entry_size =
-        sizeof(struct font_cache_entry) + bitmap_bytes_size;
+        offsetof(struct font_cache_entry, bitmap) + bitmap_bytes_size;
 
     /* make sure font cache entries are a multiple of 16 bits */
     if (font_cache_entry_size % 2 != 0)
         font_cache_entry_size++;
 
+    /* each entry also takes a chain link and at most one hash bucket */
     int cache_size = buf_size /
-        (font_cache_entry_size + LRU_SLOT_OVERHEAD + sizeof(short));
+        (font_cache_entry_size + LRU_SLOT_OVERHEAD + 2 * sizeof(short));
+
+    int buckets = 1;
+    while (buckets * 2 <= cache_size)
+        buckets *= 2;
 
-    fcache->_size = 1;
+    fcache->_size = 0;
     fcache->_capacity = cache_size;
-    fcache->_prev_result = 0;
-    fcache->_prev_char_code = 0;
+    fcache->_hash_mask = buckets - 1;
+    fcache->_hits = 0;
+    fcache->_misses = 0;
 
-    /* set up index */
-    fcache->_index = buf;
+    /* set up the hash table */
+    fcache->_hash = buf;
+    fcache->_next = fcache->_hash + buckets;
 
     /* set up lru list */
-    unsigned char* lru_buf = buf;
-    lru_buf += sizeof(short) * cache_size;
+    unsigned char* lru_buf = (unsigned char*)(fcache->_next + cache_size);
     lru_create(&fcache->_lru, lru_buf, cache_size, font_cache_entry_size);
 
     /* initialise cache */
     lru_traverse(&fcache->_lru, font_cache_lru_init);
-    short i;
-    for (i = 0; i < cache_size; i++)
-        fcache->_index[i] = i; /* small cheat here */
+    int i;
+    for (i = 0; i < buckets; i++)
+        fcache->_hash[i] = NO_ENTRY;
+}
+
+static inline short *bucket(struct font_cache* fcache,
+                            unsigned short char_code)
+{
+    return &fcache->_hash[char_code & fcache->_hash_mask];
 }
 
-/*************************************************************************
- * Binary search that attempts a primary lucky guess that succeeds
- * when there are consecutive codes in the cache between previous 
- * search and new search. Returns a negative of insertion point if 
- * not found.
- ************************************************************************/
-static int search(struct font_cache* fcache,
-                  unsigned short char_code,
-                  int size,
-                  int *p_insertion_point )
+/*******************************************************************************
+ * find the lru handle of char_code, NO_ENTRY if it is not cached
+ ******************************************************************************/
+static short lookup(struct font_cache* fcache, unsigned short char_code)
 {
-    struct font_cache_entry *p;
-    int left, right, mid=-1, c;
-    left = 0;
-    right = size;
-    
-    /* go for a lucky guess */
-    mid = char_code + 
-        fcache->_prev_result - fcache->_prev_char_code;
-            
-    /* check bounds */        
-    if ( mid < 0 || mid > right )
-            mid = ( left + right ) / 2;
-
-    do
+    short handle = *bucket(fcache, char_code);
+    while (handle != NO_ENTRY)
     {
-        p = lru_data(&fcache->_lru, fcache->_index[mid]);
-        c = p->_char_code - char_code;
+        struct font_cache_entry *p = lru_data(&fcache->_lru, handle);
+        if (p->_char_code == char_code) /* chained entries are all used */
+            break;
+        handle = fcache->_next[handle];
+    }
+    return handle;
+}
 
-        if (c == 0)
+/*******************************************************************************
+ * remove the entry at handle from the chain of its char_code
+ ******************************************************************************/
+static void chain_remove(struct font_cache* fcache, unsigned short char_code,
+                   short handle)
+{
+    short *link = bucket(fcache, char_code);
+    while (*link != NO_ENTRY)
+    {
+        if (*link == handle)
         {
-            fcache->_prev_result = mid;
-            fcache->_prev_char_code = char_code;
-            *p_insertion_point = mid;
-            return 1;
+            *link = fcache->_next[handle];
+            return;
         }
-        if (c < 0)
-            left = mid + 1;
-        else
-            right = mid - 1;
-
-        mid = (left + right) / 2;
+        link = &fcache->_next[*link];
     }
-    while (left <= right);
-    
-    /* not found */
-    *p_insertion_point = mid;
-    return 0;
 }
+
+/*******************************************************************************
+ * font_cache_touch
+ ******************************************************************************/
+bool font_cache_touch(struct font_cache* fcache, unsigned short char_code)
+{
+    short handle = lookup(fcache, char_code);
+    if (handle == NO_ENTRY)
+        return false;
+    lru_touch(&fcache->_lru, handle);
+    return true;
+}
+
+/*******************************************************************************
+ * font_cache_get_stats
+ ******************************************************************************/
+void font_cache_get_stats(struct font_cache* fcache,
+                          struct font_cache_stats* stats)
+{
+    stats->size = fcache->_size;
+    stats->capacity = fcache->_capacity;
+    stats->hits = fcache->_hits;
+    stats->misses = fcache->_misses;
+}
+
+/*******************************************************************************
+ * load char_code into the least recently used entry
+ ******************************************************************************/
+static struct font_cache_entry* load(
+    struct font_cache* fcache,
+    unsigned short char_code,
+    unsigned char flags,
+    void (*callback) (struct font_cache_entry* p, void *callback_data),
+    void *callback_data)
+{
+    short handle = fcache->_lru._head;
+    struct font_cache_entry* p = lru_data(&fcache->_lru, handle);
+
+    if (p->_flags & FONT_CACHE_USED)
+        chain_remove(fcache, p->_char_code, handle);
+    else
+        fcache->_size++;
+
+    short *head = bucket(fcache, char_code);
+    fcache->_next[handle] = *head;
+    *head = handle;
+
+    /* load new entry into cache */
+    lru_touch(&fcache->_lru, handle);
+
+    p->_char_code = char_code;
+    p->_flags = FONT_CACHE_USED | flags;
+    /* fill bitmap */
+    callback(p, callback_data);
+    return p;
+}
+
+/*******************************************************************************
+ * font_cache_prefetch
+ ******************************************************************************/
+void font_cache_prefetch(
+    struct font_cache* fcache,
+    unsigned short char_code,
+    void (*callback) (struct font_cache_entry* p, void *callback_data),
+    void *callback_data)
+{
+    if (lookup(fcache, char_code) == NO_ENTRY)
+        load(fcache, char_code, FONT_CACHE_PREFETCHED,
+             callback, callback_data);
+}
+
 /*******************************************************************************
  * font_cache_get
  ******************************************************************************/
@@ -130,79 +200,27 @@ struct font_cache_entry* font_cache_get(
     void *callback_data)
 {
     struct font_cache_entry* p;
-    int insertion_point;
-    int index_to_replace;
-    
-    /* check bounds */
-    p = lru_data(&fcache->_lru, fcache->_index[0]);
-    if( char_code < p->_char_code )
-        insertion_point = -1;
-    else
+    short handle = lookup(fcache, char_code);
+
+    if (handle != NO_ENTRY)
     {
-        p = lru_data(&fcache->_lru, fcache->_index[fcache->_capacity - 1]);
-        if( char_code > p->_char_code )
+        p = lru_data(&fcache->_lru, handle);
+        /* the first lookup of a prefetched glyph is the miss it saved */
+        if (p->_flags & FONT_CACHE_PREFETCHED)
         {
-            insertion_point = fcache->_capacity - 1;
+            p->_flags &= ~FONT_CACHE_PREFETCHED;
+            fcache->_misses++;
         }
         else
-        {
-            if( search(fcache, char_code, fcache->_size - 1, &insertion_point))
-            {
-                short lru_handle = fcache->_index[insertion_point];
-                p = lru_data(&fcache->_lru, lru_handle);
-                if (p->_char_code == char_code)
-                {
-                    lru_touch(&fcache->_lru, lru_handle);
-                    return lru_data(&fcache->_lru, lru_handle);
-                }
-            }
-            else
-            {
-                p = lru_data(&fcache->_lru, 
-                fcache->_index[insertion_point+1]);
-                if ( char_code > p->_char_code )
-                     insertion_point++;
-            }
-        }
+            fcache->_hits++;
+        lru_touch(&fcache->_lru, handle);
+        return p;
     }
-    
+
     /* not found */
+    fcache->_misses++;
     if (cache_only)
         return NULL;
 
-    /* find index to replace */
-    short lru_handle_to_replace = fcache->_lru._head;
-    p = lru_data(&fcache->_lru, lru_handle_to_replace);
-    search(fcache, p->_char_code, fcache->_size - 1, &index_to_replace);
-    if (insertion_point < index_to_replace)
-    {
-        /* shift memory up */
-        memmove(fcache->_index + insertion_point + 2,
-                fcache->_index + insertion_point + 1,
-                (index_to_replace - insertion_point - 1) * sizeof(short));
-
-        /* add to index */
-        fcache->_index[insertion_point + 1] = lru_handle_to_replace;
-    }
-    else if (insertion_point > index_to_replace)
-    {
-        /* shift memory down */
-        memmove(fcache->_index + index_to_replace,
-                fcache->_index + index_to_replace + 1,
-                (insertion_point - index_to_replace) * sizeof(short));
-
-        /* add to index */
-        fcache->_index[insertion_point] = lru_handle_to_replace;
-    }
-
-    /* load new entry into cache */
-    lru_touch(&fcache->_lru, lru_handle_to_replace);
-
-    if (fcache->_size < fcache->_capacity)
-        fcache->_size++;
-
-    p->_char_code = char_code;
-    /* fill bitmap */
-    callback(p, callback_data);
-    return p;
+    return load(fcache, char_code, 0, callback, callback_data);
 }
@@ -88,6 +88,9 @@ int fdprintf(int fildes, const char *fmt, ...) ATTRIBUTE_PRINTF(2, 3);
 #ifndef filesize
 #define filesize        FS_PREFIX(filesize)
 #endif
+#ifndef filemtime
+#define filemtime       FS_PREFIX(filemtime)
+#endif
 #ifndef fsamefile
 #define fsamefile       FS_PREFIX(fsamefile)
 #endif
@@ -44,6 +44,7 @@ void fileobj_fileop_sync(struct filestr_base *stream);
 void fileobj_fileop_truncate(struct filestr_base *stream);
 extern void ftruncate_internal_callback(struct filestr_base *stream,
                                         struct filestr_base *s);
+void fileobj_discard_extents(struct fat_file *fatfilep);
 
 file_size_t * fileobj_get_sizep(const struct filestr_base *stream);
 unsigned int fileobj_get_flags(const struct filestr_base *stream);
@@ -54,6 +54,7 @@ ssize_t write(int fildes, const void *buf, size_t nbyte);
 int     remove(const char *path);
 int     rename(const char *old, const char *new);
 off_t   filesize(int fildes);
+time_t  filemtime(int fildes);
 int     fsamefile(int fildes1, int fildes2);
 int     relate(const char *path1, const char *path2);
 bool    file_exists(const char *path);
@@ -31,18 +31,33 @@ struct font_cache
     struct lru _lru;
     int _size;
     int _capacity;
-    int _prev_char_code;
-    int _prev_result;
-    short *_index; /* index of lru handles in char_code order */
+    int _hash_mask;
+    short *_hash; /* first lru handle for each char_code hash */
+    short *_next; /* next lru handle with the same hash, by lru handle */
+    unsigned long _hits;   /* lookups found in the cache */
+    unsigned long _misses; /* lookups which were not */
 };
 
 struct font_cache_entry
 {
     unsigned short _char_code;
+    unsigned char _flags;
     unsigned char width;
     unsigned char bitmap[1]; /* place holder */
 };
 
+/* font_cache_entry._flags */
+#define FONT_CACHE_USED       0x01 /* holds a glyph, _char_code is valid */
+#define FONT_CACHE_PREFETCHED 0x02 /* loaded ahead and not looked up yet */
+
+struct font_cache_stats
+{
+    int size;     /* glyphs in the cache */
+    int capacity; /* glyphs that fit */
+    unsigned long hits;
+    unsigned long misses;
+};
+
 /* void (*f) (void*, struct font_cache_entry*); */
 /* Create an auto sized font cache from buf */
 void font_cache_create(
@@ -60,4 +75,19 @@ struct font_cache_entry* font_cache_get(
     void (*callback) (struct font_cache_entry* p, void *callback_data),
     void *callback_data);
 
+/* Mark char_code as recently used without loading it or counting the
+ * lookup. Returns false if it is not in the cache. */
+bool font_cache_touch(struct font_cache* fcache, unsigned short char_code);
+
+/* Load char_code ahead of its use if it is not in the cache. Nothing is
+ * counted until font_cache_get() looks it up, which then counts a miss. */
+void font_cache_prefetch(
+    struct font_cache* fcache,
+    unsigned short char_code,
+    void (*callback) (struct font_cache_entry* p, void *callback_data),
+    void *callback_data);
+
+void font_cache_get_stats(struct font_cache* fcache,
+                          struct font_cache_stats* stats);
+
 #endif
@@ -83,6 +83,7 @@ ssize_t app_write(int fildes, const void *buf, size_t nbyte);
 int     app_remove(const char *path);
 int     app_rename(const char *old, const char *new);
 #define app_filesize    os_filesize
+#define app_filemtime   os_filemtime
 #define app_fsamefile   os_fsamefile
 int     app_relate(const char *path1, const char *path2);
 bool    app_file_exists(const char *path);
@@ -34,6 +34,7 @@ void * os_lc_open(const char *ospath);
 
 #ifndef OSFUNCTIONS_DECLARED
 off_t os_filesize(int osfd);
+time_t os_filemtime(int osfd);
 int os_fsamefile(int osfd1, int osfd2);
 int os_relate(const char *path1, const char *path2);
 bool os_file_exists(const char *ospath);
@@ -21,6 +21,7 @@
 #define RB_FILESYSTEM_OS
 #include <sys/statfs.h> /* lowest common denominator */
 #include <sys/stat.h>
+#include <time.h>
 #include <string.h>
 #include <errno.h>
 #include "config.h"
@@ -45,6 +46,18 @@ off_t os_filesize(int osfd)
         return -1;
 }
 
+time_t os_filemtime(int osfd)
+{
+    OS_STAT_T sb;
+    struct tm tm;
+
+    /* local time like dir_get_info() */
+    if (os_fstat(osfd, &sb) || !localtime_r(&sb.st_mtime, &tm))
+        return -1;
+
+    return mktime(&tm);
+}
+
 int os_fsamefile(int osfd1, int osfd2)
 {
     struct stat sb1, sb2;
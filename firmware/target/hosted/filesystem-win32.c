@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <time.h>
 #include "config.h"
 #include "system.h"
 #include "file.h"
@@ -360,6 +361,18 @@ int os_opendir_and_fd(const char *osdirname, _WDIR **osdirpp,
     return rc;
 }
 
+time_t os_filemtime(int osfd)
+{
+    OS_STAT_T sb;
+    struct tm tm;
+
+    /* local time like dir_get_info() */
+    if (os_fstat(osfd, &sb) || !localtime_r(&sb.st_mtime, &tm))
+        return -1;
+
+    return mktime(&tm);
+}
+
 int os_fsamefile(int osfd1, int osfd2)
 {
     BY_HANDLE_FILE_INFORMATION info1, info2;
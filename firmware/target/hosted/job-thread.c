@@ -0,0 +1,91 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <pthread.h>
+#include "job-thread.h"
+
+static pthread_mutex_t job_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static bool job_thread_running = false;
+static void (*job_fn)(void *arg) = NULL; /* pending or running job */
+static void *job_arg;
+
+static void * job_thread(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&job_mtx);
+    while (1)
+    {
+        while (!job_fn)
+            pthread_cond_wait(&job_cond, &job_mtx);
+
+        void (*fn)(void *) = job_fn;
+        pthread_mutex_unlock(&job_mtx);
+
+        fn(job_arg);
+
+        pthread_mutex_lock(&job_mtx);
+        job_fn = NULL;
+        pthread_cond_broadcast(&job_cond);
+    }
+
+    return NULL;
+}
+
+bool job_thread_init(void)
+{
+    pthread_t thread;
+
+    if (!job_thread_running &&
+        pthread_create(&thread, NULL, job_thread, NULL) == 0)
+    {
+        pthread_detach(thread);
+        job_thread_running = true;
+    }
+
+    return job_thread_running;
+}
+
+void job_thread_wait(void)
+{
+    if (!job_thread_running)
+        return;
+
+    pthread_mutex_lock(&job_mtx);
+    while (job_fn)
+        pthread_cond_wait(&job_cond, &job_mtx);
+    pthread_mutex_unlock(&job_mtx);
+}
+
+bool job_thread_start(void (*fn)(void *arg), void *arg)
+{
+    if (!job_thread_running)
+        return false;
+
+    job_thread_wait();
+
+    pthread_mutex_lock(&job_mtx);
+    job_fn = fn;
+    job_arg = arg;
+    pthread_cond_broadcast(&job_cond);
+    pthread_mutex_unlock(&job_mtx);
+    return true;
+}
@@ -0,0 +1,38 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef __JOB_THREAD_H__
+#define __JOB_THREAD_H__
+
+#include <stdbool.h>
+
+/* One native helper thread running one job at a time beside its caller;
+ * backs the codec API's job_start/job_wait on hosted builds. Jobs must be
+ * pure computation, they don't run as a Rockbox thread. */
+
+/* Start the thread if it isn't running yet. Returns false if it can't be. */
+bool job_thread_init(void);
+
+/* Hand fn(arg) to the thread, after the previous job is done. Returns false
+ * (and the caller does the work itself) if the thread isn't running. */
+bool job_thread_start(void (*fn)(void *arg), void *arg);
+
+/* Wait for the job handed over last to finish */
+void job_thread_wait(void);
+
+#endif /* __JOB_THREAD_H__ */
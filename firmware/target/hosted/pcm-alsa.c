@@ -32,13 +32,17 @@
  * tick tasks are run from a signal handler too, please install
  * an alternative stack for it too.
  *
- * TODO: Rewrite this to do it properly with multithreading
- *
  * Alternatively, a version using polling in a tick task is provided. While
  * supposedly safer, it appears to use more CPU (however I didn't measure it
  * accurately, only looked at htop). At least, in this mode the "default"
  * device works which doesnt break with other apps running.
- * device works which doesnt break with other apps running.
+ *
+ * The writer thread version does it properly with multithreading: a
+ * realtime priority thread sleeps on the device and copies each period
+ * straight from the mixer buffer into the mmap'ed ring, without the
+ * intermediate frames buffer. It copes with much smaller device buffers.
+ * If the device can't do mmap access, it falls back to snd_pcm_writei()
+ * from the same thread. Targets select it with PCM_ALSA_WRITER_THREAD.
  */
 
 
@@ -56,29 +60,53 @@
 #include "pcm_mixer.h"
 #include "pcm_sampr.h"
 #include "audiohw.h"
+#include "pcm-alsa.h"
 
 #include <pthread.h>
 #include <signal.h>
-
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Define one of these, or neither for the tick task */
+#ifdef PCM_ALSA_WRITER_THREAD
+#define USE_WRITER_THREAD
+#else
 #define USE_ASYNC_CALLBACK
+#endif
 /* plughw:0,0 works with both, however "default" is recommended.
  * default doesnt seem to work with async callback but doesn't break
  * with multple applications running */
 static char device[] = "plughw:0,0";                    /* playback device */
-static const snd_pcm_access_t access_ = SND_PCM_ACCESS_RW_INTERLEAVED; /* access mode */
+#ifdef USE_WRITER_THREAD
+static snd_pcm_access_t access_ = SND_PCM_ACCESS_MMAP_INTERLEAVED; /* access mode */
+#else
+static snd_pcm_access_t access_ = SND_PCM_ACCESS_RW_INTERLEAVED; /* access mode */
+#endif
 static const snd_pcm_format_t format = SND_PCM_FORMAT_S16;    /* sample format */
 static const int channels = 2;                                /* count of channels */
 static unsigned int rate = 44100;                       /* stream rate */
 
 static snd_pcm_t *handle;
-static snd_pcm_sframes_t buffer_size = MIX_FRAME_SAMPLES * 32; /* ~16k */
-static snd_pcm_sframes_t period_size = MIX_FRAME_SAMPLES * 4;  /*  ~4k */
+static snd_pcm_sframes_t buffer_size = PCM_ALSA_BUFFER_SIZE;
+static snd_pcm_sframes_t period_size = PCM_ALSA_PERIOD_SIZE;
 static short *frames;
 
 static const void  *pcm_data = 0;
 static size_t       pcm_size = 0;
 
-#ifdef USE_ASYNC_CALLBACK
+#if defined(USE_WRITER_THREAD)
+static pthread_mutex_t pcm_mtx;
+static pthread_cond_t writer_cond;
+static pthread_t writer;
+static bool writer_run = false;     /* set while the device should be fed */
+static bool writer_drain = false;   /* play out what's queued once stopped */
+static bool writer_quit = false;    /* set by cleanup() */
+static int writer_wakeup[2];        /* pipe to kick the writer out of poll */
+#elif defined(USE_ASYNC_CALLBACK)
 static snd_async_handler_t *ahandler;
 static pthread_mutex_t pcm_mtx;
 static char signal_stack[SIGSTKSZ];
@@ -86,6 +114,11 @@ static char signal_stack[SIGSTKSZ];
 static int recursion;
 #endif
 
+/* Telemetry, see pcm_alsa_get_debug() */
+static struct pcm_alsa_debug stats;
+static struct timespec xrun_time;   /* when the pending xrun was detected */
+static bool xrun_pending = false;
+
 static int set_hwparams(snd_pcm_t *handle, unsigned sample_rate)
 {
     unsigned int rrate;
@@ -103,6 +136,12 @@ static int set_hwparams(snd_pcm_t *handle, unsigned sample_rate)
     }
     /* set the interleaved read/write format */
     err = snd_pcm_hw_params_set_access(handle, params, access_);
+    if (err < 0 && access_ == SND_PCM_ACCESS_MMAP_INTERLEAVED)
+    {
+        printf("No mmap access, falling back to writes: %s\n", snd_strerror(err));
+        access_ = SND_PCM_ACCESS_RW_INTERLEAVED;
+        err = snd_pcm_hw_params_set_access(handle, params, access_);
+    }
     if (err < 0)
     {
         printf("Access type not available for playback: %s\n", snd_strerror(err));
@@ -152,7 +191,7 @@ static int set_hwparams(snd_pcm_t *handle, unsigned sample_rate)
         printf("Unable to set period size %ld for playback: %s\n", period_size, snd_strerror(err));
         goto error;
     }
-    if (!frames)
+    if (!frames && access_ != SND_PCM_ACCESS_MMAP_INTERLEAVED)
         frames = malloc(period_size * channels * sizeof(short));
 
     /* write the parameters to device */
@@ -212,10 +251,11 @@ error:
     return err;
 }
 
-/* copy pcm samples to a spare buffer, suitable for snd_pcm_writei() */
-static bool fill_frames(void)
+/* copy count frames of pcm samples to dst, which is either the spare
+ * buffer for snd_pcm_writei() or the device's own ring */
+static bool fill_frames(short *dst, ssize_t count)
 {
-    ssize_t copy_n, frames_left = period_size;
+    ssize_t copy_n, frames_left = count;
     bool new_buffer = false;
 
     while (frames_left > 0)
@@ -230,7 +270,7 @@ static bool fill_frames(void)
             }
         }
         copy_n = MIN((ssize_t)pcm_size, frames_left*4);
-        memcpy(&frames[2*(period_size-frames_left)], pcm_data, copy_n);
+        memcpy(&dst[2*(count-frames_left)], pcm_data, copy_n);
 
         pcm_data += copy_n;
         pcm_size -= copy_n;
@@ -245,6 +285,210 @@ static bool fill_frames(void)
     return true;
 }
 
+/* get the device going again after an error, noting underruns */
+static int recover(snd_pcm_t *handle, int err)
+{
+    if (err == -EPIPE && !xrun_pending)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &xrun_time);
+        xrun_pending = true;
+        stats.xruns++;
+    }
+
+    err = snd_pcm_recover(handle, err, 1);
+    if (err < 0)
+        DEBUGF("Recovery failed: %s\n", snd_strerror(err));
+    return err;
+}
+
+/* record how much is queued in the device when it asks for more */
+static void note_fill(snd_pcm_t *handle, snd_pcm_sframes_t avail)
+{
+    if (snd_pcm_state(handle) != SND_PCM_STATE_RUNNING)
+        return;
+
+    if (xrun_pending)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        stats.recovery_last = (now.tv_sec - xrun_time.tv_sec) * 1000000 +
+                              (now.tv_nsec - xrun_time.tv_nsec) / 1000;
+        if (stats.recovery_last > stats.recovery_max)
+            stats.recovery_max = stats.recovery_last;
+        xrun_pending = false;
+    }
+
+    stats.fill_last = avail < buffer_size ? buffer_size - avail : 0;
+    if (stats.fill_last < stats.fill_min)
+        stats.fill_min = stats.fill_last;
+}
+
+#if defined(USE_WRITER_THREAD)
+/* write as many periods as the device has room for */
+static void write_periods(void)
+{
+    while (writer_run)
+    {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+        if (avail < 0)
+        {
+            recover(handle, avail);
+            return;
+        }
+
+        note_fill(handle, avail);
+
+        if (avail < period_size)
+            return;
+
+        int err;
+        if (access_ == SND_PCM_ACCESS_MMAP_INTERLEAVED)
+        {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset, count = period_size;
+
+            err = snd_pcm_mmap_begin(handle, &areas, &offset, &count);
+            if (err < 0)
+            {
+                recover(handle, err);
+                return;
+            }
+
+            /* interleaved: all channels share the first area */
+            short *dst = (short *)((char *)areas[0].addr +
+                (areas[0].first + offset * areas[0].step) / 8);
+
+            /* a partial period is dropped like below */
+            if (!fill_frames(dst, count))
+                count = 0;
+
+            err = snd_pcm_mmap_commit(handle, offset, count);
+            if (count == 0)
+                break;
+
+            /* mmap writes don't start the device by themselves */
+            if (err >= 0 && snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+            {
+                err = snd_pcm_start(handle);
+                if (err < 0)
+                    DEBUGF("Start error: %s\n", snd_strerror(err));
+            }
+        }
+        else
+        {
+            if (!fill_frames(frames, period_size))
+                break;
+
+            err = snd_pcm_writei(handle, frames, period_size);
+        }
+
+        if (err < 0 && err != -EAGAIN)
+        {
+            recover(handle, err);
+            return;
+        }
+
+        stats.periods++;
+    }
+}
+
+static void * writer_thread(void *arg)
+{
+    struct pollfd pfds[8];
+    (void)arg;
+
+    pthread_mutex_lock(&pcm_mtx);
+
+    while (!writer_quit)
+    {
+        if (!writer_run)
+        {
+            if (writer_drain)
+            {
+                /* see pcm_play_dma_stop(); may take a while, so unlocked */
+                writer_drain = false;
+                pthread_mutex_unlock(&pcm_mtx);
+                snd_pcm_drain(handle);
+                pthread_mutex_lock(&pcm_mtx);
+            }
+            else
+                pthread_cond_wait(&writer_cond, &pcm_mtx);
+            continue;
+        }
+
+        write_periods();
+        if (!writer_run)
+            continue;
+
+        /* sleep until there's room for a period without holding the lock so
+         * the device can be reconfigured meanwhile, which kicks us awake */
+        int n = snd_pcm_poll_descriptors(handle, pfds, ARRAYLEN(pfds) - 1);
+        if (n < 0)
+            n = 0;
+        pfds[n].fd = writer_wakeup[0];
+        pfds[n].events = POLLIN;
+        pfds[n].revents = 0;
+
+        pthread_mutex_unlock(&pcm_mtx);
+        poll(pfds, n + 1, 100);
+        pthread_mutex_lock(&pcm_mtx);
+
+        if (pfds[n].revents & POLLIN)
+        {
+            char buf[16];
+            while (read(writer_wakeup[0], buf, sizeof(buf)) > 0);
+        }
+    }
+
+    pthread_mutex_unlock(&pcm_mtx);
+    return NULL;
+}
+
+/* have the writer notice a state change; call with pcm_mtx held */
+static void writer_kick(bool run)
+{
+    writer_run = run;
+    pthread_cond_signal(&writer_cond);
+    if (write(writer_wakeup[1], "", 1) < 0)
+        DEBUGF("%s: %s\n", __func__, strerror(errno));
+}
+
+static void writer_init(void)
+{
+    pthread_attr_t attr;
+    struct sched_param param;
+
+    if (pipe(writer_wakeup) < 0)
+    {
+        printf("Cannot create writer pipe: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    fcntl(writer_wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(writer_wakeup[1], F_SETFL, O_NONBLOCK);
+
+    pthread_cond_init(&writer_cond, NULL);
+
+    /* falls behind easily at normal priority with small buffers */
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) / 2;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+    pthread_attr_setschedparam(&attr, &param);
+
+    if (pthread_create(&writer, &attr, writer_thread, NULL) != 0)
+    {
+        printf("No realtime priority for the pcm writer\n");
+        if (pthread_create(&writer, NULL, writer_thread, NULL) != 0)
+        {
+            printf("Cannot create pcm writer thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_attr_destroy(&attr);
+}
+
+#else /* !USE_WRITER_THREAD */
 #ifdef USE_ASYNC_CALLBACK
 static void async_callback(snd_async_handler_t *ahandler)
 {
@@ -259,16 +503,25 @@ static void pcm_tick(void)
         return;
 #endif
 
-    while (snd_pcm_avail_update(handle) >= period_size)
+    snd_pcm_sframes_t avail;
+    while ((avail = snd_pcm_avail_update(handle)) >= period_size)
     {
-        if (fill_frames())
+        note_fill(handle, avail);
+
+        if (fill_frames(frames, period_size))
         {
             int err = snd_pcm_writei(handle, frames, period_size);
+            if (err == -EPIPE)
+            {
+                recover(handle, err);
+                break;
+            }
             if (err < 0 && err != period_size && err != -EAGAIN)
             {
                 printf("Write error: written %i expected %li\n", err, period_size);
                 break;
             }
+            stats.periods++;
         }
         else
         {
@@ -280,7 +533,9 @@ static void pcm_tick(void)
     pthread_mutex_unlock(&pcm_mtx);
 #endif
 }
+#endif /* USE_WRITER_THREAD */
 
+#ifndef USE_WRITER_THREAD
 static int async_rw(snd_pcm_t *handle)
 {
     int err;
@@ -350,10 +605,18 @@ static int async_rw(snd_pcm_t *handle)
     }
     return 0;
 }
+#endif /* !USE_WRITER_THREAD */
 
 
 void cleanup(void)
 {
+#ifdef USE_WRITER_THREAD
+    pthread_mutex_lock(&pcm_mtx);
+    writer_quit = true;
+    writer_kick(false);
+    pthread_mutex_unlock(&pcm_mtx);
+    pthread_join(writer, NULL);
+#endif
     free(frames);
     frames = NULL;
     snd_pcm_close(handle);
@@ -363,8 +626,14 @@ void cleanup(void)
 void pcm_play_dma_init(void)
 {
     int err;
+    const char *env;
     audiohw_preinit();
 
+    if ((env = getenv("ROCKBOX_ALSA_PERIOD")) && atol(env) > 0)
+        period_size = atol(env);
+    if ((env = getenv("ROCKBOX_ALSA_BUFFER")) && atol(env) > 0)
+        buffer_size = atol(env);
+
     if ((err = snd_pcm_open(&handle, device, SND_PCM_STREAM_PLAYBACK, 0)) < 0)
     {
         printf("%s(): Cannot open device %s: %s\n", __func__, device, snd_strerror(err));
@@ -386,14 +655,20 @@ void pcm_play_dma_init(void)
         exit(EXIT_FAILURE);
     }
 
-    pcm_dma_apply_settings();
+    stats.fill_min = buffer_size;
 
-#ifdef USE_ASYNC_CALLBACK
+#if defined(USE_WRITER_THREAD) || defined(USE_ASYNC_CALLBACK)
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
     pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
     pthread_mutex_init(&pcm_mtx, &attr);
-#else
+#endif
+
+    pcm_dma_apply_settings();
+
+#if defined(USE_WRITER_THREAD)
+    writer_init();
+#elif !defined(USE_ASYNC_CALLBACK)
     tick_add_task(pcm_tick);
 #endif
 
@@ -404,7 +679,7 @@ void pcm_play_dma_init(void)
 
 void pcm_play_lock(void)
 {
-#ifdef USE_ASYNC_CALLBACK
+#if defined(USE_WRITER_THREAD) || defined(USE_ASYNC_CALLBACK)
     pthread_mutex_lock(&pcm_mtx);
 #else
     if (recursion++ == 0)
@@ -414,7 +689,7 @@ void pcm_play_lock(void)
 
 void pcm_play_unlock(void)
 {
-#ifdef USE_ASYNC_CALLBACK
+#if defined(USE_WRITER_THREAD) || defined(USE_ASYNC_CALLBACK)
     pthread_mutex_unlock(&pcm_mtx);
 #else
     if (--recursion == 0)
@@ -438,13 +713,32 @@ void pcm_dma_apply_settings(void)
 
 void pcm_play_dma_pause(bool pause)
 {
+#ifdef USE_WRITER_THREAD
+    if (snd_pcm_pause(handle, pause) < 0)
+    {
+        /* no hardware pause; the writer stops feeding it, so stop it too
+         * rather than let it run dry */
+        if (pause)
+            snd_pcm_drop(handle);
+        else
+            snd_pcm_prepare(handle);
+    }
+    writer_kick(!pause);
+#else
     snd_pcm_pause(handle, pause);
+#endif
 }
 
 
 void pcm_play_dma_stop(void)
 {
+#ifdef USE_WRITER_THREAD
+    /* the writer drains without holding pcm_mtx, which the caller does */
+    writer_drain = true;
+    writer_kick(false);
+#else
     snd_pcm_drain(handle);
+#endif
 }
 
 void pcm_play_dma_start(const void *addr, size_t size)
@@ -454,6 +748,19 @@ void pcm_play_dma_start(const void *addr, size_t size)
     pcm_data = addr;
     pcm_size = size;
 
+#ifdef USE_WRITER_THREAD
+    writer_drain = false;
+    /* no silence needed up front, the writer fills the device with data
+     * which starts it */
+    if (snd_pcm_state(handle) == SND_PCM_STATE_SETUP)
+    {
+        int err = snd_pcm_prepare(handle);
+        if (err < 0)
+            printf("Prepare error: %s\n", snd_strerror(err));
+    }
+
+    writer_kick(true);
+#else
     while (1)
     {
         snd_pcm_state_t state = snd_pcm_state(handle);
@@ -464,9 +771,7 @@ void pcm_play_dma_start(const void *addr, size_t size)
             case SND_PCM_STATE_XRUN:
             {
                 DEBUGF("Trying to recover from error\n");
-                int err = snd_pcm_recover(handle, -EPIPE, 0);
-                if (err < 0)
-                    DEBUGF("Recovery failed: %s\n", snd_strerror(err));
+                recover(handle, -EPIPE);
                 continue;
             }
             case SND_PCM_STATE_SETUP:
@@ -497,6 +802,7 @@ void pcm_play_dma_start(const void *addr, size_t size)
                 return;
         }
     }
+#endif /* USE_WRITER_THREAD */
 }
 
 size_t pcm_get_bytes_waiting(void)
@@ -516,6 +822,35 @@ void pcm_play_dma_postinit(void)
     audiohw_postinit();
 }
 
+void pcm_alsa_get_debug(struct pcm_alsa_debug *dbg, bool reset)
+{
+    pcm_play_lock();
+
+#if defined(USE_WRITER_THREAD)
+    stats.method = "writer thread";
+#elif defined(USE_ASYNC_CALLBACK)
+    stats.method = "async callback";
+#else
+    stats.method = "tick task";
+#endif
+    stats.mmap = access_ == SND_PCM_ACCESS_MMAP_INTERLEAVED;
+    stats.period_size = period_size;
+    stats.buffer_size = buffer_size;
+
+    if (reset)
+    {
+        stats.periods = 0;
+        stats.xruns = 0;
+        stats.recovery_last = 0;
+        stats.recovery_max = 0;
+        stats.fill_min = buffer_size;
+    }
+
+    *dbg = stats;
+
+    pcm_play_unlock();
+}
+
 
 void pcm_set_mixer_volume(int volume)
 {
@@ -0,0 +1,51 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+#ifndef __PCM_ALSA_H__
+#define __PCM_ALSA_H__
+
+#include <stdbool.h>
+
+/* Device period and buffer sizes in frames. Targets may override these;
+ * at runtime the ROCKBOX_ALSA_PERIOD and ROCKBOX_ALSA_BUFFER environment
+ * variables take precedence. */
+#ifndef PCM_ALSA_PERIOD_SIZE
+#define PCM_ALSA_PERIOD_SIZE    (MIX_FRAME_SAMPLES * 4)
+#endif
+#ifndef PCM_ALSA_BUFFER_SIZE
+#define PCM_ALSA_BUFFER_SIZE    (PCM_ALSA_PERIOD_SIZE * 8)
+#endif
+
+struct pcm_alsa_debug
+{
+    const char *method;             /* how the device is fed */
+    bool mmap;                      /* writing directly into the ring */
+    unsigned long period_size;      /* frames */
+    unsigned long buffer_size;      /* frames */
+    unsigned long periods;          /* periods written */
+    unsigned long xruns;            /* underruns recovered from */
+    unsigned long recovery_last;    /* us to get running again */
+    unsigned long recovery_max;     /* us */
+    unsigned long fill_last;        /* frames queued in the device */
+    unsigned long fill_min;         /* lowest queued while running */
+};
+
+void pcm_alsa_get_debug(struct pcm_alsa_debug *dbg, bool reset);
+
+#endif /* __PCM_ALSA_H__ */
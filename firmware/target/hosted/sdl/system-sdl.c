@@ -376,6 +376,13 @@ void sys_handle_argv(int argc, char *argv[])
                     debug_buttons = true;
                     printf("Printing background button clicks.\n");
             }
+#ifdef HAVE_SDL_THREADS
+            else if (!strcmp("--detach-decoder", argv[x]))
+            {
+                sim_thread_allow_detach = true;
+                printf("Decoding the bitstream outside the thread lock.\n");
+            }
+#endif
             else 
             {
                 printf("rockboxui\n");
@@ -393,6 +400,9 @@ void sys_handle_argv(int argc, char *argv[])
                 printf("  --alarm \t Simulate a wake-up on alarm\n");
                 printf("  --root [DIR]\t Set root directory\n");
                 printf("  --mapping \t Output coordinates and radius for mapping backgrounds\n");
+#ifdef HAVE_SDL_THREADS
+                printf("  --detach-decoder \t Overlap only the bitstream decode with other threads; DSP and kernel calls stay serialized\n");
+#endif
                 exit(0);
             }
         }
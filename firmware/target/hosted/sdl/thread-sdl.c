@@ -55,6 +55,9 @@ static jmp_buf thread_jmpbufs[MAXTHREADS];
  * that enables us to simulate a cooperative environment even if
  * the host is preemptive */
 static SDL_mutex *m;
+/* Set by --detach-decoder: allows threads to detach from the lock and run in
+ * parallel with the others, see sim_thread_detach() */
+bool sim_thread_allow_detach = false;
 #define THREADS_RUN                 0
 #define THREADS_EXIT                1
 #define THREADS_EXIT_COMMAND_DONE   2
@@ -150,6 +153,19 @@ void * sim_thread_unlock(void)
     return current;
 }
 
+/* Leave the threading system to run in parallel with the other threads;
+ * unlike sim_thread_unlock() this is meant to last while the caller does
+ * real work. The thread must not touch any kernel object (or call anything
+ * that might) until it reenters through sim_thread_lock(). Returns NULL and
+ * does nothing unless --detach-decoder was given. */
+void * sim_thread_detach(void)
+{
+    if (!sim_thread_allow_detach)
+        return NULL;
+
+    return sim_thread_unlock();
+}
+
 void switch_thread(void)
 {
     struct thread_entry *current = __running_self_entry();
@@ -23,9 +23,14 @@
 #define __THREADSDL_H__
 
 #ifdef HAVE_SDL_THREADS
+#include <stdbool.h>
+
+extern bool sim_thread_allow_detach;
+
 /* extra thread functions that only apply when running on hosting platforms */
 void sim_thread_lock(void *me);
 void * sim_thread_unlock(void);
+void * sim_thread_detach(void);
 void sim_thread_exception_wait(void);
 void sim_thread_shutdown(void); /* Shut down all kernel threads gracefully */
 #endif
@@ -72,7 +72,7 @@
 #define CODEC_ENC_MAGIC 0x52454E43 /* RENC */
 
 /* increase this every time the api struct changes */
-#define CODEC_API_VERSION 47
+#define CODEC_API_VERSION 49
 
 /* update this to latest version if a change to the api struct breaks
    backwards compatibility (and please take the opportunity to sort in any
@@ -218,6 +218,19 @@ struct codec_api {
 
     /* new stuff at the end, sort into place next time
        the API gets incompatible */
+
+    /* Seek index kept with the current track between plays; tag
+       identifies the codec's format. load fills at most *size bytes and
+       sets *size to what was stored, save replaces it. */
+    bool (*seek_index_load)(uint32_t tag, void *buf, size_t *size);
+    void (*seek_index_save)(uint32_t tag, const void *buf, size_t size);
+
+    /* Run fn(arg) on a helper thread beside the codec. Returns false if
+       there is no spare core, then the codec calls fn itself. fn must not
+       use the codec API. One job at a time; job_wait returns once it is
+       done and may be called when nothing was started. */
+    bool (*job_start)(void (*fn)(void *arg), void *arg);
+    void (*job_wait)(void);
 };
 
 /* codec header */
@@ -0,0 +1,115 @@
+/*
+
+libdemac - A Monkey's Audio decoder
+
+$Id$
+
+SSE2/AVX2 vector math for x86-64 hosts
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
+
+*/
+
+/* pmaddwd does the same as the MMX version, 8 or 16 coefficients at a time.
+ * The history pointers advance by one sample per call so nothing is aligned,
+ * unaligned loads cost nothing extra on the CPUs that have SSE2. AVX2 is
+ * used when the build enables it (-mavx2). */
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+#define FUSED_VECTOR_MATH
+
+#ifdef __AVX2__
+typedef __m256i vec_t;
+#define VEC_N           16
+#define vec_load(p)     _mm256_loadu_si256((const __m256i *)(p))
+#define vec_store(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define vec_madd        _mm256_madd_epi16
+#define vec_add16       _mm256_add_epi16
+#define vec_sub16       _mm256_sub_epi16
+#define vec_add32       _mm256_add_epi32
+#define vec_zero        _mm256_setzero_si256
+
+static inline int32_t vec_sum(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+#else
+typedef __m128i vec_t;
+#define VEC_N           8
+#define vec_load(p)     _mm_loadu_si128((const __m128i *)(p))
+#define vec_store(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define vec_madd        _mm_madd_epi16
+#define vec_add16       _mm_add_epi16
+#define vec_sub16       _mm_sub_epi16
+#define vec_add32       _mm_add_epi32
+#define vec_zero        _mm_setzero_si128
+
+static inline int32_t vec_sum(__m128i s)
+{
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+#endif
+
+/* Calculate scalarproduct, then add a 2nd vector (fused for performance) */
+static inline int32_t vector_sp_add(int16_t* v1, int16_t* f2, int16_t* s2)
+{
+    vec_t acc = vec_zero();
+    int i;
+
+    for (i = 0; i < ORDER; i += VEC_N)
+    {
+        vec_t v = vec_load(v1 + i);
+        acc = vec_add32(acc, vec_madd(v, vec_load(f2 + i)));
+        vec_store(v1 + i, vec_add16(v, vec_load(s2 + i)));
+    }
+    return vec_sum(acc);
+}
+
+/* Calculate scalarproduct, then subtract a 2nd vector (fused for performance) */
+static inline int32_t vector_sp_sub(int16_t* v1, int16_t* f2, int16_t* s2)
+{
+    vec_t acc = vec_zero();
+    int i;
+
+    for (i = 0; i < ORDER; i += VEC_N)
+    {
+        vec_t v = vec_load(v1 + i);
+        acc = vec_add32(acc, vec_madd(v, vec_load(f2 + i)));
+        vec_store(v1 + i, vec_sub16(v, vec_load(s2 + i)));
+    }
+    return vec_sum(acc);
+}
+
+static inline int32_t scalarproduct(int16_t* v1, int16_t* v2)
+{
+    vec_t acc = vec_zero();
+    int i;
+
+    for (i = 0; i < ORDER; i += VEC_N)
+        acc = vec_add32(acc, vec_madd(vec_load(v1 + i), vec_load(v2 + i)));
+
+    return vec_sum(acc);
+}
@@ -90,6 +90,9 @@ static bool flac_init(FLACContext* fc, int first_frame_offset)
     ci->memset(fc,0,sizeof(FLACContext));
     nseekpoints=0;
 
+    fc->job_start = ci->job_start;
+    fc->job_wait = ci->job_wait;
+
     fc->sample_skip = 0;
     
     /* Reset sample buffers */
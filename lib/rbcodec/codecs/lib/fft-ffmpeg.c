@@ -55,6 +55,7 @@
 /* asm-optimised functions and/or macros */
 #include "fft-ffmpeg_arm.h"
 #include "fft-ffmpeg_cf.h"
+#include "fft-ffmpeg_sse4.h"
 
 #ifndef ICODE_ATTR_TREMOR_MDCT
 #define ICODE_ATTR_TREMOR_MDCT ICODE_ATTR
@@ -275,6 +276,22 @@ static inline FFTComplex* TRANSFORM_ZERO(FFTComplex * z, unsigned int n)
 }
 #endif
 
+#ifndef FFT_FFMPEG_INCL_OPTIMISED_TRANSFORM_PAIR
+/* two neighbouring transforms, the second one's twiddle is step further
+   along the direction pass() walks sincos_lookup0 in */
+static inline FFTComplex* TRANSFORM_PAIR_W10(FFTComplex * z, unsigned int n, const FFTSample * w, unsigned int step)
+{
+    z = TRANSFORM_W10(z,n,w);
+    return TRANSFORM_W10(z,n,w+step);
+}
+
+static inline FFTComplex* TRANSFORM_PAIR_W01(FFTComplex * z, unsigned int n, const FFTSample * w, unsigned int step)
+{
+    z = TRANSFORM_W01(z,n,w);
+    return TRANSFORM_W01(z,n,w-step);
+}
+#endif
+
 /* z[0...8n-1], w[1...2n-1] */
 static void pass(FFTComplex *z_arg, unsigned int STEP_arg, unsigned int n_arg) ICODE_ATTR_TREMOR_MDCT;
 static void pass(FFTComplex *z_arg, unsigned int STEP_arg, unsigned int n_arg)
@@ -293,20 +310,16 @@ static void pass(FFTComplex *z_arg, unsigned int STEP_arg, unsigned int n_arg)
     w += STEP;
     /* first pass forwards through sincos_lookup0*/
     do {
-        z = TRANSFORM_W10(z,n,w);
-        w += STEP;
-        z = TRANSFORM_W10(z,n,w);
-        w += STEP;
+        z = TRANSFORM_PAIR_W10(z,n,w,STEP);
+        w += STEP*2;
     } while(LIKELY(w < w_end));
     /* second half: pass backwards through sincos_lookup0*/
     /* wim and wre are now in opposite places so ordering now [0],[1] */
     w_end=sincos_lookup0;
     while(LIKELY(w>w_end))
     {
-        z = TRANSFORM_W01(z,n,w);
-        w -= STEP;
-        z = TRANSFORM_W01(z,n,w);
-        w -= STEP;
+        z = TRANSFORM_PAIR_W01(z,n,w,STEP);
+        w -= STEP*2;
     }
 }
 
@@ -0,0 +1,107 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * SSE4.1 transform pairs for ffmpeg's fft on x86-64 hosts (used in
+ * fft-ffmpeg.c)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/* pass() does its transforms in pairs of neighbouring z[] whose twiddles are
+ * STEP apart, so one register holds {re, im} of both. Every product is the
+ * generic MULT31, (hi 32 bits of the 64 bit product) << 1, and the sums wrap
+ * like the C ones, so the output is bit exact. vector_bench checks that
+ * against the C version, which it builds with FFT_FFMPEG_GENERIC.
+ *
+ * Plain SSE2 only has the unsigned pmuludq. Correcting its products for
+ * the sign costs about what the pairing saves, so SSE2-only builds keep
+ * the C version. */
+
+#if defined(__SSE4_1__) && !defined(CPU_ARM) && !defined(CPU_COLDFIRE) && \
+    !defined(FFT_FFMPEG_GENERIC)
+#include <smmintrin.h>
+
+/* MULT31 of four lanes */
+static inline __m128i mult31_x4(__m128i a, __m128i b)
+{
+    const __m128i odd = _mm_set_epi32(-1, 0, -1, 0);
+    __m128i p0 = _mm_mul_epi32(a, b);
+    __m128i p1 = _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    __m128i hi = _mm_or_si128(_mm_srli_epi64(p0, 32),
+                              _mm_and_si128(p1, odd));
+    return _mm_slli_epi32(hi, 1);
+}
+
+/* z[0], z[1] against twiddles wre/wim, each {k, k, k+1, k+1} */
+static inline FFTComplex* transform_pair(FFTComplex *z, unsigned int n,
+                                         __m128i wre, __m128i wim)
+{
+    const __m128i neg_im = _mm_set_epi32(-1, 0, -1, 0);
+    const __m128i neg_re = _mm_set_epi32(0, -1, 0, -1);
+    __m128i a0 = _mm_loadu_si128((__m128i *)&z[0]);
+    __m128i a1 = _mm_loadu_si128((__m128i *)&z[n]);
+    __m128i a2 = _mm_loadu_si128((__m128i *)&z[n*2]);
+    __m128i a3 = _mm_loadu_si128((__m128i *)&z[n*3]);
+    __m128i p, q, t12, t56, u, v;
+
+    /* XPROD31_R: {t1, t2} = {re*wre + im*wim, im*wre - re*wim} */
+    p = mult31_x4(a2, wre);
+    q = _mm_shuffle_epi32(mult31_x4(a2, wim), _MM_SHUFFLE(2, 3, 0, 1));
+    t12 = _mm_add_epi32(p, _mm_sub_epi32(_mm_xor_si128(q, neg_im), neg_im));
+
+    /* XNPROD31_R: {t5, t6} = {re*wre - im*wim, im*wre + re*wim} */
+    p = mult31_x4(a3, wre);
+    q = _mm_shuffle_epi32(mult31_x4(a3, wim), _MM_SHUFFLE(2, 3, 0, 1));
+    t56 = _mm_add_epi32(p, _mm_sub_epi32(_mm_xor_si128(q, neg_re), neg_re));
+
+    /* BUTTERFLIES: a0 +- {t1 + t5, t2 + t6}, a1 +- {t2 - t6, t5 - t1} */
+    u = _mm_add_epi32(t12, t56);
+    v = _mm_shuffle_epi32(_mm_sub_epi32(t12, t56), _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_sub_epi32(_mm_xor_si128(v, neg_im), neg_im);
+
+    _mm_storeu_si128((__m128i *)&z[0],   _mm_add_epi32(a0, u));
+    _mm_storeu_si128((__m128i *)&z[n*2], _mm_sub_epi32(a0, u));
+    _mm_storeu_si128((__m128i *)&z[n],   _mm_add_epi32(a1, v));
+    _mm_storeu_si128((__m128i *)&z[n*3], _mm_sub_epi32(a1, v));
+    return z+2;
+}
+
+/* {w[0], w[1], w2[0], w2[1]} */
+static inline __m128i load_twiddles(const FFTSample *w, const FFTSample *w2)
+{
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)w),
+                              _mm_loadl_epi64((const __m128i *)w2));
+}
+
+#define FFT_FFMPEG_INCL_OPTIMISED_TRANSFORM_PAIR
+static inline FFTComplex* TRANSFORM_PAIR_W10(FFTComplex * z, unsigned int n,
+                                             const FFTSample * w,
+                                             unsigned int step)
+{
+    __m128i t = load_twiddles(w, w+step);
+    return transform_pair(z, n, _mm_shuffle_epi32(t, _MM_SHUFFLE(3, 3, 1, 1)),
+                                _mm_shuffle_epi32(t, _MM_SHUFFLE(2, 2, 0, 0)));
+}
+
+static inline FFTComplex* TRANSFORM_PAIR_W01(FFTComplex * z, unsigned int n,
+                                             const FFTSample * w,
+                                             unsigned int step)
+{
+    __m128i t = load_twiddles(w, w-step);
+    return transform_pair(z, n, _mm_shuffle_epi32(t, _MM_SHUFFLE(2, 2, 0, 0)),
+                                _mm_shuffle_epi32(t, _MM_SHUFFLE(3, 3, 1, 1)));
+}
+#endif /* __SSE4_1__ */
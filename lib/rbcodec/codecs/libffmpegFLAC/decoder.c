@@ -174,12 +174,17 @@ static int decode_residuals(FLACContext *s, int32_t* decoded, int pred_order)
     return 0;
 }    
 
-static int decode_subframe_fixed(FLACContext *s, int32_t* decoded, int pred_order) ICODE_ATTR_FLAC;
-static int decode_subframe_fixed(FLACContext *s, int32_t* decoded, int pred_order)
+static int decode_subframe_fixed(FLACContext *s, struct flac_restore *r,
+                                 int pred_order) ICODE_ATTR_FLAC;
+static int decode_subframe_fixed(FLACContext *s, struct flac_restore *r,
+                                 int pred_order)
 {
-    const int blocksize = s->blocksize;
-    int a, b, c, d, i;
-        
+    int32_t *decoded = r->decoded;
+    int i;
+
+    if (pred_order > 4)
+        return -5;
+
     /* warm up samples */
     for (i = 0; i < pred_order; i++)
     {
@@ -189,45 +194,20 @@ static int decode_subframe_fixed(FLACContext *s, int32_t* decoded, int pred_orde
     if (decode_residuals(s, decoded, pred_order) < 0)
         return -4;
 
-    a = decoded[pred_order-1];
-    b = a - decoded[pred_order-2];
-    c = b - decoded[pred_order-2] + decoded[pred_order-3];
-    d = c - decoded[pred_order-2] + 2*decoded[pred_order-3] - decoded[pred_order-4];
-
-    switch(pred_order)
-    {
-        case 0:
-            break;
-        case 1:
-            for (i = pred_order; i < blocksize; i++)
-                decoded[i] = a += decoded[i];
-            break;
-        case 2:
-            for (i = pred_order; i < blocksize; i++)
-                decoded[i] = a += b += decoded[i];
-            break;
-        case 3:
-            for (i = pred_order; i < blocksize; i++)
-                decoded[i] = a += b += c += decoded[i];
-            break;
-        case 4:
-            for (i = pred_order; i < blocksize; i++)
-                decoded[i] = a += b += c += d += decoded[i];
-            break;
-        default:
-            return -5;
-    }
-
+    if (pred_order > 0)
+        r->type = RESTORE_FIXED;
+    r->order = pred_order;
     return 0;
 }
 
-static int decode_subframe_lpc(FLACContext *s, int32_t* decoded, int pred_order) ICODE_ATTR_FLAC;
-static int decode_subframe_lpc(FLACContext *s, int32_t* decoded, int pred_order)
+static int decode_subframe_lpc(FLACContext *s, struct flac_restore *r,
+                               int pred_order) ICODE_ATTR_FLAC;
+static int decode_subframe_lpc(FLACContext *s, struct flac_restore *r,
+                               int pred_order)
 {
-    int sum, i, j;
-    int64_t wsum;
+    int32_t *decoded = r->decoded;
+    int i;
     int coeff_prec, qlevel;
-    int coeffs[pred_order];
 
     /* warm up samples */
     for (i = 0; i < pred_order; i++)
@@ -250,52 +230,113 @@ static int decode_subframe_lpc(FLACContext *s, int32_t* decoded, int pred_order)
 
     for (i = 0; i < pred_order; i++)
     {
-        coeffs[i] = get_sbits(&s->gb, coeff_prec);
+        r->coeffs[i] = get_sbits(&s->gb, coeff_prec);
     }
     
     if (decode_residuals(s, decoded, pred_order) < 0)
         return -8;
 
-    if ((s->bps + coeff_prec + av_log2(pred_order)) <= 32) {
+    r->type = ((s->bps + coeff_prec + av_log2(pred_order)) <= 32) ?
+              RESTORE_LPC : RESTORE_LPC_WIDE;
+    r->order = pred_order;
+    r->qlevel = qlevel;
+    return 0;
+}
+
+/* Turns the residuals of a subframe into samples. Only touches r and its
+ * decoded buffer, so it may run on a helper thread while the next subframe
+ * is parsed. */
+static void restore_subframe(void *arg) ICODE_ATTR_FLAC;
+static void restore_subframe(void *arg)
+{
+    struct flac_restore *r = arg;
+    int32_t *decoded = r->decoded;
+    const int blocksize = r->blocksize;
+    const int pred_order = r->order;
+    int *coeffs = r->coeffs;
+    int a, b, c, d, i, j, sum;
+    int64_t wsum;
+
+    switch (r->type)
+    {
+    case RESTORE_FIXED:
+        a = decoded[pred_order-1];
+        b = a - decoded[pred_order-2];
+        c = b - decoded[pred_order-2] + decoded[pred_order-3];
+        d = c - decoded[pred_order-2] + 2*decoded[pred_order-3] - decoded[pred_order-4];
+
+        switch(pred_order)
+        {
+            case 0:
+                break;
+            case 1:
+                for (i = pred_order; i < blocksize; i++)
+                    decoded[i] = a += decoded[i];
+                break;
+            case 2:
+                for (i = pred_order; i < blocksize; i++)
+                    decoded[i] = a += b += decoded[i];
+                break;
+            case 3:
+                for (i = pred_order; i < blocksize; i++)
+                    decoded[i] = a += b += c += decoded[i];
+                break;
+            case 4:
+                for (i = pred_order; i < blocksize; i++)
+                    decoded[i] = a += b += c += d += decoded[i];
+                break;
+        }
+        break;
+
+    case RESTORE_LPC:
         #if defined(CPU_COLDFIRE)
         (void)sum;
-        lpc_decode_emac(s->blocksize - pred_order, qlevel, pred_order,
+        lpc_decode_emac(blocksize - pred_order, r->qlevel, pred_order,
                         decoded + pred_order, coeffs);
         #elif defined(CPU_ARM)
         (void)sum;
-        lpc_decode_arm(s->blocksize - pred_order, qlevel, pred_order,
+        lpc_decode_arm(blocksize - pred_order, r->qlevel, pred_order,
                        decoded + pred_order, coeffs);
         #else
-        for (i = pred_order; i < s->blocksize; i++)
+        for (i = pred_order; i < blocksize; i++)
         {
             sum = 0;
             for (j = 0; j < pred_order; j++)
                 sum += coeffs[j] * decoded[i-j-1];
-            decoded[i] += sum >> qlevel;
+            decoded[i] += sum >> r->qlevel;
         }
         #endif
-    } else {
+        break;
+
+    case RESTORE_LPC_WIDE:
         #if defined(CPU_COLDFIRE)
         (void)wsum;
         (void)j;
-        lpc_decode_emac_wide(s->blocksize - pred_order, qlevel, pred_order,
+        lpc_decode_emac_wide(blocksize - pred_order, r->qlevel, pred_order,
                              decoded + pred_order, coeffs);
         #else
-        for (i = pred_order; i < s->blocksize; i++)
+        for (i = pred_order; i < blocksize; i++)
         {
             wsum = 0;
             for (j = 0; j < pred_order; j++)
                 wsum += (int64_t)coeffs[j] * (int64_t)decoded[i-j-1];
-            decoded[i] += wsum >> qlevel;
+            decoded[i] += wsum >> r->qlevel;
         }
         #endif
+        break;
+    }
+
+    if (r->wasted)
+    {
+        for (i = 0; i < blocksize; i++)
+            decoded[i] <<= r->wasted;
     }
-    
-    return 0;
 }
 
-static inline int decode_subframe(FLACContext *s, int channel, int32_t* decoded)
+static inline int decode_subframe(FLACContext *s, int channel,
+                                  struct flac_restore *r)
 {
+    int32_t *decoded = r->decoded;
     int type, wasted = 0;
     int i, tmp;
     
@@ -339,6 +380,10 @@ static inline int decode_subframe(FLACContext *s, int channel, int32_t* decoded)
     }
 #endif
 //FIXME use av_log2 for types
+    r->type = RESTORE_NONE;
+    r->blocksize = s->blocksize;
+    r->wasted = wasted;
+
     if (type == 0)
     {
         //fprintf(stderr,"coding type: constant\n");
@@ -355,13 +400,13 @@ static inline int decode_subframe(FLACContext *s, int channel, int32_t* decoded)
     else if ((type >= 8) && (type <= 12))
     {
         //fprintf(stderr,"coding type: fixed\n");
-        if (decode_subframe_fixed(s, decoded, type & ~0x8) < 0)
+        if (decode_subframe_fixed(s, r, type & ~0x8) < 0)
             return -10;
     }
     else if (type >= 32)
     {
         //fprintf(stderr,"coding type: lpc\n");
-        if (decode_subframe_lpc(s, decoded, (type & ~0x20)+1) < 0)
+        if (decode_subframe_lpc(s, r, (type & ~0x20)+1) < 0)
             return -11;
     }
     else
@@ -369,13 +414,6 @@ static inline int decode_subframe(FLACContext *s, int channel, int32_t* decoded)
         //fprintf(stderr,"Unknown coding type: %d\n",type);
         return -12;
     }
-        
-    if (wasted)
-    {
-        int i;
-        for (i = 0; i < s->blocksize; i++)
-            decoded[i] <<= wasted;
-    }
 
     return 0;
 }
@@ -473,12 +511,26 @@ static int decode_frame(FLACContext *s,
     s->bps          = bps;
     s->decorrelation= decorrelation;
 
+    /* The prediction of each channel but the last runs on the helper
+       thread, if there is one, while the next subframe is parsed */
     for (ch=0; ch<s->channels; ++ch) {
+        struct flac_restore *r = &s->restore[ch % FLAC_RESTORE_SLOTS];
         yield();
-        if ((res=decode_subframe(s, ch, s->decoded[ch])) < 0)
+        r->decoded = s->decoded[ch];
+        if ((res=decode_subframe(s, ch, r)) < 0) {
+            if (s->job_wait)
+                s->job_wait();
             return res-100;
+        }
+        if (FLAC_RESTORE_SLOTS == 1 ||
+            ch == s->channels-1 || r->type < RESTORE_LPC ||
+            !s->job_start || !s->job_start(restore_subframe, r))
+            restore_subframe(r);
     }
-    
+
+    if (s->job_wait)
+        s->job_wait();
+
     yield();
     align_get_bits(&s->gb);
 
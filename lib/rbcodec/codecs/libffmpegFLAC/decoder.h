@@ -1,6 +1,7 @@
 #ifndef _FLAC_DECODER_H
 #define _FLAC_DECODER_H
  
+#include <stdbool.h>
 #include "bitstream.h"
 
 #define MAX_CHANNELS 6       /* Maximum supported channels, only left/right will be played back */
@@ -16,6 +17,33 @@ enum decorrelation_type {
     MID_SIDE,
 };
 
+enum restore_type {
+    RESTORE_NONE,
+    RESTORE_FIXED,
+    RESTORE_LPC,
+    RESTORE_LPC_WIDE,
+};
+
+/* Subframes are only restored in parallel (on the helper thread) on hosted
+ * builds, which have no IRAM to spare. Native targets restore each one right
+ * after parsing it and keep just one of these in IRAM. */
+#if (CONFIG_PLATFORM & PLATFORM_HOSTED)
+#define FLAC_RESTORE_SLOTS MAX_CHANNELS
+#else
+#define FLAC_RESTORE_SLOTS 1
+#endif
+
+/* What is needed to turn a subframe's residuals into samples */
+struct flac_restore {
+    int32_t *decoded;
+    int blocksize;
+    enum restore_type type;
+    int order;
+    int qlevel;
+    int wasted;
+    int coeffs[32];
+};
+
 typedef struct FLACContext {
     GetBitContext gb;
 
@@ -40,6 +68,11 @@ typedef struct FLACContext {
     int framesize;
     
     int32_t *decoded[MAX_CHANNELS];
+    struct flac_restore restore[FLAC_RESTORE_SLOTS];
+
+    /* Optional helper thread (codec API job_start/job_wait) */
+    bool (*job_start)(void (*fn)(void *arg), void *arg);
+    void (*job_wait)(void);
 } FLACContext;
 
 int flac_decode_frame(FLACContext *s,
@@ -74,6 +74,71 @@ static void bs_read (Bitstream *bs)
     bs->ptr = bs->buf;
 }
 
+// Open the specified BitStream for reading the next file_bytes of the input
+// in place. The data is requested in chunks of up to DIRECT_CHUNK bytes and
+// each chunk is only advanced over once it has been read completely, so the
+// pointer stays valid while it's in use.
+
+#define DIRECT_CHUNK 4096
+
+static uchar direct_pad [4];
+
+static void bs_read_direct (Bitstream *bs);
+
+void bs_open_read_direct (Bitstream *bs, request_stream request, advance_stream advance, uint32_t file_bytes)
+{
+    CLEAR (*bs);
+    bs->request = request;
+    bs->advance = advance;
+    bs->file_bytes = file_bytes;
+    bs->wrap = bs_read_direct;
+    bs_read_direct (bs);
+    bs->ptr--;
+}
+
+static void bs_read_direct (Bitstream *bs)
+{
+    int32_t bytes = 0;
+
+    if (bs->buf && bs->buf != direct_pad)
+        bs->advance (bs->end - bs->buf);
+
+    bs->buf = bs->end = NULL;
+
+    if (bs->file_bytes) {
+        int32_t wanted = bs->file_bytes > DIRECT_CHUNK ? DIRECT_CHUNK : bs->file_bytes;
+
+        bs->buf = bs->request (&bytes, wanted);
+
+        if (bs->buf && bytes > 0) {
+            bs->end = bs->buf + bytes;
+            bs->file_bytes -= bytes;
+        }
+    }
+
+    if (!bs->end) {
+        // same as running out of data with a copied bitstream
+        memset (direct_pad, -1, sizeof (direct_pad));
+        bs->buf = direct_pad;
+        bs->end = direct_pad + sizeof (direct_pad);
+        bs->error = 1;
+    }
+
+    bs->ptr = bs->buf;
+}
+
+// Finish reading a BitStream at the end of a block. A bitstream that reads in
+// place advances over its current chunk; anything of the block that was never
+// requested is skipped by the header search, as with a copied bitstream.
+
+void bs_close_read (Bitstream *bs)
+{
+    if (bs->request && bs->buf && bs->buf != direct_pad)
+        bs->advance (bs->end - bs->buf);
+
+    CLEAR (*bs);
+}
+
 // Open the specified BitStream using the specified buffer pointers. It is
 // assumed that enough buffer space has been allocated for all data that will
 // be written, otherwise an error will be generated.
@@ -122,7 +187,7 @@ void little_endian_to_native (void *data, char *format)
     while (*format) {
         switch (*format) {
             case 'L':
-                *(long *)cp = letoh32(*(long *)cp);
+                *(int32_t *)cp = letoh32(*(int32_t *)cp);
                 cp += 4;
                 break;
 
@@ -149,7 +214,7 @@ void native_to_little_endian (void *data, char *format)
     while (*format) {
         switch (*format) {
             case 'L':
-                *(long *)cp = htole32(*(long *)cp);
+                *(int32_t *)cp = htole32(*(int32_t *)cp);
                 cp += 4;
                 break;
 
@@ -80,6 +80,9 @@ int init_wv_bitstream (WavpackContext *wpc, WavpackMetadata *wpmd)
 
     if (wpmd->data)
         bs_open_read (&wps->wvbits, wpmd->data, (unsigned char *) wpmd->data + wpmd->byte_length, NULL, 0);
+    else if (wpmd->byte_length && wpc->request)
+        bs_open_read_direct (&wps->wvbits, wpc->request, wpc->advance,
+            wpmd->byte_length + (wpmd->byte_length & 1));
     else if (wpmd->byte_length)
         bs_open_read (&wps->wvbits, wpc->read_buffer, wpc->read_buffer + sizeof (wpc->read_buffer),
             wpc->infile, wpmd->byte_length + (wpmd->byte_length & 1));
@@ -315,14 +318,91 @@ static void decorr_mono_pass (struct decorr_pass *dpp, int32_t *buffer, int32_t
 static void decorr_stereo_pass (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count);
 static void fixup_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample_count);
 
+// Calls for fewer samples than this aren't worth splitting for a helper thread
+
+#define SPLIT_MIN_SAMPLES 256
+
+// Run all the decorrelation passes over part of the buffer. Each pass takes
+// its history from the previous part out of the decorr_pass, so parts can be
+// done one after another.
+
+struct decorr_part {
+    WavpackStream *wps;
+    int32_t *buffer;
+    uint32_t sample_count;
+};
+
+static void decorr_passes (void *arg)
+{
+    struct decorr_part *part = arg;
+    WavpackStream *wps = part->wps;
+    uint32_t flags = wps->wphdr.flags, sample_count = part->sample_count;
+    int32_t *buffer = part->buffer;
+    struct decorr_pass *dpp;
+    int tcount;
+
+    if (flags & MONO_DATA)
+        for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++)
+            decorr_mono_pass (dpp, buffer, sample_count);
+    else if (sample_count < 16)
+        for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++)
+            decorr_stereo_pass (dpp, buffer, sample_count);
+    else
+        for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++) {
+            decorr_stereo_pass (dpp, buffer, 8);
+#if defined(CPU_COLDFIRE)
+            decorr_stereo_pass_cont_mcf5249 (dpp, buffer + 16, sample_count - 8);
+#elif defined(CPU_ARM)
+            if (((flags & MAG_MASK) >> MAG_LSB) > 15)
+                decorr_stereo_pass_cont_arml (dpp, buffer + 16, sample_count - 8);
+            else
+                decorr_stereo_pass_cont_arm (dpp, buffer + 16, sample_count - 8);
+#else
+            decorr_stereo_pass_cont (dpp, buffer + 16, sample_count - 8);
+#endif
+        }
+}
+
+// Read the residuals into the buffer and run the decorrelation passes over
+// them. The passes of each sample only depend on the samples before it, so
+// with a helper thread the first half goes through the passes there while
+// the residuals of the second half are read here.
+
+static uint32_t get_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_count)
+{
+    WavpackStream *wps = &wpc->stream;
+    uint32_t flags = wps->wphdr.flags, half, i;
+    struct decorr_part first = { wps, buffer, sample_count }, second;
+
+    if (sample_count < SPLIT_MIN_SAMPLES || !wpc->job_start) {
+        i = get_words (buffer, sample_count, flags, &wps->w, &wps->wvbits);
+        decorr_passes (&first);
+        return i;
+    }
+
+    half = sample_count / 2;
+    first.sample_count = half;
+    second.wps = wps;
+    second.buffer = buffer + (flags & MONO_DATA ? half : half * 2);
+    second.sample_count = sample_count - half;
+
+    i = get_words (buffer, half, flags, &wps->w, &wps->wvbits);
+
+    if (!wpc->job_start (decorr_passes, &first))
+        decorr_passes (&first);
+
+    i += get_words (second.buffer, second.sample_count, flags, &wps->w, &wps->wvbits);
+    wpc->job_wait ();
+    decorr_passes (&second);
+    return i;
+}
+
 int32_t unpack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_count)
 {
     WavpackStream *wps = &wpc->stream;
     uint32_t flags = wps->wphdr.flags, crc = wps->crc, i;
     int32_t mute_limit = (1L << ((flags & MAG_MASK) >> MAG_LSB)) + 2;
-    struct decorr_pass *dpp;
     int32_t *bptr, *eptr;
-    int tcount;
 
     if (wps->sample_index + sample_count > wps->wphdr.block_index + wps->wphdr.block_samples)
         sample_count = wps->wphdr.block_index + wps->wphdr.block_samples - wps->sample_index;
@@ -340,10 +420,7 @@ int32_t unpack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_co
 
     if (flags & MONO_DATA) {
         eptr = buffer + sample_count;
-        i = get_words (buffer, sample_count, flags, &wps->w, &wps->wvbits);
-
-        for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++)
-            decorr_mono_pass (dpp, buffer, sample_count);
+        i = get_samples (wpc, buffer, sample_count);
 
         for (bptr = buffer; bptr < eptr; ++bptr) {
             if (labs (bptr [0]) > mute_limit) {
@@ -359,25 +436,7 @@ int32_t unpack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_co
 
     else {
         eptr = buffer + (sample_count * 2);
-        i = get_words (buffer, sample_count, flags, &wps->w, &wps->wvbits);
-
-        if (sample_count < 16)
-            for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++)
-                decorr_stereo_pass (dpp, buffer, sample_count);
-        else
-            for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++) {
-                decorr_stereo_pass (dpp, buffer, 8);
-#if defined(CPU_COLDFIRE)
-                decorr_stereo_pass_cont_mcf5249 (dpp, buffer + 16, sample_count - 8);
-#elif defined(CPU_ARM)
-                if (((flags & MAG_MASK) >> MAG_LSB) > 15)
-                    decorr_stereo_pass_cont_arml (dpp, buffer + 16, sample_count - 8);
-                else
-                    decorr_stereo_pass_cont_arm (dpp, buffer + 16, sample_count - 8);
-#else
-                decorr_stereo_pass_cont (dpp, buffer + 16, sample_count - 8);
-#endif
-            }
+        i = get_samples (wpc, buffer, sample_count);
 
         if (flags & JOINT_STEREO)
             for (bptr = buffer; bptr < eptr; bptr += 2) {
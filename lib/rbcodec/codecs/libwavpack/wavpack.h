@@ -11,6 +11,7 @@
 #include "codeclib.h"
 #endif
 #include <inttypes.h>
+#include <stdbool.h>
 
 // This header file contains all the definitions required by WavPack.
 
@@ -170,12 +171,22 @@ typedef struct {
 
 typedef int32_t (*read_stream)(void *, int32_t);
 
+// optional direct access to the input, so that the audio bitstream can be
+// read in place instead of being copied: request_stream returns a pointer to
+// up to the wanted number of bytes (setting the actual number) and
+// advance_stream consumes them, which also invalidates the pointer
+
+typedef void *(*request_stream)(int32_t *, int32_t);
+typedef void (*advance_stream)(int32_t);
+
 typedef struct bs {
     uchar *buf, *end, *ptr;
     void (*wrap)(struct bs *bs);
     uint32_t file_bytes, sr;
     int error, bc;
     read_stream file;
+    request_stream request;
+    advance_stream advance;
 } Bitstream;
 
 #define MAX_NTERMS 16
@@ -241,9 +252,15 @@ typedef struct {
     char error_message [80];
 
     read_stream infile;
+    request_stream request;
+    advance_stream advance;
     uint32_t total_samples, crc_errors, first_flags;
     int open_flags, norm_offset, reduced_channels, lossy_blocks;
 
+    // optional helper thread, set by the caller after opening
+    bool (*job_start) (void (*fn) (void *arg), void *arg);
+    void (*job_wait) (void);
+
 } WavpackContext;
 
 //////////////////////// function prototypes and macros //////////////////////
@@ -253,6 +270,8 @@ typedef struct {
 // bits.c
 
 void bs_open_read (Bitstream *bs, uchar *buffer_start, uchar *buffer_end, read_stream file, uint32_t file_bytes);
+void bs_open_read_direct (Bitstream *bs, request_stream request, advance_stream advance, uint32_t file_bytes);
+void bs_close_read (Bitstream *bs);
 void bs_open_write (Bitstream *bs, uchar *buffer_start, uchar *buffer_end);
 uint32_t bs_close_write (Bitstream *bs);
 
@@ -414,7 +433,7 @@ void float_normalize (int32_t *values, int32_t num_values, int delta_exp);
 
 // wputils.c
 
-WavpackContext *WavpackOpenFileInput (read_stream infile, char *error);
+WavpackContext *WavpackOpenFileInput (read_stream infile, request_stream request, advance_stream advance, char *error);
 
 int WavpackGetMode (WavpackContext *wpc);
 
@@ -43,17 +43,20 @@ static uint32_t read_next_header (read_stream infile, WavpackHeader *wphdr);
 // this function will not handle "correction" files, plays only the first
 // two channels of multi-channel files, and is limited in resolution in some
 // large integer or floating point files (but always provides at least 24 bits
-// of resolution).
+// of resolution). If request and advance are given, the audio bitstream is
+// read in place through them instead of being copied with infile.
 
 static WavpackContext wpc IBSS_ATTR;
 
-WavpackContext *WavpackOpenFileInput (read_stream infile, char *error)
+WavpackContext *WavpackOpenFileInput (read_stream infile, request_stream request, advance_stream advance, char *error)
 {
     WavpackStream *wps = &wpc.stream;
     uint32_t bcount;
 
     CLEAR (wpc);
     wpc.infile = infile;
+    wpc.request = request;
+    wpc.advance = advance;
     wpc.total_samples = (uint32_t) -1;
     wpc.norm_offset = 0;
     wpc.open_flags = 0;
@@ -62,6 +65,7 @@ WavpackContext *WavpackOpenFileInput (read_stream infile, char *error)
 
     while (!wps->wphdr.block_samples) {
 
+        bs_close_read (&wps->wvbits);
         bcount = read_next_header (wpc.infile, &wps->wphdr);
 
         if (bcount == (uint32_t) -1) {
@@ -168,6 +172,7 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
     while (samples) {
         if (!wps->wphdr.block_samples || !(wps->wphdr.flags & INITIAL_BLOCK) ||
             wps->sample_index >= wps->wphdr.block_index + wps->wphdr.block_samples) {
+                bs_close_read (&wps->wvbits);
                 bcount = read_next_header (wpc->infile, &wps->wphdr);
 
                 if (bcount == (uint32_t) -1)
@@ -56,6 +56,120 @@ static unsigned char mad_main_data[MAD_BUFFER_MDLEN] IBSS_ATTR;
 static int mpeg_latency[3] = { 0, 481, 529 };
 static int mpeg_framesize[3] = {384, 1152, 1152};
 
+/* Seek index: file offsets of every step'th frame from the first one on,
+ * recorded as frames are decoded and kept with the track between plays.
+ * Seeks into the indexed part of the file are sample exact; beyond it the
+ * TOC or bitrate estimate is used as before. When the table fills up every
+ * other entry is dropped and the step doubled. */
+#define SEEK_INDEX_TAG      0x4d504131 /* 'MPA1' */
+#define SEEK_INDEX_ENTRIES  2048
+#define SEEK_INDEX_MIN_SAVE 64  /* new frames worth writing the index for */
+#define SEEK_PREROLL        4   /* frames to refill the bit reservoir */
+
+static struct seek_index
+{
+    uint32_t frame_samples;     /* samples per frame, 0 = none indexed */
+    uint32_t step;              /* frames per entry */
+    uint32_t frames;            /* frames indexed */
+    uint32_t count;             /* entries used */
+    uint32_t offset[SEEK_INDEX_ENTRIES];
+} seek_index;
+
+#define SEEK_INDEX_SIZE(count) \
+    (offsetof(struct seek_index, offset) + (count)*sizeof (uint32_t))
+
+static uint32_t seek_index_saved; /* frames indexed when loaded or saved */
+static long frame_num;            /* next frame to be decoded; -1 = unknown */
+
+static void seek_index_load(void)
+{
+    size_t size = sizeof (seek_index);
+
+    /* Hosts without index storage only index the current play */
+    if (!ci->seek_index_load ||
+        !ci->seek_index_load(SEEK_INDEX_TAG, &seek_index, &size) ||
+        size < SEEK_INDEX_SIZE(0) || seek_index.count > SEEK_INDEX_ENTRIES ||
+        size != SEEK_INDEX_SIZE(seek_index.count) || seek_index.step == 0 ||
+        seek_index.frames > seek_index.count * seek_index.step)
+    {
+        ci->memset(&seek_index, 0, SEEK_INDEX_SIZE(0));
+        seek_index.step = 1;
+    }
+
+    seek_index_saved = seek_index.frames;
+}
+
+static void seek_index_save(void)
+{
+    if (!ci->seek_index_save ||
+        seek_index.frames < seek_index_saved + SEEK_INDEX_MIN_SAVE)
+        return;
+
+    ci->seek_index_save(SEEK_INDEX_TAG, &seek_index,
+                        SEEK_INDEX_SIZE(seek_index.count));
+    seek_index_saved = seek_index.frames;
+}
+
+/* Account for a frame whose header decoded at file offset pos */
+static void seek_index_add(uint32_t pos, uint32_t samples)
+{
+    if (frame_num < 0)
+        return;
+
+    if ((uint32_t)frame_num == seek_index.frames)
+    {
+        if (seek_index.frame_samples == 0)
+            seek_index.frame_samples = samples;
+
+        if (samples != seek_index.frame_samples)
+        {
+            /* Frame numbers no longer map to samples - stop here */
+            frame_num = -1;
+            return;
+        }
+
+        if (frame_num % seek_index.step == 0 &&
+            seek_index.count >= SEEK_INDEX_ENTRIES)
+        {
+            for (uint32_t i = 0; i < SEEK_INDEX_ENTRIES/2; i++)
+                seek_index.offset[i] = seek_index.offset[i*2];
+
+            seek_index.count = SEEK_INDEX_ENTRIES/2;
+            seek_index.step *= 2;
+        }
+
+        if (frame_num % seek_index.step == 0)
+            seek_index.offset[seek_index.count++] = pos;
+
+        seek_index.frames++;
+    }
+
+    frame_num++;
+}
+
+/* Find where to decode from to reach decoded sample number sample (counted
+ * from the first frame) exactly. Returns the samples to skip after seeking
+ * to *pos, or -1 if that part of the file isn't indexed yet. */
+static long seek_index_find(int64_t sample, uint32_t *pos)
+{
+    if (seek_index.frame_samples == 0 || sample < 0)
+        return -1;
+
+    int64_t frame = sample / seek_index.frame_samples;
+    if (frame >= seek_index.frames)
+        return -1;
+
+    frame -= SEEK_PREROLL;
+    if (frame < 0)
+        frame = 0;
+
+    uint32_t entry = frame / seek_index.step;
+    *pos = seek_index.offset[entry];
+    frame_num = entry * seek_index.step;
+
+    return sample - (int64_t)frame_num * seek_index.frame_samples;
+}
+
 static void init_mad(void)
 {
     ci->memset(&stream, 0, sizeof(struct mad_stream));
@@ -336,6 +450,8 @@ enum codec_status codec_run(void)
     int framelength;
     int padding = MAD_BUFFER_GUARD; /* to help mad decode the last frame */
     intptr_t param;
+    uint32_t indexpos;
+    long skip;
 
     /* Reinitializing seems to be necessary to avoid playback quircks when seeking. */
     init_mad();
@@ -345,18 +461,6 @@ enum codec_status codec_run(void)
     ci->configure(DSP_SET_FREQUENCY, ci->id3->frequency);
     current_frequency = ci->id3->frequency;
     codec_set_replaygain(ci->id3);
-    
-    if (!ci->id3->offset && ci->id3->elapsed) {
-        /* Have elapsed time but not offset */
-        ci->id3->offset = get_file_pos(ci->id3->elapsed);
-    }
-
-    if (ci->id3->offset) {
-        ci->seek_buffer(ci->id3->offset);
-        set_elapsed(ci->id3);
-    }
-    else
-        ci->seek_buffer(ci->id3->first_frame_offset);
 
     if (ci->id3->lead_trim >= 0 && ci->id3->tail_trim >= 0) {
         stop_skip = ci->id3->tail_trim - mpeg_latency[ci->id3->layer];
@@ -380,13 +484,39 @@ enum codec_status codec_run(void)
         padding = MAD_BUFFER_GUARD;
     }
 
+    seek_index_load();
+    frame_num = 0;
+
     samplesdone = ((int64_t)ci->id3->elapsed) * current_frequency / 1000;
 
-    /* Don't skip any samples unless we start at the beginning. */
-    if (samplesdone > 0)
-        samples_to_skip = 0;
-    else
-        samples_to_skip = start_skip;
+    if (samplesdone > 0 &&
+        (skip = seek_index_find(samplesdone + start_skip, &indexpos)) >= 0) {
+        /* Resume exactly where we left off */
+        ci->seek_buffer(indexpos);
+        samples_to_skip = skip;
+    }
+    else {
+        if (!ci->id3->offset && ci->id3->elapsed) {
+            /* Have elapsed time but not offset */
+            ci->id3->offset = get_file_pos(ci->id3->elapsed);
+        }
+
+        if (ci->id3->offset) {
+            ci->seek_buffer(ci->id3->offset);
+            set_elapsed(ci->id3);
+            frame_num = -1;
+        }
+        else
+            ci->seek_buffer(ci->id3->first_frame_offset);
+
+        samplesdone = ((int64_t)ci->id3->elapsed) * current_frequency / 1000;
+
+        /* Don't skip any samples unless we start at the beginning. */
+        if (samplesdone > 0)
+            samples_to_skip = 0;
+        else
+            samples_to_skip = start_skip;
+    }
 
     framelength = 0;
 
@@ -409,9 +539,15 @@ enum codec_status codec_run(void)
             if (param == 0) {
                 newpos = ci->id3->first_frame_offset;
                 samples_to_skip = start_skip;
+                frame_num = 0;
+            } else if ((skip = seek_index_find(samplesdone + start_skip,
+                                               &indexpos)) >= 0) {
+                newpos = indexpos;
+                samples_to_skip = skip;
             } else {
                 newpos = get_file_pos(param);
                 samples_to_skip = 0;
+                frame_num = -1;
             }
 
             if (!ci->seek_buffer(newpos))
@@ -450,7 +586,17 @@ enum codec_status codec_run(void)
                 file_end++;
                 continue;
             } else if (MAD_RECOVERABLE(stream.error)) {
-                /* Probably syncing after a seek */
+                /* Probably syncing after a seek. Errors past the header
+                   still used up a frame, one that outputs nothing. */
+                if ((stream.error & 0xff00) == 0x0200) {
+                    seek_index_add(ci->curpos +
+                                   (stream.this_frame - stream.buffer),
+                                   32 * MAD_NSBSAMPLES(&frame.header));
+
+                    samples_to_skip -= 32 * MAD_NSBSAMPLES(&frame.header);
+                    if (samples_to_skip < 0)
+                        samples_to_skip = 0;
+                }
                 continue;
             } else {
                 /* Some other unrecoverable error */
@@ -458,6 +604,9 @@ enum codec_status codec_run(void)
             }
         }
 
+        seek_index_add(ci->curpos + (stream.this_frame - stream.buffer),
+                       32 * MAD_NSBSAMPLES(&frame.header));
+
         /* Do the pcmbuf insert here. Note, this is the PREVIOUS frame's pcm
            data (not the one just decoded above). When we exit the decoding
            loop we will need to process the final frame that was decoded. */
@@ -522,5 +671,7 @@ enum codec_status codec_run(void)
                           framelength - stop_skip);
     }
 
+    seek_index_save();
+
     return CODEC_OK;
 }
@@ -35,6 +35,21 @@ static int32_t read_callback (void *buffer, int32_t bytes)
     return retval;
 }
 
+/* The audio bitstream is read in place from the buffer */
+static void *request_callback (int32_t *bytes, int32_t wanted)
+{
+    size_t realsize;
+    void *ptr = ci->request_buffer (&realsize, wanted);
+    *bytes = realsize;
+    return ptr;
+}
+
+static void advance_callback (int32_t bytes)
+{
+    ci->advance_buffer (bytes);
+    ci->set_offset(ci->curpos);
+}
+
 /* this is the codec entry point */
 enum codec_status codec_main(enum codec_entry_call_reason reason)
 {
@@ -67,11 +82,15 @@ enum codec_status codec_run(void)
     ci->seek_buffer (offset);
 
     /* Create a decoder instance */
-    wpc = WavpackOpenFileInput (read_callback, error);
+    wpc = WavpackOpenFileInput (read_callback, request_callback,
+                                 advance_callback, error);
 
     if (!wpc)
         return CODEC_ERROR;
 
+    wpc->job_start = ci->job_start;
+    wpc->job_wait = ci->job_wait;
+
     ci->configure(DSP_SET_FREQUENCY, WavpackGetSampleRate (wpc));
     codec_set_replaygain(ci->id3);
     /* bps = WavpackGetBytesPerSample (wpc); */
@@ -113,13 +132,17 @@ enum codec_status codec_run(void)
                 ci->seek_buffer (ci->curpos - skip);
             }
 
-            wpc = WavpackOpenFileInput (read_callback, error);
+            wpc = WavpackOpenFileInput (read_callback, request_callback,
+                                         advance_callback, error);
             if (!wpc)
             {
                 ci->seek_complete();
                 break;
             }
 
+            wpc->job_start = ci->job_start;
+            wpc->job_wait = ci->job_wait;
+
             ci->set_elapsed (WavpackGetSampleIndex (wpc) / sr_100 * 10);
             ci->seek_complete();
         }
@@ -23,6 +23,7 @@
 #include "platform.h"
 #include "dsp_core.h"
 #include "dsp_sample_io.h"
+#include <string.h>
 
 /* Define LOGF_ENABLE to enable logf output in this file */
 /*#define LOGF_ENABLE*/
@@ -39,6 +40,41 @@
 #define DSP_PROCESS_END()
 #endif /* !DSP_PROCESS_START */
 
+#ifdef DSP_PROFILE_TIMER
+/* Stage names for the profile, in database order */
+#define DSP_PROC_DB_START \
+    static const char * const dsp_proc_names[] = {
+#define DSP_PROC_DB_ITEM(name) \
+    #name,
+#define DSP_PROC_DB_STOP };
+
+#include "dsp_proc_database.h"
+
+#define DSP_PROFILE_INPUT   0
+#define DSP_PROFILE_OUTPUT  (DSP_NUM_PROC_STAGES + 1)
+
+/* Input, output and every stage must fit into the counter array */
+typedef char dsp_profile_stages_fit[
+    DSP_NUM_PROC_STAGES + 2 <= DSP_PROFILE_MAX_STAGES ? 1 : -1];
+
+#define DSP_PROFILE_START(profile) \
+    ((profile) ? (uint32_t)DSP_PROFILE_TIMER() : 0)
+
+#define DSP_PROFILE_STOP(profile, stage, start, count)                  \
+    ({ if (profile)                                                     \
+       {                                                                \
+           struct dsp_profile_stage *__p = &(profile)->stages[stage];  \
+           __p->time += (uint32_t)DSP_PROFILE_TIMER() - (start);       \
+           __p->samples += (count);                                    \
+           __p->calls++;                                               \
+       } })
+#else
+#define DSP_PROFILE_START(profile) \
+    ({ (void)(profile); 0; })
+#define DSP_PROFILE_STOP(profile, stage, start, count) \
+    ({ (void)(start); (void)(count); })
+#endif /* DSP_PROFILE_TIMER */
+
 /* Linked lists give fewer loads in processing loop compared to some index
  * list, which is more important than keeping occasionally executed code
  * simple */
@@ -59,6 +95,7 @@ struct dsp_config
         uint8_t db_index;           /* Index in database array */
     } *proc_slots;                  /* Pointer to first in list of enabled
                                        stages */
+    struct dsp_profile *profile;    /* Profiling counters (NULL = off) */
 };
 
 #define NACT_BIT    BIT_N(___DSP_PROC_ID_RESERVED)
@@ -70,6 +107,11 @@ dsp_proc_slot_arr[DSP_NUM_PROC_STAGES+DSP_VOICE_NUM_PROC_STAGES] IBSS_ATTR;
 /* General DSP config */
 static struct dsp_config dsp_conf[DSP_COUNT] IBSS_ATTR;
 
+#ifdef DSP_PROFILE_TIMER
+/* Profiling counters - only touched while profiling is enabled */
+static struct dsp_profile dsp_profiles[DSP_COUNT];
+#endif
+
 /** Processing stages support functions **/
 static const struct dsp_proc_db_entry *
 proc_db_entry(const struct dsp_proc_slot *s)
@@ -352,6 +394,7 @@ static NO_INLINE bool dsp_proc_new_format(struct dsp_proc_slot *s,
 
 static FORCE_INLINE void dsp_proc_call(struct dsp_proc_slot *s,
                                        struct dsp_config *dsp,
+                                       struct dsp_profile *profile,
                                        struct dsp_buffer **buf_p)
 {
     struct dsp_buffer *buf = *buf_p;
@@ -370,7 +413,12 @@ static FORCE_INLINE void dsp_proc_call(struct dsp_proc_slot *s,
         buf->proc_mask |= s->mask;
     }
 
+    int count = buf->remcount;
+    uint32_t start = DSP_PROFILE_START(profile);
+
     s->proc_entry.process(&s->proc_entry, buf_p);
+
+    DSP_PROFILE_STOP(profile, s->db_index + 1, start, count);
 }
 
 /**
@@ -428,6 +476,9 @@ void dsp_process(struct dsp_config *dsp, struct dsp_buffer *src,
 
     DSP_PROCESS_START();
 
+    /* Sampled once so that toggling profiling mid-call stays consistent */
+    struct dsp_profile *profile = dsp->profile;
+
     /* Tag input with codec-specified sample format */
     src->format = dsp->io_data.format;
 
@@ -441,12 +492,14 @@ void dsp_process(struct dsp_config *dsp, struct dsp_buffer *src,
         struct dsp_buffer *buf = src;
 
         /* Convert input samples to internal format */
+        uint32_t start = DSP_PROFILE_START(profile);
         dsp->io_data.input_samples(&dsp->io_data, &buf);
+        DSP_PROFILE_STOP(profile, DSP_PROFILE_INPUT, start, buf->remcount);
 
         /* Call all active/enabled stages depending if format is
            same/changed on the last output buffer */
         for (struct dsp_proc_slot *s = dsp->proc_slots; s; s = s->next)
-            dsp_proc_call(s, dsp, &buf);
+            dsp_proc_call(s, dsp, profile, &buf);
 
         /* Don't overread/write src/destination */
         int outcount = MIN(dst->bufcount, buf->remcount);
@@ -458,7 +511,9 @@ void dsp_process(struct dsp_config *dsp, struct dsp_buffer *src,
             dsp_sample_output_format_change(&dsp->io_data, &buf->format);
 
         dsp->io_data.outcount = outcount;
+        start = DSP_PROFILE_START(profile);
         dsp->io_data.output_samples(&dsp->io_data, buf, dst);
+        DSP_PROFILE_STOP(profile, DSP_PROFILE_OUTPUT, start, outcount);
 
         /* Advance buffers by what output consumed and produced */
         dsp_advance_buffer32(buf, outcount);
@@ -470,9 +525,61 @@ void dsp_process(struct dsp_config *dsp, struct dsp_buffer *src,
     DSP_PROCESS_END();
 }
 
+/* Turn stage profiling on or off; turning it on starts from zero */
+static bool dsp_profile_enable(struct dsp_config *dsp, bool enable)
+{
+#ifdef DSP_PROFILE_TIMER
+    struct dsp_profile *profile = &dsp_profiles[dsp_get_id(dsp)];
+
+    dsp->profile = NULL;
+
+    if (!enable)
+        return true;
+
+    memset(profile, 0, sizeof (*profile));
+    profile->num_stages = DSP_NUM_PROC_STAGES + 2;
+    profile->timer_freq = DSP_PROFILE_TIMER_FREQ;
+    profile->stages[DSP_PROFILE_INPUT].name = "INPUT";
+    profile->stages[DSP_PROFILE_OUTPUT].name = "OUTPUT";
+
+    for (unsigned int i = 0; i < DSP_NUM_PROC_STAGES; i++)
+        profile->stages[i + 1].name = dsp_proc_names[i];
+
+    dsp->profile = profile;
+    return true;
+#else
+    return false;
+    (void)dsp; (void)enable;
+#endif
+}
+
+/* Copy out the current counters */
+static bool dsp_profile_get(struct dsp_config *dsp,
+                            struct dsp_profile *profile)
+{
+#ifdef DSP_PROFILE_TIMER
+    if (!dsp->profile)
+        return false;
+
+    *profile = *dsp->profile;
+    return true;
+#else
+    return false;
+    (void)dsp; (void)profile;
+#endif
+}
+
 intptr_t dsp_configure(struct dsp_config *dsp, unsigned int setting,
                        intptr_t value)
 {
+    switch (setting)
+    {
+    case DSP_PROFILE_ENABLE:
+        return dsp_profile_enable(dsp, value);
+    case DSP_PROFILE_GET:
+        return dsp_profile_get(dsp, (struct dsp_profile *)value);
+    }
+
     return proc_broadcast(dsp, setting, value);
 }
 
@@ -45,6 +45,10 @@ enum dsp_settings
     DSP_PROC_CLOSE,
     DSP_PROC_NEW_FORMAT,
     DSP_PROC_SETTING, /* stage-specific should be this + id */
+    /* Past every stage-specific setting, stage ids are below 32 */
+    DSP_PROFILE_ENABLE = DSP_PROC_SETTING + 32, /* value = bool; enable
+                                                   clears the counters */
+    DSP_PROFILE_GET,    /* value = struct dsp_profile * to fill */
 };
 
 enum dsp_stereo_modes
@@ -96,6 +100,28 @@ struct dsp_buffer
                                  /* 1ch */
 };
 
+/* Per-stage profiling counters returned by DSP_PROFILE_GET. Only available
+ * if the platform config provides DSP_PROFILE_TIMER(), otherwise
+ * DSP_PROFILE_ENABLE and DSP_PROFILE_GET return false. Stage 0 is sample
+ * input, the last one sample output and the ones between are the enabled
+ * and disabled stages in database order. */
+#define DSP_PROFILE_MAX_STAGES 16
+
+struct dsp_profile_stage
+{
+    const char *name;  /* Stage name */
+    uint32_t calls;    /* Number of times the stage processed a buffer */
+    uint64_t samples;  /* Samples handed to the stage (produced, for input) */
+    uint64_t time;     /* Time spent in timer_freq units */
+};
+
+struct dsp_profile
+{
+    unsigned int num_stages;   /* Entries used in stages[] */
+    unsigned long timer_freq;  /* Frequency of the profiling timer */
+    struct dsp_profile_stage stages[DSP_PROFILE_MAX_STAGES];
+};
+
 /* Remove samples from input buffer (In). Sample size is specified.
    Provided to dsp_process(). */
 static inline void dsp_advance_buffer_input(struct dsp_buffer *buf,
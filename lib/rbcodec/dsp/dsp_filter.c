@@ -304,6 +304,69 @@ void filter_process(struct dsp_filter *f, int32_t * const buf[], int count,
 }
 #endif /* CPU */
 
+/**
+ * Run a cascade of num filters over the buffer in a single pass instead of
+ * making one pass per filter.
+ */
+#if (!defined(CPU_COLDFIRE) && !defined(CPU_ARM))
+void filter_process_cascade(struct dsp_filter * const f[], unsigned int num,
+                            int32_t * const buf[], int count,
+                            unsigned int channels)
+{
+    /* Same arithmetic as filter_process() but each sample goes through all
+       the sections while it is in a register; only the small per-section
+       histories are touched in memory. */
+    for (unsigned int c = 0; c < channels; c++) {
+        int32_t *p = buf[c];
+
+        for (int i = 0; i < count; i++) {
+            int32_t x = p[i];
+
+            for (unsigned int n = 0; n < num; n++) {
+                const int32_t *coefs = f[n]->coefs;
+                int32_t *h = f[n]->history[c];
+                long long acc = (long long) x * coefs[0];
+                acc += (long long) h[0] * coefs[1];
+                acc += (long long) h[1] * coefs[2];
+                acc += (long long) h[2] * coefs[3];
+                acc += (long long) h[3] * coefs[4];
+                h[1] = h[0];
+                h[0] = x;
+                h[3] = h[2];
+                x = (acc << f[n]->shift) >> 32;
+                h[2] = x;
+            }
+
+            p[i] = x;
+        }
+    }
+}
+#else
+/* Cache-sized block that is run through every section before moving on */
+#define FILTER_CASCADE_BLOCK 64
+
+void filter_process_cascade(struct dsp_filter * const f[], unsigned int num,
+                            int32_t * const buf[], int count,
+                            unsigned int channels)
+{
+    /* The assembly filter_process() keeps a section's state in registers
+       for the whole call, so feed it blocks small enough to stay in cache
+       across all sections rather than streaming the buffer num times. */
+    int32_t *block[2] = { buf[0], buf[channels - 1] };
+
+    while (count > 0) {
+        int n = MIN(count, FILTER_CASCADE_BLOCK);
+
+        for (unsigned int i = 0; i < num; i++)
+            filter_process(f[i], block, n, channels);
+
+        block[0] += n;
+        block[1] += n;
+        count -= n;
+    }
+}
+#endif /* CPU */
+
 /* ring buffer */
 int32_t dequeue(int32_t* buffer, int *head, int boundary)
 {
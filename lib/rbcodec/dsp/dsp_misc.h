@@ -54,6 +54,20 @@ struct dsp_replay_gains
 
 void dsp_replaygain_set_settings(const struct replaygain_settings *settings);
 
+enum resample_quality
+{
+    RESAMPLE_QUALITY_LOW = 0, /* 4-point Hermite spline */
+    RESAMPLE_QUALITY_HIGH,    /* Polyphase windowed sinc */
+    RESAMPLE_QUALITY_NUM
+};
+
+/* Select the resampler of one DSP (value = enum resample_quality) */
+#define RESAMPLE_SET_QUALITY (DSP_PROC_SETTING+DSP_PROC_RESAMPLE)
+
+/* Set the resampler quality of the audio DSP; in resample.c. Targets without
+ * HAVE_SINC_RESAMPLER always stay at RESAMPLE_QUALITY_LOW. */
+void dsp_set_resample_quality(int quality);
+
 #ifdef HAVE_PITCHCONTROL
 void dsp_set_pitch(int32_t pitch);
 int32_t dsp_get_pitch(void);
@@ -26,6 +26,12 @@
 #include "dsp_proc_entry.h"
 #include "dsp-util.h"
 #include <string.h>
+#if defined(CPU_COLDFIRE) || defined(CPU_ARM)
+/* Assembly versions in dsp_cf.S/dsp_arm.S */
+#elif defined(__SSE2__)
+#define SAMPLE_OUTPUT_SSE2
+#include <emmintrin.h>
+#endif
 
 #if 0
 #include <debug.h>
@@ -44,7 +50,70 @@ void sample_output_dithered(struct sample_io_data *this,
 
 /** Sample output **/
 
-#if !defined(CPU_COLDFIRE) && !defined(CPU_ARM)
+#ifdef SAMPLE_OUTPUT_SSE2
+/* Four samples of each channel at a time, the remainder as below. Saturating
+ * to 16 bits when narrowing is exactly what clip_sample_16 does. */
+#define OUTPUT_FOUR(s, bias, shift) \
+    ({ __m128i __v = _mm_sra_epi32(_mm_add_epi32( \
+            _mm_loadu_si128((const __m128i *)(s)), bias), shift); \
+       _mm_packs_epi32(__v, __v); })
+
+/* write mono internal format to output format */
+void sample_output_mono(struct sample_io_data *this,
+                        struct dsp_buffer *src, struct dsp_buffer *dst)
+{
+    int count = this->outcount;
+    const int32_t *s0 = src->p32[0];
+    int16_t *d = dst->p16out;
+    int scale = src->format.output_scale;
+    int32_t dc_bias = 1L << (scale - 1);
+
+    __m128i bias = _mm_set1_epi32(dc_bias);
+    __m128i shift = _mm_cvtsi32_si128(scale);
+
+    for (; count >= 4; count -= 4, s0 += 4, d += 8)
+    {
+        __m128i m = OUTPUT_FOUR(s0, bias, shift);
+        _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(m, m));
+    }
+
+    for (; count > 0; count--)
+    {
+        int32_t lr = clip_sample_16((*s0++ + dc_bias) >> scale);
+        *d++ = lr;
+        *d++ = lr;
+    }
+}
+
+/* write stereo internal format to output format */
+void sample_output_stereo(struct sample_io_data *this,
+                          struct dsp_buffer *src, struct dsp_buffer *dst)
+{
+    int count = this->outcount;
+    const int32_t *s0 = src->p32[0];
+    const int32_t *s1 = src->p32[1];
+    int16_t *d = dst->p16out;
+    int scale = src->format.output_scale;
+    int32_t dc_bias = 1L << (scale - 1);
+
+    __m128i bias = _mm_set1_epi32(dc_bias);
+    __m128i shift = _mm_cvtsi32_si128(scale);
+
+    for (; count >= 4; count -= 4, s0 += 4, s1 += 4, d += 8)
+    {
+        __m128i l = OUTPUT_FOUR(s0, bias, shift);
+        __m128i r = OUTPUT_FOUR(s1, bias, shift);
+        _mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(l, r));
+    }
+
+    for (; count > 0; count--)
+    {
+        *d++ = clip_sample_16((*s0++ + dc_bias) >> scale);
+        *d++ = clip_sample_16((*s1++ + dc_bias) >> scale);
+    }
+}
+
+#elif !defined(CPU_COLDFIRE) && !defined(CPU_ARM)
 /* write mono internal format to output format */
 void sample_output_mono(struct sample_io_data *this,
                         struct dsp_buffer *src, struct dsp_buffer *dst)
@@ -89,6 +158,10 @@ void sample_output_stereo(struct sample_io_data *this,
  * taken from the coolplayer project - coolplayer.sourceforge.net
  *
  * This function handles mono and stereo outputs.
+ *
+ * There is no SSE2 version: every sample's noise shaping uses the error
+ * left by the one before, and so does the random generator, so only the
+ * two channels could run side by side.
  */
 static struct dither_data
 {
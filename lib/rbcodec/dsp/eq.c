@@ -50,6 +50,8 @@ static struct eq_state
 {
     uint32_t enabled;                        /* Mask of enabled bands */
     uint8_t bands[EQ_NUM_BANDS+1];           /* Indexes of enabled bands */
+    unsigned int num_active;                 /* Number of enabled bands */
+    struct dsp_filter *active[EQ_NUM_BANDS]; /* Enabled filters in order */
     struct dsp_filter filters[EQ_NUM_BANDS]; /* Data for each filter */
 } eq_data IBSS_ATTR;
 
@@ -141,9 +143,14 @@ void dsp_set_eq_coefs(int band, const struct eq_band_setting *setting)
   
     /* Prepare list of enabled bands for efficient iteration */
     for (band = 0; mask != 0; mask &= mask - 1, band++)
-        eq_data.bands[band] = (uint8_t)find_first_set_bit(mask);
+    {
+        int b = find_first_set_bit(mask);
+        eq_data.bands[band] = (uint8_t)b;
+        eq_data.active[band] = &eq_data.filters[b];
+    }
 
     eq_data.bands[band] = EQ_NUM_BANDS;
+    eq_data.num_active = band;
 }
 
 /* Enable or disable the equalizer */
@@ -166,11 +173,9 @@ static void eq_process(struct dsp_proc_entry *this,
                        struct dsp_buffer **buf_p)
 {
     struct dsp_buffer *buf = *buf_p;
-    int count = buf->remcount;
-    unsigned int channels = buf->format.num_channels;
 
-    FOR_EACH_ENB_BAND(b)
-        filter_process(&eq_data.filters[*b], buf->p32, count, channels);
+    filter_process_cascade(eq_data.active, eq_data.num_active, buf->p32,
+                           buf->remcount, buf->format.num_channels);
 
     (void)this;
 }
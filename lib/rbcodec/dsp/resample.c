@@ -31,6 +31,11 @@
 /**
  * Linear interpolation resampling that introduces a one sample delay because
  * of our inability to look into the future at the end of a frame.
+ *
+ * With HAVE_SINC_RESAMPLER, RESAMPLE_QUALITY_HIGH swaps the Hermite spline
+ * for a band-limited polyphase windowed-sinc filter. It costs over ten times
+ * the cycles and SINC_TAPS/2 samples of delay but keeps images and aliases
+ * below audibility, which is what hosted and faster targets should be using.
  */
 
 #if 1 /* Set to '0' to enable debug messages */
@@ -40,9 +45,41 @@
 
 #define RESAMPLE_BUF_COUNT 192 /* Per channel, per DSP */
 
+#ifdef HAVE_SINC_RESAMPLER
+/* Windowed-sinc filter dimensions. Coefficients are tabulated for
+ * SINC_PHASES fractional positions and linearly interpolated in between
+ * using the remaining bits of the 16-bit phase fraction. */
+#define SINC_TAPS_BITS      6
+#define SINC_TAPS           (1 << SINC_TAPS_BITS)
+#define SINC_PHASE_BITS     6
+#define SINC_PHASES         (1 << SINC_PHASE_BITS)
+#define SINC_INTERP_BITS    (16 - SINC_PHASE_BITS)
+#define SINC_COEF_BITS      24 /* Coefficient format s7.24 */
+
+/* Passband edge as a fraction of the lower Nyquist frequency (s15.16) */
+#define SINC_CUTOFF         59638 /* 0.91 */
+#endif /* HAVE_SINC_RESAMPLER */
+
 /* CODEC_IDX_AUDIO = left and right, CODEC_IDX_VOICE = mono */
 static int32_t resample_out_bufs[3][RESAMPLE_BUF_COUNT] IBSS_ATTR;
 
+struct resample_data;
+
+typedef int (*resample_fn_type)(struct resample_data *data,
+                                struct dsp_buffer *src,
+                                struct dsp_buffer *dst);
+
+#ifdef HAVE_SINC_RESAMPLER
+/* Polyphase filter state, only used with RESAMPLE_QUALITY_HIGH and only
+ * available to the audio DSP */
+static struct resample_sinc_data
+{
+    int32_t history[2][SINC_TAPS-1];        /* Last samples (L+R),
+                                               0 = oldest */
+    int32_t coefs[SINC_PHASES+1][SINC_TAPS]; /* Row per phase */
+} resample_sinc_data;
+#endif /* HAVE_SINC_RESAMPLER */
+
 /* Data for each resampler on each DSP */
 static struct resample_data
 {
@@ -55,6 +92,11 @@ static struct resample_data
     unsigned int frequency_out;     /* Resampler output samplerate */
     struct dsp_buffer resample_buf; /* Buffer descriptor for resampled data */
     int32_t *resample_out_p[2];     /* Actual output buffer pointers */
+    unsigned int quality;           /* enum resample_quality */
+    resample_fn_type resample;      /* Worker for the selected quality */
+#ifdef HAVE_SINC_RESAMPLER
+    struct resample_sinc_data *sinc; /* Polyphase filter state */
+#endif
 } resample_data[DSP_COUNT] IBSS_ATTR;
 
 /* Actual worker function. Implemented here or in target assembly code. */
@@ -65,7 +107,73 @@ static void resample_flush_data(struct resample_data *data)
 {
     data->phase = 0;
     memset(&data->history, 0, sizeof (data->history));
+
+#ifdef HAVE_SINC_RESAMPLER
+    if (data->sinc)
+        memset(&data->sinc->history, 0, sizeof (data->sinc->history));
+#endif
+}
+
+#ifdef HAVE_SINC_RESAMPLER
+/* Build the windowed-sinc table for the current rate pair. The cutoff
+ * follows the lower of the two rates so that downsampling is band-limited
+ * as well. */
+static void resample_sinc_init_coefs(struct resample_data *data)
+{
+    struct resample_sinc_data *sinc = data->sinc;
+    unsigned int fin = data->frequency, fout = data->frequency_out;
+
+    /* Cutoff relative to the input Nyquist frequency, s15.16 */
+    int32_t fc = fin > fout ? (int32_t)fp_div(fout, fin, 16) : 1 << 16;
+    fc = (int64_t)fc * SINC_CUTOFF >> 16;
+
+    for (int p = 0; p <= SINC_PHASES; p++)
+    {
+        int64_t sum = 0;
+
+        for (int j = 0; j < SINC_TAPS; j++)
+        {
+            /* Distance from the interpolated point in 1/SINC_PHASES
+               samples */
+            int32_t t = (j - (SINC_TAPS/2 - 1)) * SINC_PHASES - p;
+            int64_t h;
+
+            if (t == 0)
+            {
+                h = (int64_t)fc << 14; /* s15.16 -> s1.30 */
+            }
+            else
+            {
+                /* sin(pi*fc*t) / (pi*t), 2^32 == 2*pi */
+                uint32_t ph = (int64_t)fc * t * (1 << (15 - SINC_PHASE_BITS));
+                int64_t sin = fp_sincos(ph, NULL);
+                h = (sin << (SINC_PHASE_BITS + 16)) /
+                        ((int64_t)t * 411775); /* pi*2^17 */
+            }
+
+            /* Blackman window spanning all taps */
+            long cos1, cos2;
+            fp_sincos((uint32_t)t << (32 - SINC_PHASE_BITS - SINC_TAPS_BITS),
+                      &cos1);
+            fp_sincos((uint32_t)t << (33 - SINC_PHASE_BITS - SINC_TAPS_BITS),
+                      &cos2);
+            int64_t w = 901943132 /* 0.42 */ + (cos1 >> 1) +
+                        (int64_t)cos2 * 2 / 25;
+
+            h = h * w >> (31 + 30 - SINC_COEF_BITS);
+            sinc->coefs[p][j] = h;
+            sum += h;
+        }
+
+        /* Normalize each phase to unity gain at DC */
+        for (int j = 0; j < SINC_TAPS; j++)
+        {
+            sinc->coefs[p][j] =
+                ((int64_t)sinc->coefs[p][j] << SINC_COEF_BITS) / sum;
+        }
+    }
 }
+#endif /* HAVE_SINC_RESAMPLER */
 
 static void resample_flush(struct dsp_proc_entry *this)
 {
@@ -93,6 +201,11 @@ static bool resample_new_delta(struct resample_data *data,
         return false;
     }
 
+#ifdef HAVE_SINC_RESAMPLER
+    if (data->quality == RESAMPLE_QUALITY_HIGH)
+        resample_sinc_init_coefs(data);
+#endif
+
     return true;
 }
 
@@ -188,6 +301,110 @@ int resample_hermite(struct resample_data *data, struct dsp_buffer *src,
 }
 #endif /* CPU */
 
+#ifdef HAVE_SINC_RESAMPLER
+/* Same contract as resample_hermite() but with a SINC_TAPS-point windowed
+ * sinc; the output lags by SINC_TAPS/2 samples instead of one */
+static int resample_sinc(struct resample_data *data, struct dsp_buffer *src,
+                         struct dsp_buffer *dst)
+{
+    struct resample_sinc_data *sinc = data->sinc;
+    int ch = src->format.num_channels - 1;
+    uint32_t count = MIN(src->remcount, 0x8000);
+    uint32_t delta = data->delta;
+    uint32_t phase, pos;
+    int32_t *d;
+
+    do
+    {
+        const int32_t *s = src->p32[ch];
+        int32_t *h = sinc->history[ch];
+
+        /* History followed by the start of the frame, for the positions
+         * whose window straddles the two */
+        int32_t edge[2*SINC_TAPS - 2];
+        memcpy(edge, h, (SINC_TAPS - 1) * sizeof (int32_t));
+        memcpy(edge + SINC_TAPS - 1, s,
+               MIN(count, SINC_TAPS - 1) * sizeof (int32_t));
+
+        d = dst->p32[ch];
+        int32_t *dmax = d + dst->bufcount;
+
+        /* Restore state */
+        phase = data->phase;
+        pos = phase >> 16;
+        pos = MIN(pos, count);
+
+        while (pos < count && d < dmax)
+        {
+            /* Window ends with s[pos] */
+            const int32_t *x = pos < SINC_TAPS - 1 ?
+                                    &edge[pos] : &s[pos - (SINC_TAPS - 1)];
+            uint32_t frac = phase & 0xffff;
+            const int32_t *c0 = sinc->coefs[frac >> SINC_INTERP_BITS];
+            const int32_t *c1 = c0 + SINC_TAPS;
+            int32_t t = frac & ((1 << SINC_INTERP_BITS) - 1);
+            int64_t acc = 0;
+
+            for (int j = 0; j < SINC_TAPS; j++)
+            {
+                /* Interpolate between the two neighbouring phases; their
+                   difference stays well below 2^(31 - SINC_INTERP_BITS) */
+                int32_t c = c0[j] +
+                            (((c1[j] - c0[j]) * t) >> SINC_INTERP_BITS);
+                acc += (int64_t)x[j] * c;
+            }
+
+            *d++ = acc >> SINC_COEF_BITS;
+
+            phase += delta;
+            pos = phase >> 16;
+        }
+
+        pos = MIN(pos, count);
+
+        /* Save delay samples for next time */
+        for (int j = 0; j < SINC_TAPS - 1; j++)
+        {
+            uint32_t i = pos + j;
+            h[j] = i < SINC_TAPS - 1 ? edge[i] : s[i - (SINC_TAPS - 1)];
+        }
+    }
+    while (--ch >= 0);
+
+    /* Wrap phase accumulator back to start of next frame. */
+    data->phase = phase - (pos << 16);
+
+    dst->remcount = d - dst->p32[0];
+    return pos;
+}
+#endif /* HAVE_SINC_RESAMPLER */
+
+/* Select the worker for a given quality; takes effect with the next
+ * format update */
+static void resample_set_quality(struct resample_data *data,
+                                 struct dsp_config *dsp,
+                                 unsigned int quality)
+{
+#ifdef HAVE_SINC_RESAMPLER
+    if (quality >= RESAMPLE_QUALITY_NUM || !data->sinc)
+#endif
+        quality = RESAMPLE_QUALITY_LOW;
+
+    if (quality == data->quality)
+        return;
+
+    data->quality = quality;
+#ifdef HAVE_SINC_RESAMPLER
+    data->resample = quality == RESAMPLE_QUALITY_HIGH ?
+                        resample_sinc : resample_hermite;
+#endif
+
+    /* History formats differ; start over and force new coefficients */
+    resample_flush_data(data);
+    data->frequency = 0;
+    dsp_proc_want_format_update(dsp, DSP_PROC_RESAMPLE);
+}
+
 /* Resample count stereo samples or stop when the destination is full.
  * Updates the src buffer and changes to its own output buffer to refer to
  * the resampled data. */
@@ -211,7 +428,7 @@ static void resample_process(struct dsp_proc_entry *this,
     {
         dst->bufcount = RESAMPLE_BUF_COUNT;
 
-        int consumed = resample_hermite(data, src, dst);
+        int consumed = data->resample(data, src, dst);
 
         /* Advance src by consumed amount */
         if (consumed > 0)
@@ -289,6 +506,12 @@ static void INIT_ATTR resample_dsp_init(struct dsp_config *dsp,
     dsp_proc_enable(dsp, DSP_PROC_RESAMPLE, true);
     resample_data[dsp_id].resample_out_p[0] = lbuf;
     resample_data[dsp_id].resample_out_p[1] = rbuf;
+    resample_data[dsp_id].quality = RESAMPLE_QUALITY_LOW;
+    resample_data[dsp_id].resample = resample_hermite;
+#ifdef HAVE_SINC_RESAMPLER
+    resample_data[dsp_id].sinc =
+        dsp_id == CODEC_IDX_AUDIO ? &resample_sinc_data : NULL;
+#endif
 }
 
 static void INIT_ATTR resample_proc_init(struct dsp_proc_entry *this,
@@ -335,11 +558,22 @@ static intptr_t resample_configure(struct dsp_proc_entry *this,
     case DSP_SET_OUT_FREQUENCY:
         dsp_proc_want_format_update(dsp, DSP_PROC_RESAMPLE);
         break;
+
+    case RESAMPLE_SET_QUALITY:
+        resample_set_quality((void *)this->data, dsp, value);
+        break;
     }
 
     return retval;
 }
 
+/* Set the resampler quality of the audio DSP */
+void dsp_set_resample_quality(int quality)
+{
+    dsp_configure(dsp_get_config(CODEC_IDX_AUDIO), RESAMPLE_SET_QUALITY,
+                  quality);
+}
+
 /* Database entry */
 DSP_PROC_DB_ENTRY(RESAMPLE,
                   resample_configure);
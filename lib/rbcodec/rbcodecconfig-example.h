@@ -4,6 +4,7 @@
 #define HAVE_PITCHCONTROL
 #define HAVE_SW_TONE_CONTROLS
 #define HAVE_ALBUMART
+#define HAVE_SINC_RESAMPLER
 #define NUM_CORES 1
 /* All the same unless a configuration option is added to warble */
 #define DSP_OUT_MIN_HZ     44100
@@ -30,6 +31,20 @@
 //#define MAX_PATH PATH_MAX
 // set same as rb to avoid dragons
 #define MAX_PATH 260
+
+/* clock_gettime */
+#include <time.h>
+
+/* Timer for DSP stage profiling (DSP_PROFILE_ENABLE) */
+static inline uint32_t dsp_profile_timer(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+#define DSP_PROFILE_TIMER()     dsp_profile_timer()
+#define DSP_PROFILE_TIMER_FREQ  1000000000ul
 #endif
 
 #endif
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+#             __________               __   ___.
+#   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+#   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+#   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+#   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+#                     \/            \/     \/    \/            \/
+#
+# Hosted counterpart of the test_bench plugin: runs the codec, DSP and
+# kernel benchmarks in a fixed sequence and writes the results in the same
+# CSV format, optionally comparing them against a baseline from either.
+#
+# All files in this archive are subject to the GNU General Public License.
+# See the file COPYING in the source tree root for full license agreement.
+#
+# This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+# KIND, either express or implied.
+#
+# Usage: bench.py [-w warble] [-v vector_bench] [-n runs] [-s settings]
+#                 [-o out.csv] [-b baseline.csv] FILE|DIR...
+#
+# Suites:
+#   codec  realtime factor per file, decoding without the DSP (warble -b -r)
+#   dsp    ns/sample per DSP stage over all files (warble -b -p)
+#   kernel ns per call of the SIMD kernels, if vector_bench is given
+#
+# Build warble with optimization (e.g. add -O2 to GCCOPTS). The best of the
+# runs is reported. With -b the exit status is 1 if any result got worse by
+# more than the tolerance; copy the output file to make it the new baseline.
+
+import argparse
+import json
+import os
+import platform
+import re
+import subprocess
+import sys
+import tempfile
+
+HIGHER_IS_BETTER = ("MB/s", "fps", "x")
+
+
+def warble_report(warble, args, paths):
+    """Run warble in batch mode and return its JSON report"""
+    fd, report = tempfile.mkstemp(suffix=".json")
+    os.close(fd)
+    try:
+        try:
+            p = subprocess.run([warble, "-b", "-j", "1", "-o", report] +
+                               args + paths, stdout=subprocess.PIPE,
+                               stderr=subprocess.PIPE,
+                               universal_newlines=True)
+        except OSError as e:
+            sys.exit("error: can't run %s: %s" % (warble, e.strerror))
+        try:
+            with open(report) as f:
+                return json.load(f)
+        except (OSError, ValueError):
+            sys.exit("error: warble failed:\n" + p.stderr)
+    finally:
+        os.remove(report)
+
+
+def bench_codec(warble, paths, runs, results):
+    best = {}
+    for _ in range(runs):
+        for res in warble_report(warble, ["-r"], paths)["files"]:
+            if res["status"] == "ok" and res["wall_ms"] > 0:
+                best[res["path"]] = max(best.get(res["path"], 0),
+                                        res["realtime"])
+    for path in sorted(best):
+        results.append(("codec", os.path.basename(path), best[path], "x"))
+
+
+def bench_dsp(warble, settings, paths, runs, results):
+    args = ["-p"] + (["-s", settings] if settings else [])
+    best = {}
+    for _ in range(runs):
+        stages = {}
+        for res in warble_report(warble, args, paths)["files"]:
+            for st in res.get("dsp_profile", []):
+                s = stages.setdefault(st["stage"], [0.0, 0])
+                s[0] += st["ms"]
+                s[1] += st["samples"]
+        for name, (ms, samples) in stages.items():
+            if samples:
+                ns = ms * 1e6 / samples
+                best[name] = min(best.get(name, ns), ns)
+    for name in sorted(best):
+        results.append(("dsp", name, best[name], "ns"))
+
+
+def bench_kernels(vector_bench, runs, results):
+    best = {}
+    for _ in range(runs):
+        p = subprocess.run([vector_bench], stdout=subprocess.PIPE,
+                           universal_newlines=True)
+        for m in re.finditer(r"^(.{22}) +\S+ +(\S+) +\S+x", p.stdout, re.M):
+            name, ns = m.group(1).strip(), float(m.group(2))
+            best[name] = min(best.get(name, ns), ns)
+        if p.returncode:
+            print("warning: vector_bench reported mismatches",
+                  file=sys.stderr)
+    for name in sorted(best):
+        results.append(("kernel", name, best[name], "ns"))
+
+
+def version():
+    tools = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                         "..", "..", "..", "tools")
+    try:
+        return subprocess.check_output([os.path.join(tools, "version.sh"),
+                                        os.path.join(tools, "..")],
+                                       universal_newlines=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def write_csv(path, header, results):
+    with open(path, "w") as f:
+        for key, value in header:
+            f.write("# %s,%s\n" % (key, value))
+        for suite, name, value, unit in results:
+            f.write("%s,%s,%.2f,%s\n" % (suite, name.replace(",", "_"),
+                                         value, unit))
+
+
+def read_csv(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            if line.startswith("#"):
+                continue
+            fields = line.rstrip("\r\n").split(",")
+            if len(fields) == 4:
+                results[(fields[0], fields[1], fields[3])] = float(fields[2])
+    return results
+
+
+def change(value, base, unit):
+    """Percentage change, positive is better"""
+    if base <= 0:
+        return 0.0
+    if unit in HIGHER_IS_BETTER:
+        return (value - base) * 100 / base
+    return (base - value) * 100 / base
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="Run the hosted benchmarks and compare to a baseline")
+    ap.add_argument("-w", "--warble", default="./warble.sdlapp",
+                    help="warble binary [%(default)s]")
+    ap.add_argument("-v", "--vector-bench",
+                    help="vector_bench binary, to include the kernels")
+    ap.add_argument("-n", "--runs", type=int, default=3,
+                    help="runs of each, the best counts [%(default)s]")
+    ap.add_argument("-s", "--settings",
+                    help="DSP settings file for the dsp suite")
+    ap.add_argument("-o", "--output", default="latest.csv",
+                    help="result file [%(default)s]")
+    ap.add_argument("-b", "--baseline", help="baseline to compare against")
+    ap.add_argument("-t", "--tolerance", type=float, default=5.0,
+                    help="percent change counted as noise [%(default)s]")
+    ap.add_argument("paths", nargs="+", help="files or directories")
+    args = ap.parse_args()
+
+    results = []
+    bench_codec(args.warble, args.paths, args.runs, results)
+    bench_dsp(args.warble, args.settings, args.paths, args.runs, results)
+    if args.vector_bench:
+        bench_kernels(args.vector_bench, args.runs, results)
+
+    header = [("version", version()),
+              ("target", "hosted " + platform.machine()),
+              ("host", platform.platform())]
+    write_csv(args.output, header, results)
+
+    baseline = read_csv(args.baseline) if args.baseline else {}
+    worse = 0
+    for suite, name, value, unit in results:
+        base = baseline.get((suite, name, unit))
+        if base is None:
+            print("%-7s %-24s %10.2f %-5s" % (suite, name, value, unit))
+            continue
+        pct = change(value, base, unit)
+        flag = ""
+        if pct < -args.tolerance:
+            flag = "  worse"
+            worse += 1
+        elif pct > args.tolerance:
+            flag = "  better"
+        print("%-7s %-24s %10.2f %-5s %+6.1f%%%s" % (suite, name, value, unit,
+                                                     pct, flag))
+
+    if args.baseline:
+        print("%d of %d results worse than %s" % (worse, len(results),
+                                                   args.baseline))
+    sys.exit(1 if worse else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+#             __________               __   ___.
+#   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+#   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+#   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+#   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+#                     \/            \/     \/    \/            \/
+#
+# Measure what the codec helper thread gains: decodes the given files with
+# warble in batch mode with and without -t and reports the realtime factor
+# per codec. The output hashes of both runs must match.
+#
+# All files in this archive are subject to the GNU General Public License.
+# See the file COPYING in the source tree root for full license agreement.
+#
+# This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+# KIND, either express or implied.
+#
+# Usage: helper_bench.py [-w warble] [-n runs] FILE|DIR...
+#
+# Build warble with optimization (e.g. add -O2 to GCCOPTS) for meaningful
+# timings. Files are decoded one at a time so that the helper has a core of
+# its own; the best of the runs is reported.
+
+import argparse
+import sys
+
+from bench import warble_report
+
+
+def run(warble, helper, paths):
+    return warble_report(warble, ["-r"] + (["-t"] if helper else []), paths)
+
+
+def best(warble, helper, paths, runs):
+    """Per file results of the fastest of several runs"""
+    files = {}
+    for _ in range(runs):
+        for res in run(warble, helper, paths)["files"]:
+            if res["status"] != "ok":
+                continue
+            old = files.get(res["path"])
+            if not old or res["wall_ms"] < old["wall_ms"]:
+                files[res["path"]] = res
+    return files
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="Compare decoding with and without the codec helper")
+    ap.add_argument("-w", "--warble", default="./warble.sdlapp",
+                    help="warble binary [%(default)s]")
+    ap.add_argument("-n", "--runs", type=int, default=3,
+                    help="runs of each, the best counts [%(default)s]")
+    ap.add_argument("paths", nargs="+", help="files or directories")
+    args = ap.parse_args()
+
+    single = best(args.warble, False, args.paths, args.runs)
+    helper = best(args.warble, True, args.paths, args.runs)
+
+    codecs = {}
+    for path, res in single.items():
+        other = helper.get(path)
+        if not other:
+            continue
+        if other["md5"] != res["md5"]:
+            print("warning: %s: output differs with -t" % path,
+                  file=sys.stderr)
+        c = codecs.setdefault(res["codec"], [0, 0.0, 0.0, 0.0])
+        c[0] += 1
+        c[1] += float(res["samples"]) / res["frequency"]
+        c[2] += res["wall_ms"] / 1000.0
+        c[3] += other["wall_ms"] / 1000.0
+
+    print("%-8s %6s %10s %10s %8s" % ("codec", "files", "single x",
+                                      "helper x", "gain"))
+    for name in sorted(codecs):
+        files, audio, wall1, wall2 = codecs[name]
+        rt1 = audio / wall1 if wall1 else 0
+        rt2 = audio / wall2 if wall2 else 0
+        print("%-8s %6d %10.1f %10.1f %7.0f%%" %
+              (name, files, rt1, rt2,
+               (rt2 / rt1 - 1) * 100 if rt1 else 0))
+
+
+if __name__ == "__main__":
+    main()
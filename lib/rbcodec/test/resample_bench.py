@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+#             __________               __   ___.
+#   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+#   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+#   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+#   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+#                     \/            \/     \/    \/            \/
+#
+# Compare the resampler qualities using warble: feeds sine sweeps at several
+# input rates through the DSP and reports the time spent in the RESAMPLE
+# stage and the THD+N of the 44.1 kHz output.
+#
+# All files in this archive are subject to the GNU General Public License.
+# See the file COPYING in the source tree root for full license agreement.
+#
+# This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+# KIND, either express or implied.
+#
+# Usage: resample_bench.py [-w warble] [-m MHz] [-r rates] [-f freqs]
+#
+# Build warble with optimization (e.g. add -O2 to GCCOPTS) for meaningful
+# timings. Giving the CPU clock with -m converts ns/sample to cycles/sample.
+
+import argparse
+import math
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import wave
+
+OUT_RATE = 44100
+QUALITIES = ((0, "hermite"), (1, "sinc"))
+
+
+def write_sine(path, rate, freq, seconds):
+    """Write a stereo 16-bit sine at -3 dBFS"""
+    amp = 32767 * 10 ** (-3 / 20.0)
+    count = int(rate * seconds)
+    w = wave.open(path, "wb")
+    w.setnchannels(2)
+    w.setsampwidth(2)
+    w.setframerate(rate)
+    frames = bytearray()
+    for i in range(count):
+        v = int(round(amp * math.sin(2 * math.pi * freq * i / rate)))
+        frames += struct.pack("<hh", v, v)
+    w.writeframes(bytes(frames))
+    w.close()
+
+
+def read_left(path):
+    w = wave.open(path, "rb")
+    if w.getsampwidth() != 2:
+        sys.exit("error: %s: expected 16-bit output" % path)
+    n = w.getnframes()
+    ch = w.getnchannels()
+    data = struct.unpack("<%dh" % (n * ch), w.readframes(n))
+    w.close()
+    return data[::ch]
+
+
+def sine_fit(x, rate, freq):
+    """Least squares fit of a sine at freq plus DC; returns the fit power
+    and the residual power"""
+    w = 2 * math.pi * freq / rate
+    s = [math.sin(w * i) for i in range(len(x))]
+    c = [math.cos(w * i) for i in range(len(x))]
+    n = float(len(x))
+
+    # Normal equations of the 3-parameter fit
+    ss = sum(a * a for a in s)
+    cc = sum(a * a for a in c)
+    sc = sum(a * b for a, b in zip(s, c))
+    sx = sum(a * b for a, b in zip(s, x))
+    cx = sum(a * b for a, b in zip(c, x))
+    det = ss * cc - sc * sc
+    a = (sx * cc - cx * sc) / det
+    b = (cx * ss - sx * sc) / det
+    dc = (sum(x) - a * sum(s) - b * sum(c)) / n
+
+    sig = 0.0
+    res = 0.0
+    for i in range(len(x)):
+        fit = a * s[i] + b * c[i]
+        sig += fit * fit
+        r = x[i] - fit - dc
+        res += r * r
+    return sig, res
+
+
+def thd_n(samples, rate, freq):
+    """Return THD+N in dB. The tone frequency is refined first since the
+    s15.16 phase delta makes the output rate slightly inexact."""
+    # Skip the filter delay at the start and the tail at the end
+    skip = rate // 10
+    x = samples[skip:len(samples) - skip]
+
+    # Estimate the frequency from the upward zero crossings, then refine it
+    # with a golden section search within a quarter of a DFT bin
+    cross = [i - 1 + x[i - 1] / float(x[i - 1] - x[i])
+             for i in range(1, len(x)) if x[i - 1] < 0 <= x[i]]
+    if len(cross) > 1:
+        est = (len(cross) - 1) * rate / (cross[-1] - cross[0])
+        if abs(est - freq) < freq * 0.001:
+            freq = est   # else too distorted to tell
+    span = 0.25 * rate / len(x)
+    lo, hi = freq - span, freq + span
+    g = (math.sqrt(5) - 1) / 2
+    for _ in range(24):
+        f1 = hi - g * (hi - lo)
+        f2 = lo + g * (hi - lo)
+        if sine_fit(x, rate, f1)[1] < sine_fit(x, rate, f2)[1]:
+            hi = f2
+        else:
+            lo = f1
+
+    sig, res = sine_fit(x, rate, (lo + hi) / 2)
+    return 10 * math.log10(max(res, 1e-12) / sig)
+
+
+def run(warble, quality, infile, outfile):
+    p = subprocess.run([warble, "-p", "-c", "resample=%d" % quality,
+                        infile, outfile],
+                       stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                       universal_newlines=True)
+    if p.returncode:
+        sys.exit("error: warble failed:\n" + p.stderr)
+    m = re.search(r"^\s*RESAMPLE\s+\d+\s+\d+\s+\S+\s+(\S+)", p.stderr, re.M)
+    return float(m.group(1)) if m else None
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description="Compare warble resampler qualities")
+    ap.add_argument("-w", "--warble", default="./warble.sdlapp",
+                    help="warble binary [%(default)s]")
+    ap.add_argument("-m", "--mhz", type=float,
+                    help="CPU clock, to report cycles per sample")
+    ap.add_argument("-r", "--rates", default="22050,32000,48000,96000",
+                    help="input rates [%(default)s]")
+    ap.add_argument("-f", "--freqs", default="1000,10000,18000",
+                    help="test tones in Hz [%(default)s]")
+    ap.add_argument("-s", "--seconds", type=float, default=1.0,
+                    help="length of each tone [%(default)s]")
+    args = ap.parse_args()
+
+    unit = "cyc/sample" if args.mhz else "ns/sample"
+    print("%6s %6s  %-8s %10s %10s" % ("rate", "tone", "resamp", unit,
+                                       "THD+N dB"))
+
+    tmp = tempfile.mkdtemp()
+    try:
+        for rate in [int(r) for r in args.rates.split(",")]:
+            for freq in [int(f) for f in args.freqs.split(",")]:
+                if freq * 2 >= min(rate, OUT_RATE):
+                    continue
+                infile = os.path.join(tmp, "in.wav")
+                outfile = os.path.join(tmp, "out.wav")
+                write_sine(infile, rate, freq, args.seconds)
+                for quality, name in QUALITIES:
+                    ns = run(args.warble, quality, infile, outfile)
+                    cost = "-" if ns is None else \
+                        "%.2f" % (ns * args.mhz / 1000 if args.mhz else ns)
+                    db = thd_n(read_left(outfile), OUT_RATE, freq)
+                    print("%6d %6d  %-8s %10s %10.1f" % (rate, freq, name,
+                                                         cost, db))
+    finally:
+        for f in os.listdir(tmp):
+            os.remove(os.path.join(tmp, f))
+        os.rmdir(tmp)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,351 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/* Compares the SIMD kernels picked for the host against the scalar C ones
+ * they replace: the libdemac filter vector math, the DSP sample output and
+ * the codec library fft. Results must match exactly, timings are reported
+ * per call.
+ *
+ * Build with "make vector_bench" in a warble build directory, preferably
+ * with optimization (e.g. add -O2 to GCCOPTS). Add -mavx2 for the AVX2
+ * filter path. */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rbcodecconfig.h"
+#include "platform.h"
+#include "dsp_core.h"
+#include "dsp_sample_io.h"
+#include "dsp-util.h"
+
+#define ORDER 256
+#define RUNS  200000
+
+/** libdemac filter **/
+
+/* The scalar version under other names. The codec side of demac_config.h
+ * is not wanted here, only the 16 bit filter type. */
+#define _DEMAC_CONFIG_H
+typedef int16_t filter_int;
+#define vector_add    generic_vector_add
+#define vector_sub    generic_vector_sub
+#define scalarproduct generic_scalarproduct
+#include "../codecs/demac/libdemac/vector_math_generic.h"
+#undef vector_add
+#undef vector_sub
+#undef scalarproduct
+
+/* The same choice as libdemac/filter.c makes for a hosted build */
+#if defined(__SSE2__)
+#include "../codecs/demac/libdemac/vector_math16_sse2.h"
+#ifdef __AVX2__
+#define SIMD_NAME "avx2"
+#else
+#define SIMD_NAME "sse2"
+#endif
+#endif
+
+/* Sample output from the linked DSP, whichever version was built */
+void sample_output_mono(struct sample_io_data *this,
+                        struct dsp_buffer *src, struct dsp_buffer *dst);
+void sample_output_stereo(struct sample_io_data *this,
+                          struct dsp_buffer *src, struct dsp_buffer *dst);
+
+/* Referenced by the rest of dsp_sample_output.o, never called here */
+struct dsp_config * dsp_get_config(enum dsp_ids id)
+{
+    (void)id;
+    return NULL;
+}
+
+enum dsp_ids dsp_get_id(const struct dsp_config *dsp)
+{
+    (void)dsp;
+    return 0;
+}
+
+static volatile int32_t sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report(const char *name, double scalar_ns, double simd_ns,
+                   const char *unit)
+{
+    printf("%-22s %10.2f %10.2f %8.2fx  %s\n", name, scalar_ns, simd_ns,
+           simd_ns > 0 ? scalar_ns / simd_ns : 0, unit);
+}
+
+static void fill16(int16_t *p, int n, int range)
+{
+    while (n--)
+        *p++ = (rand() % (2 * range + 1)) - range;
+}
+
+static int bench_filter(void)
+{
+#ifdef SIMD_NAME
+    /* Sliding delay and adapt windows like the filters use, so most loads
+     * are unaligned */
+    static int16_t delay[ORDER + 64], adapt[ORDER + 64];
+    static int16_t coefs[2][ORDER];
+    int16_t *a = coefs[0], *b = coefs[1];
+    int32_t r1, r2;
+    uint64_t t;
+    double ns1, ns2;
+    int i, errors = 0;
+
+    fill16(delay, ORDER + 64, 1024);
+    fill16(adapt, ORDER + 64, 1);
+    fill16(a, ORDER, 4096);
+    memcpy(b, a, sizeof (coefs[0]));
+
+    for (i = 0; i < 64; i++)
+    {
+        r1 = generic_scalarproduct(a, delay + i);
+        if (i & 1)
+        {
+            generic_vector_add(a, adapt + i);
+            r2 = vector_sp_add(b, delay + i, adapt + i);
+        }
+        else
+        {
+            generic_vector_sub(a, adapt + i);
+            r2 = vector_sp_sub(b, delay + i, adapt + i);
+        }
+
+        if (r1 != r2 || scalarproduct(b, delay + i) !=
+                        generic_scalarproduct(a, delay + i) ||
+            memcmp(a, b, sizeof (coefs[0])))
+        {
+            printf("filter: mismatch at step %d: %" PRId32 " != %" PRId32
+                   "\n", i, r1, r2);
+            errors++;
+            break;
+        }
+    }
+
+    t = now_ns();
+    for (i = 0; i < RUNS; i++)
+    {
+        sink += generic_scalarproduct(a, delay + (i & 63));
+        generic_vector_add(a, adapt + (i & 63));
+    }
+    ns1 = (double)(now_ns() - t) / RUNS;
+
+    t = now_ns();
+    for (i = 0; i < RUNS; i++)
+        sink += vector_sp_add(b, delay + (i & 63), adapt + (i & 63));
+    ns2 = (double)(now_ns() - t) / RUNS;
+
+    report("filter sp+add " SIMD_NAME, ns1, ns2, "ns/call (order 256)");
+    return errors;
+#else
+    printf("filter: no SIMD version for this host\n");
+    return 0;
+#endif
+}
+
+/** sample output **/
+
+#define OUT_COUNT 1023  /* odd to cover the scalar tail */
+
+static inline int16_t ref_output(int32_t s, int scale)
+{
+    return clip_sample_16((s + (1L << (scale - 1))) >> scale);
+}
+
+static int bench_output(bool stereo)
+{
+    static int32_t in[2][OUT_COUNT];
+    static int16_t out[OUT_COUNT * 2], ref[OUT_COUNT * 2];
+    struct sample_io_data io;
+    struct dsp_buffer src, dst;
+    const int scale = 28 + 1 - 16; /* s3.28 to 16 bits */
+    uint64_t t;
+    double ns1, ns2;
+    int i, j, errors = 0;
+
+    /* Twice the 16 bit range to exercise the clipping as well */
+    for (i = 0; i < OUT_COUNT; i++)
+    {
+        in[0][i] = (int32_t)(rand() % 0x40000 - 0x20000) << (scale - 1);
+        in[1][i] = (int32_t)(rand() % 0x40000 - 0x20000) << (scale - 1);
+        in[0][i] += rand() % (1 << scale);
+    }
+
+    memset(&io, 0, sizeof (io));
+    memset(&src, 0, sizeof (src));
+    memset(&dst, 0, sizeof (dst));
+    io.outcount = OUT_COUNT;
+    src.p32[0] = in[0];
+    src.p32[1] = in[stereo ? 1 : 0];
+    src.format.output_scale = scale;
+    dst.p16out = out;
+
+    for (i = 0; i < OUT_COUNT; i++)
+    {
+        ref[2*i] = ref_output(in[0][i], scale);
+        ref[2*i + 1] = ref_output(src.p32[1][i], scale);
+    }
+
+    if (stereo)
+        sample_output_stereo(&io, &src, &dst);
+    else
+        sample_output_mono(&io, &src, &dst);
+
+    if (memcmp(out, ref, sizeof (out)))
+    {
+        for (i = 0; out[i] == ref[i]; i++);
+        printf("output %s: mismatch at %d: %d != %d\n",
+               stereo ? "stereo" : "mono", i, out[i], ref[i]);
+        errors++;
+    }
+
+    t = now_ns();
+    for (j = 0; j < RUNS / 100; j++)
+    {
+        for (i = 0; i < OUT_COUNT; i++)
+        {
+            ref[2*i] = ref_output(in[0][i], scale);
+            ref[2*i + 1] = ref_output(src.p32[1][i], scale);
+        }
+        sink += ref[j % OUT_COUNT];
+    }
+    ns1 = (double)(now_ns() - t) / (RUNS / 100) / OUT_COUNT;
+
+    t = now_ns();
+    for (j = 0; j < RUNS / 100; j++)
+    {
+        if (stereo)
+            sample_output_stereo(&io, &src, &dst);
+        else
+            sample_output_mono(&io, &src, &dst);
+        sink += out[j % OUT_COUNT];
+    }
+    ns2 = (double)(now_ns() - t) / (RUNS / 100) / OUT_COUNT;
+
+    report(stereo ? "sample output stereo" : "sample output mono",
+           ns1, ns2, "ns/sample");
+    return errors;
+}
+
+/** codec library fft **/
+
+/* The C version under another name, the linked libcodec has the one picked
+ * for the host */
+#define FFT_FFMPEG_GENERIC
+#define ff_fft_calc_c generic_fft_calc_c
+#include "../codecs/lib/fft-ffmpeg.c"
+#undef ff_fft_calc_c
+
+void ff_fft_calc_c(int nbits, FFTComplex *z);
+
+#define FFT_MAX_BITS 12
+
+static int bench_fft(void)
+{
+#ifdef __SSE4_1__
+    static FFTComplex in[1 << FFT_MAX_BITS];
+    static FFTComplex out[1 << FFT_MAX_BITS], ref[1 << FFT_MAX_BITS];
+    const int nbits = 10;
+    uint64_t t;
+    double ns1, ns2;
+    int i, bits, errors = 0;
+
+    /* Full range, so the wrapping of the sums is compared too */
+    for (i = 0; i < (1 << FFT_MAX_BITS); i++)
+    {
+        in[i].re = (int32_t)(((uint32_t)rand() << 16) ^ rand());
+        in[i].im = (int32_t)(((uint32_t)rand() << 16) ^ rand());
+    }
+
+    for (bits = 2; bits <= FFT_MAX_BITS; bits++)
+    {
+        size_t size = sizeof (FFTComplex) << bits;
+        memcpy(ref, in, size);
+        memcpy(out, in, size);
+        generic_fft_calc_c(bits, ref);
+        ff_fft_calc_c(bits, out);
+
+        if (memcmp(out, ref, size))
+        {
+            for (i = 0; !memcmp(&out[i], &ref[i], sizeof (FFTComplex)); i++);
+            printf("fft %d: mismatch at %d: %" PRId32 ",%" PRId32 " != %"
+                   PRId32 ",%" PRId32 "\n", 1 << bits, i, out[i].re,
+                   out[i].im, ref[i].re, ref[i].im);
+            errors++;
+        }
+    }
+
+    /* Keep the values from growing out of range over the runs */
+    for (i = 0; i < (1 << nbits); i++)
+    {
+        in[i].re >>= 8;
+        in[i].im >>= 8;
+    }
+
+    t = now_ns();
+    for (i = 0; i < RUNS / 100; i++)
+    {
+        memcpy(ref, in, sizeof (FFTComplex) << nbits);
+        generic_fft_calc_c(nbits, ref);
+        sink += ref[i & 63].re;
+    }
+    ns1 = (double)(now_ns() - t) / (RUNS / 100);
+
+    t = now_ns();
+    for (i = 0; i < RUNS / 100; i++)
+    {
+        memcpy(out, in, sizeof (FFTComplex) << nbits);
+        ff_fft_calc_c(nbits, out);
+        sink += out[i & 63].re;
+    }
+    ns2 = (double)(now_ns() - t) / (RUNS / 100);
+
+    report("fft 1024 sse4.1", ns1, ns2, "ns/call");
+    return errors;
+#else
+    printf("fft: no SIMD version for this host\n");
+    return 0;
+#endif
+}
+
+int main(void)
+{
+    int errors = 0;
+
+    srand(1);
+    printf("%-22s %10s %10s %9s\n", "kernel", "scalar", "simd", "speedup");
+    errors += bench_filter();
+    errors += bench_output(false);
+    errors += bench_output(true);
+    errors += bench_fft();
+
+    if (errors)
+        printf("%d kernel(s) differ from the scalar version\n", errors);
+    return errors ? 1 : 0;
+}
@@ -21,6 +21,7 @@
 #define _DEFAULT_SOURCE /* htole64 from endian.h */
 #include <sys/types.h>
 #include <SDL.h>
+#include <dirent.h>
 #include <dlfcn.h>
 #include <endian.h>
 #include <fcntl.h>
@@ -29,7 +30,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include "buffering.h" /* TYPE_PACKET_AUDIO */
 #include "kernel.h"
@@ -41,6 +45,8 @@
 #include "sound.h"
 #include "tdspeed.h"
 #include "platform.h"
+#include "md5.h"
+#include "job-thread.h"
 
 /***************** EXPORTED *****************/
 
@@ -97,9 +103,11 @@ off_t filesize(int fd)
 
 /***************** INTERNAL *****************/
 
-static enum { MODE_PLAY, MODE_WRITE } mode;
+static enum { MODE_PLAY, MODE_WRITE, MODE_BATCH } mode;
 static bool use_dsp = true;
+static bool profile_dsp = false;
 static bool enable_loop = false;
+static bool use_helper = false;
 static const char *config = "";
 
 /* Volume control */
@@ -218,7 +226,7 @@ static uint64_t make_float64(int32_t sample, int shift)
 
 static void write_pcm(int16_t *pcm, int count)
 {
-    if (!write_header_written)
+    if (!write_raw && !write_header_written)
         write_wav_header();
     int i;
     for (i = 0; i < 2 * count; i++)
@@ -379,8 +387,677 @@ static void playback_pcm(int16_t *pcm, int count)
     }
 }
 
+/***** MODE_BATCH *****/
+
+/* MODE_BATCH decodes a list of files, each one in its own forked worker process
+ * so that no codec or DSP state leaks from one file into the next. Up to
+ * batch_jobs workers run at once. The output PCM is not written anywhere but
+ * hashed instead, so the report doubles as a golden reference: with DSP it is
+ * the MD5 of the WAV data a normal write would produce, with -r it is the MD5
+ * of the raw output file. Each worker hands its batch_result back to the
+ * parent through a pipe and the parent writes a JSON report at the end. */
+
+#define CODEC_BUFFER_FILL 0xa5
+
+enum batch_status { BATCH_OK = 0, BATCH_CODEC_ERROR, BATCH_FAILED };
+
+struct batch_result {
+    enum batch_status status;
+    unsigned int codectype;
+    unsigned long frequency;    /* codec output frequency */
+    int channels;
+    unsigned long length;       /* ms, as reported by the metadata */
+    unsigned long samples;      /* samples delivered by the codec */
+    double wall;                /* seconds spent inside the codec */
+    double cpu;                 /* user + system seconds of the worker */
+    size_t peak_mem;            /* bytes of codec_get_buffer() touched */
+    char md5[33];
+    bool has_profile;
+    struct dsp_profile profile; /* DSP stage profile with -p */
+};
+
+static int batch_jobs = 1;
+static const char *batch_report_fn = NULL;
+static char **batch_files = NULL;
+static int batch_num_files = 0;
+static struct batch_result batch_result;
+static md5_context batch_md5;
+static double batch_start_wall, batch_start_cpu;
+
+static char codec_buffer[64 * 1024 * 1024];
+static size_t codec_buffer_size = sizeof(codec_buffer);
+
+/* Batch workers get four times the largest codec buffer of any target, which
+ * the parent fills with the pattern once before forking; the workers then only
+ * copy the pages the codec actually touches. */
+#define BATCH_CODEC_BUFFER_SIZE (4 * 1024 * 1024)
+
+static double batch_wall_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double batch_cpu_time(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+         + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void batch_add_file(const char *path)
+{
+    if ((batch_num_files & 63) == 0) {
+        batch_files = realloc(batch_files,
+                              (batch_num_files + 64) * sizeof(*batch_files));
+        if (!batch_files) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    batch_files[batch_num_files++] = strdup(path);
+}
+
+static int batch_cmp_path(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void batch_add_path(const char *path, bool explicit);
+
+static void batch_add_dir(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir) {
+        perror(path);
+        exit(1);
+    }
+
+    int first = batch_num_files;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+        char str[MAX_PATH];
+        snprintf(str, sizeof(str), "%s/%s", path, entry->d_name);
+        batch_add_path(str, false);
+    }
+    closedir(dir);
+
+    /* readdir() order is arbitrary; keep reports comparable between runs */
+    qsort(batch_files + first, batch_num_files - first,
+          sizeof(*batch_files), batch_cmp_path);
+}
+
+/* Files named explicitly are always decoded; files found while walking a
+ * directory only if their extension belongs to a known codec. */
+static void batch_add_path(const char *path, bool explicit)
+{
+    struct stat st;
+    if (stat(path, &st)) {
+        perror(path);
+        exit(1);
+    }
+
+    if (S_ISDIR(st.st_mode))
+        batch_add_dir(path);
+    else if (explicit || probe_file_format(path) != AFMT_UNKNOWN)
+        batch_add_file(path);
+}
+
+static void batch_add_list(const char *list_fn)
+{
+    FILE *f = strcmp(list_fn, "-") ? fopen(list_fn, "r") : stdin;
+    if (!f) {
+        perror(list_fn);
+        exit(1);
+    }
+
+    char line[MAX_PATH];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0')
+            batch_add_path(line, true);
+    }
+
+    if (f != stdin)
+        fclose(f);
+}
+
+static void batch_begin(void)
+{
+    md5_starts(&batch_md5);
+    batch_start_cpu = batch_cpu_time();
+    batch_start_wall = batch_wall_time();
+}
+
+static void batch_end(enum batch_status status)
+{
+    struct batch_result *res = &batch_result;
+    res->wall = batch_wall_time() - batch_start_wall;
+    res->cpu = batch_cpu_time() - batch_start_cpu;
+    res->status = status;
+    res->frequency = format.freq;
+    res->channels = format.channels;
+    res->samples = num_output_samples;
+
+    /* Anything past the last byte still holding the fill pattern was never
+     * touched by the codec. */
+    size_t size = codec_buffer_size;
+    while (size > 0 && codec_buffer[size - 1] == (char)CODEC_BUFFER_FILL)
+        size--;
+    res->peak_mem = size;
+
+    uint8 digest[16];
+    md5_finish(&batch_md5, digest);
+    int i;
+    for (i = 0; i < 16; i++)
+        snprintf(res->md5 + 2 * i, 3, "%02x", digest[i]);
+}
+
+static void batch_pcm(int16_t *pcm, int count)
+{
+    int i;
+    for (i = 0; i < 2 * count; i++)
+        pcm[i] = htole16(pcm[i]);
+    md5_update(&batch_md5, (uint8 *)pcm, 4 * count);
+}
+
+static void batch_pcm_raw(int32_t *pcm, int count)
+{
+    int i;
+    for (i = 0; i < count; i++)
+        pcm[i] = htole32(pcm[i]);
+    md5_update(&batch_md5, (uint8 *)pcm, count * sizeof(*pcm));
+}
+
+static void json_string(FILE *f, const char *str)
+{
+    putc('"', f);
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            putc(c, f);
+    }
+    putc('"', f);
+}
+
+static double batch_realtime(double audio_secs, double wall)
+{
+    return wall > 0 ? audio_secs / wall : 0;
+}
+
+static double batch_audio_secs(const struct batch_result *res)
+{
+    return res->frequency ? (double)res->samples / res->frequency : 0;
+}
+
+static const char *batch_status_name(enum batch_status status)
+{
+    switch (status) {
+    case BATCH_OK:          return "ok";
+    case BATCH_CODEC_ERROR: return "codec_error";
+    default:                return "failed";
+    }
+}
+
+static double profile_ms(const struct dsp_profile *prof,
+                         const struct dsp_profile_stage *st)
+{
+    return (double)st->time * 1000 / prof->timer_freq;
+}
+
+static void batch_write_profile(FILE *f, const struct dsp_profile *prof)
+{
+    fprintf(f, ", \"dsp_profile\": [");
+    bool first = true;
+    unsigned int i;
+    for (i = 0; i < prof->num_stages; i++) {
+        const struct dsp_profile_stage *st = &prof->stages[i];
+        if (!st->calls)
+            continue;
+        fprintf(f, "%s{\"stage\": ", first ? "" : ", ");
+        json_string(f, st->name);
+        fprintf(f, ", \"calls\": %lu, \"samples\": %llu, \"ms\": %.3f, "
+                   "\"ns_per_sample\": %.2f}",
+                (unsigned long)st->calls, (unsigned long long)st->samples,
+                profile_ms(prof, st),
+                st->samples ? profile_ms(prof, st) * 1e6 / st->samples : 0);
+        first = false;
+    }
+    putc(']', f);
+}
+
+static void batch_write_report(const struct batch_result *results,
+                               double elapsed)
+{
+    FILE *f = stdout;
+    if (batch_report_fn && strcmp(batch_report_fn, "-")) {
+        f = fopen(batch_report_fn, "w");
+        if (!f) {
+            perror(batch_report_fn);
+            exit(1);
+        }
+    }
+
+    fprintf(f, "{\n  \"target\": ");
+    json_string(f, TARGET_NAME);
+    fprintf(f, ",\n  \"dsp\": %s,\n  \"helper\": %s,\n  \"jobs\": %d,\n"
+               "  \"elapsed_ms\": %.3f,\n",
+            use_dsp ? "true" : "false", use_helper ? "true" : "false",
+            batch_jobs, elapsed * 1000);
+
+    fprintf(f, "  \"files\": [");
+    int i;
+    for (i = 0; i < batch_num_files; i++) {
+        const struct batch_result *res = &results[i];
+        fprintf(f, "%s\n    {\"path\": ", i ? "," : "");
+        json_string(f, batch_files[i]);
+        fprintf(f, ", \"codec\": ");
+        json_string(f, audio_formats[res->codectype].label);
+        fprintf(f, ", \"status\": \"%s\"", batch_status_name(res->status));
+        if (res->status != BATCH_FAILED) {
+            fprintf(f, ", \"frequency\": %lu, \"channels\": %d, "
+                       "\"length_ms\": %lu, \"samples\": %lu, "
+                       "\"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+                       "\"realtime\": %.2f, \"peak_mem\": %zu, "
+                       "\"md5\": \"%s\"",
+                    res->frequency, res->channels, res->length, res->samples,
+                    res->wall * 1000, res->cpu * 1000,
+                    batch_realtime(batch_audio_secs(res), res->wall),
+                    res->peak_mem, res->md5);
+        }
+        if (res->has_profile)
+            batch_write_profile(f, &res->profile);
+        putc('}', f);
+    }
+    fprintf(f, "\n  ],\n");
+
+    fprintf(f, "  \"codecs\": [");
+    bool first = true;
+    unsigned int afmt;
+    for (afmt = 0; afmt < AFMT_NUM_CODECS; afmt++) {
+        int files = 0, failed = 0;
+        double audio_secs = 0, wall = 0, cpu = 0;
+        size_t peak_mem = 0;
+
+        for (i = 0; i < batch_num_files; i++) {
+            const struct batch_result *res = &results[i];
+            if (res->codectype != afmt)
+                continue;
+            files++;
+            if (res->status != BATCH_OK) {
+                failed++;
+                continue;
+            }
+            audio_secs += batch_audio_secs(res);
+            wall += res->wall;
+            cpu += res->cpu;
+            peak_mem = MAX(peak_mem, res->peak_mem);
+        }
+
+        if (!files)
+            continue;
+
+        fprintf(f, "%s\n    {\"codec\": ", first ? "" : ",");
+        json_string(f, audio_formats[afmt].label);
+        fprintf(f, ", \"files\": %d, \"failed\": %d, \"audio_ms\": %.3f, "
+                   "\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"realtime\": %.2f, "
+                   "\"peak_mem\": %zu}",
+                files, failed, audio_secs * 1000, wall * 1000, cpu * 1000,
+                batch_realtime(audio_secs, wall), peak_mem);
+        first = false;
+    }
+    fprintf(f, "\n  ]\n}\n");
+
+    if (f != stdout)
+        fclose(f);
+}
+
+static void decode_file(const char *input_fn);
+
+/* Runs in the worker process; never returns */
+static void batch_worker(const char *input_fn, int result_fd)
+{
+    memset(&batch_result, 0, sizeof(batch_result));
+    batch_result.status = BATCH_FAILED;
+    decode_file(input_fn);
+    write(result_fd, &batch_result, sizeof(batch_result));
+    _exit(0);
+}
+
+static int batch_run(void)
+{
+    struct batch_result *results = calloc(batch_num_files, sizeof(*results));
+    struct {
+        pid_t pid;
+        int fd;
+        int index;
+    } workers[batch_jobs];
+    int next = 0, running = 0, done = 0, failed = 0;
+    int i;
+
+    if (!results) {
+        perror("calloc");
+        exit(1);
+    }
+
+    double start = batch_wall_time();
+
+    codec_buffer_size = BATCH_CODEC_BUFFER_SIZE;
+    memset(codec_buffer, CODEC_BUFFER_FILL, codec_buffer_size);
+
+    while (next < batch_num_files || running > 0) {
+        while (running < batch_jobs && next < batch_num_files) {
+            int fds[2];
+            if (pipe(fds)) {
+                perror("pipe");
+                exit(1);
+            }
+            fflush(NULL);
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                exit(1);
+            } else if (pid == 0) {
+                close(fds[0]);
+                batch_worker(batch_files[next], fds[1]);
+            }
+            close(fds[1]);
+            workers[running].pid = pid;
+            workers[running].fd = fds[0];
+            workers[running].index = next;
+            running++;
+            next++;
+        }
+
+        int wstatus;
+        pid_t pid = wait(&wstatus);
+        if (pid < 0) {
+            perror("wait");
+            exit(1);
+        }
+
+        for (i = 0; i < running; i++) {
+            if (workers[i].pid == pid)
+                break;
+        }
+        if (i == running)
+            continue;
+
+        struct batch_result *res = &results[workers[i].index];
+        const char *fn = batch_files[workers[i].index];
+        if (read(workers[i].fd, res, sizeof(*res)) != sizeof(*res)
+                || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+            memset(res, 0, sizeof(*res));
+            res->status = BATCH_FAILED;
+            res->codectype = probe_file_format(fn);
+        }
+        close(workers[i].fd);
+        workers[i] = workers[--running];
+
+        if (res->status != BATCH_OK)
+            failed++;
+        fprintf(stderr, "[%d/%d] %s: %s", ++done, batch_num_files, fn,
+                batch_status_name(res->status));
+        if (res->status != BATCH_FAILED)
+            fprintf(stderr, " (%.2fx realtime)",
+                    batch_realtime(batch_audio_secs(res), res->wall));
+        putc('\n', stderr);
+    }
+
+    batch_write_report(results, batch_wall_time() - start);
+    free(results);
+
+    return failed ? 1 : 0;
+}
+
+/***** DSP SETTINGS FILE *****/
+
+/* The DSP part of config.cfg, so that a device's sound settings can be
+ * rendered on the host. Names, values and defaults follow settings_list.c;
+ * everything else in the file is ignored. */
+
+enum dsp_setting_type { DS_INT, DS_BOOL, DS_CHOICE, DS_EQ };
+
+#define GS(field) offsetof(struct user_settings, field)
+
+static const struct dsp_setting {
+    const char *name;
+    enum dsp_setting_type type;
+    size_t offset;
+    int def;             /* Default; band index for DS_EQ */
+    const char *choices; /* DS_CHOICE: comma separated cfg values */
+} dsp_settings[] = {
+    { "crossfeed", DS_CHOICE, GS(crossfeed), 0, "off,meier,custom" },
+    { "crossfeed direct gain", DS_INT, GS(crossfeed_direct_gain), -15 },
+    { "crossfeed cross gain", DS_INT, GS(crossfeed_cross_gain), -60 },
+    { "crossfeed hf attenuation", DS_INT,
+      GS(crossfeed_hf_attenuation), -160 },
+    { "crossfeed hf cutoff", DS_INT, GS(crossfeed_hf_cutoff), 700 },
+    { "eq enabled", DS_BOOL, GS(eq_enabled), false },
+    { "eq precut", DS_INT, GS(eq_precut), 0 },
+    { "eq low shelf filter", DS_EQ, GS(eq_band_settings[0]), 0 },
+    { "eq peak filter 1", DS_EQ, GS(eq_band_settings[1]), 1 },
+    { "eq peak filter 2", DS_EQ, GS(eq_band_settings[2]), 2 },
+    { "eq peak filter 3", DS_EQ, GS(eq_band_settings[3]), 3 },
+    { "eq peak filter 4", DS_EQ, GS(eq_band_settings[4]), 4 },
+    { "eq peak filter 5", DS_EQ, GS(eq_band_settings[5]), 5 },
+    { "eq peak filter 6", DS_EQ, GS(eq_band_settings[6]), 6 },
+    { "eq peak filter 7", DS_EQ, GS(eq_band_settings[7]), 7 },
+    { "eq peak filter 8", DS_EQ, GS(eq_band_settings[8]), 8 },
+    { "eq high shelf filter", DS_EQ, GS(eq_band_settings[9]), 9 },
+    { "dithering enabled", DS_BOOL, GS(dithering_enabled), false },
+#ifdef HAVE_SINC_RESAMPLER
+    { "resample quality", DS_CHOICE, GS(resample_quality), 0, "normal,high" },
+#endif
+    { "surround enabled", DS_INT, GS(surround_enabled), 0 },
+    { "surround balance", DS_INT, GS(surround_balance), 35 },
+    { "surround_fx1", DS_INT, GS(surround_fx1), 3400 },
+    { "surround_fx2", DS_INT, GS(surround_fx2), 320 },
+    { "side only", DS_BOOL, GS(surround_method2), false },
+    { "surround mix", DS_INT, GS(surround_mix), 50 },
+    { "afr enabled", DS_CHOICE, GS(afr_enabled), 0,
+      "off,weak,moderate,strong" },
+    { "pbe", DS_INT, GS(pbe), 0 },
+    { "pbe precut", DS_INT, GS(pbe_precut), -25 },
+    { "timestretch enabled", DS_BOOL, GS(timestretch_enabled), true },
+    { "compressor threshold", DS_INT, GS(compressor_settings.threshold), 0 },
+    { "compressor makeup gain", DS_CHOICE,
+      GS(compressor_settings.makeup_gain), 1, "off,auto" },
+    { "compressor ratio", DS_CHOICE, GS(compressor_settings.ratio), 1,
+      "2:1,4:1,6:1,10:1,limit" },
+    { "compressor knee", DS_CHOICE, GS(compressor_settings.knee), 1,
+      "hard knee,soft knee" },
+    { "compressor attack time", DS_INT,
+      GS(compressor_settings.attack_time), 5 },
+    { "compressor release time", DS_INT,
+      GS(compressor_settings.release_time), 500 },
+    { "channels", DS_CHOICE, GS(channel_config), 0,
+      "stereo,mono,custom,mono left,mono right,karaoke" },
+    { "stereo_width", DS_INT, GS(stereo_width), 100 },
+    { "bass", DS_INT, GS(bass), 0 },
+    { "treble", DS_INT, GS(treble), 0 },
+};
+
+static const struct eq_band_setting eq_band_defaults[EQ_NUM_BANDS] = {
+    { 32, 7, 0 }, { 64, 10, 0 }, { 125, 10, 0 }, { 250, 10, 0 },
+    { 500, 10, 0 }, { 1000, 10, 0 }, { 2000, 10, 0 }, { 4000, 10, 0 },
+    { 8000, 10, 0 }, { 16000, 7, 0 },
+};
+
+static const char *dsp_settings_fn = NULL;
+
+static void dsp_setting_store(const struct dsp_setting *ds, int val)
+{
+    void *var = (char *)&global_settings + ds->offset;
+    if (ds->type == DS_BOOL)
+        *(bool *)var = val;
+    else
+        *(int *)var = val;
+}
+
+static bool dsp_setting_parse(const struct dsp_setting *ds, const char *val)
+{
+    char *end;
+    int i;
+
+    switch (ds->type) {
+    case DS_INT:
+        /* TABLE_SETTINGs write 0 as "off" */
+        if (!strcmp(val, "off")) {
+            dsp_setting_store(ds, 0);
+            return true;
+        }
+        i = strtol(val, &end, 10);
+        if (end == val)
+            return false;
+        dsp_setting_store(ds, i);
+        return true;
+    case DS_BOOL:
+        if (strcmp(val, "on") && strcmp(val, "off"))
+            return false;
+        dsp_setting_store(ds, !strcmp(val, "on"));
+        return true;
+    case DS_CHOICE: {
+        const char *c = ds->choices;
+        size_t len = strlen(val);
+        for (i = 0; c; i++) {
+            const char *next = strchr(c, ',');
+            size_t clen = next ? (size_t)(next - c) : strlen(c);
+            if (clen == len && !strncmp(c, val, len)) {
+                dsp_setting_store(ds, i);
+                return true;
+            }
+            c = next ? next + 1 : NULL;
+        }
+        return false;
+    }
+    case DS_EQ: {
+        struct eq_band_setting *eq =
+            (void *)((char *)&global_settings + ds->offset);
+        struct eq_band_setting band;
+        if (sscanf(val, "%d , %d , %d", &band.cutoff, &band.q,
+                   &band.gain) != 3)
+            return false;
+        *eq = band;
+        return true;
+    }
+    }
+
+    return false;
+}
+
+/* Reset the DSP settings to their defaults and apply the settings file */
+static void load_dsp_settings(const char *fn)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAYLEN(dsp_settings); i++) {
+        const struct dsp_setting *ds = &dsp_settings[i];
+        if (ds->type == DS_EQ)
+            global_settings.eq_band_settings[ds->def] =
+                eq_band_defaults[ds->def];
+        else
+            dsp_setting_store(ds, ds->def);
+    }
+
+    FILE *f = fopen(fn, "r");
+    if (!f) {
+        perror(fn);
+        exit(1);
+    }
+
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *name = line + strspn(line, " \t");
+        if (*name == '#')
+            continue;
+        char *val = strchr(name, ':');
+        if (!val)
+            continue;
+        *val++ = '\0';
+        val += strspn(val, " \t");
+        val[strcspn(val, "\r\n")] = '\0';
+
+        for (i = 0; i < ARRAYLEN(dsp_settings); i++) {
+            if (strcmp(name, dsp_settings[i].name))
+                continue;
+            if (!dsp_setting_parse(&dsp_settings[i], val)) {
+                fprintf(stderr, "error: %s:%d: bad value \"%s\" for %s\n",
+                        fn, lineno, val, name);
+                exit(1);
+            }
+            break;
+        }
+    }
+    fclose(f);
+}
+
+/* Push the loaded settings to the DSP, in the order settings_apply() uses */
+static void apply_dsp_settings(void)
+{
+    struct user_settings *gs = &global_settings;
+    int i;
+
+    channel_mode_set_config(gs->channel_config);
+    channel_mode_custom_set_width(gs->stereo_width);
+    tone_set_bass(gs->bass * 10);
+    tone_set_treble(gs->treble * 10);
+    tone_set_prescale(MAX(MAX(gs->bass, gs->treble), 0) * 10);
+
+    dsp_set_crossfeed_type(gs->crossfeed);
+    dsp_set_crossfeed_direct_gain(gs->crossfeed_direct_gain);
+    dsp_set_crossfeed_cross_params(gs->crossfeed_cross_gain,
+                                   gs->crossfeed_hf_attenuation,
+                                   gs->crossfeed_hf_cutoff);
+
+    dsp_eq_enable(gs->eq_enabled);
+    dsp_set_eq_precut(gs->eq_precut);
+    for (i = 0; i < EQ_NUM_BANDS; i++)
+        dsp_set_eq_coefs(i, &gs->eq_band_settings[i]);
+
+    dsp_dither_enable(gs->dithering_enabled);
+#ifdef HAVE_SINC_RESAMPLER
+    dsp_set_resample_quality(gs->resample_quality);
+#endif
+    dsp_surround_set_balance(gs->surround_balance);
+    dsp_surround_set_cutoff(gs->surround_fx1, gs->surround_fx2);
+    dsp_surround_side_only(gs->surround_method2);
+    dsp_surround_mix(gs->surround_mix);
+    dsp_surround_enable(gs->surround_enabled);
+    dsp_afr_enable(gs->afr_enabled);
+    dsp_pbe_precut(gs->pbe_precut);
+    dsp_pbe_enable(gs->pbe);
+    dsp_timestretch_enable(gs->timestretch_enabled);
+    dsp_set_compressor(&gs->compressor_settings);
+}
+
 /***** ALL MODES *****/
 
+/* Enable the equalizer with all bands at the default frequencies and Q
+   boosted by db, or turn it off for 0 */
+static void set_eq(double db)
+{
+    int i;
+
+    for (i = 0; i < EQ_NUM_BANDS; i++) {
+        struct eq_band_setting band = eq_band_defaults[i];
+        band.gain = db * 10;
+        dsp_set_eq_coefs(i, &band);
+    }
+    dsp_set_eq_precut(db > 0 ? db : 0);
+    dsp_eq_enable(db != 0);
+}
+
 static void perform_config(void)
 {
     /* TODO: equalizer, etc. */
@@ -397,6 +1074,8 @@ static void perform_config(void)
                 return;
         } else if (!strncmp(name, "dither=", 7)) {
             dsp_dither_enable(atoi(val) ? true : false);
+        } else if (!strncmp(name, "eq=", 3)) {
+            set_eq(atof(val));
         } else if (!strncmp(name, "halt=", 5)) {
             if (atoi(val))
                 codec_action = CODEC_ACTION_HALT;
@@ -406,6 +1085,8 @@ static void perform_config(void)
             ci.id3->offset = atoi(val);
         } else if (!strncmp(name, "rate=", 5)) {
             dsp_set_pitch(atof(val) * PITCH_SPEED_100);
+        } else if (!strncmp(name, "resample=", 9)) {
+            dsp_set_resample_quality(atoi(val));
         } else if (!strncmp(name, "seek=", 5)) {
             codec_action = CODEC_ACTION_SEEK_TIME;
             codec_action_param = atoi(val);
@@ -428,9 +1109,8 @@ static void perform_config(void)
 
 static void *ci_codec_get_buffer(size_t *size)
 {
-    static char buffer[64 * 1024 * 1024];
-    char *ptr = buffer;
-    *size = sizeof(buffer);
+    char *ptr = codec_buffer;
+    *size = codec_buffer_size;
     if ((intptr_t)ptr & (CACHEALIGN_SIZE - 1))
         ptr += CACHEALIGN_SIZE - ((intptr_t)ptr & (CACHEALIGN_SIZE - 1));
     return ptr;
@@ -462,6 +1142,8 @@ static void ci_pcmbuf_insert(const void *ch1, const void *ch2, int count)
                     write_pcm(buf, dst.remcount);
                 else if (mode == MODE_PLAY)
                     playback_pcm(buf, dst.remcount);
+                else if (mode == MODE_BATCH)
+                    batch_pcm(buf, dst.remcount);
             } else if (src.remcount <= 0) {
                 break;
             }
@@ -495,6 +1177,8 @@ static void ci_pcmbuf_insert(const void *ch1, const void *ch2, int count)
 
         if (mode == MODE_WRITE)
             write_pcm_raw(buf, count);
+        else if (mode == MODE_BATCH)
+            batch_pcm_raw(buf, count);
     }
 
     perform_config();
@@ -591,19 +1275,18 @@ static void ci_set_offset(size_t value)
 
 static void ci_configure(int setting, intptr_t value)
 {
-    if (use_dsp) {
-        dsp_configure(ci.dsp, setting, value);
-    } else {
-        if (setting == DSP_SET_FREQUENCY
-                || setting == DSP_SET_FREQUENCY)
-            format.freq = value;
-        else if (setting == DSP_SET_SAMPLE_DEPTH)
-            format.depth = value;
-        else if (setting == DSP_SET_STEREO_MODE) {
-            format.stereo_mode = value;
-            format.channels = (value == STEREO_MONO) ? 1 : 2;
-        }
+    /* Tracked even with DSP for the batch report */
+    if (setting == DSP_SET_FREQUENCY)
+        format.freq = value;
+    else if (setting == DSP_SET_SAMPLE_DEPTH)
+        format.depth = value;
+    else if (setting == DSP_SET_STEREO_MODE) {
+        format.stereo_mode = value;
+        format.channels = (value == STEREO_MONO) ? 1 : 2;
     }
+
+    if (use_dsp)
+        dsp_configure(ci.dsp, setting, value);
 }
 
 static enum codec_command_action ci_get_command(intptr_t *param)
@@ -624,6 +1307,37 @@ static unsigned ci_sleep(unsigned ticks)
     return 0;
 }
 
+/* Every run starts from scratch; nothing is kept between files */
+static bool ci_seek_index_load(uint32_t tag, void *buf, size_t *size)
+{
+    (void)tag;
+    (void)buf;
+    (void)size;
+    return false;
+}
+
+static void ci_seek_index_save(uint32_t tag, const void *buf, size_t size)
+{
+    (void)tag;
+    (void)buf;
+    (void)size;
+}
+
+/* With -t, codecs get a helper thread like on multi-core hosted targets.
+ * It is started on first use so that it exists in batch workers. */
+static bool ci_job_start(void (*fn)(void *arg), void *arg)
+{
+    if (!use_helper)
+        return false;
+
+    if (!job_thread_init()) {
+        use_helper = false;
+        return false;
+    }
+
+    return job_thread_start(fn, arg);
+}
+
 static void ci_debugf(const char *fmt, ...)
 {
     va_list ap;
@@ -717,6 +1431,11 @@ static struct codec_api ci = {
     ci_round_value_to_list32,
 
 #endif /* HAVE_RECORDING */
+
+    ci_seek_index_load,
+    ci_seek_index_save,
+    ci_job_start,
+    job_thread_wait,
 };
 
 static void print_mp3entry(const struct mp3entry *id3, FILE *f)
@@ -756,15 +1475,34 @@ static void print_mp3entry(const struct mp3entry *id3, FILE *f)
     if (id3->mb_track_id) fprintf(f, "Musicbrainz track ID: %s\n", id3->mb_track_id);
 }
 
+static void print_dsp_profile(const struct dsp_profile *prof, FILE *f)
+{
+    fprintf(f, "DSP profile:\n");
+    fprintf(f, "  %-14s %10s %12s %10s %10s\n",
+            "stage", "calls", "samples", "ms", "ns/sample");
+    unsigned int i;
+    for (i = 0; i < prof->num_stages; i++) {
+        const struct dsp_profile_stage *st = &prof->stages[i];
+        if (!st->calls)
+            continue;
+        fprintf(f, "  %-14s %10lu %12llu %10.3f %10.2f\n", st->name,
+                (unsigned long)st->calls, (unsigned long long)st->samples,
+                profile_ms(prof, st),
+                st->samples ? profile_ms(prof, st) * 1e6 / st->samples : 0);
+    }
+}
+
 static void decode_file(const char *input_fn)
 {
     /* Initialize DSP before any sort of interaction */
     dsp_init();
 
-    /* Set up global settings */
-    memset(&global_settings, 0, sizeof(global_settings));
-    global_settings.timestretch_enabled = true;
-    dsp_timestretch_enable(true);
+    /* Set up global settings, unless a settings file filled them in */
+    if (!dsp_settings_fn) {
+        memset(&global_settings, 0, sizeof(global_settings));
+        global_settings.timestretch_enabled = true;
+    }
+    dsp_timestretch_enable(global_settings.timestretch_enabled);
 
     /* Open file */
     if (!strcmp(input_fn, "-")) {
@@ -783,7 +1521,10 @@ static void decode_file(const char *input_fn)
         fprintf(stderr, "error: metadata parsing failed\n");
         exit(1);
     }
-    print_mp3entry(&id3, stderr);
+    if (mode != MODE_BATCH)
+        print_mp3entry(&id3, stderr);
+    batch_result.codectype = id3.codectype;
+    batch_result.length = id3.length;
     ci.filesize = filesize(input_fd);
     ci.id3 = &id3;
     if (use_dsp) {
@@ -791,6 +1532,12 @@ static void decode_file(const char *input_fn)
         dsp_configure(ci.dsp, DSP_SET_OUT_FREQUENCY, DSP_OUT_DEFAULT_HZ);
         dsp_configure(ci.dsp, DSP_RESET, 0);
         dsp_dither_enable(false);
+        if (dsp_settings_fn)
+            apply_dsp_settings();
+        if (profile_dsp && !dsp_configure(ci.dsp, DSP_PROFILE_ENABLE, true)) {
+            fprintf(stderr, "error: DSP profiling not supported\n");
+            exit(1);
+        }
     }
     perform_config();
 
@@ -820,14 +1567,40 @@ static void decode_file(const char *input_fn)
 
     /* Run the codec */
     *c_hdr->api = &ci;
+    double start = batch_wall_time();
+    if (mode == MODE_BATCH)
+        batch_begin();
     if (c_hdr->entry_point(CODEC_LOAD) != CODEC_OK) {
         fprintf(stderr, "error: codec returned error from codec_main\n");
         exit(1);
     }
+    enum batch_status status = BATCH_OK;
     if (c_hdr->run_proc() != CODEC_OK) {
         fprintf(stderr, "error: codec error\n");
+        status = BATCH_CODEC_ERROR;
     }
     c_hdr->entry_point(CODEC_UNLOAD);
+    if (mode == MODE_BATCH)
+        batch_end(status);
+
+    if (use_dsp && profile_dsp) {
+        struct dsp_profile prof;
+        dsp_configure(ci.dsp, DSP_PROFILE_GET, (intptr_t)&prof);
+        if (mode == MODE_BATCH) {
+            batch_result.has_profile = true;
+            batch_result.profile = prof;
+        } else {
+            print_dsp_profile(&prof, stderr);
+        }
+    }
+
+    if (mode == MODE_WRITE && profile_dsp) {
+        double secs = batch_wall_time() - start;
+        double audio = format.freq ?
+            (double)num_output_samples / format.freq : 0;
+        fprintf(stderr, "Rendered %.3f s of audio in %.3f s (%.1fx realtime)\n",
+                audio, secs, secs > 0 ? audio / secs : 0);
+    }
 
     /* Close */
     dlclose(dlcodec);
@@ -840,21 +1613,41 @@ static void print_help(const char *progname)
     fprintf(stderr, "Usage:\n"
                     "        Play: %s [options] INPUTFILE\n"
                     "Write to WAV: %s [options] INPUTFILE OUTPUTFILE\n"
+                    "       Batch: %s -b [options] [-l LISTFILE] [FILE|DIR]...\n"
                     "\n"
                     "general options:\n"
                     "  -c a=1:b=2    Configuration (see below)\n"
                     "  -h            Show this help\n"
+                    "  -p            Profile the DSP stages and print the time\n"
+                    "                spent in each (added to the report with -b)\n"
+                    "  -s <file>     Load the DSP settings (EQ, crossfeed, compressor,\n"
+                    "                etc.) from <file>, which uses config.cfg syntax\n"
+                    "  -t            Give the codec a helper thread, as on multi-core\n"
+                    "                hosted targets\n"
                     "\n"
                     "write to WAV options:\n"
                     "  -f            Write raw codec output converted to 64-bit float\n"
+                    "  -n            Write DSP output without WAV header\n"
                     "  -r            Write raw 32-bit codec output without WAV header\n"
                     "\n"
+                    "batch options:\n"
+                    "  -b            Decode every file given, directories recursively,\n"
+                    "                and write a JSON report with timing, CPU time,\n"
+                    "                codec memory use and MD5 of the output PCM\n"
+                    "  -j <n>        Decode <n> files in parallel [number of CPUs]\n"
+                    "  -l <file>     Also decode the files listed in <file>, one per\n"
+                    "                line (\"-\" reads the list from stdin)\n"
+                    "  -o <file>     Write the report to <file> [stdout]\n"
+                    "  -r            Hash raw 32-bit codec output instead of DSP output\n"
+                    "\n"
                     "configuration:\n"
                     "  dither=<0|1>  Enable/disable dithering [0]\n"
+                    "  eq=<n>        Set all EQ bands to <n> dB, 0 disables [0]\n"
                     "  halt=<0|1>    Stop decoding if 1 [0]\n"
                     "  loop=<0|1>    Enable/disable looping [0]\n"
                     "  offset=<n>    Start at byte offset within the file [0]\n"
                     "  rate=<n>      Multiply rate by <n> [1.0]\n"
+                    "  resample=<n>  Resampler quality: 0 = Hermite, 1 = sinc [0]\n"
                     "  seek=<n>      Seek <n> ms into the file\n"
                     "  tempo=<n>     Timestretch by <n> [1.0]\n"
                     "  vol=<n>       Set volume attenuation to <n> dB [-0]\n"
@@ -866,17 +1659,51 @@ static void print_help(const char *progname)
                     "  %s in.adx -c loop=1:wait=44100:halt=1\n"
                     "  # Lower pitch 1 octave and write to out.wav\n"
                     "  %s in.ogg -c rate=0.5:tempo=2 out.wav\n"
-                    , progname, progname, progname, progname);
+                    "  # Render with the sound settings of a device\n"
+                    "  %s -s config.cfg in.flac out.wav\n"
+                    "  # Benchmark a music collection on 4 cores\n"
+                    "  %s -b -j 4 -o report.json ~/music\n"
+                    , progname, progname, progname, progname, progname, progname,
+                    progname);
 }
 
 int main(int argc, char **argv)
 {
+    bool batch = false;
+    const char *list_fn = NULL;
     int opt;
-    while ((opt = getopt(argc, argv, "c:fhr")) != -1) {
+
+    batch_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (batch_jobs < 1)
+        batch_jobs = 1;
+
+    while ((opt = getopt(argc, argv, "bc:fhj:l:no:prs:t")) != -1) {
         switch (opt) {
+        case 'b':
+            batch = true;
+            break;
         case 'c':
             config = optarg;
             break;
+        case 'j':
+            batch_jobs = atoi(optarg);
+            if (batch_jobs < 1) {
+                fprintf(stderr, "error: -j needs a positive number\n");
+                exit(1);
+            }
+            break;
+        case 'l':
+            list_fn = optarg;
+            break;
+        case 'n':
+            write_raw = true;
+            break;
+        case 'o':
+            batch_report_fn = optarg;
+            break;
+        case 'p':
+            profile_dsp = true;
+            break;
         case 'f':
             use_dsp = false;
             break;
@@ -884,6 +1711,12 @@ int main(int argc, char **argv)
             use_dsp = false;
             write_raw = true;
             break;
+        case 's':
+            dsp_settings_fn = optarg;
+            break;
+        case 't':
+            use_helper = true;
+            break;
         case 'h': /* fallthrough */
         default:
             print_help(argv[0]);
@@ -891,6 +1724,31 @@ int main(int argc, char **argv)
         }
     }
 
+    /* Some DSP stages allocate their buffers with core_alloc */
+    core_allocator_init();
+
+    if (dsp_settings_fn)
+        load_dsp_settings(dsp_settings_fn);
+
+    if (batch) {
+        int i;
+        if (list_fn)
+            batch_add_list(list_fn);
+        for (i = optind; i < argc; i++)
+            batch_add_path(argv[i], true);
+        if (batch_num_files == 0) {
+            fprintf(stderr, "error: no files to decode\n");
+            print_help(argv[0]);
+            exit(1);
+        }
+        mode = MODE_BATCH;
+        return batch_run();
+    } else if (list_fn || batch_report_fn) {
+        fprintf(stderr, "error: -l and -o need -b\n");
+        print_help(argv[0]);
+        exit(1);
+    }
+
     if (argc == optind + 2) {
         write_init(argv[optind + 1]);
     } else if (argc == optind + 1) {
@@ -899,7 +1757,6 @@ int main(int argc, char **argv)
             print_help(argv[0]);
             exit(1);
         }
-        core_allocator_init();
         playback_init();
     } else {
         if (argc > 1)
@@ -278,6 +278,12 @@ const struct tag_info* find_tag(const char* name)
 
 }
 
+/* The start of the table, for code that has to relocate tag pointers */
+const struct tag_info* get_tag_table(void)
+{
+    return legal_tags;
+}
+
 /* Searches through the legal escape characters string */
 int find_escape_character(char lookup)
 {
@@ -350,6 +350,12 @@ struct tag_info
  */
 const struct tag_info* find_tag(const char* name);
 
+/*
+ * Returns the first entry of the tag table. Tag pointers stay at the same
+ * offset from it in every run of the same build.
+ */
+const struct tag_info* get_tag_table(void);
+
 /*
  * Determines whether a character is legal to escape or not.  If 
  * lookup is not found in the legal escape characters string, returns
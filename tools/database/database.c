@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <sys/stat.h>
 
@@ -12,15 +13,37 @@
 /* This is meant to be run on the root of the dap. it'll put the db files into
  * a .rockbox subdir */
 
+static void usage(const char *name)
+{
+    printf("Usage: %s [-f]\n"
+           "Builds or updates the database of the files in the current dir.\n"
+           "Only directories changed since the last run are scanned unless\n"
+           "-f is given.\n", name);
+}
+
 int main(int argc, char **argv)
 {
-    (void)argc;
-    (void)argv;
+    bool full = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-f"))
+            full = true;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
 
     errno = 0;
     if (mkdir(ROCKBOX_DIR) == -1 && errno != EEXIST)
         return 1;
 
+    /* Without the signatures of the last scan every file is checked */
+    if (full)
+        remove(TAGCACHE_FILE_DIRS);
+
     /* / is actually ., will get translated in io.c
      * (with the help of sim_root_dir below */
     const char *paths[] = { "/", NULL };
@@ -578,6 +578,15 @@ off_t sim_filesize(int fildes)
     return os_filesize(filestr->osfd);
 }
 
+time_t sim_filemtime(int fildes)
+{
+    struct filestr_desc *filestr = get_filestr(fildes);
+    if (!filestr)
+        return -1;
+
+    return os_filemtime(filestr->osfd);
+}
+
 int sim_fsamefile(int fildes1, int fildes2)
 {
     struct filestr_desc *filestr1 = get_filestr(fildes1);
@@ -69,6 +69,7 @@ ssize_t sim_write(int fildes, const void *buf, size_t nbyte);
 int     sim_remove(const char *path);
 int     sim_rename(const char *old, const char *new);
 off_t   sim_filesize(int fildes);
+time_t  sim_filemtime(int fildes);
 int     sim_fsamefile(int fildes1, int fildes2);
 int     sim_relate(const char *path1, const char *path2);
 bool    sim_file_exists(const char *path);